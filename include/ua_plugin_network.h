@@ -82,6 +82,18 @@ struct UA_Connection {
      * @return Returns an error code or UA_STATUSCODE_GOOD. */
     UA_StatusCode (*send)(UA_Connection *connection, UA_ByteString *buf);
 
+    /* Sends several message buffers (e.g. the chunks of a message) in one
+     * operation. The buffers are sent in order and are always freed, even if
+     * sending fails. The array itself is not freed. Optional, can be NULL. Then
+     * the buffers are sent one by one.
+     *
+     * @param connection The connection
+     * @param bufs The message buffers
+     * @param bufsSize The number of buffers
+     * @return Returns an error code or UA_STATUSCODE_GOOD. */
+    UA_StatusCode (*sendMultiple)(UA_Connection *connection, UA_ByteString *bufs,
+                                  size_t bufsSize);
+
     /* Receive a message from the remote connection
      *
      * @param connection The connection
@@ -63,6 +63,14 @@ typedef struct {
     UA_Boolean isInverse;
     size_t targetIdsSize;
     UA_ExpandedNodeId *targetIds;
+
+    /* Members specific to open62541. Maintained by UA_Node_addReference and
+     * UA_Node_deleteReference. The targets array has spare capacity for
+     * amortized growth. For many targets, the positions in the array are
+     * indexed by the hash of the target NodeId. Both can be zero/NULL. */
+    size_t targetIdsCapacity;
+    size_t targetIdsIndexSize;
+    UA_UInt32 *targetIdsIndex; /* Position + 1 of the target or 0 if empty */
 } UA_NodeReferenceKind;
 
 #define UA_NODE_BASEATTRIBUTES                  \
@@ -178,6 +186,7 @@ typedef struct {
     UA_Byte accessLevel;
     UA_Double minimumSamplingInterval;
     UA_Boolean historizing; /* currently unsupported */
+    const UA_DataSourceBatch *dataSourceBatch; /* Only with a DataSource */
 } UA_VariableNode;
 
 /**
@@ -507,6 +516,21 @@ UA_Node_deleteReferences(UA_Node *node);
 void UA_EXPORT
 UA_Node_deleteMembers(UA_Node *node);
 
+/* Encode the node into a newly allocated buffer. The encoding is portable and
+ * can be stored outside of the process, e.g. in a precompiled image of the
+ * address space. The members specific to open62541 (context, callbacks and
+ * lifecycle) are not encoded. The value of a variable with a DataSource is
+ * encoded as empty. */
+UA_StatusCode UA_EXPORT
+UA_Node_encodeBinary(const UA_Node *node, UA_ByteString *dst);
+
+/* Decode a node that was encoded with UA_Node_encodeBinary. The destination
+ * node must be empty and its NodeClass needs to be set to the encoded NodeClass
+ * before calling this method. The offset is advanced past the node.
+ * UA_Node_deleteMembers is called on the node when an error occurs. */
+UA_StatusCode UA_EXPORT
+UA_Node_decodeBinary(const UA_ByteString *src, size_t *offset, UA_Node *dst);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
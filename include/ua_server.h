@@ -64,6 +64,18 @@ UA_Server_run_iterate(UA_Server *server, UA_Boolean waitInternal);
 UA_StatusCode UA_EXPORT
 UA_Server_run_shutdown(UA_Server *server);
 
+/* Statistics of the session management. The average cost of a session lookup
+ * is lookupComparisons / lookups. The counters are not synchronized with the
+ * worker threads and can be approximate in multithreaded builds. */
+typedef struct {
+    UA_UInt32 currentSessionCount;
+    UA_UInt64 lookups;           /* Lookups by authentication token or id */
+    UA_UInt64 lookupComparisons; /* NodeIds compared during the lookups */
+} UA_SessionStatistics;
+
+void UA_EXPORT
+UA_Server_getSessionStatistics(UA_Server *server, UA_SessionStatistics *stats);
+
 /**
  * Repeated Callbacks
  * ------------------ */
@@ -679,6 +691,45 @@ UA_StatusCode UA_EXPORT
 UA_Server_setVariableNode_dataSource(UA_Server *server, const UA_NodeId nodeId,
                                      const UA_DataSource dataSource);
 
+/**
+ * Batched Data Source
+ * ^^^^^^^^^^^^^^^^^^^
+ * Data sources that are backed by the same device (e.g. a fieldbus) can be
+ * grouped in a batch. The server then reads the values of all variables of the
+ * batch that are requested by one Read request, or sampled at the same
+ * sampling interval by MonitoredItems, with a single call. Single reads (e.g.
+ * ``UA_Server_readValue``) still use the read callback of the data source. */
+typedef struct {
+    const UA_NodeId *nodeId;
+    void *nodeContext;
+    const UA_NumericRange *range; /* NULL if the entire value is read */
+    UA_DataValue *value; /* The (non-null) DataValue that is returned */
+} UA_DataSourceReadItem;
+
+typedef struct {
+    /* Copies the data from the source into the values of all items. The
+     * semantics for the individual items are the same as for the read callback
+     * of the data source.
+     *
+     * @param batchContext The context of the batch (e.g. the device)
+     * @param includeSourceTimeStamp If true, then the source timestamps are
+     *        expected to be set
+     * @return If an error is returned, then no releasing of the values is
+     *         done. The error is returned for all items. */
+    UA_StatusCode (*read)(UA_Server *server, const UA_NodeId *sessionId,
+                          void *sessionContext, void *batchContext,
+                          UA_Boolean includeSourceTimeStamp,
+                          size_t itemsSize, const UA_DataSourceReadItem *items);
+    void *context;
+} UA_DataSourceBatch;
+
+/* Add a variable with a data source to a batch. The batch is not copied and
+ * has to outlive the variable. Setting NULL removes the variable from its
+ * batch. */
+UA_StatusCode UA_EXPORT
+UA_Server_setVariableNode_dataSourceBatch(UA_Server *server, const UA_NodeId nodeId,
+                                          const UA_DataSourceBatch *batch);
+
 /**
  * .. _value-callback:
  *
@@ -969,6 +1020,26 @@ UA_Server_addNode_finish(UA_Server *server, const UA_NodeId nodeId,
                          const UA_NodeId referenceTypeId,
                          const UA_NodeId typeDefinitionId);
 
+/**
+ * Large address spaces are loaded faster with UA_Server_addNodesBulk. All nodes
+ * are first added to the nodestore. So parents and type definitions may come
+ * later in the array than the nodes that reference them. Then the references
+ * to the parents and the type definitions are added in one batch where every
+ * node is edited only once. At last, the consistency checks, the instantiation
+ * of mandatory children and the constructors run for each node as in
+ * UA_Server_addNode_finish. The members of every type definition are browsed
+ * only once (when its first instance is finished) and then instantiated for
+ * all nodes of that type.
+ *
+ * The optional ``nodeContexts``, ``results`` and ``outNewNodeIds`` arrays have
+ * the length ``itemsSize``. Nodes that fail are removed again and their
+ * ``outNewNodeIds`` entry is the null NodeId. Returns the first error of the
+ * items or an error if the internal allocation failed. */
+UA_StatusCode UA_EXPORT
+UA_Server_addNodesBulk(UA_Server *server, size_t itemsSize,
+                       const UA_AddNodesItem *items, void **nodeContexts,
+                       UA_StatusCode *results, UA_NodeId *outNewNodeIds);
+
 /* Deletes a node and optionally all references leading to the node. */
 UA_StatusCode UA_EXPORT
 UA_Server_deleteNode(UA_Server *server, const UA_NodeId nodeId,
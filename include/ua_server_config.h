@@ -49,6 +49,32 @@ struct UA_ServerConfig {
     size_t customDataTypesSize;
     UA_DataType *customDataTypes;
 
+    /* Requests are decoded into an arena that is reset after every message.
+     * This is the size of the arena blocks in bytes. Zero disables the arena
+     * and every decoded member is allocated individually. Not used if
+     * multithreading is enabled. */
+    size_t requestArenaSize;
+
+    /* Read and Call requests with at least twice this many operations are
+     * split into slices of at least this size. The slices are processed in
+     * parallel by the worker threads. The response is sent when all slices are
+     * done. Operations in different slices may be executed in any order, so
+     * DataSources and method callbacks have to be thread-safe. Writes are
+     * always processed in the order of the request. Zero disables the
+     * parallel processing. Only if multithreading is enabled. */
+    size_t parallelOperationsBatchSize;
+
+    /* Number of slots in the cache for the values of DataSources. A Read with
+     * a maxAge is served from the cache while the cached value is not older.
+     * The cached values are shared by all sessions. Zero disables the
+     * cache. */
+    size_t dataSourceCacheSize;
+
+    /* Cache the values per session. Enable if DataSources return different
+     * values depending on the session. Then a cached value is only served to
+     * the session that has read it. */
+    UA_Boolean dataSourceCachePerSession;
+
     /* Nodestore */
     UA_Nodestore nodestore;
 
@@ -86,6 +112,12 @@ struct UA_ServerConfig {
     UA_DurationRange samplingIntervalLimits;
     UA_UInt32Range queueSizeLimits; /* Negotiated with the client */
 
+    /* MonitoredItems on the value of a VariableNode that request a
+     * samplingInterval of zero are notified when the value is written, instead
+     * of being sampled periodically. This applies only to VariableNodes that
+     * store their value in the node and have no onRead callback. */
+    UA_Boolean monitoredItemsNotifyOnWrite;
+
     /* Discovery */
 #ifdef UA_ENABLE_DISCOVERY
     /* Timeout in seconds when to automatically remove a registered server from
@@ -146,6 +146,14 @@ UA_ServerConfig_new_minimal(UA_UInt16 portNumber,
     /* conf->customDataTypesSize = 0; */
     /* conf->customDataTypes = NULL; */
 
+    /* Request Decoding */
+    conf->requestArenaSize = 1 << 16; /* 64kB */
+
+    /* Service Operations */
+    conf->parallelOperationsBatchSize = 1000;
+    conf->dataSourceCacheSize = 1024;
+    conf->dataSourceCachePerSession = false;
+
     /* Networking */
     /* conf->networkLayersSize = 0; */
     /* conf->networkLayers = NULL; */
@@ -190,6 +198,7 @@ UA_ServerConfig_new_minimal(UA_UInt16 portNumber,
     /* Limits for MonitoredItems */
     conf->samplingIntervalLimits = UA_DURATIONRANGE(50.0, 24.0 * 3600.0 * 1000.0);
     conf->queueSizeLimits = UA_UINT32RANGE(1, 100);
+    conf->monitoredItemsNotifyOnWrite = false;
 
 #ifdef UA_ENABLE_DISCOVERY
     conf->discoveryCleanupTimeout = 60 * 60;
@@ -64,6 +64,8 @@
 # include <sys/ioctl.h>
 # include <fcntl.h>
 # include <unistd.h> // read, write, close
+# include <sys/socket.h> // sendmsg
+# include <sys/uio.h> // struct iovec
 # include <netdb.h>
 # ifdef __QNX__
 #  include <sys/socket.h>
@@ -77,6 +79,9 @@
 # ifndef __CYGWIN__
 #  include <netinet/tcp.h>
 # endif
+# ifdef __linux__
+#  include <sys/epoll.h>
+# endif
 #endif
 
 /* unsigned int for windows and workaround to a glibc bug */
@@ -135,15 +140,16 @@ connection_releaserecvbuffer(UA_Connection *connection,
     UA_ByteString_deleteMembers(buf);
 }
 
+/* Send the full buffer. This may require several calls to send. The buffer is
+ * not released. */
 static UA_StatusCode
-connection_write(UA_Connection *connection, UA_ByteString *buf) {
+socket_write(UA_Connection *connection, const UA_ByteString *buf) {
     /* Prevent OS signals when sending to a closed socket */
     int flags = 0;
 #ifdef MSG_NOSIGNAL
     flags |= MSG_NOSIGNAL;
 #endif
 
-    /* Send the full buffer. This may require several calls to send */
     size_t nWritten = 0;
     do {
         ssize_t n = 0;
@@ -154,58 +160,122 @@ connection_write(UA_Connection *connection, UA_ByteString *buf) {
                      WIN32_INT bytes_to_send, flags);
             if(n < 0 && errno__ != INTERRUPTED && errno__ != AGAIN) {
                 connection->close(connection);
-                UA_ByteString_deleteMembers(buf);
                 return UA_STATUSCODE_BADCONNECTIONCLOSED;
             }
         } while(n < 0);
         nWritten += (size_t)n;
     } while(nWritten < buf->length);
-
-    /* Free the buffer */
-    UA_ByteString_deleteMembers(buf);
     return UA_STATUSCODE_GOOD;
 }
 
+#define SOCKET_MAXIOV 64
+
+/* Send several buffers in order. Where available, they are gathered into a
+ * single call to sendmsg. The buffers are not released. */
 static UA_StatusCode
-connection_recv(UA_Connection *connection, UA_ByteString *response,
-                UA_UInt32 timeout) {
-    /* Listen on the socket for the given timeout until a message arrives */
-    if(timeout > 0) {
-        fd_set fdset;
-        FD_ZERO(&fdset);
-        UA_fd_set(connection->sockfd, &fdset);
-        UA_UInt32 timeout_usec = timeout * 1000;
-        struct timeval tmptv = {(long int)(timeout_usec / 1000000),
-                                (long int)(timeout_usec % 1000000)};
-        int resultsize = select(connection->sockfd+1, &fdset, NULL,
-                                NULL, &tmptv);
-
-        /* No result */
-        if(resultsize == 0)
-            return UA_STATUSCODE_GOODNONCRITICALTIMEOUT;
+socket_writemultiple(UA_Connection *connection, const UA_ByteString *bufs,
+                     size_t bufsSize) {
+#ifdef _WIN32
+    for(size_t i = 0; i < bufsSize; i++) {
+        UA_StatusCode retval = socket_write(connection, &bufs[i]);
+        if(retval != UA_STATUSCODE_GOOD)
+            return retval;
     }
+    return UA_STATUSCODE_GOOD;
+#else
+    /* Prevent OS signals when sending to a closed socket */
+    int flags = 0;
+#ifdef MSG_NOSIGNAL
+    flags |= MSG_NOSIGNAL;
+#endif
 
-    response->data = (UA_Byte*)
-        UA_malloc(connection->localConf.recvBufferSize);
-    if(!response->data) {
-        response->length = 0;
-        return UA_STATUSCODE_BADOUTOFMEMORY; /* not enough memory retry */
+    size_t current = 0; /* The first buffer that is not completely sent */
+    size_t offset = 0;  /* Bytes of the current buffer that are already sent */
+    while(current < bufsSize) {
+        struct iovec iov[SOCKET_MAXIOV];
+        size_t iovSize = 0;
+        for(size_t i = current; i < bufsSize && iovSize < SOCKET_MAXIOV; i++) {
+            size_t skip = (i == current) ? offset : 0;
+            iov[iovSize].iov_base = (void*)(bufs[i].data + skip);
+            iov[iovSize].iov_len = bufs[i].length - skip;
+            iovSize++;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(struct msghdr));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovSize;
+        ssize_t n = sendmsg((SOCKET)connection->sockfd, &msg, flags);
+        if(n < 0) {
+            if(errno__ == INTERRUPTED || errno__ == AGAIN)
+                continue;
+            connection->close(connection);
+            return UA_STATUSCODE_BADCONNECTIONCLOSED;
+        }
+
+        /* Forward to the first buffer that is not completely sent */
+        size_t sent = (size_t)n;
+        while(current < bufsSize && sent >= bufs[current].length - offset) {
+            sent -= bufs[current].length - offset;
+            offset = 0;
+            current++;
+        }
+        offset += sent;
     }
+    return UA_STATUSCODE_GOOD;
+#endif
+}
 
+static UA_StatusCode
+connection_write(UA_Connection *connection, UA_ByteString *buf) {
+    UA_StatusCode retval = socket_write(connection, buf);
+    UA_ByteString_deleteMembers(buf);
+    return retval;
+}
+
+static UA_StatusCode
+connection_writemultiple(UA_Connection *connection, UA_ByteString *bufs,
+                         size_t bufsSize) {
+    UA_StatusCode retval = socket_writemultiple(connection, bufs, bufsSize);
+    for(size_t i = 0; i < bufsSize; i++)
+        UA_ByteString_deleteMembers(&bufs[i]);
+    return retval;
+}
+
+/* Listen on the socket for the given timeout until a message arrives */
+static UA_Boolean
+socket_waitreadable(UA_Connection *connection, UA_UInt32 timeout) {
+    fd_set fdset;
+    FD_ZERO(&fdset);
+    UA_fd_set(connection->sockfd, &fdset);
+    UA_UInt32 timeout_usec = timeout * 1000;
+    struct timeval tmptv = {(long int)(timeout_usec / 1000000),
+                            (long int)(timeout_usec % 1000000)};
+    int resultsize = select(connection->sockfd+1, &fdset, NULL,
+                            NULL, &tmptv);
+    return (resultsize != 0);
+}
+
+/* Receive into the buffer (of at least localConf.recvBufferSize bytes) and set
+ * the length of the received message. If no message was received, the length
+ * is set to zero. */
+static UA_StatusCode
+socket_recv(UA_Connection *connection, UA_ByteString *response,
+            UA_UInt32 timeout) {
     /* Get the received packet(s) */
     ssize_t ret = recv(connection->sockfd, (char*)response->data,
                        connection->localConf.recvBufferSize, 0);
 
     /* The remote side closed the connection */
     if(ret == 0) {
-        UA_ByteString_deleteMembers(response);
+        response->length = 0;
         connection->close(connection);
         return UA_STATUSCODE_BADCONNECTIONCLOSED;
     }
 
     /* Error case */
     if(ret < 0) {
-        UA_ByteString_deleteMembers(response);
+        response->length = 0;
         if(errno__ == INTERRUPTED || (timeout > 0) ?
            false : (errno__ == EAGAIN || errno__ == WOULDBLOCK))
             return UA_STATUSCODE_GOOD; /* statuscode_good but no data -> retry */
@@ -218,6 +288,26 @@ connection_recv(UA_Connection *connection, UA_ByteString *response,
     return UA_STATUSCODE_GOOD;
 }
 
+static UA_StatusCode
+connection_recv(UA_Connection *connection, UA_ByteString *response,
+                UA_UInt32 timeout) {
+    /* No result */
+    if(timeout > 0 && !socket_waitreadable(connection, timeout))
+        return UA_STATUSCODE_GOODNONCRITICALTIMEOUT;
+
+    response->data = (UA_Byte*)
+        UA_malloc(connection->localConf.recvBufferSize);
+    if(!response->data) {
+        response->length = 0;
+        return UA_STATUSCODE_BADOUTOFMEMORY; /* not enough memory retry */
+    }
+
+    UA_StatusCode retval = socket_recv(connection, response, timeout);
+    if(response->length == 0)
+        UA_ByteString_deleteMembers(response);
+    return retval;
+}
+
 static UA_StatusCode
 socket_set_nonblocking(SOCKET sockfd) {
 #ifdef _WIN32
@@ -250,6 +340,165 @@ socket_set_blocking(SOCKET sockfd) {
     return UA_STATUSCODE_GOOD;
 }
 
+/***************/
+/* Buffer Pool */
+/***************/
+
+/* The server network layer keeps a pool of fixed-size slabs for the send and
+ * receive buffers of its connections. Slabs are allocated on first use and are
+ * returned to the pool when the buffer is released. So the steady-state
+ * traffic does not allocate from the heap.
+ *
+ * Every buffer is preceded by a header with the index of its slab. Buffers that
+ * do not fit into a slab (or when all slabs are in use) are allocated from the
+ * heap with the index BUFFERPOOL_NOSLAB.
+ *
+ * The free slabs form a stack of indices that is terminated with
+ * BUFFERPOOL_NOSLAB. With multithreading, the head of the
+ * stack is updated with a compare-and-swap. The head contains a tag in the
+ * upper 32 bits that is incremented with every update to prevent the ABA
+ * problem. */
+
+#define BUFFERPOOL_MAXSLABS 128
+#define BUFFERPOOL_HEADER 8 /* Keep the buffer 8-byte aligned */
+#define BUFFERPOOL_NOSLAB 0xffffffff
+
+static UA_INLINE UA_UInt64
+BufferPool_cas(volatile UA_UInt64 *addr, UA_UInt64 expected, UA_UInt64 newval) {
+#ifndef UA_ENABLE_MULTITHREADING
+    UA_UInt64 old = *addr;
+    if(old == expected)
+        *addr = newval;
+    return old;
+#else
+# ifdef _MSC_VER /* Visual Studio */
+    return (UA_UInt64)_InterlockedCompareExchange64((volatile __int64*)addr,
+                                                    (__int64)newval,
+                                                    (__int64)expected);
+# else /* GCC/Clang */
+    return __sync_val_compare_and_swap(addr, expected, newval);
+# endif
+#endif
+}
+
+static UA_INLINE void
+BufferPool_count(volatile UA_UInt32 *counter) {
+#ifndef UA_ENABLE_MULTITHREADING
+    ++(*counter);
+#else
+# ifdef _MSC_VER /* Visual Studio */
+    _InterlockedIncrement((volatile long*)counter);
+# else /* GCC/Clang */
+    __sync_add_and_fetch(counter, 1);
+# endif
+#endif
+}
+
+typedef struct {
+    size_t slabSize;
+    UA_Byte *slabs[BUFFERPOOL_MAXSLABS]; /* NULL until first use */
+    volatile UA_UInt32 next[BUFFERPOOL_MAXSLABS];
+    volatile UA_UInt64 head; /* (tag << 32) | index of the first free slab */
+    volatile UA_UInt32 hits;
+    volatile UA_UInt32 misses;
+} BufferPool;
+
+static void
+BufferPool_init(BufferPool *pool, size_t slabSize) {
+    memset(pool, 0, sizeof(BufferPool));
+    pool->slabSize = slabSize;
+    for(UA_UInt32 i = 0; i < BUFFERPOOL_MAXSLABS - 1; i++)
+        pool->next[i] = i + 1;
+    pool->next[BUFFERPOOL_MAXSLABS - 1] = BUFFERPOOL_NOSLAB;
+    pool->head = 0;
+}
+
+static void
+BufferPool_deleteMembers(BufferPool *pool) {
+    for(size_t i = 0; i < BUFFERPOOL_MAXSLABS; i++) {
+        UA_free(pool->slabs[i]);
+        pool->slabs[i] = NULL;
+    }
+}
+
+static UA_UInt32
+BufferPool_pop(BufferPool *pool) {
+    UA_UInt64 head = pool->head;
+    while(true) {
+        UA_UInt32 index = (UA_UInt32)head;
+        if(index == BUFFERPOOL_NOSLAB)
+            return BUFFERPOOL_NOSLAB;
+        UA_UInt64 newhead = (((head >> 32) + 1) << 32) | pool->next[index];
+        UA_UInt64 old = BufferPool_cas(&pool->head, head, newhead);
+        if(old == head)
+            return index;
+        head = old;
+    }
+}
+
+static void
+BufferPool_push(BufferPool *pool, UA_UInt32 index) {
+    UA_UInt64 head = pool->head;
+    while(true) {
+        pool->next[index] = (UA_UInt32)head;
+        UA_UInt64 newhead = (((head >> 32) + 1) << 32) | index;
+        UA_UInt64 old = BufferPool_cas(&pool->head, head, newhead);
+        if(old == head)
+            return;
+        head = old;
+    }
+}
+
+static UA_StatusCode
+BufferPool_get(BufferPool *pool, size_t length, UA_ByteString *buf) {
+    UA_Byte *mem = NULL;
+    UA_UInt32 index = BUFFERPOOL_NOSLAB;
+    if(length <= pool->slabSize)
+        index = BufferPool_pop(pool);
+
+    if(index != BUFFERPOOL_NOSLAB) {
+        /* Take the slab. It is allocated when it is first used. */
+        mem = pool->slabs[index];
+        if(mem) {
+            BufferPool_count(&pool->hits);
+        } else {
+            BufferPool_count(&pool->misses);
+            mem = (UA_Byte*)UA_malloc(BUFFERPOOL_HEADER + pool->slabSize);
+            if(!mem) {
+                BufferPool_push(pool, index);
+                return UA_STATUSCODE_BADOUTOFMEMORY;
+            }
+            pool->slabs[index] = mem;
+        }
+    } else {
+        /* The buffer is too large or all slabs are in use */
+        BufferPool_count(&pool->misses);
+        mem = (UA_Byte*)UA_malloc(BUFFERPOOL_HEADER + length);
+        if(!mem)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    memcpy(mem, &index, sizeof(UA_UInt32));
+    buf->data = &mem[BUFFERPOOL_HEADER];
+    buf->length = length;
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+BufferPool_release(BufferPool *pool, UA_ByteString *buf) {
+    if(!buf->data)
+        return;
+    UA_Byte *mem = buf->data - BUFFERPOOL_HEADER;
+    UA_UInt32 index;
+    memcpy(&index, mem, sizeof(UA_UInt32));
+    if(index == BUFFERPOOL_NOSLAB)
+        UA_free(mem);
+    else
+        BufferPool_push(pool, index);
+    buf->data = NULL;
+    buf->length = 0;
+}
+
 /***************************/
 /* Server NetworkLayer TCP */
 /***************************/
@@ -267,8 +516,61 @@ typedef struct {
     UA_Int32 serverSockets[FD_SETSIZE];
     UA_UInt16 serverSocketsSize;
     LIST_HEAD(, ConnectionEntry) connections;
+    BufferPool pool;
 } ServerNetworkLayerTCP;
 
+/* The send and receive buffers of the server connections are taken from the
+ * buffer pool of the network layer */
+
+static UA_StatusCode
+ServerNetworkLayerTCP_getSendBuffer(UA_Connection *connection,
+                                    size_t length, UA_ByteString *buf) {
+    if(length > connection->remoteConf.recvBufferSize)
+        return UA_STATUSCODE_BADCOMMUNICATIONERROR;
+    ServerNetworkLayerTCP *layer = (ServerNetworkLayerTCP*)connection->handle;
+    return BufferPool_get(&layer->pool, length, buf);
+}
+
+static void
+ServerNetworkLayerTCP_releaseBuffer(UA_Connection *connection,
+                                    UA_ByteString *buf) {
+    ServerNetworkLayerTCP *layer = (ServerNetworkLayerTCP*)connection->handle;
+    BufferPool_release(&layer->pool, buf);
+}
+
+static UA_StatusCode
+ServerNetworkLayerTCP_write(UA_Connection *connection, UA_ByteString *buf) {
+    UA_StatusCode retval = socket_write(connection, buf);
+    ServerNetworkLayerTCP_releaseBuffer(connection, buf);
+    return retval;
+}
+
+static UA_StatusCode
+ServerNetworkLayerTCP_writeMultiple(UA_Connection *connection, UA_ByteString *bufs,
+                                    size_t bufsSize) {
+    UA_StatusCode retval = socket_writemultiple(connection, bufs, bufsSize);
+    for(size_t i = 0; i < bufsSize; i++)
+        ServerNetworkLayerTCP_releaseBuffer(connection, &bufs[i]);
+    return retval;
+}
+
+static UA_StatusCode
+ServerNetworkLayerTCP_recv(UA_Connection *connection, UA_ByteString *response) {
+    ServerNetworkLayerTCP *layer = (ServerNetworkLayerTCP*)connection->handle;
+    UA_StatusCode retval = BufferPool_get(&layer->pool,
+                                          connection->localConf.recvBufferSize,
+                                          response);
+    if(retval != UA_STATUSCODE_GOOD) {
+        response->length = 0;
+        return UA_STATUSCODE_BADOUTOFMEMORY; /* not enough memory retry */
+    }
+
+    retval = socket_recv(connection, response, 0);
+    if(response->length == 0)
+        BufferPool_release(&layer->pool, response);
+    return retval;
+}
+
 static void
 ServerNetworkLayerTCP_freeConnection(UA_Connection *connection) {
     UA_Connection_deleteMembers(connection);
@@ -328,12 +630,13 @@ ServerNetworkLayerTCP_add(ServerNetworkLayerTCP *layer, UA_Int32 newsockfd,
     c->handle = layer;
     c->localConf = layer->conf;
     c->remoteConf = layer->conf;
-    c->send = connection_write;
+    c->send = ServerNetworkLayerTCP_write;
+    c->sendMultiple = ServerNetworkLayerTCP_writeMultiple;
     c->close = ServerNetworkLayerTCP_close;
     c->free = ServerNetworkLayerTCP_freeConnection;
-    c->getSendBuffer = connection_getsendbuffer;
-    c->releaseSendBuffer = connection_releasesendbuffer;
-    c->releaseRecvBuffer = connection_releaserecvbuffer;
+    c->getSendBuffer = ServerNetworkLayerTCP_getSendBuffer;
+    c->releaseSendBuffer = ServerNetworkLayerTCP_releaseBuffer;
+    c->releaseRecvBuffer = ServerNetworkLayerTCP_releaseBuffer;
     c->state = UA_CONNECTION_OPENING;
 
     /* Add to the linked list */
@@ -501,6 +804,23 @@ setFDSet(ServerNetworkLayerTCP *layer, fd_set *fdset) {
     return highestfd;
 }
 
+/* The socket is shutdown but not closed */
+static void
+ServerNetworkLayerTCP_remove(UA_Server *server, ConnectionEntry *e) {
+    if(e->connection.state != UA_CONNECTION_CLOSED) {
+        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_NETWORK,
+                    "Connection %i | Closed by the client",
+                    e->connection.sockfd);
+    } else {
+        UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_NETWORK,
+                    "Connection %i | Closed by the server",
+                    e->connection.sockfd);
+    }
+    LIST_REMOVE(e, pointers);
+    CLOSESOCKET(e->connection.sockfd);
+    UA_Server_removeConnection(server, &e->connection);
+}
+
 static UA_StatusCode
 ServerNetworkLayerTCP_listen(UA_ServerNetworkLayer *nl, UA_Server *server,
                              UA_UInt16 timeout) {
@@ -558,26 +878,14 @@ ServerNetworkLayerTCP_listen(UA_ServerNetworkLayer *nl, UA_Server *server,
                     e->connection.sockfd);
 
         UA_ByteString buf = UA_BYTESTRING_NULL;
-        UA_StatusCode retval = connection_recv(&e->connection, &buf, 0);
+        UA_StatusCode retval = ServerNetworkLayerTCP_recv(&e->connection, &buf);
 
-        if(retval == UA_STATUSCODE_GOOD) {
+        if(retval == UA_STATUSCODE_GOOD && buf.length > 0) {
             /* Process packets */
             UA_Server_processBinaryMessage(server, &e->connection, &buf);
-            connection_releaserecvbuffer(&e->connection, &buf);
+            ServerNetworkLayerTCP_releaseBuffer(&e->connection, &buf);
         } else if(retval == UA_STATUSCODE_BADCONNECTIONCLOSED) {
-            /* The socket is shutdown but not closed */
-            if(e->connection.state != UA_CONNECTION_CLOSED) {
-                UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_NETWORK,
-                            "Connection %i | Closed by the client",
-                            e->connection.sockfd);
-            } else {
-                UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_NETWORK,
-                            "Connection %i | Closed by the server",
-                            e->connection.sockfd);
-            }
-            LIST_REMOVE(e, pointers);
-            CLOSESOCKET(e->connection.sockfd);
-            UA_Server_removeConnection(server, &e->connection);
+            ServerNetworkLayerTCP_remove(server, e);
         }
     }
     return UA_STATUSCODE_GOOD;
@@ -627,6 +935,7 @@ ServerNetworkLayerTCP_deleteMembers(UA_ServerNetworkLayer *nl) {
     }
 
     /* Free the layer */
+    BufferPool_deleteMembers(&layer->pool);
     UA_free(layer);
 }
 
@@ -641,6 +950,8 @@ UA_ServerNetworkLayerTCP(UA_ConnectionConfig conf, UA_UInt16 port) {
 
     layer->conf = conf;
     layer->port = port;
+    BufferPool_init(&layer->pool, conf.sendBufferSize > conf.recvBufferSize ?
+                    conf.sendBufferSize : conf.recvBufferSize);
 
     nl.handle = layer;
     nl.start = ServerNetworkLayerTCP_start;
@@ -650,6 +961,278 @@ UA_ServerNetworkLayerTCP(UA_ConnectionConfig conf, UA_UInt16 port) {
     return nl;
 }
 
+void
+UA_ServerNetworkLayerTCP_getBufferPoolStatistics(const UA_ServerNetworkLayer *nl,
+                                                 UA_NetworkBufferPoolStatistics *stats) {
+    const ServerNetworkLayerTCP *layer = (const ServerNetworkLayerTCP*)nl->handle;
+    stats->hits = layer->pool.hits;
+    stats->misses = layer->pool.misses;
+}
+
+#ifdef __linux__
+
+/*********************************/
+/* Server NetworkLayer TCP epoll */
+/*********************************/
+
+/* The epoll variant shares the socket handling with the select-based network
+ * layer. But instead of rebuilding an fd_set in every iteration, the sockets
+ * are registered once in a persistent epoll set. Only the sockets that are
+ * reported as ready are processed. The connections are registered in
+ * edge-triggered mode and are read until recv returns EAGAIN, but at most
+ * EPOLL_MAXREADS times per notification. A connection that still has data is
+ * re-armed and reported again after the other ready connections. */
+
+#define EPOLL_MAXEVENTS 64
+#define EPOLL_MAXREADS 16
+
+typedef struct {
+    ServerNetworkLayerTCP tcp; /* Must be the first member. The connections
+                                * point to the layer in their handle. */
+    int epollfd;
+} ServerNetworkLayerTCPEpoll;
+
+static UA_StatusCode
+ServerNetworkLayerTCPEpoll_start(UA_ServerNetworkLayer *nl,
+                                 const UA_String *customHostname) {
+    ServerNetworkLayerTCPEpoll *layer = (ServerNetworkLayerTCPEpoll*)nl->handle;
+    layer->epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if(layer->epollfd < 0) {
+        UA_LOG_SOCKET_ERRNO_WRAP(
+            UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_NETWORK,
+                           "Could not create the epoll set: %s", errno_str));
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+
+    UA_StatusCode retval = ServerNetworkLayerTCP_start(nl, customHostname);
+    if(retval != UA_STATUSCODE_GOOD) {
+        CLOSESOCKET(layer->epollfd);
+        layer->epollfd = -1;
+        return retval;
+    }
+
+    /* Register the server sockets (level-triggered). The event points to the
+     * entry in the server socket array. A server socket that is not in the
+     * epoll set would never accept connections. */
+    for(UA_UInt16 i = 0; i < layer->tcp.serverSocketsSize; i++) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = &layer->tcp.serverSockets[i];
+        if(epoll_ctl(layer->epollfd, EPOLL_CTL_ADD,
+                     layer->tcp.serverSockets[i], &event) == 0)
+            continue;
+        UA_LOG_SOCKET_ERRNO_WRAP(
+            UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_NETWORK,
+                           "Could not add the server socket to the "
+                           "epoll set: %s", errno_str));
+        for(UA_UInt16 j = 0; j < layer->tcp.serverSocketsSize; j++) {
+            shutdown((SOCKET)layer->tcp.serverSockets[j], 2);
+            CLOSESOCKET(layer->tcp.serverSockets[j]);
+        }
+        layer->tcp.serverSocketsSize = 0;
+        CLOSESOCKET(layer->epollfd);
+        layer->epollfd = -1;
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+ServerNetworkLayerTCPEpoll_accept(ServerNetworkLayerTCPEpoll *layer,
+                                  UA_Int32 serverSocket) {
+    /* Accept all pending connections of the (nonblocking) server socket */
+    while(true) {
+        struct sockaddr_storage remote;
+        socklen_t remote_size = sizeof(remote);
+        SOCKET newsockfd = accept((SOCKET)serverSocket,
+                                  (struct sockaddr*)&remote, &remote_size);
+        if(newsockfd < 0)
+            return;
+
+        UA_LOG_TRACE(UA_Log_Stdout, UA_LOGCATEGORY_NETWORK,
+                     "Connection %i | New TCP connection on server socket %i",
+                     (int)newsockfd, serverSocket);
+
+        if(ServerNetworkLayerTCP_add(&layer->tcp, (UA_Int32)newsockfd,
+                                     &remote) != UA_STATUSCODE_GOOD) {
+            CLOSESOCKET(newsockfd);
+            continue;
+        }
+
+        /* The new connection is at the head of the list */
+        ConnectionEntry *e = LIST_FIRST(&layer->tcp.connections);
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = e;
+        if(epoll_ctl(layer->epollfd, EPOLL_CTL_ADD,
+                     (int)newsockfd, &event) < 0) {
+            UA_LOG_SOCKET_ERRNO_WRAP(
+                UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_NETWORK,
+                               "Connection %i | Could not add the socket to "
+                               "the epoll set: %s", (int)newsockfd, errno_str));
+            LIST_REMOVE(e, pointers);
+            CLOSESOCKET(newsockfd);
+            UA_free(e);
+        }
+    }
+}
+
+static void
+ServerNetworkLayerTCPEpoll_remove(ServerNetworkLayerTCPEpoll *layer,
+                                  UA_Server *server, ConnectionEntry *e) {
+    epoll_ctl(layer->epollfd, EPOLL_CTL_DEL, e->connection.sockfd, NULL);
+    ServerNetworkLayerTCP_remove(server, e);
+}
+
+/* Modifying the registration of an edge-triggered socket reports it again if
+ * it (still) has data. The event is queued behind the sockets that are already
+ * ready. */
+static void
+ServerNetworkLayerTCPEpoll_rearm(ServerNetworkLayerTCPEpoll *layer,
+                                 UA_Server *server, ConnectionEntry *e) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = e;
+    if(epoll_ctl(layer->epollfd, EPOLL_CTL_MOD,
+                 e->connection.sockfd, &event) == 0)
+        return;
+
+    /* Without the notification the connection would stall. Close it. */
+    UA_LOG_SOCKET_ERRNO_WRAP(
+        UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_NETWORK,
+                       "Connection %i | Could not re-arm the socket in the "
+                       "epoll set: %s", e->connection.sockfd, errno_str));
+    ServerNetworkLayerTCP_close(&e->connection);
+    ServerNetworkLayerTCPEpoll_remove(layer, server, e);
+}
+
+/* Read until the socket has no more data. This is required for the
+ * edge-triggered notification. If the socket cannot be drained (too many reads
+ * or out of memory), it is re-armed. */
+static void
+ServerNetworkLayerTCPEpoll_read(ServerNetworkLayerTCPEpoll *layer,
+                                UA_Server *server, ConnectionEntry *e) {
+    UA_LOG_TRACE(UA_Log_Stdout, UA_LOGCATEGORY_NETWORK,
+                 "Connection %i | Activity on the socket",
+                 e->connection.sockfd);
+
+    for(size_t i = 0; i < EPOLL_MAXREADS; i++) {
+        UA_ByteString buf = UA_BYTESTRING_NULL;
+        UA_StatusCode retval = ServerNetworkLayerTCP_recv(&e->connection, &buf);
+        if(retval == UA_STATUSCODE_BADCONNECTIONCLOSED) {
+            ServerNetworkLayerTCPEpoll_remove(layer, server, e);
+            return;
+        }
+
+        /* Out of memory. The data remains in the socket. */
+        if(retval != UA_STATUSCODE_GOOD)
+            break;
+
+        /* No more data available */
+        if(buf.length == 0)
+            return;
+
+        /* Process packets */
+        UA_Server_processBinaryMessage(server, &e->connection, &buf);
+        ServerNetworkLayerTCP_releaseBuffer(&e->connection, &buf);
+    }
+
+    ServerNetworkLayerTCPEpoll_rearm(layer, server, e);
+}
+
+static UA_StatusCode
+ServerNetworkLayerTCPEpoll_listen(UA_ServerNetworkLayer *nl, UA_Server *server,
+                                  UA_UInt16 timeout) {
+    ServerNetworkLayerTCPEpoll *layer = (ServerNetworkLayerTCPEpoll*)nl->handle;
+    if(layer->epollfd < 0)
+        return UA_STATUSCODE_GOOD;
+
+    struct epoll_event events[EPOLL_MAXEVENTS];
+    int nfds = epoll_wait(layer->epollfd, events, EPOLL_MAXEVENTS, timeout);
+    if(nfds < 0) {
+        if(errno__ != INTERRUPTED) {
+            UA_LOG_SOCKET_ERRNO_WRAP(
+                UA_LOG_WARNING(UA_Log_Stdout, UA_LOGCATEGORY_NETWORK,
+                               "Socket epoll_wait failed with %s", errno_str));
+        }
+        // we will retry, so do not return bad
+        return UA_STATUSCODE_GOOD;
+    }
+
+    for(int i = 0; i < nfds; i++) {
+        /* Accept new connections via the server sockets */
+        UA_Boolean isServerSocket = false;
+        for(UA_UInt16 j = 0; j < layer->tcp.serverSocketsSize; j++) {
+            if(events[i].data.ptr != &layer->tcp.serverSockets[j])
+                continue;
+            ServerNetworkLayerTCPEpoll_accept(layer, layer->tcp.serverSockets[j]);
+            isServerSocket = true;
+            break;
+        }
+
+        /* Read from established sockets */
+        if(!isServerSocket)
+            ServerNetworkLayerTCPEpoll_read(layer, server,
+                                            (ConnectionEntry*)events[i].data.ptr);
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+ServerNetworkLayerTCPEpoll_stop(UA_ServerNetworkLayer *nl, UA_Server *server) {
+    ServerNetworkLayerTCPEpoll *layer = (ServerNetworkLayerTCPEpoll*)nl->handle;
+    UA_LOG_INFO(UA_Log_Stdout, UA_LOGCATEGORY_NETWORK,
+                "Shutting down the TCP network layer");
+
+    /* Close the server sockets. They are removed from the epoll set
+     * automatically. */
+    for(UA_UInt16 i = 0; i < layer->tcp.serverSocketsSize; i++) {
+        shutdown((SOCKET)layer->tcp.serverSockets[i], 2);
+        CLOSESOCKET(layer->tcp.serverSockets[i]);
+    }
+    layer->tcp.serverSocketsSize = 0;
+
+    /* Close and remove the open connections. The server is no longer
+     * processing messages. So the connections can be removed without waiting
+     * for the epoll notification. */
+    ConnectionEntry *e, *e_tmp;
+    LIST_FOREACH_SAFE(e, &layer->tcp.connections, pointers, e_tmp) {
+        ServerNetworkLayerTCP_close(&e->connection);
+        ServerNetworkLayerTCPEpoll_remove(layer, server, e);
+    }
+
+    CLOSESOCKET(layer->epollfd);
+    layer->epollfd = -1;
+}
+
+UA_ServerNetworkLayer
+UA_ServerNetworkLayerTCP_epoll(UA_ConnectionConfig conf, UA_UInt16 port) {
+    UA_ServerNetworkLayer nl;
+    memset(&nl, 0, sizeof(UA_ServerNetworkLayer));
+    ServerNetworkLayerTCPEpoll *layer = (ServerNetworkLayerTCPEpoll*)
+        UA_calloc(1,sizeof(ServerNetworkLayerTCPEpoll));
+    if(!layer)
+        return nl;
+
+    layer->tcp.conf = conf;
+    layer->tcp.port = port;
+    BufferPool_init(&layer->tcp.pool, conf.sendBufferSize > conf.recvBufferSize ?
+                    conf.sendBufferSize : conf.recvBufferSize);
+    layer->epollfd = -1;
+
+    nl.handle = layer;
+    nl.start = ServerNetworkLayerTCPEpoll_start;
+    nl.listen = ServerNetworkLayerTCPEpoll_listen;
+    nl.stop = ServerNetworkLayerTCPEpoll_stop;
+    nl.deleteMembers = ServerNetworkLayerTCP_deleteMembers;
+    return nl;
+}
+
+#endif /* __linux__ */
+
 /***************************/
 /* Client NetworkLayer TCP */
 /***************************/
@@ -677,6 +1260,7 @@ UA_ClientConnectionTCP(UA_ConnectionConfig conf,
     connection.localConf = conf;
     connection.remoteConf = conf;
     connection.send = connection_write;
+    connection.sendMultiple = connection_writemultiple;
     connection.recv = connection_recv;
     connection.close = ClientNetworkLayerTCP_close;
     connection.free = NULL;
@@ -14,6 +14,29 @@ extern "C" {
 UA_ServerNetworkLayer UA_EXPORT
 UA_ServerNetworkLayerTCP(UA_ConnectionConfig conf, UA_UInt16 port);
 
+#ifdef __linux__
+/* Same as UA_ServerNetworkLayerTCP. But the sockets are kept in a persistent
+ * epoll set instead of rebuilding an fd_set for select in every iteration. So
+ * the network layer is not limited by FD_SETSIZE and the cost of an iteration
+ * does not grow with the number of (idle) connections. */
+UA_ServerNetworkLayer UA_EXPORT
+UA_ServerNetworkLayerTCP_epoll(UA_ConnectionConfig conf, UA_UInt16 port);
+#endif
+
+/* The server network layers take the send and receive buffers of their
+ * connections from a pool of fixed-size slabs. A hit is a buffer served from an
+ * already allocated slab. A miss required a heap allocation. */
+typedef struct {
+    UA_UInt32 hits;
+    UA_UInt32 misses;
+} UA_NetworkBufferPoolStatistics;
+
+/* Only for network layers created with UA_ServerNetworkLayerTCP and
+ * UA_ServerNetworkLayerTCP_epoll */
+void UA_EXPORT
+UA_ServerNetworkLayerTCP_getBufferPoolStatistics(const UA_ServerNetworkLayer *nl,
+                                                 UA_NetworkBufferPoolStatistics *stats);
+
 UA_Connection UA_EXPORT
 UA_ClientConnectionTCP(UA_ConnectionConfig conf, const char *endpointUrl, const UA_UInt32 timeout);
 
@@ -9,11 +9,7 @@
 
 #ifdef UA_ENABLE_MULTITHREADING
 #include <pthread.h>
-#define BEGIN_CRITSECT(NODEMAP) pthread_mutex_lock(&(NODEMAP)->mutex)
-#define END_CRITSECT(NODEMAP) pthread_mutex_unlock(&(NODEMAP)->mutex)
-#else
-#define BEGIN_CRITSECT(NODEMAP)
-#define END_CRITSECT(NODEMAP)
+#include <sched.h>
 #endif
 
 /* The default Nodestore is simply a hash-map from NodeIds to Nodes. To find an
@@ -21,28 +17,405 @@
  *
  * - Tombstone or non-matching NodeId: continue searching
  * - Matching NodeId: Return the entry
- * - NULL: Abort the search */
+ * - NULL: Abort the search
+ *
+ * Numeric NodeIds in the first namespaces are not hashed. They are stored in a
+ * direct index per namespace. The index is a radix table. The directory points
+ * to leaves with the entries of consecutive identifiers. The leaves are created
+ * on demand, so sparse identifiers don't take much memory.
+ *
+ * With multithreading, only the writers (insert, replace, remove) are
+ * serialized with a mutex. Readers never take the mutex. They announce
+ * themselves in one of several reader counters and take a reference to the
+ * entry with an atomic increment. Writers never modify a published entry or
+ * table. Instead, the new version is published and the old version is retired.
+ * Retired entries and tables are released once all reader counters were seen
+ * at zero, as no reader can still be in the process of looking them up. Under
+ * a constant load, the counters are rarely zero at the same time. So every
+ * reader stripe has one counter per parity of a global epoch. When too much
+ * memory is retired, the writer advances the epoch and waits for the counters
+ * of the previous parity. New readers use the other counter, so the counters
+ * of the previous parity drain even under a constant read load. */
 
 typedef struct UA_NodeMapEntry {
     struct UA_NodeMapEntry *orig; /* the version this is a copy from (or NULL) */
-    UA_UInt16 refCount; /* How many consumers have a reference to the node? */
-    UA_Boolean deleted; /* Node was marked as deleted and can be deleted when refCount == 0 */
+#ifdef UA_ENABLE_MULTITHREADING
+    struct UA_NodeMapEntry *nextRetired;
+#endif
+    /* How many consumers have a reference to the node? The highest bit is set
+     * when the node was deleted. It is freed when the refCount drops to zero. */
+    UA_UInt32 refCount;
     UA_Node node;
 } UA_NodeMapEntry;
 
 #define UA_NODEMAP_MINSIZE 64
 #define UA_NODEMAP_TOMBSTONE ((UA_NodeMapEntry*)0x01)
+#define UA_NODEMAP_DELETED 0x80000000
 
-typedef struct {
+/* The slots are allocated together with the table */
+typedef struct UA_NodeMapTable {
+#ifdef UA_ENABLE_MULTITHREADING
+    struct UA_NodeMapTable *nextRetired;
+#endif
     UA_NodeMapEntry **entries;
     UA_UInt32 size;
-    UA_UInt32 count;
     UA_UInt32 sizePrimeIndex;
+} UA_NodeMapTable;
+
+#define UA_NODEMAP_NUMERICNAMESPACES 16
+#define UA_NODEMAP_NUMERICMAX (1 << 24) /* Larger identifiers are hashed */
+#define UA_NODEMAP_LEAFBITS 6
+#define UA_NODEMAP_LEAFSIZE (1 << UA_NODEMAP_LEAFBITS)
+#define UA_NODEMAP_MINDIRECTORYSIZE 16
+
+typedef struct {
+    UA_NodeMapEntry *entries[UA_NODEMAP_LEAFSIZE];
+} UA_NodeMapLeaf;
+
+/* The leaf pointers are allocated together with the directory. A larger
+ * directory points to the same leaves. The leaves are only released when the
+ * nodestore is deleted. */
+typedef struct UA_NodeMapDirectory {
 #ifdef UA_ENABLE_MULTITHREADING
-    pthread_mutex_t mutex; /* Protect access */
+    struct UA_NodeMapDirectory *nextRetired;
+#endif
+    UA_NodeMapLeaf **leaves;
+    UA_UInt32 size; /* Number of leaves */
+} UA_NodeMapDirectory;
+
+#ifdef UA_ENABLE_MULTITHREADING
+#define UA_NODEMAP_READERSTRIPES_BITS 4
+#define UA_NODEMAP_READERSTRIPES (1 << UA_NODEMAP_READERSTRIPES_BITS)
+#define UA_NODEMAP_MAXRETIRED 256 /* Wait for the readers beyond this */
+
+/* The readers are spread over several stripes in their own cache line. A
+ * reader counts itself for the parity of the epoch when it started. */
+typedef struct {
+    UA_UInt32 readers[2];
+    UA_Byte padding[56];
+} UA_NodeMapReaderStripe;
+#endif
+
+typedef struct {
+    UA_NodeMapTable *table;
+    UA_UInt32 count; /* Entries in the hash-map */
+    UA_NodeMapDirectory *numeric[UA_NODEMAP_NUMERICNAMESPACES];
+    UA_UInt32 numericCount; /* Entries in the direct index */
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_t mutex; /* Serialize the writers */
+    UA_NodeMapEntry *retiredEntries;
+    UA_NodeMapTable *retiredTables;
+    UA_NodeMapDirectory *retiredDirectories;
+    UA_UInt32 retiredCount;
+    UA_UInt32 iterators; /* Active iterations (the visitor may write) */
+    UA_UInt32 epoch; /* The parity selects the reader counters */
+    pthread_mutex_t epochMutex; /* Serialize the waiting for readers */
+    UA_NodeMapReaderStripe stripes[UA_NODEMAP_READERSTRIPES];
 #endif
 } UA_NodeMap;
 
+/*********************/
+/* Atomic Operations */
+/*********************/
+
+/* The pointers and counters shared between readers and writers are accessed
+ * with sequentially consistent atomics. A writer that removes a pointer and
+ * then finds no active reader knows that no reader can still use it. */
+#ifdef UA_ENABLE_MULTITHREADING
+# define NODEMAP_LOAD(PTR) __atomic_load_n(PTR, __ATOMIC_SEQ_CST)
+# define NODEMAP_STORE(PTR, VAL) __atomic_store_n(PTR, VAL, __ATOMIC_SEQ_CST)
+# define NODEMAP_ADD(PTR, VAL) __atomic_add_fetch(PTR, VAL, __ATOMIC_SEQ_CST)
+#else
+# define NODEMAP_LOAD(PTR) (*(PTR))
+# define NODEMAP_STORE(PTR, VAL) (*(PTR) = (VAL))
+# define NODEMAP_ADD(PTR, VAL) (*(PTR) += (VAL))
+#endif
+
+/****************************/
+/* Readers and Reclamation  */
+/****************************/
+
+static void
+deleteEntry(UA_NodeMapEntry *entry) {
+    UA_Node_deleteMembers(&entry->node);
+    UA_free(entry);
+}
+
+static void
+releaseEntry(UA_NodeMapEntry *entry) {
+    if(NODEMAP_ADD(&entry->refCount, (UA_UInt32)-1) == UA_NODEMAP_DELETED)
+        deleteEntry(entry);
+}
+
+/* The entry is deleted when the last reference is released */
+static void
+markEntryDeleted(UA_NodeMapEntry *entry) {
+    if(NODEMAP_ADD(&entry->refCount, UA_NODEMAP_DELETED) == UA_NODEMAP_DELETED)
+        deleteEntry(entry);
+}
+
+#ifdef UA_ENABLE_MULTITHREADING
+
+/* Returns the reader counter that is decreased at the end of the read */
+static UA_UInt32 *
+beginRead(UA_NodeMap *ns) {
+    /* Spread the threads over the stripes */
+    pthread_t self = pthread_self();
+    UA_UInt64 id = 0;
+    memcpy(&id, &self, sizeof(self) < sizeof(id) ? sizeof(self) : sizeof(id));
+    size_t index = (size_t)((id * 0x9e3779b97f4a7c15) >> (64 - UA_NODEMAP_READERSTRIPES_BITS));
+    UA_UInt32 parity = NODEMAP_LOAD(&ns->epoch) & 1;
+    UA_UInt32 *readers = &ns->stripes[index].readers[parity];
+    NODEMAP_ADD(readers, 1);
+    return readers;
+}
+
+static void
+endRead(UA_UInt32 *readers) {
+    NODEMAP_ADD(readers, (UA_UInt32)-1);
+}
+
+static void
+deleteRetired(UA_NodeMapEntry *entries, UA_NodeMapTable *tables,
+              UA_NodeMapDirectory *directories) {
+    while(tables) {
+        UA_NodeMapTable *table = tables;
+        tables = table->nextRetired;
+        UA_free(table);
+    }
+    while(directories) {
+        UA_NodeMapDirectory *dir = directories;
+        directories = dir->nextRetired;
+        UA_free(dir);
+    }
+    while(entries) {
+        UA_NodeMapEntry *entry = entries;
+        entries = entry->nextRetired;
+        markEntryDeleted(entry);
+    }
+}
+
+/* Wait until every reader counter was zero once after the memory was retired.
+ * A reader that increases a counter after it was seen at zero cannot find the
+ * retired memory anymore.
+ *
+ * The epoch is advanced before the counters of the previous parity are
+ * checked. Only readers that loaded the epoch before the advancement (at most
+ * one per thread) can still increase them. So the wait ends under a constant
+ * read load. This is done for both parities, as long-running readers may still
+ * be counted for an earlier epoch. Concurrent writers wait one after another,
+ * so that the epoch does not change during the wait. */
+static void
+waitForReaders(UA_NodeMap *ns) {
+    pthread_mutex_lock(&ns->epochMutex);
+    for(size_t round = 0; round < 2; round++) {
+        UA_UInt32 parity = (NODEMAP_ADD(&ns->epoch, 1) - 1) & 1;
+        for(size_t i = 0; i < UA_NODEMAP_READERSTRIPES; i++) {
+            while(NODEMAP_LOAD(&ns->stripes[i].readers[parity]) != 0)
+                sched_yield();
+        }
+    }
+    pthread_mutex_unlock(&ns->epochMutex);
+}
+
+/* Release the retired entries and tables if no reader is active. Readers that
+ * start afterwards cannot find them anymore. Called by the writers at the end
+ * of the critical section. */
+static void
+reclaimAndUnlock(UA_NodeMap *ns) {
+    if(!ns->retiredEntries && !ns->retiredTables && !ns->retiredDirectories) {
+        pthread_mutex_unlock(&ns->mutex);
+        return;
+    }
+
+    UA_Boolean active = false;
+    for(size_t i = 0; i < UA_NODEMAP_READERSTRIPES; i++) {
+        if(NODEMAP_LOAD(&ns->stripes[i].readers[0]) != 0 ||
+           NODEMAP_LOAD(&ns->stripes[i].readers[1]) != 0) {
+            active = true;
+            break;
+        }
+    }
+
+    /* Try again with the next write. Don't wait during an iteration. The
+     * visitor may be waiting for the mutex or be in this thread. */
+    if(active && (ns->retiredCount < UA_NODEMAP_MAXRETIRED ||
+                  NODEMAP_LOAD(&ns->iterators) > 0)) {
+        pthread_mutex_unlock(&ns->mutex);
+        return;
+    }
+
+    /* Take the retired memory and wait for the readers without the lock */
+    UA_NodeMapEntry *entries = ns->retiredEntries;
+    UA_NodeMapTable *tables = ns->retiredTables;
+    UA_NodeMapDirectory *directories = ns->retiredDirectories;
+    ns->retiredEntries = NULL;
+    ns->retiredTables = NULL;
+    ns->retiredDirectories = NULL;
+    ns->retiredCount = 0;
+    pthread_mutex_unlock(&ns->mutex);
+    if(active)
+        waitForReaders(ns);
+    deleteRetired(entries, tables, directories);
+}
+
+#define BEGIN_READ(NODEMAP) UA_UInt32 *readers = beginRead(NODEMAP)
+#define END_READ(NODEMAP) endRead(readers)
+#define BEGIN_CRITSECT(NODEMAP) pthread_mutex_lock(&(NODEMAP)->mutex)
+#define END_CRITSECT(NODEMAP) reclaimAndUnlock(NODEMAP)
+#else
+#define BEGIN_READ(NODEMAP)
+#define END_READ(NODEMAP)
+#define BEGIN_CRITSECT(NODEMAP)
+#define END_CRITSECT(NODEMAP)
+#endif
+
+/* The entry was removed from the table */
+static void
+retireEntry(UA_NodeMap *ns, UA_NodeMapEntry *entry) {
+#ifdef UA_ENABLE_MULTITHREADING
+    entry->nextRetired = ns->retiredEntries;
+    ns->retiredEntries = entry;
+    ns->retiredCount++;
+#else
+    markEntryDeleted(entry);
+#endif
+}
+
+static void
+retireTable(UA_NodeMap *ns, UA_NodeMapTable *table) {
+#ifdef UA_ENABLE_MULTITHREADING
+    table->nextRetired = ns->retiredTables;
+    ns->retiredTables = table;
+    ns->retiredCount++;
+#else
+    UA_free(table);
+#endif
+}
+
+static void
+retireDirectory(UA_NodeMap *ns, UA_NodeMapDirectory *dir) {
+#ifdef UA_ENABLE_MULTITHREADING
+    dir->nextRetired = ns->retiredDirectories;
+    ns->retiredDirectories = dir;
+    ns->retiredCount++;
+#else
+    UA_free(dir);
+#endif
+}
+
+/****************/
+/* Direct Index */
+/****************/
+
+static UA_Boolean
+isNumericIndexed(const UA_NodeId *nodeid) {
+    return (nodeid->identifierType == UA_NODEIDTYPE_NUMERIC &&
+            nodeid->namespaceIndex < UA_NODEMAP_NUMERICNAMESPACES &&
+            nodeid->identifier.numeric < UA_NODEMAP_NUMERICMAX);
+}
+
+/* Every level is loaded only once. A writer may concurrently publish a larger
+ * directory or a new leaf. */
+static UA_NodeMapEntry *
+findNumericEntry(UA_NodeMap *ns, const UA_NodeId *nodeid) {
+    UA_UInt32 id = nodeid->identifier.numeric;
+    UA_NodeMapDirectory *dir = NODEMAP_LOAD(&ns->numeric[nodeid->namespaceIndex]);
+    if(!dir || (id >> UA_NODEMAP_LEAFBITS) >= dir->size)
+        return NULL;
+    UA_NodeMapLeaf *leaf = NODEMAP_LOAD(&dir->leaves[id >> UA_NODEMAP_LEAFBITS]);
+    if(!leaf)
+        return NULL;
+    return NODEMAP_LOAD(&leaf->entries[id & (UA_NODEMAP_LEAFSIZE - 1)]);
+}
+
+static UA_NodeMapLeaf *
+getLeaf(UA_NodeMap *ns, UA_UInt16 nsIndex, UA_UInt32 leafIndex) {
+    UA_NodeMapDirectory *dir = ns->numeric[nsIndex];
+    if(dir && leafIndex < dir->size)
+        return dir->leaves[leafIndex];
+    return NULL;
+}
+
+/* Grow the directory so that it contains the leaf index. Readers see either
+ * the old or the new directory. Both point to the same leaves. */
+static UA_NodeMapDirectory *
+growDirectory(UA_NodeMap *ns, UA_UInt16 nsIndex, UA_UInt32 leafIndex) {
+    UA_NodeMapDirectory *odir = ns->numeric[nsIndex];
+    UA_UInt32 size = UA_NODEMAP_MINDIRECTORYSIZE;
+    while(size <= leafIndex)
+        size *= 2;
+    UA_NodeMapDirectory *dir = (UA_NodeMapDirectory*)
+        UA_calloc(1, sizeof(UA_NodeMapDirectory) + (size * sizeof(UA_NodeMapLeaf*)));
+    if(!dir)
+        return NULL;
+    dir->leaves = (UA_NodeMapLeaf**)&dir[1];
+    dir->size = size;
+    if(odir) {
+        memcpy(dir->leaves, odir->leaves, odir->size * sizeof(UA_NodeMapLeaf*));
+        retireDirectory(ns, odir);
+    }
+    NODEMAP_STORE(&ns->numeric[nsIndex], dir);
+    return dir;
+}
+
+/* Returns the slot in the direct index. If create is set, the directory and
+ * leaf are created on demand. Returns NULL if the slot does not exist or the
+ * memory could not be allocated. */
+static UA_NodeMapEntry **
+findNumericSlot(UA_NodeMap *ns, const UA_NodeId *nodeid, UA_Boolean create) {
+    UA_UInt16 nsIndex = nodeid->namespaceIndex;
+    UA_UInt32 id = nodeid->identifier.numeric;
+    UA_UInt32 leafIndex = id >> UA_NODEMAP_LEAFBITS;
+    UA_NodeMapLeaf *leaf = getLeaf(ns, nsIndex, leafIndex);
+    if(!leaf) {
+        if(!create)
+            return NULL;
+        UA_NodeMapDirectory *dir = ns->numeric[nsIndex];
+        if(!dir || leafIndex >= dir->size) {
+            dir = growDirectory(ns, nsIndex, leafIndex);
+            if(!dir)
+                return NULL;
+        }
+        leaf = (UA_NodeMapLeaf*)UA_calloc(1, sizeof(UA_NodeMapLeaf));
+        if(!leaf)
+            return NULL;
+        NODEMAP_STORE(&dir->leaves[leafIndex], leaf);
+    }
+    return &leaf->entries[id & (UA_NODEMAP_LEAFSIZE - 1)];
+}
+
+static void
+clearNumericSlot(UA_NodeMap *ns, UA_NodeMapEntry **slot) {
+    UA_NodeMapEntry *entry = *slot;
+    NODEMAP_STORE(slot, NULL);
+    retireEntry(ns, entry);
+    --ns->numericCount;
+}
+
+static void
+deleteNumericIndex(UA_NodeMap *ns) {
+    for(size_t i = 0; i < UA_NODEMAP_NUMERICNAMESPACES; i++) {
+        UA_NodeMapDirectory *dir = ns->numeric[i];
+        if(!dir)
+            continue;
+        for(UA_UInt32 j = 0; j < dir->size; j++) {
+            UA_NodeMapLeaf *leaf = dir->leaves[j];
+            if(!leaf)
+                continue;
+            for(size_t k = 0; k < UA_NODEMAP_LEAFSIZE; k++) {
+                if(!leaf->entries[k])
+                    continue;
+                /* On debugging builds, check that all nodes were release */
+                UA_assert(leaf->entries[k]->refCount == 0);
+                deleteEntry(leaf->entries[k]);
+            }
+            UA_free(leaf);
+        }
+        UA_free(dir);
+    }
+}
+
 /*********************/
 /* HashMap Utilities */
 /*********************/
@@ -74,21 +447,34 @@ higher_prime_index(UA_UInt32 n) {
     return low;
 }
 
+static UA_NodeMapTable *
+newTable(UA_UInt32 sizePrimeIndex) {
+    UA_UInt32 size = primes[sizePrimeIndex];
+    UA_NodeMapTable *table = (UA_NodeMapTable*)
+        UA_calloc(1, sizeof(UA_NodeMapTable) + (size * sizeof(UA_NodeMapEntry*)));
+    if(!table)
+        return NULL;
+    table->entries = (UA_NodeMapEntry**)&table[1];
+    table->size = size;
+    table->sizePrimeIndex = sizePrimeIndex;
+    return table;
+}
+
 /* returns an empty slot or null if the nodeid exists */
 static UA_NodeMapEntry **
-findFreeSlot(const UA_NodeMap *ns, const UA_NodeId *nodeid) {
+findFreeSlot(const UA_NodeMapTable *table, const UA_NodeId *nodeid) {
     UA_UInt32 h = UA_NodeId_hash(nodeid);
-    UA_UInt32 size = ns->size;
+    UA_UInt32 size = table->size;
     UA_UInt32 idx = mod(h, size);
     UA_UInt32 hash2 = mod2(h, size);
 
     while(true) {
-        UA_NodeMapEntry *e = ns->entries[idx];
+        UA_NodeMapEntry *e = table->entries[idx];
         if(e > UA_NODEMAP_TOMBSTONE &&
            UA_NodeId_equal(&e->node.nodeId, nodeid))
             return NULL;
-        if(ns->entries[idx] <= UA_NODEMAP_TOMBSTONE)
-            return &ns->entries[idx];
+        if(table->entries[idx] <= UA_NODEMAP_TOMBSTONE)
+            return &table->entries[idx];
         idx += hash2;
         if(idx >= size)
             idx -= size;
@@ -101,35 +487,31 @@ findFreeSlot(const UA_NodeMap *ns, const UA_NodeId *nodeid) {
 /* The occupancy of the table after the call will be about 50% */
 static UA_StatusCode
 expand(UA_NodeMap *ns) {
-    UA_UInt32 osize = ns->size;
+    UA_NodeMapTable *otable = ns->table;
+    UA_UInt32 osize = otable->size;
     UA_UInt32 count = ns->count;
     /* Resize only when table after removal of unused elements is either too
        full or too empty */
     if(count * 2 < osize && (count * 8 > osize || osize <= UA_NODEMAP_MINSIZE))
         return UA_STATUSCODE_GOOD;
 
-    UA_NodeMapEntry **oentries = ns->entries;
-    UA_UInt32 nindex = higher_prime_index(count * 2);
-    UA_UInt32 nsize = primes[nindex];
-    UA_NodeMapEntry **nentries = (UA_NodeMapEntry **)UA_calloc(nsize, sizeof(UA_NodeMapEntry*));
-    if(!nentries)
+    UA_NodeMapTable *ntable = newTable(higher_prime_index(count * 2));
+    if(!ntable)
         return UA_STATUSCODE_BADOUTOFMEMORY;
 
-    ns->entries = nentries;
-    ns->size = nsize;
-    ns->sizePrimeIndex = nindex;
-
     /* recompute the position of every entry and insert the pointer */
     for(size_t i = 0, j = 0; i < osize && j < count; ++i) {
-        if(oentries[i] <= UA_NODEMAP_TOMBSTONE)
+        if(otable->entries[i] <= UA_NODEMAP_TOMBSTONE)
             continue;
-        UA_NodeMapEntry **e = findFreeSlot(ns, &oentries[i]->node.nodeId);
+        UA_NodeMapEntry **e = findFreeSlot(ntable, &otable->entries[i]->node.nodeId);
         UA_assert(e);
-        *e = oentries[i];
+        *e = otable->entries[i];
         ++j;
     }
 
-    UA_free(oentries);
+    /* Readers see either the old or the new table */
+    NODEMAP_STORE(&ns->table, ntable);
+    retireTable(ns, otable);
     return UA_STATUSCODE_GOOD;
 }
 
@@ -171,44 +553,57 @@ newEntry(UA_NodeClass nodeClass) {
     return entry;
 }
 
-static void
-deleteEntry(UA_NodeMapEntry *entry) {
-    UA_Node_deleteMembers(&entry->node);
-    UA_free(entry);
-}
-
-static void
-cleanupEntry(UA_NodeMapEntry *entry) {
-    if(entry->deleted && entry->refCount == 0)
-        deleteEntry(entry);
-}
-
 static UA_StatusCode
 clearSlot(UA_NodeMap *ns, UA_NodeMapEntry **slot) {
-    (*slot)->deleted = true;
-    cleanupEntry(*slot);
-    *slot = UA_NODEMAP_TOMBSTONE;
+    UA_NodeMapEntry *entry = *slot;
+    NODEMAP_STORE(slot, UA_NODEMAP_TOMBSTONE);
+    retireEntry(ns, entry);
     --ns->count;
     /* Downsize the hashmap if it is very empty */
-    if(ns->count * 8 < ns->size && ns->size > 32)
+    if(ns->count * 8 < ns->table->size && ns->table->size > 32)
         expand(ns); /* Can fail. Just continue with the bigger hashmap. */
     return UA_STATUSCODE_GOOD;
 }
 
 static UA_NodeMapEntry **
-findOccupiedSlot(const UA_NodeMap *ns, const UA_NodeId *nodeid) {
+findOccupiedSlot(const UA_NodeMapTable *table, const UA_NodeId *nodeid) {
+    UA_UInt32 h = UA_NodeId_hash(nodeid);
+    UA_UInt32 size = table->size;
+    UA_UInt32 idx = mod(h, size);
+    UA_UInt32 hash2 = mod2(h, size);
+
+    while(true) {
+        UA_NodeMapEntry *e = table->entries[idx];
+        if(!e)
+            return NULL;
+        if(e > UA_NODEMAP_TOMBSTONE &&
+           UA_NodeId_equal(&e->node.nodeId, nodeid))
+            return &table->entries[idx];
+        idx += hash2;
+        if(idx >= size)
+            idx -= size;
+    }
+
+    /* NOTREACHED */
+    return NULL;
+}
+
+/* Same as findOccupiedSlot, but every slot is loaded only once. The slot may
+ * be replaced concurrently by a writer. */
+static UA_NodeMapEntry *
+findEntry(const UA_NodeMapTable *table, const UA_NodeId *nodeid) {
     UA_UInt32 h = UA_NodeId_hash(nodeid);
-    UA_UInt32 size = ns->size;
+    UA_UInt32 size = table->size;
     UA_UInt32 idx = mod(h, size);
     UA_UInt32 hash2 = mod2(h, size);
 
     while(true) {
-        UA_NodeMapEntry *e = ns->entries[idx];
+        UA_NodeMapEntry *e = NODEMAP_LOAD(&table->entries[idx]);
         if(!e)
             return NULL;
         if(e > UA_NODEMAP_TOMBSTONE &&
            UA_NodeId_equal(&e->node.nodeId, nodeid))
-            return &ns->entries[idx];
+            return e;
         idx += hash2;
         if(idx >= size)
             idx -= size;
@@ -218,6 +613,43 @@ findOccupiedSlot(const UA_NodeMap *ns, const UA_NodeId *nodeid) {
     return NULL;
 }
 
+/* Find the occupied slot for the writers */
+static UA_NodeMapEntry **
+findNodeSlot(UA_NodeMap *ns, const UA_NodeId *nodeid) {
+    if(isNumericIndexed(nodeid)) {
+        UA_NodeMapEntry **slot = findNumericSlot(ns, nodeid, false);
+        return (slot && *slot) ? slot : NULL;
+    }
+    return findOccupiedSlot(ns->table, nodeid);
+}
+
+static UA_StatusCode
+findInsertSlot(UA_NodeMap *ns, const UA_NodeId *nodeid,
+               UA_NodeMapEntry ***outSlot) {
+    UA_NodeMapEntry **slot;
+    if(isNumericIndexed(nodeid)) {
+        slot = findNumericSlot(ns, nodeid, true);
+        if(!slot)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        if(*slot)
+            return UA_STATUSCODE_BADNODEIDEXISTS;
+    } else {
+        slot = findFreeSlot(ns->table, nodeid);
+        if(!slot)
+            return UA_STATUSCODE_BADNODEIDEXISTS;
+    }
+    *outSlot = slot;
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+removeSlot(UA_NodeMap *ns, const UA_NodeId *nodeid, UA_NodeMapEntry **slot) {
+    if(isNumericIndexed(nodeid))
+        clearNumericSlot(ns, slot);
+    else
+        clearSlot(ns, slot);
+}
+
 /***********************/
 /* Interface functions */
 /***********************/
@@ -230,62 +662,53 @@ UA_NodeMap_newNode(void *context, UA_NodeClass nodeClass) {
     return &entry->node;
 }
 
+/* The node was never inserted. No synchronization required. */
 static void
 UA_NodeMap_deleteNode(void *context, UA_Node *node) {
-#ifdef UA_ENABLE_MULTITHREADING
-    UA_NodeMap *ns = (UA_NodeMap*)context;
-#endif
-    BEGIN_CRITSECT(ns);
     UA_NodeMapEntry *entry = container_of(node, UA_NodeMapEntry, node);
     UA_assert(&entry->node == node);
     deleteEntry(entry);
-    END_CRITSECT(ns);
 }
 
 static const UA_Node *
 UA_NodeMap_getNode(void *context, const UA_NodeId *nodeid) {
     UA_NodeMap *ns = (UA_NodeMap*)context;
-    BEGIN_CRITSECT(ns);
-    UA_NodeMapEntry **entry = findOccupiedSlot(ns, nodeid);
+    BEGIN_READ(ns);
+    UA_NodeMapEntry *entry;
+    if(isNumericIndexed(nodeid))
+        entry = findNumericEntry(ns, nodeid);
+    else
+        entry = findEntry(NODEMAP_LOAD(&ns->table), nodeid);
     if(!entry) {
-        END_CRITSECT(ns);
+        END_READ(ns);
         return NULL;
     }
-    ++(*entry)->refCount;
-    END_CRITSECT(ns);
-    return (const UA_Node*)&(*entry)->node;
+    NODEMAP_ADD(&entry->refCount, 1);
+    END_READ(ns);
+    return (const UA_Node*)&entry->node;
 }
 
 static void
 UA_NodeMap_releaseNode(void *context, const UA_Node *node) {
     if (!node)
         return;
-#ifdef UA_ENABLE_MULTITHREADING
-    UA_NodeMap *ns = (UA_NodeMap*)context;
-#endif
-    BEGIN_CRITSECT(ns);
     UA_NodeMapEntry *entry = container_of(node, UA_NodeMapEntry, node);
     UA_assert(&entry->node == node);
-    UA_assert(entry->refCount > 0);
-    --entry->refCount;
-    cleanupEntry(entry);
-    END_CRITSECT(ns);
+    UA_assert((NODEMAP_LOAD(&entry->refCount) & ~(UA_UInt32)UA_NODEMAP_DELETED) > 0);
+    releaseEntry(entry);
 }
 
 static UA_StatusCode
 UA_NodeMap_getNodeCopy(void *context, const UA_NodeId *nodeid,
                        UA_Node **outNode) {
-    UA_NodeMap *ns = (UA_NodeMap*)context;
-    BEGIN_CRITSECT(ns);
-    UA_NodeMapEntry **slot = findOccupiedSlot(ns, nodeid);
-    if(!slot) {
-        END_CRITSECT(ns);
+    /* Hold a reference to the original during the copy */
+    const UA_Node *node = UA_NodeMap_getNode(context, nodeid);
+    if(!node)
         return UA_STATUSCODE_BADNODEIDUNKNOWN;
-    }
-    UA_NodeMapEntry *entry = *slot;
+    UA_NodeMapEntry *entry = container_of(node, UA_NodeMapEntry, node);
     UA_NodeMapEntry *newItem = newEntry(entry->node.nodeClass);
     if(!newItem) {
-        END_CRITSECT(ns);
+        UA_NodeMap_releaseNode(context, node);
         return UA_STATUSCODE_BADOUTOFMEMORY;
     }
     UA_StatusCode retval = UA_Node_copy(&entry->node, &newItem->node);
@@ -295,7 +718,7 @@ UA_NodeMap_getNodeCopy(void *context, const UA_NodeId *nodeid,
     } else {
         deleteEntry(newItem);
     }
-    END_CRITSECT(ns);
+    UA_NodeMap_releaseNode(context, node);
     return retval;
 }
 
@@ -303,10 +726,10 @@ static UA_StatusCode
 UA_NodeMap_removeNode(void *context, const UA_NodeId *nodeid) {
     UA_NodeMap *ns = (UA_NodeMap*)context;
     BEGIN_CRITSECT(ns);
-    UA_NodeMapEntry **slot = findOccupiedSlot(ns, nodeid);
+    UA_NodeMapEntry **slot = findNodeSlot(ns, nodeid);
     UA_StatusCode retval = UA_STATUSCODE_GOOD;
     if(slot)
-        retval = clearSlot(ns, slot);
+        removeSlot(ns, nodeid, slot);
     else
         retval = UA_STATUSCODE_BADNODEIDUNKNOWN;
     END_CRITSECT(ns);
@@ -318,64 +741,66 @@ UA_NodeMap_insertNode(void *context, UA_Node *node,
                       UA_NodeId *addedNodeId) {
     UA_NodeMap *ns = (UA_NodeMap*)context;
     BEGIN_CRITSECT(ns);
-    if(ns->size * 3 <= ns->count * 4) {
+    if(ns->table->size * 3 <= ns->count * 4) {
         if(expand(ns) != UA_STATUSCODE_GOOD) {
             END_CRITSECT(ns);
             return UA_STATUSCODE_BADINTERNALERROR;
         }
     }
 
-    UA_NodeId tempNodeid;
-    tempNodeid = node->nodeId;
-    tempNodeid.namespaceIndex = 0;
-    UA_NodeMapEntry **slot;
-    if(tempNodeid.identifierType == UA_NODEIDTYPE_NUMERIC &&
-       tempNodeid.identifier.numeric == 0) {
+    UA_NodeMapEntry **slot = NULL;
+    UA_StatusCode retval;
+    if(node->nodeId.identifierType == UA_NODEIDTYPE_NUMERIC &&
+       node->nodeId.identifier.numeric == 0) {
         /* create a random nodeid */
         /* start at least with 50,000 to make sure we don not conflict with nodes from the spec */
         /* E.g. adding a nodeset will create children while there are still other nodes which need to be created */
         /* Thus the node id's may collide */
-        UA_UInt32 identifier = 50000 + ns->count+1; // start value
-        UA_UInt32 size = ns->size;
-        UA_UInt32 increase = mod2(ns->count+1, size);
+        UA_UInt32 count = ns->count + ns->numericCount;
+        UA_UInt32 identifier = 50000 + count+1; // start value
+        UA_UInt32 size = ns->table->size;
+        UA_UInt32 increase = mod2(count+1, size);
         while(true) {
             node->nodeId.identifier.numeric = identifier;
-            slot = findFreeSlot(ns, &node->nodeId);
-            if(slot)
+            retval = findInsertSlot(ns, &node->nodeId, &slot);
+            if(retval != UA_STATUSCODE_BADNODEIDEXISTS)
                 break;
             identifier += increase;
             if(identifier >= size)
                 identifier -= size;
         }
     } else {
-        slot = findFreeSlot(ns, &node->nodeId);
-        if(!slot) {
-            deleteEntry(container_of(node, UA_NodeMapEntry, node));
-            END_CRITSECT(ns);
-            return UA_STATUSCODE_BADNODEIDEXISTS;
-        }
+        retval = findInsertSlot(ns, &node->nodeId, &slot);
+    }
+    if(retval != UA_STATUSCODE_GOOD) {
+        deleteEntry(container_of(node, UA_NodeMapEntry, node));
+        END_CRITSECT(ns);
+        return retval;
     }
 
-    *slot = container_of(node, UA_NodeMapEntry, node);
-    ++ns->count;
+    NODEMAP_STORE(slot, container_of(node, UA_NodeMapEntry, node));
+    if(isNumericIndexed(&node->nodeId))
+        ++ns->numericCount;
+    else
+        ++ns->count;
     UA_assert(&(*slot)->node == node);
 
-    UA_StatusCode retval = UA_STATUSCODE_GOOD;
     if(addedNodeId) {
         retval = UA_NodeId_copy(&node->nodeId, addedNodeId);
         if(retval != UA_STATUSCODE_GOOD)
-            clearSlot(ns, slot);
+            removeSlot(ns, &node->nodeId, slot);
     }
 
     END_CRITSECT(ns);
     return retval;
 }
 
+/* Copy-on-write. Readers see either the old or the new version. */
 static UA_StatusCode
 UA_NodeMap_replaceNode(void *context, UA_Node *node) {
     UA_NodeMap *ns = (UA_NodeMap*)context;
     BEGIN_CRITSECT(ns);
-    UA_NodeMapEntry **slot = findOccupiedSlot(ns, &node->nodeId);
+    UA_NodeMapEntry **slot = findNodeSlot(ns, &node->nodeId);
     if(!slot) {
         END_CRITSECT(ns);
         return UA_STATUSCODE_BADNODEIDUNKNOWN;
@@ -387,30 +812,56 @@ UA_NodeMap_replaceNode(void *context, UA_Node *node) {
         END_CRITSECT(ns);
         return UA_STATUSCODE_BADINTERNALERROR;
     }
-    (*slot)->deleted = true;
-    cleanupEntry(*slot);
-    *slot = newEntryContainer;
+    UA_NodeMapEntry *oldEntry = *slot;
+    NODEMAP_STORE(slot, newEntryContainer);
+    retireEntry(ns, oldEntry);
     END_CRITSECT(ns);
     return UA_STATUSCODE_GOOD;
 }
 
+static void
+visitEntry(UA_NodeMapEntry *entry, void *visitorContext,
+           UA_NodestoreVisitor visitor) {
+    NODEMAP_ADD(&entry->refCount, 1);
+    visitor(visitorContext, &entry->node);
+    releaseEntry(entry);
+}
+
 static void
 UA_NodeMap_iterate(void *context, void *visitorContext,
                    UA_NodestoreVisitor visitor) {
+    /* The tables and directories are not released during the iteration. The
+     * visitor may modify the nodestore. */
     UA_NodeMap *ns = (UA_NodeMap*)context;
-    BEGIN_CRITSECT(ns);
-    for(UA_UInt32 i = 0; i < ns->size; ++i) {
-        if(ns->entries[i] > UA_NODEMAP_TOMBSTONE) {
-            END_CRITSECT(ns);
-            UA_NodeMapEntry *entry = ns->entries[i];
-            entry->refCount++;
-            visitor(visitorContext, &entry->node);
-            entry->refCount--;
-            cleanupEntry(entry);
-            BEGIN_CRITSECT(ns);
+#ifdef UA_ENABLE_MULTITHREADING
+    NODEMAP_ADD(&ns->iterators, 1);
+#endif
+    BEGIN_READ(ns);
+    for(size_t i = 0; i < UA_NODEMAP_NUMERICNAMESPACES; i++) {
+        UA_NodeMapDirectory *dir = NODEMAP_LOAD(&ns->numeric[i]);
+        if(!dir)
+            continue;
+        for(UA_UInt32 j = 0; j < dir->size; j++) {
+            UA_NodeMapLeaf *leaf = NODEMAP_LOAD(&dir->leaves[j]);
+            if(!leaf)
+                continue;
+            for(size_t k = 0; k < UA_NODEMAP_LEAFSIZE; k++) {
+                UA_NodeMapEntry *entry = NODEMAP_LOAD(&leaf->entries[k]);
+                if(entry)
+                    visitEntry(entry, visitorContext, visitor);
+            }
         }
     }
-    END_CRITSECT(ns);
+    UA_NodeMapTable *table = NODEMAP_LOAD(&ns->table);
+    for(UA_UInt32 i = 0; i < table->size; ++i) {
+        UA_NodeMapEntry *entry = NODEMAP_LOAD(&table->entries[i]);
+        if(entry > UA_NODEMAP_TOMBSTONE)
+            visitEntry(entry, visitorContext, visitor);
+    }
+    END_READ(ns);
+#ifdef UA_ENABLE_MULTITHREADING
+    NODEMAP_ADD(&ns->iterators, (UA_UInt32)-1);
+#endif
 }
 
 static void
@@ -418,9 +869,12 @@ UA_NodeMap_delete(void *context) {
     UA_NodeMap *ns = (UA_NodeMap*)context;
 #ifdef UA_ENABLE_MULTITHREADING
     pthread_mutex_destroy(&ns->mutex);
+    pthread_mutex_destroy(&ns->epochMutex);
+    deleteRetired(ns->retiredEntries, ns->retiredTables, ns->retiredDirectories);
 #endif
-    UA_UInt32 size = ns->size;
-    UA_NodeMapEntry **entries = ns->entries;
+    deleteNumericIndex(ns);
+    UA_UInt32 size = ns->table->size;
+    UA_NodeMapEntry **entries = ns->table->entries;
     for(UA_UInt32 i = 0; i < size; ++i) {
         if(entries[i] > UA_NODEMAP_TOMBSTONE) {
             /* On debugging builds, check that all nodes were release */
@@ -429,27 +883,24 @@ UA_NodeMap_delete(void *context) {
             deleteEntry(entries[i]);
         }
     }
-    UA_free(ns->entries);
+    UA_free(ns->table);
     UA_free(ns);
 }
 
 UA_StatusCode
 UA_Nodestore_default_new(UA_Nodestore *ns) {
     /* Allocate and initialize the nodemap */
-    UA_NodeMap *nodemap = (UA_NodeMap*)UA_malloc(sizeof(UA_NodeMap));
+    UA_NodeMap *nodemap = (UA_NodeMap*)UA_calloc(1, sizeof(UA_NodeMap));
     if(!nodemap)
         return UA_STATUSCODE_BADOUTOFMEMORY;
-    nodemap->sizePrimeIndex = higher_prime_index(UA_NODEMAP_MINSIZE);
-    nodemap->size = primes[nodemap->sizePrimeIndex];
-    nodemap->count = 0;
-    nodemap->entries = (UA_NodeMapEntry**)
-        UA_calloc(nodemap->size, sizeof(UA_NodeMapEntry*));
-    if(!nodemap->entries) {
+    nodemap->table = newTable(higher_prime_index(UA_NODEMAP_MINSIZE));
+    if(!nodemap->table) {
         UA_free(nodemap);
         return UA_STATUSCODE_BADOUTOFMEMORY;
     }
 #ifdef UA_ENABLE_MULTITHREADING
     pthread_mutex_init(&nodemap->mutex, NULL);
+    pthread_mutex_init(&nodemap->epochMutex, NULL);
 #endif
 
     /* Populate the nodestore */
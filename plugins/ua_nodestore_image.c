@@ -0,0 +1,656 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+/* Enable POSIX features */
+#ifndef _XOPEN_SOURCE
+# define _XOPEN_SOURCE 600
+#endif
+#ifndef _DEFAULT_SOURCE
+# define _DEFAULT_SOURCE
+#endif
+
+/* Disable some security warnings on MSVC */
+#ifdef _MSC_VER
+# define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "ua_nodestore_image.h"
+#include "ua_nodestore_default.h"
+
+#include <stdio.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+# define UA_NODEIMAGE_MMAP
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+#ifdef UA_ENABLE_MULTITHREADING
+#include <pthread.h>
+#define NODEIMAGE_LOCK(NI) pthread_mutex_lock(&(NI)->mutex)
+#define NODEIMAGE_UNLOCK(NI) pthread_mutex_unlock(&(NI)->mutex)
+#else
+#define NODEIMAGE_LOCK(NI)
+#define NODEIMAGE_UNLOCK(NI)
+#endif
+
+/* The image file contains only offsets and all integers are encoded in little
+ * endian.
+ *
+ * - Header: Magic, Version, Number of nodes, Hash check, CRC32 of the header
+ *   (without the CRC) and the index
+ * - Index: (Hash of the NodeId, Offset of the record, Length of the encoded
+ *   node) for every node, sorted by the hash
+ * - Records: NodeClass, CRC32 of the encoded node, Node encoded with
+ *   UA_Node_encodeBinary
+ *
+ * A lookup searches the index for the hash. Only the records with a matching
+ * hash are decoded. The hash check detects images that were created with a
+ * different NodeId hash function.
+ *
+ * Only the header and the index are checked when the nodestore is created. So
+ * the records are not even paged in. A record is checked when it is decoded
+ * for the first time. Records that fail the check are treated as absent. */
+
+#define UA_NODEIMAGE_MAGIC 0x494e4155 /* "UANI" */
+#define UA_NODEIMAGE_VERSION 3
+#define UA_NODEIMAGE_HEADERSIZE 20
+#define UA_NODEIMAGE_ENTRYSIZE 12
+#define UA_NODEIMAGE_RECORDHEADERSIZE 8
+#define UA_NODEIMAGE_FIRSTIDENTIFIER 50000
+
+/* State of the nodes in the image */
+#define UA_NODEIMAGE_STATE_IMAGE 0   /* Only in the image */
+#define UA_NODEIMAGE_STATE_DECODED 1 /* Decoded into the overlay */
+#define UA_NODEIMAGE_STATE_REMOVED 2 /* Removed from the nodestore */
+#define UA_NODEIMAGE_STATE_CORRUPT 3 /* The record failed the check */
+
+typedef enum {
+    UA_NODEIMAGE_EXTERNAL,  /* Managed by the user */
+    UA_NODEIMAGE_MAPPED,    /* Unmapped when the nodestore is deleted */
+    UA_NODEIMAGE_ALLOCATED  /* Freed when the nodestore is deleted */
+} UA_NodeImageMemory;
+
+typedef struct {
+    UA_ByteString image;
+    UA_NodeImageMemory memory;
+    UA_UInt32 nodesSize;
+    UA_Byte *state; /* For every node in the image */
+    UA_UInt32 nextIdentifier;
+    UA_Nodestore overlay;
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_t mutex; /* Protect the state and the decoding into the overlay */
+#endif
+} UA_NodeImage;
+
+static UA_UInt32
+NodeImage_readUInt32(const UA_Byte *p) {
+    return (UA_UInt32)p[0] | ((UA_UInt32)p[1] << 8) |
+        ((UA_UInt32)p[2] << 16) | ((UA_UInt32)p[3] << 24);
+}
+
+static void
+NodeImage_writeUInt32(UA_Byte *p, UA_UInt32 v) {
+    p[0] = (UA_Byte)v;
+    p[1] = (UA_Byte)(v >> 8);
+    p[2] = (UA_Byte)(v >> 16);
+    p[3] = (UA_Byte)(v >> 24);
+}
+
+/* CRC-32 (IEEE 802.3) with a table for half bytes */
+static const UA_UInt32 crcTable[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+    0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+static UA_UInt32
+NodeImage_crc32(UA_UInt32 crc, const UA_Byte *data, size_t length) {
+    crc = ~crc;
+    for(size_t i = 0; i < length; i++) {
+        crc = crcTable[(crc ^ data[i]) & 0x0f] ^ (crc >> 4);
+        crc = crcTable[(crc ^ ((UA_UInt32)data[i] >> 4)) & 0x0f] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+/* The CRC of the header covers the index */
+static UA_UInt32
+NodeImage_headerCrc(const UA_Byte *data, UA_UInt32 nodesSize) {
+    UA_UInt32 crc = NodeImage_crc32(0, data, UA_NODEIMAGE_HEADERSIZE - 4);
+    return NodeImage_crc32(crc, &data[UA_NODEIMAGE_HEADERSIZE],
+                           (size_t)nodesSize * UA_NODEIMAGE_ENTRYSIZE);
+}
+
+static UA_Boolean
+NodeImage_validNodeClass(UA_NodeClass nodeClass) {
+    return (nodeClass == UA_NODECLASS_OBJECT || nodeClass == UA_NODECLASS_VARIABLE ||
+            nodeClass == UA_NODECLASS_METHOD || nodeClass == UA_NODECLASS_OBJECTTYPE ||
+            nodeClass == UA_NODECLASS_VARIABLETYPE || nodeClass == UA_NODECLASS_REFERENCETYPE ||
+            nodeClass == UA_NODECLASS_DATATYPE || nodeClass == UA_NODECLASS_VIEW);
+}
+
+static UA_UInt32
+NodeImage_hashCheck(void) {
+    UA_NodeId numericId = UA_NODEID_NUMERIC(0, 84);
+    UA_NodeId stringId = UA_NODEID_STRING(1, "open62541");
+    return UA_NodeId_hash(&numericId) ^ UA_NodeId_hash(&stringId);
+}
+
+/**********/
+/* Lookup */
+/**********/
+
+static const UA_Byte *
+NodeImage_entry(const UA_NodeImage *ni, UA_UInt32 pos) {
+    return &ni->image.data[UA_NODEIMAGE_HEADERSIZE + (size_t)pos * UA_NODEIMAGE_ENTRYSIZE];
+}
+
+/* Position of the first index entry with the hash */
+static UA_UInt32
+NodeImage_lowerBound(const UA_NodeImage *ni, UA_UInt32 hash) {
+    UA_UInt32 lo = 0;
+    UA_UInt32 hi = ni->nodesSize;
+    while(lo < hi) {
+        UA_UInt32 mid = lo + ((hi - lo) / 2);
+        if(NodeImage_readUInt32(NodeImage_entry(ni, mid)) < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Decode a node from the image. The node is allocated in the overlay. The
+ * record is checked against its CRC and the index entry. Returns
+ * BADDECODINGERROR if the record is corrupt. */
+static UA_StatusCode
+NodeImage_decodeNode(UA_NodeImage *ni, UA_UInt32 pos, UA_Node **outNode) {
+    const UA_Byte *entry = NodeImage_entry(ni, pos);
+    size_t offset = NodeImage_readUInt32(&entry[4]);
+    const UA_Byte *record = &ni->image.data[offset];
+    UA_ByteString encoded;
+    encoded.length = NodeImage_readUInt32(&entry[8]);
+    encoded.data = &ni->image.data[offset + UA_NODEIMAGE_RECORDHEADERSIZE];
+    UA_NodeClass nodeClass = (UA_NodeClass)NodeImage_readUInt32(record);
+    if(!NodeImage_validNodeClass(nodeClass) ||
+       NodeImage_readUInt32(&record[4]) != NodeImage_crc32(0, encoded.data, encoded.length))
+        return UA_STATUSCODE_BADDECODINGERROR;
+
+    UA_Node *node = ni->overlay.newNode(ni->overlay.context, nodeClass);
+    if(!node)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    size_t encodedOffset = 0;
+    UA_StatusCode retval = UA_Node_decodeBinary(&encoded, &encodedOffset, node);
+    if(retval == UA_STATUSCODE_GOOD &&
+       (encodedOffset != encoded.length ||
+        UA_NodeId_hash(&node->nodeId) != NodeImage_readUInt32(entry)))
+        retval = UA_STATUSCODE_BADDECODINGERROR;
+    if(retval != UA_STATUSCODE_GOOD) {
+        ni->overlay.deleteNode(ni->overlay.context, node);
+        return (retval == UA_STATUSCODE_BADOUTOFMEMORY) ?
+            retval : UA_STATUSCODE_BADDECODINGERROR;
+    }
+    *outNode = node;
+    return UA_STATUSCODE_GOOD;
+}
+
+/* Find and decode a node of the image that was not removed. Only the records
+ * with a matching hash are decoded. Corrupt records are marked and skipped.
+ * outNode is NULL if the node is not in the image. Call with the lock
+ * taken. */
+static UA_StatusCode
+NodeImage_findNode(UA_NodeImage *ni, const UA_NodeId *nodeId,
+                   UA_Node **outNode, UA_UInt32 *outPos) {
+    *outNode = NULL;
+    UA_UInt32 hash = UA_NodeId_hash(nodeId);
+    for(UA_UInt32 pos = NodeImage_lowerBound(ni, hash); pos < ni->nodesSize; pos++) {
+        if(NodeImage_readUInt32(NodeImage_entry(ni, pos)) != hash)
+            break;
+        if(ni->state[pos] == UA_NODEIMAGE_STATE_REMOVED ||
+           ni->state[pos] == UA_NODEIMAGE_STATE_CORRUPT)
+            continue;
+        UA_Node *node = NULL;
+        UA_StatusCode retval = NodeImage_decodeNode(ni, pos, &node);
+        if(retval == UA_STATUSCODE_BADDECODINGERROR) {
+            ni->state[pos] = UA_NODEIMAGE_STATE_CORRUPT;
+            continue;
+        }
+        if(retval != UA_STATUSCODE_GOOD)
+            return retval;
+        if(UA_NodeId_equal(&node->nodeId, nodeId)) {
+            *outNode = node;
+            *outPos = pos;
+            return UA_STATUSCODE_GOOD;
+        }
+        ni->overlay.deleteNode(ni->overlay.context, node);
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+/* Decode the node into the overlay if it is only in the image. Call with the
+ * lock taken. */
+static void
+NodeImage_decodeIntoOverlay(UA_NodeImage *ni, const UA_NodeId *nodeId) {
+    const UA_Node *node = ni->overlay.getNode(ni->overlay.context, nodeId);
+    if(node) {
+        ni->overlay.releaseNode(ni->overlay.context, node);
+        return;
+    }
+    UA_UInt32 pos = 0;
+    UA_Node *decoded = NULL;
+    NodeImage_findNode(ni, nodeId, &decoded, &pos);
+    if(!decoded || ni->state[pos] != UA_NODEIMAGE_STATE_IMAGE) {
+        if(decoded)
+            ni->overlay.deleteNode(ni->overlay.context, decoded);
+        return;
+    }
+    if(ni->overlay.insertNode(ni->overlay.context, decoded, NULL) == UA_STATUSCODE_GOOD)
+        ni->state[pos] = UA_NODEIMAGE_STATE_DECODED;
+}
+
+/*********************/
+/* Nodestore Methods */
+/*********************/
+
+static UA_Node *
+UA_NodeImage_newNode(void *context, UA_NodeClass nodeClass) {
+    UA_NodeImage *ni = (UA_NodeImage*)context;
+    return ni->overlay.newNode(ni->overlay.context, nodeClass);
+}
+
+static void
+UA_NodeImage_deleteNode(void *context, UA_Node *node) {
+    UA_NodeImage *ni = (UA_NodeImage*)context;
+    ni->overlay.deleteNode(ni->overlay.context, node);
+}
+
+static const UA_Node *
+UA_NodeImage_getNode(void *context, const UA_NodeId *nodeid) {
+    UA_NodeImage *ni = (UA_NodeImage*)context;
+    const UA_Node *node = ni->overlay.getNode(ni->overlay.context, nodeid);
+    if(node)
+        return node;
+    NODEIMAGE_LOCK(ni);
+    NodeImage_decodeIntoOverlay(ni, nodeid);
+    NODEIMAGE_UNLOCK(ni);
+    return ni->overlay.getNode(ni->overlay.context, nodeid);
+}
+
+static void
+UA_NodeImage_releaseNode(void *context, const UA_Node *node) {
+    UA_NodeImage *ni = (UA_NodeImage*)context;
+    ni->overlay.releaseNode(ni->overlay.context, node);
+}
+
+static UA_StatusCode
+UA_NodeImage_getNodeCopy(void *context, const UA_NodeId *nodeid,
+                         UA_Node **outNode) {
+    UA_NodeImage *ni = (UA_NodeImage*)context;
+    const UA_Node *node = UA_NodeImage_getNode(context, nodeid);
+    if(!node)
+        return UA_STATUSCODE_BADNODEIDUNKNOWN;
+    ni->overlay.releaseNode(ni->overlay.context, node);
+    return ni->overlay.getNodeCopy(ni->overlay.context, nodeid, outNode);
+}
+
+static UA_StatusCode
+UA_NodeImage_removeNode(void *context, const UA_NodeId *nodeid) {
+    UA_NodeImage *ni = (UA_NodeImage*)context;
+    NODEIMAGE_LOCK(ni);
+    UA_UInt32 pos = 0;
+    UA_Node *decoded = NULL;
+    UA_StatusCode retval = NodeImage_findNode(ni, nodeid, &decoded, &pos);
+    if(retval != UA_STATUSCODE_GOOD) {
+        NODEIMAGE_UNLOCK(ni);
+        return retval;
+    }
+    if(decoded) {
+        ni->state[pos] = UA_NODEIMAGE_STATE_REMOVED;
+        ni->overlay.deleteNode(ni->overlay.context, decoded);
+    }
+    retval = ni->overlay.removeNode(ni->overlay.context, nodeid);
+    NODEIMAGE_UNLOCK(ni);
+    if(decoded)
+        return UA_STATUSCODE_GOOD;
+    return retval;
+}
+
+static UA_StatusCode
+UA_NodeImage_insertNode(void *context, UA_Node *node,
+                        UA_NodeId *addedNodeId) {
+    UA_NodeImage *ni = (UA_NodeImage*)context;
+    NODEIMAGE_LOCK(ni);
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    UA_UInt32 pos = 0;
+    UA_Node *decoded = NULL;
+    if(node->nodeId.identifierType == UA_NODEIDTYPE_NUMERIC &&
+       node->nodeId.identifier.numeric == 0) {
+        /* Assign an identifier that is neither used in the overlay nor in the
+         * image */
+        UA_NodeId id = node->nodeId;
+        while(true) {
+            id.identifier.numeric = ni->nextIdentifier++;
+            if(id.identifier.numeric == 0)
+                continue;
+            const UA_Node *existing = ni->overlay.getNode(ni->overlay.context, &id);
+            if(existing) {
+                ni->overlay.releaseNode(ni->overlay.context, existing);
+                continue;
+            }
+            retval = NodeImage_findNode(ni, &id, &decoded, &pos);
+            if(retval != UA_STATUSCODE_GOOD || !decoded)
+                break;
+            ni->overlay.deleteNode(ni->overlay.context, decoded);
+        }
+        node->nodeId = id;
+    } else {
+        retval = NodeImage_findNode(ni, &node->nodeId, &decoded, &pos);
+        if(decoded) {
+            ni->overlay.deleteNode(ni->overlay.context, decoded);
+            retval = UA_STATUSCODE_BADNODEIDEXISTS;
+        }
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+        ni->overlay.deleteNode(ni->overlay.context, node);
+    if(retval == UA_STATUSCODE_GOOD)
+        retval = ni->overlay.insertNode(ni->overlay.context, node, addedNodeId);
+    NODEIMAGE_UNLOCK(ni);
+    return retval;
+}
+
+static UA_StatusCode
+UA_NodeImage_replaceNode(void *context, UA_Node *node) {
+    UA_NodeImage *ni = (UA_NodeImage*)context;
+    const UA_Node *orig = UA_NodeImage_getNode(context, &node->nodeId);
+    if(orig)
+        ni->overlay.releaseNode(ni->overlay.context, orig);
+    return ni->overlay.replaceNode(ni->overlay.context, node);
+}
+
+static void
+UA_NodeImage_iterate(void *context, void *visitorContext,
+                     UA_NodestoreVisitor visitor) {
+    UA_NodeImage *ni = (UA_NodeImage*)context;
+
+    /* Decode all remaining nodes into the overlay */
+    NODEIMAGE_LOCK(ni);
+    for(UA_UInt32 pos = 0; pos < ni->nodesSize; pos++) {
+        if(ni->state[pos] != UA_NODEIMAGE_STATE_IMAGE)
+            continue;
+        UA_Node *node = NULL;
+        UA_StatusCode retval = NodeImage_decodeNode(ni, pos, &node);
+        if(retval == UA_STATUSCODE_BADDECODINGERROR)
+            ni->state[pos] = UA_NODEIMAGE_STATE_CORRUPT;
+        if(retval != UA_STATUSCODE_GOOD)
+            continue;
+        retval = ni->overlay.insertNode(ni->overlay.context, node, NULL);
+        if(retval == UA_STATUSCODE_GOOD || retval == UA_STATUSCODE_BADNODEIDEXISTS)
+            ni->state[pos] = UA_NODEIMAGE_STATE_DECODED;
+    }
+    NODEIMAGE_UNLOCK(ni);
+
+    ni->overlay.iterate(ni->overlay.context, visitorContext, visitor);
+}
+
+static void
+UA_NodeImage_delete(void *context) {
+    UA_NodeImage *ni = (UA_NodeImage*)context;
+    ni->overlay.deleteNodestore(ni->overlay.context);
+    UA_free(ni->state);
+#ifdef UA_NODEIMAGE_MMAP
+    if(ni->memory == UA_NODEIMAGE_MAPPED)
+        munmap(ni->image.data, ni->image.length);
+#endif
+    if(ni->memory == UA_NODEIMAGE_ALLOCATED)
+        UA_ByteString_deleteMembers(&ni->image);
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_destroy(&ni->mutex);
+#endif
+    UA_free(ni);
+}
+
+/*********************/
+/* Create the Images */
+/*********************/
+
+/* Check the header and the index. The records are checked when they are
+ * decoded for the first time. */
+static UA_StatusCode
+NodeImage_validate(const UA_ByteString *image, UA_UInt32 *nodesSize) {
+    if(image->length < UA_NODEIMAGE_HEADERSIZE ||
+       (UA_UInt64)image->length > UA_UINT32_MAX ||
+       NodeImage_readUInt32(image->data) != UA_NODEIMAGE_MAGIC ||
+       NodeImage_readUInt32(&image->data[4]) != UA_NODEIMAGE_VERSION ||
+       NodeImage_readUInt32(&image->data[12]) != NodeImage_hashCheck())
+        return UA_STATUSCODE_BADDECODINGERROR;
+
+    /* Check that the index is within the image and not corrupted */
+    *nodesSize = NodeImage_readUInt32(&image->data[8]);
+    size_t recordsBegin = UA_NODEIMAGE_HEADERSIZE +
+        ((size_t)*nodesSize * UA_NODEIMAGE_ENTRYSIZE);
+    if(recordsBegin > image->length ||
+       NodeImage_readUInt32(&image->data[16]) != NodeImage_headerCrc(image->data, *nodesSize))
+        return UA_STATUSCODE_BADDECODINGERROR;
+
+    /* Check that all records are within the image */
+    UA_UInt32 lastHash = 0;
+    for(UA_UInt32 i = 0; i < *nodesSize; i++) {
+        const UA_Byte *entry =
+            &image->data[UA_NODEIMAGE_HEADERSIZE + ((size_t)i * UA_NODEIMAGE_ENTRYSIZE)];
+        UA_UInt32 hash = NodeImage_readUInt32(entry);
+        size_t offset = NodeImage_readUInt32(&entry[4]);
+        size_t length = NodeImage_readUInt32(&entry[8]);
+        if(hash < lastHash || offset < recordsBegin ||
+           offset + UA_NODEIMAGE_RECORDHEADERSIZE + length > image->length)
+            return UA_STATUSCODE_BADDECODINGERROR;
+        lastHash = hash;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+UA_Nodestore_image_new(UA_Nodestore *ns, const UA_ByteString *image) {
+    UA_UInt32 nodesSize = 0;
+    UA_StatusCode retval = NodeImage_validate(image, &nodesSize);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    UA_NodeImage *ni = (UA_NodeImage*)UA_calloc(1, sizeof(UA_NodeImage));
+    if(!ni)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    ni->state = (UA_Byte*)UA_calloc(nodesSize + 1, sizeof(UA_Byte));
+    if(!ni->state) {
+        UA_free(ni);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    retval = UA_Nodestore_default_new(&ni->overlay);
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_free(ni->state);
+        UA_free(ni);
+        return retval;
+    }
+    ni->image = *image;
+    ni->memory = UA_NODEIMAGE_EXTERNAL;
+    ni->nodesSize = nodesSize;
+    ni->nextIdentifier = UA_NODEIMAGE_FIRSTIDENTIFIER;
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_init(&ni->mutex, NULL);
+#endif
+
+    /* Populate the nodestore */
+    ns->context = ni;
+    ns->deleteNodestore = UA_NodeImage_delete;
+    ns->inPlaceEditAllowed = ni->overlay.inPlaceEditAllowed;
+    ns->newNode = UA_NodeImage_newNode;
+    ns->deleteNode = UA_NodeImage_deleteNode;
+    ns->getNode = UA_NodeImage_getNode;
+    ns->releaseNode = UA_NodeImage_releaseNode;
+    ns->getNodeCopy = UA_NodeImage_getNodeCopy;
+    ns->insertNode = UA_NodeImage_insertNode;
+    ns->replaceNode = UA_NodeImage_replaceNode;
+    ns->removeNode = UA_NodeImage_removeNode;
+    ns->iterate = UA_NodeImage_iterate;
+
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+UA_Nodestore_image_newFromFile(UA_Nodestore *ns, const char *path) {
+    UA_ByteString image = UA_BYTESTRING_NULL;
+    UA_NodeImageMemory memory;
+#ifdef UA_NODEIMAGE_MMAP
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return UA_STATUSCODE_BADNOTFOUND;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return UA_STATUSCODE_BADNOTFOUND;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    image.data = (UA_Byte*)data;
+    image.length = (size_t)st.st_size;
+    memory = UA_NODEIMAGE_MAPPED;
+#else
+    FILE *f = fopen(path, "rb");
+    if(!f)
+        return UA_STATUSCODE_BADNOTFOUND;
+    long size = -1;
+    if(fseek(f, 0, SEEK_END) == 0)
+        size = ftell(f);
+    if(size <= 0 || fseek(f, 0, SEEK_SET) != 0 ||
+       UA_ByteString_allocBuffer(&image, (size_t)size) != UA_STATUSCODE_GOOD) {
+        fclose(f);
+        return UA_STATUSCODE_BADNOTFOUND;
+    }
+    size_t read = fread(image.data, 1, image.length, f);
+    fclose(f);
+    if(read != image.length) {
+        UA_ByteString_deleteMembers(&image);
+        return UA_STATUSCODE_BADNOTFOUND;
+    }
+    memory = UA_NODEIMAGE_ALLOCATED;
+#endif
+
+    UA_StatusCode retval = UA_Nodestore_image_new(ns, &image);
+    if(retval != UA_STATUSCODE_GOOD) {
+#ifdef UA_NODEIMAGE_MMAP
+        munmap(image.data, image.length);
+#else
+        UA_ByteString_deleteMembers(&image);
+#endif
+        return retval;
+    }
+    ((UA_NodeImage*)ns->context)->memory = memory;
+    return UA_STATUSCODE_GOOD;
+}
+
+/*********************/
+/* Encode the Images */
+/*********************/
+
+typedef struct {
+    UA_UInt32 hash;
+    UA_NodeClass nodeClass;
+    UA_ByteString encoded;
+} UA_NodeImageRecord;
+
+typedef struct {
+    UA_NodeImageRecord *records;
+    size_t recordsSize;
+    size_t recordsCapacity;
+    UA_StatusCode retval;
+} UA_NodeImageEncoding;
+
+static void
+NodeImage_encodeVisitor(void *context, const UA_Node *node) {
+    UA_NodeImageEncoding *enc = (UA_NodeImageEncoding*)context;
+    if(enc->retval != UA_STATUSCODE_GOOD)
+        return;
+    if(enc->recordsSize == enc->recordsCapacity) {
+        size_t capacity = (enc->recordsCapacity > 0) ? enc->recordsCapacity * 2 : 1024;
+        UA_NodeImageRecord *records = (UA_NodeImageRecord*)
+            UA_realloc(enc->records, capacity * sizeof(UA_NodeImageRecord));
+        if(!records) {
+            enc->retval = UA_STATUSCODE_BADOUTOFMEMORY;
+            return;
+        }
+        enc->records = records;
+        enc->recordsCapacity = capacity;
+    }
+    UA_NodeImageRecord *record = &enc->records[enc->recordsSize];
+    record->hash = UA_NodeId_hash(&node->nodeId);
+    record->nodeClass = node->nodeClass;
+    enc->retval = UA_Node_encodeBinary(node, &record->encoded);
+    if(enc->retval == UA_STATUSCODE_GOOD)
+        enc->recordsSize++;
+}
+
+static int
+NodeImage_compareRecords(const void *p1, const void *p2) {
+    const UA_NodeImageRecord *r1 = (const UA_NodeImageRecord*)p1;
+    const UA_NodeImageRecord *r2 = (const UA_NodeImageRecord*)p2;
+    if(r1->hash == r2->hash)
+        return 0;
+    return (r1->hash < r2->hash) ? -1 : 1;
+}
+
+UA_StatusCode
+UA_Nodestore_image_encode(UA_Nodestore *ns, UA_ByteString *image) {
+    UA_NodeImageEncoding enc;
+    memset(&enc, 0, sizeof(UA_NodeImageEncoding));
+    ns->iterate(ns->context, &enc, NodeImage_encodeVisitor);
+    UA_StatusCode retval = enc.retval;
+    if(retval != UA_STATUSCODE_GOOD)
+        goto cleanup;
+
+    qsort(enc.records, enc.recordsSize, sizeof(UA_NodeImageRecord),
+          NodeImage_compareRecords);
+
+    /* The offsets are 32bit */
+    size_t length = UA_NODEIMAGE_HEADERSIZE + (enc.recordsSize * UA_NODEIMAGE_ENTRYSIZE);
+    for(size_t i = 0; i < enc.recordsSize; i++)
+        length += UA_NODEIMAGE_RECORDHEADERSIZE + enc.records[i].encoded.length;
+    if((UA_UInt64)length > UA_UINT32_MAX) {
+        retval = UA_STATUSCODE_BADENCODINGLIMITSEXCEEDED;
+        goto cleanup;
+    }
+    retval = UA_ByteString_allocBuffer(image, length);
+    if(retval != UA_STATUSCODE_GOOD)
+        goto cleanup;
+
+    NodeImage_writeUInt32(image->data, UA_NODEIMAGE_MAGIC);
+    NodeImage_writeUInt32(&image->data[4], UA_NODEIMAGE_VERSION);
+    NodeImage_writeUInt32(&image->data[8], (UA_UInt32)enc.recordsSize);
+    NodeImage_writeUInt32(&image->data[12], NodeImage_hashCheck());
+    size_t offset = UA_NODEIMAGE_HEADERSIZE + (enc.recordsSize * UA_NODEIMAGE_ENTRYSIZE);
+    for(size_t i = 0; i < enc.recordsSize; i++) {
+        UA_NodeImageRecord *record = &enc.records[i];
+        UA_Byte *entry = &image->data[UA_NODEIMAGE_HEADERSIZE + (i * UA_NODEIMAGE_ENTRYSIZE)];
+        NodeImage_writeUInt32(entry, record->hash);
+        NodeImage_writeUInt32(&entry[4], (UA_UInt32)offset);
+        NodeImage_writeUInt32(&entry[8], (UA_UInt32)record->encoded.length);
+        NodeImage_writeUInt32(&image->data[offset], (UA_UInt32)record->nodeClass);
+        NodeImage_writeUInt32(&image->data[offset + 4],
+                              NodeImage_crc32(0, record->encoded.data,
+                                              record->encoded.length));
+        memcpy(&image->data[offset + UA_NODEIMAGE_RECORDHEADERSIZE],
+               record->encoded.data, record->encoded.length);
+        offset += UA_NODEIMAGE_RECORDHEADERSIZE + record->encoded.length;
+    }
+    NodeImage_writeUInt32(&image->data[16],
+                          NodeImage_headerCrc(image->data, (UA_UInt32)enc.recordsSize));
+
+ cleanup:
+    for(size_t i = 0; i < enc.recordsSize; i++)
+        UA_ByteString_deleteMembers(&enc.records[i].encoded);
+    UA_free(enc.records);
+    return retval;
+}
@@ -0,0 +1,49 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef UA_NODESTORE_IMAGE_H_
+#define UA_NODESTORE_IMAGE_H_
+
+#include "ua_plugin_nodestore.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Nodestore on top of a precompiled image of the address space (e.g. namespace
+ * zero). The image saves the time to create the nodes one by one when the
+ * server starts. A node is decoded from the image into an overlay default
+ * nodestore in the heap when it is first accessed. Edits and new nodes only
+ * go to the overlay. Removed image nodes are marked as such. The image itself
+ * is never written to.
+ *
+ * Nodes are not served from the image directly. So the heap usage for the
+ * accessed nodes is the same as with the default nodestore. Only the pages of
+ * a mapped image file that were never accessed are shared between processes.
+ *
+ * UA_Nodestore_image_new checks the header and the index with a checksum. A
+ * record is checked when it is first accessed. A corrupt record is treated as
+ * if the node was not in the image.
+ *
+ * The image does not contain node contexts, callbacks, DataSources and
+ * lifecycles. If the image contains namespace zero, the server skips the
+ * creation of namespace zero and only attaches its callbacks and DataSources.
+ * The image has to remain valid until the nodestore is deleted. */
+UA_StatusCode UA_EXPORT
+UA_Nodestore_image_new(UA_Nodestore *ns, const UA_ByteString *image);
+
+/* Load the image from a file. The file is mapped read-only into memory (or
+ * read where mmap is not available). The mapping is released when the
+ * nodestore is deleted. */
+UA_StatusCode UA_EXPORT
+UA_Nodestore_image_newFromFile(UA_Nodestore *ns, const char *path);
+
+/* Encode all nodes of a nodestore into a newly allocated image */
+UA_StatusCode UA_EXPORT
+UA_Nodestore_image_encode(UA_Nodestore *ns, UA_ByteString *image);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* UA_NODESTORE_IMAGE_H_ */
@@ -0,0 +1,529 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#include "ua_nodestore_robinhood.h"
+
+/* container_of */
+#ifndef container_of
+#define container_of(ptr, type, member) \
+    (type *)((uintptr_t)ptr - offsetof(type,member))
+#endif
+
+#ifdef UA_ENABLE_MULTITHREADING
+#include <pthread.h>
+#define NODETABLE_LOCK(TABLE) pthread_mutex_lock(&(TABLE)->mutex)
+#define NODETABLE_UNLOCK(TABLE) pthread_mutex_unlock(&(TABLE)->mutex)
+#else
+#define NODETABLE_LOCK(TABLE)
+#define NODETABLE_UNLOCK(TABLE)
+#endif
+
+/* The table has a power-of-two capacity. A NodeId is placed at the position
+ * of its hash or as close after it as possible. On insertion, an entry that is
+ * further away from its ideal position takes the slot of an entry that is
+ * closer to its own (Robin Hood). So the probe distances stay short and a
+ * lookup can stop as soon as it sees an entry closer to its ideal position
+ * than the searched key would be. Removed entries are filled by shifting the
+ * following entries back. There are no tombstones.
+ *
+ * Every slot contains the hash and a compact key of the NodeId. Only if the
+ * compact key is not the complete identifier (GUIDs and long strings) and
+ * hash and compact key match, the NodeId of the node is compared. */
+
+typedef struct UA_NodeTableEntry {
+    struct UA_NodeTableEntry *orig; /* the version this is a copy from (or NULL) */
+    UA_UInt32 refCount; /* How many consumers have a reference to the node? */
+    UA_Boolean deleted; /* Node was marked as deleted and can be deleted when refCount == 0 */
+    UA_Node node;
+} UA_NodeTableEntry;
+
+#define UA_NODETABLE_MINSIZE 64
+
+#define UA_NODETABLE_KEY_NUMERIC 0
+#define UA_NODETABLE_KEY_STRING 1     /* Complete string of up to eight bytes */
+#define UA_NODETABLE_KEY_BYTESTRING 2 /* Complete bytestring of up to eight bytes */
+#define UA_NODETABLE_KEY_PARTIAL 3    /* Prefix of the identifier. Compare the node. */
+
+typedef struct {
+    UA_NodeTableEntry *entry; /* NULL for an empty slot */
+    UA_UInt64 key;
+    UA_UInt32 hash;
+    UA_UInt16 namespaceIndex;
+    UA_Byte keyType;
+    UA_Byte keyLength;
+} UA_NodeTableSlot;
+
+typedef struct {
+    UA_NodeTableSlot *slots;
+    UA_UInt32 capacity; /* Power of two */
+    UA_UInt32 count;
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_t mutex; /* Protect access */
+#endif
+} UA_NodeTable;
+
+/**************/
+/* Slot Keys  */
+/**************/
+
+static void
+NodeTable_makeKey(const UA_NodeId *id, UA_NodeTableSlot *key) {
+    key->entry = NULL;
+    key->key = 0;
+    key->namespaceIndex = id->namespaceIndex;
+    key->keyLength = 0;
+    switch(id->identifierType) {
+    case UA_NODEIDTYPE_NUMERIC:
+        /* Multiplicative hashing is enough for numeric identifiers */
+        key->keyType = UA_NODETABLE_KEY_NUMERIC;
+        key->key = id->identifier.numeric;
+        key->hash = (UA_UInt32)((((UA_UInt64)id->namespaceIndex << 32 |
+                                  id->identifier.numeric) * 0x9e3779b97f4a7c15) >> 32);
+        return;
+    case UA_NODEIDTYPE_STRING:
+    case UA_NODEIDTYPE_BYTESTRING: {
+        const UA_String *s = &id->identifier.string;
+        if(s->length <= sizeof(UA_UInt64)) {
+            key->keyType = (id->identifierType == UA_NODEIDTYPE_STRING) ?
+                UA_NODETABLE_KEY_STRING : UA_NODETABLE_KEY_BYTESTRING;
+            key->keyLength = (UA_Byte)s->length;
+            if(s->length > 0)
+                memcpy(&key->key, s->data, s->length);
+        } else {
+            key->keyType = UA_NODETABLE_KEY_PARTIAL;
+            memcpy(&key->key, s->data, sizeof(UA_UInt64));
+        }
+        break;
+    }
+    default: /* GUID */
+        key->keyType = UA_NODETABLE_KEY_PARTIAL;
+        memcpy(&key->key, &id->identifier.guid, sizeof(UA_UInt64));
+        break;
+    }
+    key->hash = UA_NodeId_hash(id);
+}
+
+static UA_Boolean
+NodeTable_slotMatches(const UA_NodeTableSlot *slot, const UA_NodeTableSlot *key,
+                      const UA_NodeId *id) {
+    if(slot->hash != key->hash || slot->key != key->key ||
+       slot->namespaceIndex != key->namespaceIndex ||
+       slot->keyType != key->keyType || slot->keyLength != key->keyLength)
+        return false;
+    if(key->keyType != UA_NODETABLE_KEY_PARTIAL)
+        return true;
+    return UA_NodeId_equal(&slot->entry->node.nodeId, id);
+}
+
+/*******************/
+/* Table Utilities */
+/*******************/
+
+/* Distance of the slot from the ideal position of its entry */
+static UA_UInt32
+NodeTable_distance(const UA_NodeTable *table, const UA_NodeTableSlot *slot) {
+    UA_UInt32 pos = (UA_UInt32)(slot - table->slots);
+    return (pos - slot->hash) & (table->capacity - 1);
+}
+
+static UA_NodeTableSlot *
+NodeTable_findSlot(const UA_NodeTable *table, const UA_NodeTableSlot *key,
+                   const UA_NodeId *id) {
+    UA_UInt32 mask = table->capacity - 1;
+    UA_UInt32 pos = key->hash & mask;
+    for(UA_UInt32 dist = 0; ; dist++) {
+        UA_NodeTableSlot *slot = &table->slots[pos];
+        if(!slot->entry || NodeTable_distance(table, slot) < dist)
+            return NULL; /* The key would have been placed here */
+        if(NodeTable_slotMatches(slot, key, id))
+            return slot;
+        pos = (pos + 1) & mask;
+    }
+}
+
+/* The key must not be contained in the table */
+static UA_NodeTableSlot *
+NodeTable_insertSlot(UA_NodeTable *table, UA_NodeTableSlot slot) {
+    UA_UInt32 mask = table->capacity - 1;
+    UA_UInt32 pos = slot.hash & mask;
+    UA_NodeTableSlot *inserted = NULL;
+    for(UA_UInt32 dist = 0; ; dist++) {
+        UA_NodeTableSlot *current = &table->slots[pos];
+        if(!current->entry) {
+            *current = slot;
+            return inserted ? inserted : current;
+        }
+
+        /* Take the slot from an entry that is closer to its ideal position */
+        UA_UInt32 currentDist = NodeTable_distance(table, current);
+        if(currentDist < dist) {
+            UA_NodeTableSlot tmp = *current;
+            *current = slot;
+            slot = tmp;
+            dist = currentDist;
+            if(!inserted)
+                inserted = current;
+        }
+        pos = (pos + 1) & mask;
+    }
+}
+
+/* Shift the following entries back until one is at its ideal position */
+static void
+NodeTable_removeSlot(UA_NodeTable *table, UA_NodeTableSlot *slot) {
+    UA_UInt32 mask = table->capacity - 1;
+    UA_UInt32 pos = (UA_UInt32)(slot - table->slots);
+    while(true) {
+        UA_UInt32 next = (pos + 1) & mask;
+        UA_NodeTableSlot *nextSlot = &table->slots[next];
+        if(!nextSlot->entry || NodeTable_distance(table, nextSlot) == 0)
+            break;
+        table->slots[pos] = *nextSlot;
+        pos = next;
+    }
+    memset(&table->slots[pos], 0, sizeof(UA_NodeTableSlot));
+}
+
+/* The hashes are cached in the slots. So the entries are moved to the new
+ * slots without touching the nodes. */
+static UA_StatusCode
+NodeTable_resize(UA_NodeTable *table, UA_UInt32 capacity) {
+    UA_NodeTableSlot *slots = (UA_NodeTableSlot*)
+        UA_calloc(capacity, sizeof(UA_NodeTableSlot));
+    if(!slots)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    UA_NodeTableSlot *oslots = table->slots;
+    UA_UInt32 ocapacity = table->capacity;
+    table->slots = slots;
+    table->capacity = capacity;
+    for(UA_UInt32 i = 0; i < ocapacity; i++) {
+        if(oslots[i].entry)
+            NodeTable_insertSlot(table, oslots[i]);
+    }
+    UA_free(oslots);
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_NodeTableEntry *
+NodeTable_newEntry(UA_NodeClass nodeClass) {
+    size_t size = sizeof(UA_NodeTableEntry) - sizeof(UA_Node);
+    switch(nodeClass) {
+    case UA_NODECLASS_OBJECT:
+        size += sizeof(UA_ObjectNode);
+        break;
+    case UA_NODECLASS_VARIABLE:
+        size += sizeof(UA_VariableNode);
+        break;
+    case UA_NODECLASS_METHOD:
+        size += sizeof(UA_MethodNode);
+        break;
+    case UA_NODECLASS_OBJECTTYPE:
+        size += sizeof(UA_ObjectTypeNode);
+        break;
+    case UA_NODECLASS_VARIABLETYPE:
+        size += sizeof(UA_VariableTypeNode);
+        break;
+    case UA_NODECLASS_REFERENCETYPE:
+        size += sizeof(UA_ReferenceTypeNode);
+        break;
+    case UA_NODECLASS_DATATYPE:
+        size += sizeof(UA_DataTypeNode);
+        break;
+    case UA_NODECLASS_VIEW:
+        size += sizeof(UA_ViewNode);
+        break;
+    default:
+        return NULL;
+    }
+    UA_NodeTableEntry *entry = (UA_NodeTableEntry*)UA_calloc(1, size);
+    if(!entry)
+        return NULL;
+    entry->node.nodeClass = nodeClass;
+    return entry;
+}
+
+static void
+NodeTable_deleteEntry(UA_NodeTableEntry *entry) {
+    UA_Node_deleteMembers(&entry->node);
+    UA_free(entry);
+}
+
+static void
+NodeTable_cleanupEntry(UA_NodeTableEntry *entry) {
+    if(entry->deleted && entry->refCount == 0)
+        NodeTable_deleteEntry(entry);
+}
+
+static void
+NodeTable_clearSlot(UA_NodeTable *table, UA_NodeTableSlot *slot) {
+    UA_NodeTableEntry *entry = slot->entry;
+    NodeTable_removeSlot(table, slot);
+    --table->count;
+    entry->deleted = true;
+    NodeTable_cleanupEntry(entry);
+
+    /* Downsize the table if it is very empty */
+    if(table->count * 8 < table->capacity && table->capacity > UA_NODETABLE_MINSIZE)
+        NodeTable_resize(table, table->capacity / 2); /* Can fail. Just continue
+                                                       * with the bigger table. */
+}
+
+/***********************/
+/* Interface functions */
+/***********************/
+
+static UA_Node *
+UA_NodeTable_newNode(void *context, UA_NodeClass nodeClass) {
+    UA_NodeTableEntry *entry = NodeTable_newEntry(nodeClass);
+    if(!entry)
+        return NULL;
+    return &entry->node;
+}
+
+static void
+UA_NodeTable_deleteNode(void *context, UA_Node *node) {
+    UA_NodeTableEntry *entry = container_of(node, UA_NodeTableEntry, node);
+    UA_assert(&entry->node == node);
+    NodeTable_deleteEntry(entry);
+}
+
+static const UA_Node *
+UA_NodeTable_getNode(void *context, const UA_NodeId *nodeid) {
+    UA_NodeTable *table = (UA_NodeTable*)context;
+    UA_NodeTableSlot key;
+    NodeTable_makeKey(nodeid, &key);
+    NODETABLE_LOCK(table);
+    UA_NodeTableSlot *slot = NodeTable_findSlot(table, &key, nodeid);
+    if(!slot) {
+        NODETABLE_UNLOCK(table);
+        return NULL;
+    }
+    ++slot->entry->refCount;
+    NODETABLE_UNLOCK(table);
+    return (const UA_Node*)&slot->entry->node;
+}
+
+static void
+UA_NodeTable_releaseNode(void *context, const UA_Node *node) {
+    if(!node)
+        return;
+#ifdef UA_ENABLE_MULTITHREADING
+    UA_NodeTable *table = (UA_NodeTable*)context;
+#endif
+    NODETABLE_LOCK(table);
+    UA_NodeTableEntry *entry = container_of(node, UA_NodeTableEntry, node);
+    UA_assert(&entry->node == node);
+    UA_assert(entry->refCount > 0);
+    --entry->refCount;
+    NodeTable_cleanupEntry(entry);
+    NODETABLE_UNLOCK(table);
+}
+
+static UA_StatusCode
+UA_NodeTable_getNodeCopy(void *context, const UA_NodeId *nodeid,
+                         UA_Node **outNode) {
+    UA_NodeTable *table = (UA_NodeTable*)context;
+    UA_NodeTableSlot key;
+    NodeTable_makeKey(nodeid, &key);
+    NODETABLE_LOCK(table);
+    UA_NodeTableSlot *slot = NodeTable_findSlot(table, &key, nodeid);
+    if(!slot) {
+        NODETABLE_UNLOCK(table);
+        return UA_STATUSCODE_BADNODEIDUNKNOWN;
+    }
+    UA_NodeTableEntry *entry = slot->entry;
+    UA_NodeTableEntry *newItem = NodeTable_newEntry(entry->node.nodeClass);
+    if(!newItem) {
+        NODETABLE_UNLOCK(table);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    UA_StatusCode retval = UA_Node_copy(&entry->node, &newItem->node);
+    if(retval == UA_STATUSCODE_GOOD) {
+        newItem->orig = entry; // store the pointer to the original
+        *outNode = &newItem->node;
+    } else {
+        NodeTable_deleteEntry(newItem);
+    }
+    NODETABLE_UNLOCK(table);
+    return retval;
+}
+
+static UA_StatusCode
+UA_NodeTable_removeNode(void *context, const UA_NodeId *nodeid) {
+    UA_NodeTable *table = (UA_NodeTable*)context;
+    UA_NodeTableSlot key;
+    NodeTable_makeKey(nodeid, &key);
+    NODETABLE_LOCK(table);
+    UA_NodeTableSlot *slot = NodeTable_findSlot(table, &key, nodeid);
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    if(slot)
+        NodeTable_clearSlot(table, slot);
+    else
+        retval = UA_STATUSCODE_BADNODEIDUNKNOWN;
+    NODETABLE_UNLOCK(table);
+    return retval;
+}
+
+static UA_StatusCode
+UA_NodeTable_insertNode(void *context, UA_Node *node,
+                        UA_NodeId *addedNodeId) {
+    UA_NodeTable *table = (UA_NodeTable*)context;
+    UA_NodeTableEntry *entry = container_of(node, UA_NodeTableEntry, node);
+    NODETABLE_LOCK(table);
+
+    /* Grow to keep the occupancy below 7/8 */
+    if((table->count + 1) * 8 > table->capacity * 7) {
+        if(NodeTable_resize(table, table->capacity * 2) != UA_STATUSCODE_GOOD) {
+            NodeTable_deleteEntry(entry);
+            NODETABLE_UNLOCK(table);
+            return UA_STATUSCODE_BADINTERNALERROR;
+        }
+    }
+
+    UA_NodeTableSlot key;
+    if(node->nodeId.identifierType == UA_NODEIDTYPE_NUMERIC &&
+       node->nodeId.identifier.numeric == 0) {
+        /* Create a fresh nodeid. Start at least with 50,000 to make sure we
+         * don't conflict with nodes from the spec. */
+        node->nodeId.identifier.numeric = 50000 + table->count + 1;
+        while(true) {
+            NodeTable_makeKey(&node->nodeId, &key);
+            if(!NodeTable_findSlot(table, &key, &node->nodeId))
+                break;
+            ++node->nodeId.identifier.numeric;
+        }
+    } else {
+        NodeTable_makeKey(&node->nodeId, &key);
+        if(NodeTable_findSlot(table, &key, &node->nodeId)) {
+            NodeTable_deleteEntry(entry);
+            NODETABLE_UNLOCK(table);
+            return UA_STATUSCODE_BADNODEIDEXISTS;
+        }
+    }
+
+    key.entry = entry;
+    UA_NodeTableSlot *slot = NodeTable_insertSlot(table, key);
+    ++table->count;
+
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    if(addedNodeId) {
+        retval = UA_NodeId_copy(&node->nodeId, addedNodeId);
+        if(retval != UA_STATUSCODE_GOOD)
+            NodeTable_clearSlot(table, slot);
+    }
+
+    NODETABLE_UNLOCK(table);
+    return retval;
+}
+
+static UA_StatusCode
+UA_NodeTable_replaceNode(void *context, UA_Node *node) {
+    UA_NodeTable *table = (UA_NodeTable*)context;
+    UA_NodeTableEntry *newEntry = container_of(node, UA_NodeTableEntry, node);
+    UA_NodeTableSlot key;
+    NodeTable_makeKey(&node->nodeId, &key);
+    NODETABLE_LOCK(table);
+    UA_NodeTableSlot *slot = NodeTable_findSlot(table, &key, &node->nodeId);
+    if(!slot) {
+        NodeTable_deleteEntry(newEntry);
+        NODETABLE_UNLOCK(table);
+        return UA_STATUSCODE_BADNODEIDUNKNOWN;
+    }
+    if(slot->entry != newEntry->orig) {
+        /* The node was updated since the copy was made */
+        NodeTable_deleteEntry(newEntry);
+        NODETABLE_UNLOCK(table);
+        return UA_STATUSCODE_BADINTERNALERROR;
+    }
+    slot->entry->deleted = true;
+    NodeTable_cleanupEntry(slot->entry);
+    slot->entry = newEntry;
+    NODETABLE_UNLOCK(table);
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+UA_NodeTable_iterate(void *context, void *visitorContext,
+                     UA_NodestoreVisitor visitor) {
+    /* The visitor may add or remove nodes. That moves entries between the
+     * slots. So the entries are collected first. */
+    UA_NodeTable *table = (UA_NodeTable*)context;
+    NODETABLE_LOCK(table);
+    UA_UInt32 count = table->count;
+    UA_NodeTableEntry **entries = (UA_NodeTableEntry**)
+        UA_malloc(count * sizeof(UA_NodeTableEntry*));
+    if(!entries) {
+        NODETABLE_UNLOCK(table);
+        return;
+    }
+    for(UA_UInt32 i = 0, j = 0; i < table->capacity && j < count; i++) {
+        UA_NodeTableEntry *entry = table->slots[i].entry;
+        if(!entry)
+            continue;
+        ++entry->refCount;
+        entries[j++] = entry;
+    }
+    NODETABLE_UNLOCK(table);
+
+    for(UA_UInt32 i = 0; i < count; i++) {
+        visitor(visitorContext, &entries[i]->node);
+        NODETABLE_LOCK(table);
+        --entries[i]->refCount;
+        NodeTable_cleanupEntry(entries[i]);
+        NODETABLE_UNLOCK(table);
+    }
+    UA_free(entries);
+}
+
+static void
+UA_NodeTable_delete(void *context) {
+    UA_NodeTable *table = (UA_NodeTable*)context;
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_destroy(&table->mutex);
+#endif
+    for(UA_UInt32 i = 0; i < table->capacity; i++) {
+        UA_NodeTableEntry *entry = table->slots[i].entry;
+        if(!entry)
+            continue;
+        /* On debugging builds, check that all nodes were release */
+        UA_assert(entry->refCount == 0);
+        NodeTable_deleteEntry(entry);
+    }
+    UA_free(table->slots);
+    UA_free(table);
+}
+
+UA_StatusCode
+UA_Nodestore_robinhood_new(UA_Nodestore *ns) {
+    /* Allocate and initialize the table */
+    UA_NodeTable *table = (UA_NodeTable*)UA_calloc(1, sizeof(UA_NodeTable));
+    if(!table)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    table->capacity = UA_NODETABLE_MINSIZE;
+    table->slots = (UA_NodeTableSlot*)
+        UA_calloc(table->capacity, sizeof(UA_NodeTableSlot));
+    if(!table->slots) {
+        UA_free(table);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_init(&table->mutex, NULL);
+#endif
+
+    /* Populate the nodestore */
+    ns->context = table;
+    ns->deleteNodestore = UA_NodeTable_delete;
+    ns->inPlaceEditAllowed = true;
+    ns->newNode = UA_NodeTable_newNode;
+    ns->deleteNode = UA_NodeTable_deleteNode;
+    ns->getNode = UA_NodeTable_getNode;
+    ns->releaseNode = UA_NodeTable_releaseNode;
+    ns->getNodeCopy = UA_NodeTable_getNodeCopy;
+    ns->insertNode = UA_NodeTable_insertNode;
+    ns->replaceNode = UA_NodeTable_replaceNode;
+    ns->removeNode = UA_NodeTable_removeNode;
+    ns->iterate = UA_NodeTable_iterate;
+
+    return UA_STATUSCODE_GOOD;
+}
@@ -0,0 +1,26 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+#ifndef UA_NODESTORE_ROBINHOOD_H_
+#define UA_NODESTORE_ROBINHOOD_H_
+
+#include "ua_plugin_nodestore.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Alternative to the default nodestore. The nodes are kept in an
+ * open-addressing hash table with Robin Hood probing. Every slot stores the
+ * hash and a compact key of the NodeId (numeric identifiers and strings of up
+ * to eight bytes are stored completely). Lookups resolve misses and collisions
+ * without touching the memory of the nodes. Initializes the nodestore, sets the
+ * context and function pointers. */
+UA_StatusCode UA_EXPORT
+UA_Nodestore_robinhood_new(UA_Nodestore *ns);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* UA_NODESTORE_ROBINHOOD_H_ */
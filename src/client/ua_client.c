@@ -22,6 +22,8 @@ UA_Client_init(UA_Client* client, UA_ClientConfig config) {
     client->channel.securityPolicy = &client->securityPolicy;
     client->channel.securityMode = UA_MESSAGESECURITYMODE_NONE;
     client->config = config;
+    UA_DataTypeIndex_init(&client->customTypesIndex, config.customDataTypesSize,
+                          config.customDataTypes);
 }
 
 UA_Client *
@@ -36,6 +38,7 @@ UA_Client_new(UA_ClientConfig config) {
 static void
 UA_Client_deleteMembers(UA_Client* client) {
     UA_Client_disconnect(client);
+    UA_DataTypeIndex_deleteMembers(&client->customTypesIndex);
     client->securityPolicy.deleteMembers(&client->securityPolicy);
     UA_SecureChannel_deleteMembersCleanup(&client->channel);
     UA_Connection_deleteMembers(&client->connection);
@@ -214,9 +217,11 @@ processServiceResponse(void *application, UA_SecureChannel *channel,
     expectedNodeId = UA_NODEID_NUMERIC(0, rd->responseType->binaryEncodingId);
     if(UA_NodeId_equal(&responseId, &expectedNodeId)) {
         /* Decode the response */
-        retval = UA_decodeBinary(message, &offset, rd->response, rd->responseType,
-                                 rd->client->config.customDataTypesSize,
-                                 rd->client->config.customDataTypes);
+        UA_DecodeBinaryOptions options;
+        memset(&options, 0, sizeof(UA_DecodeBinaryOptions));
+        options.customTypes = &rd->client->customTypesIndex;
+        retval = UA_decodeBinaryWithOptions(message, &offset, rd->response,
+                                            rd->responseType, &options);
     } else {
         UA_LOG_ERROR(rd->client->config.logger, UA_LOGCATEGORY_CLIENT,
                      "Reply contains the wrong service response");
@@ -6,6 +6,7 @@
 #define UA_CLIENT_INTERNAL_H_
 
 #include "ua_securechannel.h"
+#include "ua_types_encoding_binary.h"
 #include "queue.h"
 
  /**************************/
@@ -71,6 +72,7 @@ struct UA_Client {
     /* State */
     UA_ClientState state;
     UA_ClientConfig config;
+    UA_DataTypeIndex customTypesIndex; /* Lookup index for config.customDataTypes */
 
     /* Connection */
     UA_Connection connection;
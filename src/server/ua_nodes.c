@@ -85,6 +85,7 @@ UA_VariableNode_copy(const UA_VariableNode *src, UA_VariableNode *dst) {
     dst->accessLevel = src->accessLevel;
     dst->minimumSamplingInterval = src->minimumSamplingInterval;
     dst->historizing = src->historizing;
+    dst->dataSourceBatch = src->dataSourceBatch;
     return retval;
 }
 
@@ -175,6 +176,16 @@ UA_Node_copy(const UA_Node *src, UA_Node *dst) {
             if(retval != UA_STATUSCODE_GOOD)
                 break;
             drefs->targetIdsSize = srefs->targetIdsSize;
+            drefs->targetIdsCapacity = srefs->targetIdsSize;
+            if(!srefs->targetIdsIndex)
+                continue;
+            drefs->targetIdsIndex = (UA_UInt32*)
+                UA_malloc(srefs->targetIdsIndexSize * sizeof(UA_UInt32));
+            if(!drefs->targetIdsIndex)
+                continue; /* Rebuilt with the next lookup */
+            memcpy(drefs->targetIdsIndex, srefs->targetIdsIndex,
+                   srefs->targetIdsIndexSize * sizeof(UA_UInt32));
+            drefs->targetIdsIndexSize = srefs->targetIdsIndexSize;
         }
         if(retval != UA_STATUSCODE_GOOD) {
             UA_Node_deleteMembers(dst);
@@ -461,28 +472,165 @@ UA_Node_setAttributes(UA_Node *node, const void *attributes,
 /* Manage References */
 /*********************/
 
+/* Above this number of targets, the positions of the targets are indexed by
+ * the hash of the target NodeId. The index is an open-addressing table with
+ * linear probing and a power-of-two size. It is filled at most to one half. */
+#define UA_REFERENCETARGETS_INDEXTHRESHOLD 8
+
+/* Consecutive numeric identifiers have consecutive hashes. Mix the bits so
+ * that they don't form long probing sequences. */
+static UA_UInt32
+targetHash(const UA_NodeId *target) {
+    UA_UInt32 h = UA_NodeId_hash(target);
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h;
+}
+
+static UA_UInt32 *
+targetIndexSlot(const UA_NodeReferenceKind *refs, const UA_NodeId *target) {
+    size_t mask = refs->targetIdsIndexSize - 1;
+    size_t i = targetHash(target) & mask;
+    while(refs->targetIdsIndex[i] != 0) {
+        if(UA_NodeId_equal(target, &refs->targetIds[refs->targetIdsIndex[i] - 1].nodeId))
+            return &refs->targetIdsIndex[i];
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+/* Find the slot pointing to the position. The target must be indexed. */
+static UA_UInt32 *
+targetIndexSlotByPosition(const UA_NodeReferenceKind *refs, size_t pos) {
+    size_t mask = refs->targetIdsIndexSize - 1;
+    size_t i = targetHash(&refs->targetIds[pos].nodeId) & mask;
+    while(refs->targetIdsIndex[i] != pos + 1)
+        i = (i + 1) & mask;
+    return &refs->targetIdsIndex[i];
+}
+
+static void
+targetIndexInsert(UA_NodeReferenceKind *refs, size_t pos) {
+    size_t mask = refs->targetIdsIndexSize - 1;
+    size_t i = targetHash(&refs->targetIds[pos].nodeId) & mask;
+    while(refs->targetIdsIndex[i] != 0)
+        i = (i + 1) & mask;
+    refs->targetIdsIndex[i] = (UA_UInt32)(pos + 1);
+}
+
+/* Shift the following slots back so that the probing sequences stay intact */
+static void
+targetIndexRemove(UA_NodeReferenceKind *refs, UA_UInt32 *slot) {
+    size_t mask = refs->targetIdsIndexSize - 1;
+    size_t i = (size_t)(slot - refs->targetIdsIndex);
+    size_t j = i;
+    while(true) {
+        j = (j + 1) & mask;
+        UA_UInt32 pos = refs->targetIdsIndex[j];
+        if(pos == 0)
+            break;
+        size_t k = targetHash(&refs->targetIds[pos - 1].nodeId) & mask;
+        /* Can the entry in j be moved to i? (Is k cyclically outside (i,j]?) */
+        if((i <= j) ? (k <= i || k > j) : (k <= i && k > j)) {
+            refs->targetIdsIndex[i] = pos;
+            i = j;
+        }
+    }
+    refs->targetIdsIndex[i] = 0;
+}
+
+static void
+targetIndexDelete(UA_NodeReferenceKind *refs) {
+    UA_free(refs->targetIdsIndex);
+    refs->targetIdsIndex = NULL;
+    refs->targetIdsIndexSize = 0;
+}
+
+/* (Re)build the index if required. Without an index, the targets are searched
+ * linearly. */
 static UA_StatusCode
-addReferenceTarget(UA_NodeReferenceKind *refs, const UA_ExpandedNodeId *target) {
-    UA_ExpandedNodeId *targets =
-        (UA_ExpandedNodeId*) UA_realloc(refs->targetIds,
-                                        sizeof(UA_ExpandedNodeId) * (refs->targetIdsSize+1));
-    if(!targets)
+targetIndexUpdate(UA_NodeReferenceKind *refs) {
+    if(refs->targetIdsSize <= UA_REFERENCETARGETS_INDEXTHRESHOLD) {
+        if(refs->targetIdsIndex)
+            targetIndexDelete(refs);
+        return UA_STATUSCODE_GOOD;
+    }
+    if(refs->targetIdsIndex && refs->targetIdsSize * 2 <= refs->targetIdsIndexSize)
+        return UA_STATUSCODE_GOOD;
+
+    size_t indexSize = 2 * UA_REFERENCETARGETS_INDEXTHRESHOLD;
+    while(indexSize < refs->targetIdsSize * 4)
+        indexSize *= 2;
+    UA_UInt32 *index = (UA_UInt32*)UA_calloc(indexSize, sizeof(UA_UInt32));
+    if(!index)
         return UA_STATUSCODE_BADOUTOFMEMORY;
+    UA_free(refs->targetIdsIndex);
+    refs->targetIdsIndex = index;
+    refs->targetIdsIndexSize = indexSize;
+    for(size_t i = 0; i < refs->targetIdsSize; ++i)
+        targetIndexInsert(refs, i);
+    return UA_STATUSCODE_GOOD;
+}
+
+/* Returns the position of the target or targetIdsSize if not found */
+static size_t
+findTarget(UA_NodeReferenceKind *refs, const UA_NodeId *target) {
+    if(targetIndexUpdate(refs) == UA_STATUSCODE_GOOD && refs->targetIdsIndex) {
+        UA_UInt32 *slot = targetIndexSlot(refs, target);
+        return slot ? (size_t)(*slot - 1) : refs->targetIdsSize;
+    }
+    for(size_t i = 0; i < refs->targetIdsSize; ++i) {
+        if(UA_NodeId_equal(target, &refs->targetIds[i].nodeId))
+            return i;
+    }
+    return refs->targetIdsSize;
+}
+
+static UA_StatusCode
+addReferenceTarget(UA_NodeReferenceKind *refs, const UA_ExpandedNodeId *target) {
+    if(findTarget(refs, &target->nodeId) < refs->targetIdsSize)
+        return UA_STATUSCODE_BADDUPLICATEREFERENCENOTALLOWED;
+
+    /* Grow the array with amortized cost */
+    if(refs->targetIdsSize >= refs->targetIdsCapacity) {
+        size_t capacity = (refs->targetIdsSize > 0) ? refs->targetIdsSize * 2 : 1;
+        UA_ExpandedNodeId *targets =
+            (UA_ExpandedNodeId*) UA_realloc(refs->targetIds,
+                                            sizeof(UA_ExpandedNodeId) * capacity);
+        if(!targets)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        refs->targetIds = targets;
+        refs->targetIdsCapacity = capacity;
+    }
 
-    refs->targetIds = targets;
     UA_StatusCode retval =
         UA_ExpandedNodeId_copy(target, &refs->targetIds[refs->targetIdsSize]);
 
     if(retval == UA_STATUSCODE_GOOD) {
         refs->targetIdsSize++;
+        if(refs->targetIdsIndex &&
+           refs->targetIdsSize * 2 <= refs->targetIdsIndexSize)
+            targetIndexInsert(refs, refs->targetIdsSize - 1);
+        else if(targetIndexUpdate(refs) != UA_STATUSCODE_GOOD)
+            targetIndexDelete(refs); /* Without the new target. Rebuilt with the
+                                      * next lookup. */
     } else if(refs->targetIdsSize == 0) {
         /* We had zero references before (realloc was a malloc) */
         UA_free(refs->targetIds);
         refs->targetIds = NULL;
+        refs->targetIdsCapacity = 0;
     }
     return retval;
 }
 
+static void
+deleteReferenceKindMembers(UA_NodeReferenceKind *refs) {
+    UA_Array_delete(refs->targetIds, refs->targetIdsSize, &UA_TYPES[UA_TYPES_EXPANDEDNODEID]);
+    UA_NodeId_deleteMembers(&refs->referenceTypeId);
+    UA_free(refs->targetIdsIndex);
+}
+
 static UA_StatusCode
 addReferenceKind(UA_Node *node, const UA_AddReferencesItem *item) {
     UA_NodeReferenceKind *refs =
@@ -501,7 +649,7 @@ addReferenceKind(UA_Node *node, const UA_AddReferencesItem *item) {
     if(retval == UA_STATUSCODE_GOOD) {
         node->referencesSize++;
     } else {
-        UA_NodeId_deleteMembers(&newRef->referenceTypeId);
+        deleteReferenceKindMembers(newRef);
         if(node->referencesSize == 0) {
             UA_free(node->references);
             node->references = NULL;
@@ -532,52 +680,368 @@ UA_Node_deleteReference(UA_Node *node, const UA_DeleteReferencesItem *item) {
         if(!UA_NodeId_equal(&item->referenceTypeId, &refs->referenceTypeId))
             continue;
 
-        for(size_t j = refs->targetIdsSize; j > 0; --j) {
-            if(!UA_NodeId_equal(&item->targetNodeId.nodeId, &refs->targetIds[j-1].nodeId))
-                continue;
+        size_t j = findTarget(refs, &item->targetNodeId.nodeId);
+        if(j == refs->targetIdsSize)
+            continue;
 
-            /* Ok, delete the reference */
-            UA_ExpandedNodeId_deleteMembers(&refs->targetIds[j-1]);
-            refs->targetIdsSize--;
-
-            /* One matching target remaining */
-            if(refs->targetIdsSize > 0) {
-                if(j-1 != refs->targetIdsSize) // avoid valgrind error: Source
-                                               // and destination overlap in
-                                               // memcpy
-                    refs->targetIds[j-1] = refs->targetIds[refs->targetIdsSize];
-                return UA_STATUSCODE_GOOD;
-            }
+        /* Ok, delete the reference */
+        size_t last = refs->targetIdsSize - 1;
+        if(refs->targetIdsIndex) {
+            targetIndexRemove(refs, targetIndexSlotByPosition(refs, j));
+            if(j != last)
+                *targetIndexSlotByPosition(refs, last) = (UA_UInt32)(j + 1);
+        }
+        UA_ExpandedNodeId_deleteMembers(&refs->targetIds[j]);
+        refs->targetIdsSize--;
 
-            /* Remove refs */
-            UA_free(refs->targetIds);
-            UA_NodeId_deleteMembers(&refs->referenceTypeId);
-            node->referencesSize--;
-            if(node->referencesSize > 0) {
-                if(i-1 != node->referencesSize) // avoid valgrind error: Source
-                                                // and destination overlap in
-                                                // memcpy
-                    node->references[i-1] = node->references[node->referencesSize];
-                return UA_STATUSCODE_GOOD;
-            }
+        /* One matching target remaining */
+        if(refs->targetIdsSize > 0) {
+            if(j != refs->targetIdsSize) // avoid valgrind error: Source
+                                         // and destination overlap in
+                                         // memcpy
+                refs->targetIds[j] = refs->targetIds[refs->targetIdsSize];
+            if(refs->targetIdsSize <= UA_REFERENCETARGETS_INDEXTHRESHOLD &&
+               refs->targetIdsIndex)
+                targetIndexDelete(refs);
+            return UA_STATUSCODE_GOOD;
+        }
 
-            /* Remove the node references */
-            UA_free(node->references);
-            node->references = NULL;
+        /* Remove refs */
+        deleteReferenceKindMembers(refs);
+        node->referencesSize--;
+        if(node->referencesSize > 0) {
+            if(i-1 != node->referencesSize) // avoid valgrind error: Source
+                                            // and destination overlap in
+                                            // memcpy
+                node->references[i-1] = node->references[node->referencesSize];
             return UA_STATUSCODE_GOOD;
         }
+
+        /* Remove the node references */
+        UA_free(node->references);
+        node->references = NULL;
+        return UA_STATUSCODE_GOOD;
     }
     return UA_STATUSCODE_UNCERTAINREFERENCENOTDELETED;
 }
 
 void UA_Node_deleteReferences(UA_Node *node) {
-    for(size_t i = 0; i < node->referencesSize; ++i) {
-        UA_NodeReferenceKind *refs = &node->references[i];
-        UA_Array_delete(refs->targetIds, refs->targetIdsSize, &UA_TYPES[UA_TYPES_EXPANDEDNODEID]);
-        UA_NodeId_deleteMembers(&refs->referenceTypeId);
-    }
+    for(size_t i = 0; i < node->referencesSize; ++i)
+        deleteReferenceKindMembers(&node->references[i]);
     if(node->references)
         UA_free(node->references);
     node->references = NULL;
     node->referencesSize = 0;
 }
+
+/****************************/
+/* Binary Encoding of Nodes */
+/****************************/
+
+/* The encoding starts with the NodeClass, followed by the standard attributes,
+ * the references and the attributes of the NodeClass. The same code walks over
+ * the members for the size calculation, the encoding and the decoding. */
+
+typedef enum {
+    UA_NODECODING_CALCSIZE,
+    UA_NODECODING_ENCODE,
+    UA_NODECODING_DECODE
+} UA_NodeCodingMode;
+
+typedef struct {
+    UA_NodeCodingMode mode;
+    size_t size;              /* calcsize */
+    UA_Byte *pos;             /* encode */
+    const UA_Byte *end;
+    const UA_ByteString *src; /* decode */
+    size_t *offset;
+} UA_NodeCoding;
+
+static UA_StatusCode
+codeNodeMember(UA_NodeCoding *nc, void *p, const UA_DataType *type) {
+    switch(nc->mode) {
+    case UA_NODECODING_CALCSIZE:
+        nc->size += UA_calcSizeBinary(p, type);
+        return UA_STATUSCODE_GOOD;
+    case UA_NODECODING_ENCODE:
+        return UA_encodeBinary(p, type, &nc->pos, &nc->end, NULL, NULL);
+    default:
+        return UA_decodeBinary(nc->src, nc->offset, p, type, 0, NULL);
+    }
+}
+
+static UA_StatusCode
+codeNodeArray(UA_NodeCoding *nc, void **p, size_t *size, const UA_DataType *type) {
+    UA_Int32 length = (UA_Int32)*size;
+    UA_StatusCode retval = codeNodeMember(nc, &length, &UA_TYPES[UA_TYPES_INT32]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    if(nc->mode == UA_NODECODING_DECODE) {
+        if(length <= 0)
+            return UA_STATUSCODE_GOOD;
+        /* Every element takes at least one byte */
+        if((size_t)length > nc->src->length - *nc->offset)
+            return UA_STATUSCODE_BADDECODINGERROR;
+        *p = UA_Array_new((size_t)length, type);
+        if(!*p)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        *size = (size_t)length;
+    }
+
+    uintptr_t ptr = (uintptr_t)*p;
+    for(UA_Int32 i = 0; i < length && retval == UA_STATUSCODE_GOOD; i++) {
+        retval = codeNodeMember(nc, (void*)ptr, type);
+        ptr += type->memSize;
+    }
+    return retval;
+}
+
+static UA_StatusCode
+codeNodeReferences(UA_NodeCoding *nc, UA_Node *node) {
+    UA_Int32 length = (UA_Int32)node->referencesSize;
+    UA_StatusCode retval = codeNodeMember(nc, &length, &UA_TYPES[UA_TYPES_INT32]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    if(nc->mode == UA_NODECODING_DECODE) {
+        if(length <= 0)
+            return UA_STATUSCODE_GOOD;
+        if((size_t)length > nc->src->length - *nc->offset)
+            return UA_STATUSCODE_BADDECODINGERROR;
+        node->references = (UA_NodeReferenceKind*)
+            UA_calloc((size_t)length, sizeof(UA_NodeReferenceKind));
+        if(!node->references)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        node->referencesSize = (size_t)length;
+    }
+
+    for(size_t i = 0; i < node->referencesSize; i++) {
+        UA_NodeReferenceKind *refs = &node->references[i];
+        retval = codeNodeMember(nc, &refs->referenceTypeId, &UA_TYPES[UA_TYPES_NODEID]);
+        retval |= codeNodeMember(nc, &refs->isInverse, &UA_TYPES[UA_TYPES_BOOLEAN]);
+        if(retval != UA_STATUSCODE_GOOD)
+            return retval;
+        retval = codeNodeArray(nc, (void**)&refs->targetIds, &refs->targetIdsSize,
+                               &UA_TYPES[UA_TYPES_EXPANDEDNODEID]);
+        refs->targetIdsCapacity = refs->targetIdsSize;
+        if(retval != UA_STATUSCODE_GOOD)
+            return retval;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+/* The Variant encoding wraps values of non-builtin types in ExtensionObjects.
+ * Types without a binary encoding (e.g. LocaleId) cannot be decoded from
+ * there. So the index of non-builtin types in UA_TYPES (plus one) is encoded
+ * first and the content of the value is encoded directly with that type. The
+ * index is zero for builtin types and empty values. */
+static UA_StatusCode
+codeNodeValue(UA_NodeCoding *nc, UA_DataValue *value) {
+    UA_UInt16 typeIndex = 0;
+    const UA_DataType *type = value->value.type;
+    if(nc->mode != UA_NODECODING_DECODE && type && !type->builtin &&
+       type == &UA_TYPES[type->typeIndex])
+        typeIndex = (UA_UInt16)(type->typeIndex + 1);
+    UA_StatusCode retval = codeNodeMember(nc, &typeIndex, &UA_TYPES[UA_TYPES_UINT16]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    if(typeIndex == 0)
+        return codeNodeMember(nc, value, &UA_TYPES[UA_TYPES_DATAVALUE]);
+    if(typeIndex > UA_TYPES_COUNT)
+        return UA_STATUSCODE_BADDECODINGERROR;
+    type = &UA_TYPES[typeIndex - 1];
+
+    /* The DataValue without the content of the variant */
+    UA_Variant content;
+    if(nc->mode == UA_NODECODING_DECODE) {
+        retval = codeNodeMember(nc, value, &UA_TYPES[UA_TYPES_DATAVALUE]);
+        UA_Variant_init(&content);
+    } else {
+        UA_DataValue shallow = *value;
+        UA_Variant_init(&shallow.value);
+        retval = codeNodeMember(nc, &shallow, &UA_TYPES[UA_TYPES_DATAVALUE]);
+        content = value->value;
+    }
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    /* Scalar or array */
+    UA_Boolean isArray = !UA_Variant_isScalar(&content);
+    retval = codeNodeMember(nc, &isArray, &UA_TYPES[UA_TYPES_BOOLEAN]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    if(isArray) {
+        retval = codeNodeArray(nc, &content.data, &content.arrayLength, type);
+        if(nc->mode == UA_NODECODING_DECODE && !content.data)
+            content.data = UA_EMPTY_ARRAY_SENTINEL;
+        if(retval == UA_STATUSCODE_GOOD)
+            retval = codeNodeArray(nc, (void**)&content.arrayDimensions,
+                                   &content.arrayDimensionsSize,
+                                   &UA_TYPES[UA_TYPES_UINT32]);
+    } else {
+        if(nc->mode == UA_NODECODING_DECODE) {
+            content.data = UA_new(type);
+            if(!content.data)
+                return UA_STATUSCODE_BADOUTOFMEMORY;
+        }
+        retval = codeNodeMember(nc, content.data, type);
+    }
+
+    /* Move the content into the decoded value */
+    if(nc->mode == UA_NODECODING_DECODE) {
+        content.type = type;
+        if(retval == UA_STATUSCODE_GOOD)
+            value->value = content;
+        else
+            UA_Variant_deleteMembers(&content);
+    }
+    return retval;
+}
+
+static UA_StatusCode
+codeVariableNodeMembers(UA_NodeCoding *nc, UA_VariableNode *node) {
+    UA_StatusCode retval = codeNodeMember(nc, &node->dataType, &UA_TYPES[UA_TYPES_NODEID]);
+    retval |= codeNodeMember(nc, &node->valueRank, &UA_TYPES[UA_TYPES_INT32]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    retval = codeNodeArray(nc, (void**)&node->arrayDimensions, &node->arrayDimensionsSize,
+                           &UA_TYPES[UA_TYPES_UINT32]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    /* A DataSource cannot be encoded. It is replaced by an empty value. */
+    if(node->valueSource == UA_VALUESOURCE_DATASOURCE) {
+        UA_DataValue empty;
+        UA_DataValue_init(&empty);
+        UA_UInt16 noTypeIndex = 0;
+        retval = codeNodeMember(nc, &noTypeIndex, &UA_TYPES[UA_TYPES_UINT16]);
+        if(retval != UA_STATUSCODE_GOOD)
+            return retval;
+        return codeNodeMember(nc, &empty, &UA_TYPES[UA_TYPES_DATAVALUE]);
+    }
+    return codeNodeValue(nc, &node->value.data.value);
+}
+
+static UA_StatusCode
+codeNode(UA_NodeCoding *nc, UA_Node *node) {
+    UA_NodeClass nodeClass = node->nodeClass;
+    UA_StatusCode retval = codeNodeMember(nc, &nodeClass, &UA_TYPES[UA_TYPES_NODECLASS]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    if(nodeClass != node->nodeClass)
+        return UA_STATUSCODE_BADNODECLASSINVALID;
+
+    /* Standard attributes */
+    retval |= codeNodeMember(nc, &node->nodeId, &UA_TYPES[UA_TYPES_NODEID]);
+    retval |= codeNodeMember(nc, &node->browseName, &UA_TYPES[UA_TYPES_QUALIFIEDNAME]);
+    retval |= codeNodeMember(nc, &node->displayName, &UA_TYPES[UA_TYPES_LOCALIZEDTEXT]);
+    retval |= codeNodeMember(nc, &node->description, &UA_TYPES[UA_TYPES_LOCALIZEDTEXT]);
+    retval |= codeNodeMember(nc, &node->writeMask, &UA_TYPES[UA_TYPES_UINT32]);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    retval = codeNodeReferences(nc, node);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    /* Attributes of the nodeclass */
+    switch(node->nodeClass) {
+    case UA_NODECLASS_OBJECT: {
+        UA_ObjectNode *onode = (UA_ObjectNode*)node;
+        retval = codeNodeMember(nc, &onode->eventNotifier, &UA_TYPES[UA_TYPES_BYTE]);
+        break;
+    }
+    case UA_NODECLASS_VARIABLE: {
+        UA_VariableNode *vnode = (UA_VariableNode*)node;
+        retval = codeVariableNodeMembers(nc, vnode);
+        retval |= codeNodeMember(nc, &vnode->accessLevel, &UA_TYPES[UA_TYPES_BYTE]);
+        retval |= codeNodeMember(nc, &vnode->minimumSamplingInterval,
+                                 &UA_TYPES[UA_TYPES_DOUBLE]);
+        retval |= codeNodeMember(nc, &vnode->historizing, &UA_TYPES[UA_TYPES_BOOLEAN]);
+        break;
+    }
+    case UA_NODECLASS_VARIABLETYPE: {
+        UA_VariableTypeNode *vtnode = (UA_VariableTypeNode*)node;
+        retval = codeVariableNodeMembers(nc, (UA_VariableNode*)node);
+        retval |= codeNodeMember(nc, &vtnode->isAbstract, &UA_TYPES[UA_TYPES_BOOLEAN]);
+        break;
+    }
+    case UA_NODECLASS_METHOD: {
+        UA_MethodNode *mnode = (UA_MethodNode*)node;
+        retval = codeNodeMember(nc, &mnode->executable, &UA_TYPES[UA_TYPES_BOOLEAN]);
+        break;
+    }
+    case UA_NODECLASS_OBJECTTYPE: {
+        UA_ObjectTypeNode *otnode = (UA_ObjectTypeNode*)node;
+        retval = codeNodeMember(nc, &otnode->isAbstract, &UA_TYPES[UA_TYPES_BOOLEAN]);
+        break;
+    }
+    case UA_NODECLASS_REFERENCETYPE: {
+        UA_ReferenceTypeNode *rtnode = (UA_ReferenceTypeNode*)node;
+        retval = codeNodeMember(nc, &rtnode->isAbstract, &UA_TYPES[UA_TYPES_BOOLEAN]);
+        retval |= codeNodeMember(nc, &rtnode->symmetric, &UA_TYPES[UA_TYPES_BOOLEAN]);
+        retval |= codeNodeMember(nc, &rtnode->inverseName, &UA_TYPES[UA_TYPES_LOCALIZEDTEXT]);
+        break;
+    }
+    case UA_NODECLASS_DATATYPE: {
+        UA_DataTypeNode *dtnode = (UA_DataTypeNode*)node;
+        retval = codeNodeMember(nc, &dtnode->isAbstract, &UA_TYPES[UA_TYPES_BOOLEAN]);
+        break;
+    }
+    case UA_NODECLASS_VIEW: {
+        UA_ViewNode *vnode = (UA_ViewNode*)node;
+        retval = codeNodeMember(nc, &vnode->eventNotifier, &UA_TYPES[UA_TYPES_BYTE]);
+        retval |= codeNodeMember(nc, &vnode->containsNoLoops, &UA_TYPES[UA_TYPES_BOOLEAN]);
+        break;
+    }
+    default:
+        retval = UA_STATUSCODE_BADNODECLASSINVALID;
+        break;
+    }
+    return retval;
+}
+
+UA_StatusCode
+UA_Node_encodeBinary(const UA_Node *node, UA_ByteString *dst) {
+    /* The node is not modified for the size calculation and the encoding */
+    UA_Node *n = (UA_Node*)(uintptr_t)node;
+    UA_NodeCoding nc;
+    memset(&nc, 0, sizeof(UA_NodeCoding));
+    nc.mode = UA_NODECODING_CALCSIZE;
+    UA_StatusCode retval = codeNode(&nc, n);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    retval = UA_ByteString_allocBuffer(dst, nc.size);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    nc.mode = UA_NODECODING_ENCODE;
+    nc.pos = dst->data;
+    nc.end = &dst->data[dst->length];
+    retval = codeNode(&nc, n);
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_ByteString_deleteMembers(dst);
+        return retval;
+    }
+
+    /* The size calculation is an upper bound. Variants with non-builtin
+     * types are wrapped in ExtensionObjects and encoded shorter. */
+    dst->length = (size_t)(nc.pos - dst->data);
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+UA_Node_decodeBinary(const UA_ByteString *src, size_t *offset, UA_Node *dst) {
+    if(*offset > src->length)
+        return UA_STATUSCODE_BADDECODINGERROR;
+    UA_NodeCoding nc;
+    memset(&nc, 0, sizeof(UA_NodeCoding));
+    nc.mode = UA_NODECODING_DECODE;
+    nc.src = src;
+    nc.offset = offset;
+    UA_StatusCode retval = codeNode(&nc, dst);
+    if(retval != UA_STATUSCODE_GOOD)
+        UA_Node_deleteMembers(dst);
+    return retval;
+}
@@ -10,14 +10,41 @@
 #define STARTCHANNELID 1
 #define STARTTOKENID 1
 
+/* Minimum number of buckets in the id index and slots in the timeout heap */
+#define CHANNEL_INDEX_MINSIZE 16
+
+/* Not contained in the timeout heap */
+#define NOT_IN_HEAP (~(size_t)0)
+
 UA_StatusCode
 UA_SecureChannelManager_init(UA_SecureChannelManager* cm, UA_Server* server) {
     LIST_INIT(&cm->channels);
+    LIST_INIT(&cm->renewedChannels);
+    LIST_INIT(&cm->sessionlessChannels);
     // TODO: use an ID that is likely to be unique after a restart
     cm->lastChannelId = STARTCHANNELID;
     cm->lastTokenId = STARTTOKENID;
     cm->currentChannelCount = 0;
     cm->server = server;
+
+    /* Size the id index and the heap for the maximum number of channels */
+    size_t size = CHANNEL_INDEX_MINSIZE;
+    while(size < server->config.maxSecureChannels)
+        size *= 2;
+    cm->idIndex = (struct channel_list*)UA_malloc(sizeof(struct channel_list) * size);
+    cm->timeoutHeap = (channel_list_entry**)UA_malloc(sizeof(channel_list_entry*) * size);
+    if(!cm->idIndex || !cm->timeoutHeap) {
+        UA_free(cm->idIndex);
+        UA_free(cm->timeoutHeap);
+        cm->idIndex = NULL;
+        cm->timeoutHeap = NULL;
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    for(size_t i = 0; i < size; i++)
+        LIST_INIT(&cm->idIndex[i]);
+    cm->idIndexSize = size;
+    cm->timeoutHeapSize = 0;
+    cm->timeoutHeapCapacity = size;
     return UA_STATUSCODE_GOOD;
 }
 
@@ -28,8 +55,126 @@ void UA_SecureChannelManager_deleteMembers(UA_SecureChannelManager* cm) {
         UA_SecureChannel_deleteMembersCleanup(&entry->channel);
         UA_free(entry);
     }
+    UA_free(cm->idIndex);
+    UA_free(cm->timeoutHeap);
+    cm->idIndex = NULL;
+    cm->timeoutHeap = NULL;
+    cm->timeoutHeapSize = 0;
+    cm->timeoutHeapCapacity = 0;
+}
+
+/****************/
+/* Timeout Heap */
+/****************/
+
+static void
+channelHeapSet(UA_SecureChannelManager *cm, size_t pos, channel_list_entry *entry) {
+    cm->timeoutHeap[pos] = entry;
+    entry->heapIndex = pos;
+}
+
+static void
+channelHeapSiftUp(UA_SecureChannelManager *cm, size_t pos) {
+    channel_list_entry *entry = cm->timeoutHeap[pos];
+    while(pos > 0) {
+        size_t parent = (pos - 1) / 2;
+        if(cm->timeoutHeap[parent]->timeout <= entry->timeout)
+            break;
+        channelHeapSet(cm, pos, cm->timeoutHeap[parent]);
+        pos = parent;
+    }
+    channelHeapSet(cm, pos, entry);
 }
 
+static void
+channelHeapSiftDown(UA_SecureChannelManager *cm, size_t pos) {
+    channel_list_entry *entry = cm->timeoutHeap[pos];
+    while(true) {
+        size_t child = (2 * pos) + 1;
+        if(child >= cm->timeoutHeapSize)
+            break;
+        if(child + 1 < cm->timeoutHeapSize &&
+           cm->timeoutHeap[child + 1]->timeout < cm->timeoutHeap[child]->timeout)
+            child++;
+        if(entry->timeout <= cm->timeoutHeap[child]->timeout)
+            break;
+        channelHeapSet(cm, pos, cm->timeoutHeap[child]);
+        pos = child;
+    }
+    channelHeapSet(cm, pos, entry);
+}
+
+static UA_StatusCode
+channelHeapInsert(UA_SecureChannelManager *cm, channel_list_entry *entry) {
+    if(cm->timeoutHeapSize == cm->timeoutHeapCapacity) {
+        size_t newCapacity = cm->timeoutHeapCapacity * 2;
+        channel_list_entry **newHeap = (channel_list_entry**)
+            UA_realloc(cm->timeoutHeap, sizeof(channel_list_entry*) * newCapacity);
+        if(!newHeap)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        cm->timeoutHeap = newHeap;
+        cm->timeoutHeapCapacity = newCapacity;
+    }
+    cm->timeoutHeap[cm->timeoutHeapSize] = entry;
+    cm->timeoutHeapSize++;
+    channelHeapSiftUp(cm, cm->timeoutHeapSize - 1);
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+channelHeapRemove(UA_SecureChannelManager *cm, channel_list_entry *entry) {
+    size_t pos = entry->heapIndex;
+    entry->heapIndex = NOT_IN_HEAP;
+    cm->timeoutHeapSize--;
+    if(pos == cm->timeoutHeapSize)
+        return;
+    channelHeapSet(cm, pos, cm->timeoutHeap[cm->timeoutHeapSize]);
+    if(pos > 0 && cm->timeoutHeap[pos]->timeout <
+       cm->timeoutHeap[(pos - 1) / 2]->timeout)
+        channelHeapSiftUp(cm, pos);
+    else
+        channelHeapSiftDown(cm, pos);
+}
+
+/* Lower the timeout of the entry. The key in the heap is only a lower bound
+ * for the actual timeout. So the heap is not updated when a token is revolved
+ * and the timeout increases. This is fixed up lazily during the cleanup. */
+static void
+channelHeapLowerTimeout(UA_SecureChannelManager *cm, channel_list_entry *entry,
+                 UA_DateTime timeout) {
+    if(entry->heapIndex == NOT_IN_HEAP || entry->timeout <= timeout)
+        return;
+    entry->timeout = timeout;
+    channelHeapSiftUp(cm, entry->heapIndex);
+}
+
+static UA_DateTime
+tokenTimeout(const UA_ChannelSecurityToken *token) {
+    return token->createdAt +
+        (UA_DateTime)(token->revisedLifetime * UA_MSEC_TO_DATETIME);
+}
+
+/* Keep the list of channels without a session in sync with the sessions of
+ * the channel */
+static void
+updateSessionless(UA_SecureChannelManager *cm, channel_list_entry *entry) {
+    /* The channel was already removed from the manager */
+    if(entry->heapIndex == NOT_IN_HEAP)
+        return;
+    UA_Boolean sessionless = LIST_EMPTY(&entry->channel.sessions);
+    if(sessionless == entry->sessionless)
+        return;
+    if(sessionless)
+        LIST_INSERT_HEAD(&cm->sessionlessChannels, entry, sessionlessPointers);
+    else
+        LIST_REMOVE(entry, sessionlessPointers);
+    entry->sessionless = sessionless;
+}
+
+/*******************/
+/* Channel Removal */
+/*******************/
+
 static void
 removeSecureChannelCallback(UA_Server *server, void *entry) {
     channel_list_entry *centry = (channel_list_entry*)entry;
@@ -51,6 +196,14 @@ removeSecureChannel(UA_SecureChannelManager *cm, channel_list_entry *entry) {
 
     /* Detach the channel and make the capacity available */
     LIST_REMOVE(entry, pointers);
+    if(entry->channel.securityToken.channelId != 0)
+        LIST_REMOVE(entry, idPointers);
+    if(entry->renewed)
+        LIST_REMOVE(entry, renewPointers);
+    if(entry->sessionless)
+        LIST_REMOVE(entry, sessionlessPointers);
+    if(entry->heapIndex != NOT_IN_HEAP)
+        channelHeapRemove(cm, entry);
     UA_atomic_add(&cm->currentChannelCount, (UA_UInt32)-1);
     return UA_STATUSCODE_GOOD;
 }
@@ -58,34 +211,50 @@ removeSecureChannel(UA_SecureChannelManager *cm, channel_list_entry *entry) {
 /* remove channels that were not renewed or who have no connection attached */
 void
 UA_SecureChannelManager_cleanupTimedOut(UA_SecureChannelManager *cm, UA_DateTime nowMonotonic) {
-    channel_list_entry *entry, *temp;
-    LIST_FOREACH_SAFE(entry, &cm->channels, pointers, temp) {
-        UA_DateTime timeout = entry->channel.securityToken.createdAt +
-            (UA_DateTime)(entry->channel.securityToken.revisedLifetime * UA_MSEC_TO_DATETIME);
-        if(timeout < nowMonotonic || !entry->channel.connection) {
-            UA_LOG_INFO_CHANNEL(cm->server->config.logger, &entry->channel,
-                                "SecureChannel has timed out");
-            removeSecureChannel(cm, entry);
-        } else if(entry->channel.nextSecurityToken.tokenId > 0) {
-            UA_SecureChannel_revolveTokens(&entry->channel);
+    /* Take the channels with the earliest (lower bound) timeout from the top of
+     * the heap until the first channel has not timed out */
+    while(cm->timeoutHeapSize > 0) {
+        channel_list_entry *entry = cm->timeoutHeap[0];
+        if(entry->timeout >= nowMonotonic)
+            break;
+
+        /* The token was revolved in the meantime. Reinsert with the actual
+         * timeout. */
+        UA_DateTime timeout = tokenTimeout(&entry->channel.securityToken);
+        if(timeout >= nowMonotonic && entry->channel.connection) {
+            entry->timeout = timeout;
+            channelHeapSiftDown(cm, 0);
+            continue;
         }
+
+        UA_LOG_INFO_CHANNEL(cm->server->config.logger, &entry->channel,
+                            "SecureChannel has timed out");
+        if(removeSecureChannel(cm, entry) != UA_STATUSCODE_GOOD)
+            break; /* Try again next time */
+    }
+
+    /* Revolve the tokens of the renewed channels. The new token may time out
+     * before the key of the channel in the heap. */
+    channel_list_entry *entry, *temp;
+    LIST_FOREACH_SAFE(entry, &cm->renewedChannels, renewPointers, temp) {
+        LIST_REMOVE(entry, renewPointers);
+        entry->renewed = false;
+        if(entry->channel.nextSecurityToken.tokenId == 0)
+            continue;
+        UA_SecureChannel_revolveTokens(&entry->channel);
+        channelHeapLowerTimeout(cm, entry, tokenTimeout(&entry->channel.securityToken));
     }
 }
 
 /* remove the first channel that has no session attached */
 static UA_Boolean purgeFirstChannelWithoutSession(UA_SecureChannelManager* cm) {
-    channel_list_entry* entry;
-    LIST_FOREACH(entry, &cm->channels, pointers) {
-        if(LIST_EMPTY(&(entry->channel.sessions))) {
-            UA_LOG_DEBUG_CHANNEL(cm->server->config.logger, &entry->channel,
-                                 "Channel was purged since maxSecureChannels was "
-                                 "reached and channel had no session attached");
-            removeSecureChannel(cm, entry);
-            UA_assert(entry != LIST_FIRST(&cm->channels));
-            return true;
-        }
-    }
-    return false;
+    channel_list_entry *entry = LIST_FIRST(&cm->sessionlessChannels);
+    if(!entry)
+        return false;
+    UA_LOG_DEBUG_CHANNEL(cm->server->config.logger, &entry->channel,
+                         "Channel was purged since maxSecureChannels was "
+                         "reached and channel had no session attached");
+    return (removeSecureChannel(cm, entry) == UA_STATUSCODE_GOOD);
 }
 
 UA_StatusCode
@@ -125,7 +294,20 @@ UA_SecureChannelManager_create(UA_SecureChannelManager *const cm, UA_Connection
     entry->channel.securityToken.createdAt = UA_DateTime_now();
     entry->channel.securityToken.revisedLifetime = cm->server->config.maxSecurityTokenLifetime;
 
+    /* Add to the timeout heap */
+    entry->renewed = false;
+    entry->sessionless = false;
+    entry->heapIndex = NOT_IN_HEAP;
+    entry->timeout = tokenTimeout(&entry->channel.securityToken);
+    retval = channelHeapInsert(cm, entry);
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_SecureChannel_deleteMembersCleanup(&entry->channel);
+        UA_free(entry);
+        return retval;
+    }
+
     LIST_INSERT_HEAD(&cm->channels, entry, pointers);
+    updateSessionless(cm, entry);
     UA_atomic_add(&cm->currentChannelCount, 1);
     UA_Connection_attachSecureChannel(connection, &entry->channel);
     return UA_STATUSCODE_GOOD;
@@ -172,6 +354,12 @@ UA_SecureChannelManager_open(UA_SecureChannelManager* cm, UA_SecureChannel *chan
     // Now overwrite the creation date with the internal monotonic clock
     channel->securityToken.createdAt = UA_DateTime_nowMonotonic();
 
+    /* Index by the channelId and update the timeout */
+    channel_list_entry *entry = (channel_list_entry*)channel;
+    LIST_INSERT_HEAD(&cm->idIndex[channel->securityToken.channelId & (cm->idIndexSize - 1)],
+                     entry, idPointers);
+    channelHeapLowerTimeout(cm, entry, tokenTimeout(&channel->securityToken));
+
     channel->state = UA_SECURECHANNELSTATE_OPEN;
     return UA_STATUSCODE_GOOD;
 }
@@ -214,27 +402,61 @@ UA_SecureChannelManager_renew(UA_SecureChannelManager* cm, UA_SecureChannel *cha
 
     /* Reset the internal creation date to the monotonic clock */
     channel->nextSecurityToken.createdAt = UA_DateTime_nowMonotonic();
+
+    /* The next token might have a shorter lifetime. Revolve the tokens during
+     * the next cleanup if the client does not use the new token before. */
+    channel_list_entry *entry = (channel_list_entry*)channel;
+    channelHeapLowerTimeout(cm, entry, tokenTimeout(&channel->nextSecurityToken));
+    if(!entry->renewed) {
+        LIST_INSERT_HEAD(&cm->renewedChannels, entry, renewPointers);
+        entry->renewed = true;
+    }
     return UA_STATUSCODE_GOOD;
 }
 
-UA_SecureChannel*
-UA_SecureChannelManager_get(UA_SecureChannelManager* cm, UA_UInt32 channelId) {
+static channel_list_entry *
+findChannelEntry(UA_SecureChannelManager *cm, UA_UInt32 channelId) {
     channel_list_entry* entry;
-    LIST_FOREACH(entry, &cm->channels, pointers) {
+    LIST_FOREACH(entry, &cm->idIndex[channelId & (cm->idIndexSize - 1)], idPointers) {
         if(entry->channel.securityToken.channelId == channelId)
-            return &entry->channel;
+            return entry;
     }
     return NULL;
 }
 
+UA_SecureChannel*
+UA_SecureChannelManager_get(UA_SecureChannelManager* cm, UA_UInt32 channelId) {
+    channel_list_entry* entry = findChannelEntry(cm, channelId);
+    if(!entry)
+        return NULL;
+    return &entry->channel;
+}
+
 UA_StatusCode
 UA_SecureChannelManager_close(UA_SecureChannelManager* cm, UA_UInt32 channelId) {
-    channel_list_entry* entry;
-    LIST_FOREACH(entry, &cm->channels, pointers) {
-        if(entry->channel.securityToken.channelId == channelId)
-            break;
-    }
+    channel_list_entry* entry = findChannelEntry(cm, channelId);
     if(!entry)
         return UA_STATUSCODE_BADINTERNALERROR;
     return removeSecureChannel(cm, entry);
 }
+
+void
+UA_SecureChannelManager_attachSession(UA_SecureChannelManager *cm,
+                                      UA_SecureChannel *channel, UA_Session *session) {
+    UA_SecureChannel_attachSession(channel, session);
+    updateSessionless(cm, (channel_list_entry*)channel);
+}
+
+void
+UA_SecureChannelManager_detachSession(UA_SecureChannelManager *cm,
+                                      UA_SecureChannel *channel, UA_Session *session) {
+    UA_SecureChannel_detachSession(channel, session);
+    updateSessionless(cm, (channel_list_entry*)channel);
+}
+
+void
+UA_SecureChannelManager_connectionClosed(UA_SecureChannelManager *cm,
+                                         UA_SecureChannel *channel) {
+    /* Move to the top of the timeout heap */
+    channelHeapLowerTimeout(cm, (channel_list_entry*)channel, INT64_MIN);
+}
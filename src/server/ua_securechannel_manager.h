@@ -17,14 +17,44 @@ extern "C" {
 typedef struct channel_list_entry {
     UA_SecureChannel channel;
     LIST_ENTRY(channel_list_entry) pointers;
+    LIST_ENTRY(channel_list_entry) idPointers;    /* Bucket in the id index */
+    LIST_ENTRY(channel_list_entry) renewPointers; /* List of renewed channels */
+    LIST_ENTRY(channel_list_entry) sessionlessPointers; /* List of channels
+                                                         * without a session */
+    UA_Boolean renewed;       /* Contained in the list of renewed channels */
+    UA_Boolean sessionless;   /* Contained in the list of channels without a
+                               * session */
+    size_t heapIndex;         /* Position in the timeout heap */
+    UA_DateTime timeout;      /* Key in the timeout heap. A lower bound for the
+                               * timeout of the current or next token. */
 } channel_list_entry;
 
+LIST_HEAD(channel_list, channel_list_entry);
+
 typedef struct UA_SecureChannelManager {
-    LIST_HEAD(channel_list, channel_list_entry) channels; // doubly-linked list of channels
+    struct channel_list channels; // doubly-linked list of channels
     UA_UInt32 currentChannelCount;
     UA_UInt32 lastChannelId;
     UA_UInt32 lastTokenId;
     UA_Server *server;
+
+    /* Hash index (with chaining) of the open channels by the channelId. The
+     * number of buckets is a power of two. */
+    struct channel_list *idIndex;
+    size_t idIndexSize;
+
+    /* Binary min-heap of the channels ordered by the timeout */
+    channel_list_entry **timeoutHeap;
+    size_t timeoutHeapSize;
+    size_t timeoutHeapCapacity;
+
+    /* Channels with a pending next security token. The tokens are revolved
+     * during the next cleanup. */
+    struct channel_list renewedChannels;
+
+    /* Channels without a session. One of them is purged when the maximum
+     * number of channels is reached. */
+    struct channel_list sessionlessChannels;
 } UA_SecureChannelManager;
 
 UA_StatusCode
@@ -61,6 +91,22 @@ UA_SecureChannelManager_get(UA_SecureChannelManager *cm, UA_UInt32 channelId);
 UA_StatusCode
 UA_SecureChannelManager_close(UA_SecureChannelManager *cm, UA_UInt32 channelId);
 
+/* Attach and detach sessions to the channels of the manager. The manager keeps
+ * track of the channels without a session. */
+void
+UA_SecureChannelManager_attachSession(UA_SecureChannelManager *cm,
+                                      UA_SecureChannel *channel, UA_Session *session);
+
+void
+UA_SecureChannelManager_detachSession(UA_SecureChannelManager *cm,
+                                      UA_SecureChannel *channel, UA_Session *session);
+
+/* The connection of the channel was closed. The channel is removed during the
+ * next cleanup. */
+void
+UA_SecureChannelManager_connectionClosed(UA_SecureChannelManager *cm,
+                                         UA_SecureChannel *channel);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -9,6 +9,10 @@
 #include "ua_namespaceinit_generated.h"
 #endif
 
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+#include "ua_subscription.h"
+#endif
+
 /**********************/
 /* Namespace Handling */
 /**********************/
@@ -90,7 +94,15 @@ void UA_Server_delete(UA_Server *server) {
     /* Delete all internal data */
     UA_SecureChannelManager_deleteMembers(&server->secureChannelManager);
     UA_SessionManager_deleteMembers(&server->sessionManager);
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    UA_SamplingGroups_delete(server);
+#endif
     UA_Array_delete(server->namespaces, server->namespacesSize, &UA_TYPES[UA_TYPES_STRING]);
+    UA_ReferenceTypeCache_delete(server->referenceTypeCache);
+    UA_DataSourceCache_deleteMembers(&server->dataSourceCache);
+    UA_free(server->batchedNodes);
+    UA_DataTypeIndex_deleteMembers(&server->customTypesIndex);
+    UA_Arena_deleteMembers(&server->requestArena);
 
 #ifdef UA_ENABLE_DISCOVERY
     registeredServer_list_entry *rs, *rs_tmp;
@@ -129,11 +141,6 @@ void UA_Server_delete(UA_Server *server) {
     }
 # endif
 
-#endif
-
-#ifdef UA_ENABLE_MULTITHREADING
-    pthread_cond_destroy(&server->dispatchQueue_condition);
-    pthread_mutex_destroy(&server->dispatchQueue_mutex);
 #endif
 
     /* Delete the timed work */
@@ -173,6 +180,11 @@ UA_Server_new(const UA_ServerConfig *config) {
     }
 
     server->config = *config;
+    UA_DataTypeIndex_init(&server->customTypesIndex, config->customDataTypesSize,
+                          config->customDataTypes);
+    UA_Arena_init(&server->requestArena, config->requestArenaSize);
+    UA_DataSourceCache_init(&server->dataSourceCache, config->dataSourceCacheSize,
+                            config->dataSourceCachePerSession);
 
     /* Init start time to zero, the actual start time will be sampled in
      * UA_Server_run_startup() */
@@ -187,13 +199,14 @@ UA_Server_new(const UA_ServerConfig *config) {
     UA_Timer_init(&server->timer);
 
     /* Initialized the linked list for delayed callbacks */
-#ifndef UA_ENABLE_MULTITHREADING
     SLIST_INIT(&server->delayedCallbacks);
-#endif
 
-    /* Initialized the dispatch queue for worker threads */
-#ifdef UA_ENABLE_MULTITHREADING
-    cds_wfcq_init(&server->dispatchQueue_head, &server->dispatchQueue_tail);
+    /* Initialize the shared sampling of MonitoredItems */
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    LIST_INIT(&server->samplingGroups);
+    for(size_t i = 0; i < UA_ONWRITE_SAMPLINGGROUPS_HASH_PRIME; i++)
+        LIST_INIT(&server->onWriteSamplingGroups[i]);
+    LIST_INIT(&server->samplingTicks);
 #endif
 
     /* Create Namespaces 0 and 1 */
@@ -203,8 +216,20 @@ UA_Server_new(const UA_ServerConfig *config) {
     server->namespacesSize = 2;
 
     /* Initialized SecureChannel and Session managers */
-    UA_SecureChannelManager_init(&server->secureChannelManager, server);
-    UA_SessionManager_init(&server->sessionManager, server);
+    if(UA_SecureChannelManager_init(&server->secureChannelManager, server) != UA_STATUSCODE_GOOD ||
+       UA_SessionManager_init(&server->sessionManager, server) != UA_STATUSCODE_GOOD) {
+        UA_LOG_FATAL(config->logger, UA_LOGCATEGORY_SERVER,
+                     "Could not allocate the SecureChannel and Session managers");
+        UA_SecureChannelManager_deleteMembers(&server->secureChannelManager);
+        UA_Array_delete(server->namespaces, server->namespacesSize,
+                        &UA_TYPES[UA_TYPES_STRING]);
+        UA_Timer_deleteMembers(&server->timer);
+        UA_DataTypeIndex_deleteMembers(&server->customTypesIndex);
+        UA_DataSourceCache_deleteMembers(&server->dataSourceCache);
+        UA_Arena_deleteMembers(&server->requestArena);
+        UA_free(server);
+        return NULL;
+    }
 
     /* Add a regular callback for cleanup and maintenance */
     UA_Server_addRepeatedCallback(server, (UA_ServerCallback)UA_Server_cleanup, NULL,
@@ -256,6 +281,13 @@ UA_Server_new(const UA_ServerConfig *config) {
     return server;
 }
 
+void
+UA_Server_getSessionStatistics(UA_Server *server, UA_SessionStatistics *stats) {
+    stats->currentSessionCount = server->sessionManager.currentSessionCount;
+    stats->lookups = server->sessionManager.lookups;
+    stats->lookupComparisons = server->sessionManager.lookupComparisons;
+}
+
 /*****************/
 /* Repeated Jobs */
 /*****************/
@@ -349,6 +349,16 @@ processOPN(UA_Server *server, UA_SecureChannel *channel,
     return retval;
 }
 
+/* A request that was decoded into the arena is released all at once */
+static void
+deleteRequest(void *request, const UA_DataType *requestType,
+              const UA_DecodeBinaryOptions *decodeOptions) {
+    if(decodeOptions->arena)
+        UA_Arena_reset(decodeOptions->arena);
+    else
+        UA_deleteMembers(request, requestType);
+}
+
 static UA_StatusCode
 processMSG(UA_Server *server, UA_SecureChannel *channel,
            UA_UInt32 requestId, const UA_ByteString *msg) {
@@ -389,12 +399,23 @@ processMSG(UA_Server *server, UA_SecureChannel *channel,
     UA_assert(responseType);
 
     /* Decode the request */
+    UA_DecodeBinaryOptions decodeOptions;
+    memset(&decodeOptions, 0, sizeof(UA_DecodeBinaryOptions));
+    decodeOptions.customTypes = &server->customTypesIndex;
+#ifndef UA_ENABLE_MULTITHREADING
+    /* The message buffer is valid until the response is sent. So the request
+     * can point into it. */
+    if(server->requestArena.blockSize > 0) {
+        decodeOptions.arena = &server->requestArena;
+        decodeOptions.zeroCopy = true;
+    }
+#endif
     void *request = UA_alloca(requestType->memSize);
     UA_RequestHeader *requestHeader = (UA_RequestHeader*)request;
-    retval = UA_decodeBinary(msg, &offset, request, requestType,
-                             server->config.customDataTypesSize,
-                             server->config.customDataTypes);
+    retval = UA_decodeBinaryWithOptions(msg, &offset, request, requestType,
+                                        &decodeOptions);
     if(retval != UA_STATUSCODE_GOOD) {
+        deleteRequest(request, requestType, &decodeOptions);
         UA_LOG_DEBUG_CHANNEL(server->config.logger, channel,
                              "Could not decode the request");
         return sendServiceFault(channel, msg, requestPos, responseType, requestId, retval);
@@ -436,7 +457,7 @@ processMSG(UA_Server *server, UA_SecureChannel *channel,
             UA_LOG_DEBUG_CHANNEL(server->config.logger, channel,
                                  "Trying to activate a session that is " \
                                  "not known in the server");
-            UA_deleteMembers(request, requestType);
+            deleteRequest(request, requestType, &decodeOptions);
             return sendServiceFault(channel, msg, requestPos, responseType,
                                     requestId, UA_STATUSCODE_BADSESSIONIDINVALID);
         }
@@ -453,7 +474,7 @@ processMSG(UA_Server *server, UA_SecureChannel *channel,
             UA_LOG_WARNING_CHANNEL(server->config.logger, channel,
                                    "Service request %i without a valid session",
                                    requestType->binaryEncodingId);
-            UA_deleteMembers(request, requestType);
+            deleteRequest(request, requestType, &decodeOptions);
             return sendServiceFault(channel, msg, requestPos, responseType,
                                     requestId, UA_STATUSCODE_BADSESSIONIDINVALID);
         }
@@ -471,7 +492,7 @@ processMSG(UA_Server *server, UA_SecureChannel *channel,
                                requestType->binaryEncodingId);
         UA_SessionManager_removeSession(&server->sessionManager,
                                         &session->authenticationToken);
-        UA_deleteMembers(request, requestType);
+        deleteRequest(request, requestType, &decodeOptions);
         return sendServiceFault(channel, msg, requestPos, responseType,
                                 requestId, UA_STATUSCODE_BADSESSIONNOTACTIVATED);
     }
@@ -481,7 +502,7 @@ processMSG(UA_Server *server, UA_SecureChannel *channel,
         UA_LOG_WARNING_CHANNEL(server->config.logger, channel,
                                "Client tries to use a Session that is not "
                                "bound to this SecureChannel");
-        UA_deleteMembers(request, requestType);
+        deleteRequest(request, requestType, &decodeOptions);
         return sendServiceFault(channel, msg, requestPos, responseType,
                                 requestId, UA_STATUSCODE_BADSESSIONNOTACTIVATED);
     }
@@ -494,7 +515,7 @@ processMSG(UA_Server *server, UA_SecureChannel *channel,
     if(requestType == &UA_TYPES[UA_TYPES_PUBLISHREQUEST]) {
         Service_Publish(server, session,
             (const UA_PublishRequest*)request, requestId);
-        UA_deleteMembers(request, requestType);
+        deleteRequest(request, requestType, &decodeOptions);
         return UA_STATUSCODE_GOOD;
     }
 #endif
@@ -516,7 +537,7 @@ send_response:
                             "with StatusCode %s", UA_StatusCode_name(retval));
 
     /* Clean up */
-    UA_deleteMembers(request, requestType);
+    deleteRequest(request, requestType, &decodeOptions);
     UA_deleteMembers(response, responseType);
 
     return retval;
@@ -708,11 +729,15 @@ workerProcessBinaryMessage(UA_Server *server, ConnectionMessage *cm) {
     UA_free(cm);
 }
 
+/* The network layer releases the message buffer when the call returns. So the
+ * message is copied behind the callback data. The messages of a connection are
+ * processed by the same worker in the order of arrival. */
 void
 UA_Server_processBinaryMessage(UA_Server *server, UA_Connection *connection,
                                UA_ByteString *message) {
     /* Allocate the memory for the callback data */
-    ConnectionMessage *cm = (ConnectionMessage*)UA_malloc(sizeof(ConnectionMessage));
+    ConnectionMessage *cm = (ConnectionMessage*)
+        UA_malloc(sizeof(ConnectionMessage) + message->length);
 
     /* If malloc failed, execute immediately */
     if(!cm) {
@@ -720,10 +745,13 @@ UA_Server_processBinaryMessage(UA_Server *server, UA_Connection *connection,
         return;
     }
 
-    /* Dispatch to the workers */
+    /* Dispatch to the worker of the connection */
     cm->connection = connection;
-    cm->message = *message;
-    UA_Server_workerCallback(server, (UA_ServerCallback)workerProcessBinaryMessage, cm);
+    cm->message.length = message->length;
+    cm->message.data = (UA_Byte*)cm + sizeof(ConnectionMessage);
+    memcpy(cm->message.data, message->data, message->length);
+    UA_Server_workerCallbackAffine(server, (UA_UInt32)connection->sockfd,
+                                   (UA_ServerCallback)workerProcessBinaryMessage, cm);
 }
 
 static void
@@ -735,6 +763,9 @@ deleteConnectionTrampoline(UA_Server *server, void *data) {
 
 void
 UA_Server_removeConnection(UA_Server *server, UA_Connection *connection) {
+    if(connection->channel)
+        UA_SecureChannelManager_connectionClosed(&server->secureChannelManager,
+                                                 connection->channel);
     UA_Connection_detachSecureChannel(connection);
 #ifndef UA_ENABLE_MULTITHREADING
     connection->free(connection);
@@ -13,19 +13,21 @@ extern "C" {
 #include "ua_server.h"
 #include "ua_server_config.h"
 #include "ua_timer.h"
+#include "ua_types_encoding_binary.h"
 #include "ua_connection_internal.h"
 #include "ua_session_manager.h"
 #include "ua_securechannel_manager.h"
 
 #ifdef UA_ENABLE_MULTITHREADING
 
-/* TODO: Don't depend on liburcu */
-#include <urcu.h>
-#include <urcu/lfstack.h>
+#include <pthread.h>
 
 struct UA_Worker;
 typedef struct UA_Worker UA_Worker;
 
+struct UA_WorkerCallback;
+typedef struct UA_WorkerCallback UA_WorkerCallback;
+
 #endif /* UA_ENABLE_MULTITHREADING */
 
 #ifdef UA_ENABLE_DISCOVERY
@@ -64,6 +66,68 @@ typedef struct serverOnNetwork_hash_entry {
 #endif /* UA_ENABLE_DISCOVERY_MULTICAST */
 #endif /* UA_ENABLE_DISCOVERY */
 
+/* The transitive closure of the HasSubtype hierarchy below the References
+ * ReferenceType. Every known ReferenceType gets an index. The bitset of a type
+ * contains the indices of the type itself and all of its (transitive)
+ * subtypes. The cache is dropped after changes to the hierarchy and rebuilt
+ * lazily. It is not modified but replaced. The old cache is freed in a delayed
+ * callback. */
+typedef struct {
+    size_t typesSize;
+    UA_NodeId *types;
+    size_t subtypesWords;  /* Number of bitset words per type */
+    UA_UInt32 *subtypes;   /* typesSize * subtypesWords words */
+    size_t indexSize;      /* Power of two */
+    UA_UInt32 *index;      /* Open addressing NodeId -> type index + 1 */
+} UA_ReferenceTypeCache;
+
+/* Direct-mapped cache of the values read from DataSources. A slot holds the
+ * last value of one of the variables whose NodeId hashes to it. The values are
+ * shared by all sessions. In the per-session mode, the slot is selected by the
+ * NodeId and the SessionId. Then a value is only served to the session that
+ * has read it.
+ *
+ * Every NodeId hash has a generation that advances when the value or the
+ * DataSource of a variable changes. A value is only cached if the generation
+ * did not change since the read started. So a read that started before a
+ * write cannot put the old value afterwards. Cached values of an older
+ * generation are not served. */
+typedef struct {
+    UA_NodeId nodeId;     /* Null NodeId if the slot is empty */
+    UA_NodeId sessionId;  /* Only in the per-session mode */
+    UA_UInt32 generation; /* Of the NodeId when the read started */
+    UA_DateTime readTime; /* Monotonic */
+    UA_DataValue value;
+} UA_DataSourceCacheEntry;
+
+typedef struct {
+    size_t entriesSize; /* Zero if the cache is disabled */
+    UA_Boolean perSession;
+    UA_DataSourceCacheEntry *entries;
+    UA_UInt32 *generations; /* One per slot, selected by the NodeId */
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_t mutex;
+#endif
+} UA_DataSourceCache;
+
+/* Hashes of the NodeIds of the variables with a UA_DataSourceBatch, sorted for
+ * a binary search. Only the variables in the set are looked up to read their
+ * values ahead. A hash collision or a deleted variable costs one lookup. The
+ * set is not modified but replaced. The old set is freed in a delayed
+ * callback. */
+typedef struct {
+    size_t hashesSize;
+    UA_UInt32 hashes[];
+} UA_BatchedNodes;
+
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+struct UA_SamplingGroup;
+typedef LIST_HEAD(UA_ListOfSamplingGroups, UA_SamplingGroup) UA_ListOfSamplingGroups;
+#define UA_ONWRITE_SAMPLINGGROUPS_HASH_PRIME 257
+struct UA_SamplingTick;
+typedef LIST_HEAD(UA_ListOfSamplingTicks, UA_SamplingTick) UA_ListOfSamplingTicks;
+#endif
+
 struct UA_Server {
     /* Meta */
     UA_DateTime startTime;
@@ -117,20 +181,47 @@ struct UA_Server {
 
     /* Worker threads */
 #ifdef UA_ENABLE_MULTITHREADING
-    /* Dispatch queue head for the worker threads (the tail should not be in the same cache line) */
-    struct cds_wfcq_head dispatchQueue_head;
     UA_Worker *workers; /* there are nThread workers in a running server */
-    pthread_cond_t dispatchQueue_condition; /* so the workers don't spin if the queue is empty */
-    pthread_mutex_t dispatchQueue_mutex; /* mutex for access to condition variable */
-    struct cds_wfcq_tail dispatchQueue_tail; /* Dispatch queue tail for the worker threads */
+    volatile UA_UInt32 nextWorker; /* Round-robin dispatch from other threads */
+    pthread_mutex_t callbackPoolMutex;
+    UA_WorkerCallback *callbackPool; /* Free callback entries */
+    size_t callbackPoolSize;
 #endif
 
     /* For bootstrapping, omit some consistency checks, creating a reference to
      * the parent and member instantiation */
     UA_Boolean bootstrapNS0;
 
+    /* Precomputed subtype closure of the ReferenceType hierarchy. NULL until
+     * it is built. The version advances with every change to the hierarchy. */
+    UA_ReferenceTypeCache * volatile referenceTypeCache;
+    volatile UA_UInt32 referenceTypeCacheVersion;
+
+    /* Values of DataSources for reads with a maxAge */
+    UA_DataSourceCache dataSourceCache;
+
     /* Config */
     UA_ServerConfig config;
+
+    /* Lookup index for config.customDataTypes */
+    UA_DataTypeIndex customTypesIndex;
+
+    /* Memory of the currently processed request */
+    UA_Arena requestArena;
+
+    /* The variables with a UA_DataSourceBatch. Their values are read ahead of
+     * the operations. NULL if there are none. */
+    UA_BatchedNodes * volatile batchedNodes;
+
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    /* Shared sampling of the MonitoredItems */
+    UA_ListOfSamplingGroups samplingGroups;
+    /* Groups with a samplingInterval of zero are notified on write. They are
+     * hashed by the NodeId. */
+    UA_ListOfSamplingGroups onWriteSamplingGroups[UA_ONWRITE_SAMPLINGGROUPS_HASH_PRIME];
+    /* The groups with the same samplingInterval are sampled together */
+    UA_ListOfSamplingTicks samplingTicks;
+#endif
 };
 
 /*****************/
@@ -182,6 +273,12 @@ UA_Server_delayedCallback(UA_Server *server, UA_ServerCallback callback, void *d
 void
 UA_Server_workerCallback(UA_Server *server, UA_ServerCallback callback, void *data);
 
+/* Callbacks with the same affinity are executed by the same worker thread, in
+ * the order of dispatch. They are not stolen by other workers. */
+void
+UA_Server_workerCallbackAffine(UA_Server *server, UA_UInt32 affinity,
+                               UA_ServerCallback callback, void *data);
+
 /*********************/
 /* Utility Functions */
 /*********************/
@@ -203,6 +300,60 @@ isNodeInTree(UA_Nodestore *ns, const UA_NodeId *leafNode,
              const UA_NodeId *nodeToFind, const UA_NodeId *referenceTypeIds,
              size_t referenceTypeIdsSize);
 
+/* Tests whether testRef is identical to rootRef or one of its (transitive)
+ * subtypes. Uses the ReferenceType cache and falls back to isNodeInTree for
+ * NodeIds that are not in the References hierarchy. */
+UA_Boolean
+isReferenceTypeSubtype(UA_Server *server, const UA_NodeId *rootRef,
+                       const UA_NodeId *testRef);
+
+/* Drops the ReferenceType cache. It is rebuilt before its next use. */
+void
+UA_ReferenceTypeCache_invalidate(UA_Server *server);
+
+void
+UA_ReferenceTypeCache_delete(UA_ReferenceTypeCache *cache);
+
+void
+UA_DataSourceCache_init(UA_DataSourceCache *cache, size_t entriesSize,
+                        UA_Boolean perSession);
+
+void
+UA_DataSourceCache_deleteMembers(UA_DataSourceCache *cache);
+
+/* Sample the generation before the DataSource is read. Pass it to the put of
+ * the value. */
+UA_UInt32
+UA_DataSourceCache_generation(UA_DataSourceCache *cache, const UA_NodeId *nodeId);
+
+/* Copies the cached value if it was read at minReadTime or later. In the
+ * per-session mode, the value must have been read for the session. Returns
+ * whether a value was copied. */
+UA_Boolean
+UA_DataSourceCache_get(UA_DataSourceCache *cache, const UA_NodeId *nodeId,
+                       const UA_NodeId *sessionId, UA_DateTime minReadTime,
+                       UA_DataValue *value);
+
+/* Replaces the value in the slot. Does nothing if the generation of the NodeId
+ * has advanced in the meantime. */
+void
+UA_DataSourceCache_put(UA_DataSourceCache *cache, const UA_NodeId *nodeId,
+                       const UA_NodeId *sessionId, UA_UInt32 generation,
+                       UA_DateTime readTime, const UA_DataValue *value);
+
+/* Called when the value or the DataSource of the variable has changed.
+ * Advances the generation of the NodeId. */
+void
+UA_DataSourceCache_remove(UA_DataSourceCache *cache, const UA_NodeId *nodeId);
+
+UA_Boolean
+UA_BatchedNodes_contains(const UA_BatchedNodes *bn, const UA_NodeId *nodeId);
+
+/* Adds or removes the variable from the set of batched variables */
+UA_StatusCode
+UA_Server_updateBatchedNodes(UA_Server *server, const UA_NodeId *nodeId,
+                             UA_Boolean batched);
+
 /* Returns an array with the hierarchy of type nodes. The returned array starts
  * at the leaf and continues "upwards" in the hierarchy based on the
  * ``hasSubType`` references. Since multiple-inheritance is possible in general,
@@ -229,6 +380,26 @@ UA_Server_processServiceOperations(UA_Server *server, UA_Session *session,
                                    size_t *responseOperations,
                                    const UA_DataType *responseOperationsType);
 
+/* Same as above. But large requests are split into slices that are processed
+ * in parallel by the worker threads. See the parallelOperationsBatchSize in the
+ * server config. Only for services whose operations are independent of each
+ * other. The operations often take request-wide parameters from thread-local
+ * variables. The (optional) setup callback sets them from the request in every
+ * helper thread before it processes operations. Afterwards the setup callback
+ * is called with NULL to reset the variables. The request is only valid until
+ * the last slice has finished. */
+typedef void (*UA_ServiceOperationsSetup)(const void *request);
+
+UA_StatusCode
+UA_Server_processServiceOperationsParallel(UA_Server *server, UA_Session *session,
+                                           UA_ServiceOperation operationCallback,
+                                           const size_t *requestOperations,
+                                           const UA_DataType *requestOperationsType,
+                                           size_t *responseOperations,
+                                           const UA_DataType *responseOperationsType,
+                                           UA_ServiceOperationsSetup setup,
+                                           const void *request);
+
 /***************************************/
 /* Check Information Model Consistency */
 /***************************************/
@@ -237,6 +408,12 @@ UA_StatusCode
 readValueAttribute(UA_Server *server, UA_Session *session,
                    const UA_VariableNode *vn, UA_DataValue *v);
 
+/* Is the session allowed to read the value attribute according to the
+ * UserAccessLevel? Used when a sample read with the admin session is forwarded
+ * to the session. */
+UA_Boolean
+readValueAllowed(UA_Server *server, UA_Session *session, const UA_NodeId *nodeId);
+
 /* Test whether the value matches a variable definition given by
  * - datatype
  * - valueranke
@@ -287,6 +464,38 @@ UA_Server_readWithSession(UA_Server *server, UA_Session *session,
                           const UA_ReadValueId *item,
                           UA_TimestampsToReturn timestamps);
 
+/* The values of the variables with a UA_DataSourceBatch are read ahead of the
+ * individual read operations, with one call per batch. */
+typedef struct {
+    const UA_DataSourceBatch *batch; /* NULL if the value was not read ahead */
+    void *nodeContext;
+    UA_NumericRange range; /* No dimensions if the entire value is read */
+    UA_DataValue value;
+    UA_StatusCode status; /* Returned by the read callback of the batch */
+    UA_Boolean processed; /* Read or served from the cache */
+    UA_Boolean pending;   /* In the current call of the batch */
+    UA_Boolean cacheable;
+    UA_UInt32 generation; /* Of the DataSource cache when cacheable */
+} UA_ReadAheadValue;
+
+/* Returns an array with one entry per ReadValueId or NULL if no value was read
+ * ahead. With a maxAge > 0, the values are served from and added to the
+ * DataSource cache. */
+UA_ReadAheadValue *
+UA_Server_readAhead(UA_Server *server, UA_Session *session,
+                    size_t idsSize, const UA_ReadValueId *ids,
+                    UA_TimestampsToReturn timestamps, UA_Double maxAge);
+
+void
+UA_ReadAheadValues_delete(UA_ReadAheadValue *readAhead, size_t readAheadSize);
+
+/* The read-ahead value is moved into the result if the read is allowed */
+UA_DataValue
+UA_Server_readWithReadAhead(UA_Server *server, UA_Session *session,
+                            const UA_ReadValueId *item,
+                            UA_TimestampsToReturn timestamps,
+                            UA_ReadAheadValue *readAhead);
+
 /* Checks if a registration timed out and removes that registration.
  * Should be called periodically in main loop */
 void UA_Discovery_cleanupTimedOut(UA_Server *server, UA_DateTime nowMonotonic);
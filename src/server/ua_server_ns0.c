@@ -526,9 +526,8 @@ writeNs0VariableArray(UA_Server *server, UA_UInt32 id, void *v,
 /* Initialize the nodeset 0 by using the generated code of the nodeset compiler.
  * This also initialized the data sources for various variables, such as for
  * example server time. */
-UA_StatusCode
-UA_Server_initNS0(UA_Server *server) {
-
+static UA_StatusCode
+UA_Server_createNS0(UA_Server *server) {
     /* Initialize base nodes which are always required an cannot be created
      * through the NS compiler */
     server->bootstrapNS0 = true;
@@ -541,6 +540,20 @@ UA_Server_initNS0(UA_Server *server) {
     server->bootstrapNS0 = true;
     retVal = ua_namespace0(server);
     server->bootstrapNS0 = false;
+    return retVal;
+}
+
+UA_StatusCode
+UA_Server_initNS0(UA_Server *server) {
+    /* The nodestore already contains namespace zero if it was loaded from a
+     * precompiled image. Then only the callbacks and values are set up. */
+    UA_StatusCode retVal = UA_STATUSCODE_GOOD;
+    UA_NodeId rootFolder = UA_NODEID_NUMERIC(0, UA_NS0ID_ROOTFOLDER);
+    const UA_Node *root = UA_Nodestore_get(server, &rootFolder);
+    if(root)
+        UA_Nodestore_release(server, root);
+    else
+        retVal = UA_Server_createNS0(server);
     if (retVal != UA_STATUSCODE_GOOD)
         return retVal;
 
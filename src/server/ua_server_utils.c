@@ -330,13 +330,26 @@ UA_Server_editNode(UA_Server *server, UA_Session *session,
 #endif
 }
 
-UA_StatusCode
-UA_Server_processServiceOperations(UA_Server *server, UA_Session *session,
-                                   UA_ServiceOperation operationCallback,
-                                   const size_t *requestOperations,
-                                   const UA_DataType *requestOperationsType,
-                                   size_t *responseOperations,
-                                   const UA_DataType *responseOperationsType) {
+static void
+processOperations(UA_Server *server, UA_Session *session,
+                  UA_ServiceOperation operationCallback,
+                  uintptr_t reqOp, const UA_DataType *requestOperationsType,
+                  uintptr_t respOp, const UA_DataType *responseOperationsType,
+                  size_t ops) {
+    for(size_t i = 0; i < ops; i++) {
+        operationCallback(server, session, (void*)reqOp, (void*)respOp);
+        reqOp += requestOperationsType->memSize;
+        respOp += responseOperationsType->memSize;
+    }
+}
+
+/* Allocate the response array. Returns the first request and response
+ * operation. */
+static UA_StatusCode
+prepareServiceOperations(const size_t *requestOperations,
+                         size_t *responseOperations,
+                         const UA_DataType *responseOperationsType,
+                         uintptr_t *reqOp, uintptr_t *respOp) {
     size_t ops = *requestOperations;
     if(ops == 0)
         return UA_STATUSCODE_BADNOTHINGTODO;
@@ -348,14 +361,690 @@ UA_Server_processServiceOperations(UA_Server *server, UA_Session *session,
         return UA_STATUSCODE_BADOUTOFMEMORY;
 
     *responseOperations = ops;
-    uintptr_t respOp = (uintptr_t)*respPos;
+    *respOp = (uintptr_t)*respPos;
     /* No padding after size_t */
-    uintptr_t reqOp = *(uintptr_t*)((uintptr_t)requestOperations + sizeof(size_t));
-    for(size_t i = 0; i < ops; i++) {
-        operationCallback(server, session, (void*)reqOp, (void*)respOp);
-        reqOp += requestOperationsType->memSize;
-        respOp += responseOperationsType->memSize;
+    *reqOp = *(uintptr_t*)((uintptr_t)requestOperations + sizeof(size_t));
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+UA_Server_processServiceOperations(UA_Server *server, UA_Session *session,
+                                   UA_ServiceOperation operationCallback,
+                                   const size_t *requestOperations,
+                                   const UA_DataType *requestOperationsType,
+                                   size_t *responseOperations,
+                                   const UA_DataType *responseOperationsType) {
+    uintptr_t reqOp, respOp;
+    UA_StatusCode retval =
+        prepareServiceOperations(requestOperations, responseOperations,
+                                 responseOperationsType, &reqOp, &respOp);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    processOperations(server, session, operationCallback,
+                      reqOp, requestOperationsType,
+                      respOp, responseOperationsType, *requestOperations);
+    return UA_STATUSCODE_GOOD;
+}
+
+#ifndef UA_ENABLE_MULTITHREADING
+
+UA_StatusCode
+UA_Server_processServiceOperationsParallel(UA_Server *server, UA_Session *session,
+                                           UA_ServiceOperation operationCallback,
+                                           const size_t *requestOperations,
+                                           const UA_DataType *requestOperationsType,
+                                           size_t *responseOperations,
+                                           const UA_DataType *responseOperationsType,
+                                           UA_ServiceOperationsSetup setup,
+                                           const void *request) {
+    return UA_Server_processServiceOperations(server, session, operationCallback,
+                                              requestOperations, requestOperationsType,
+                                              responseOperations, responseOperationsType);
+}
+
+#else /* UA_ENABLE_MULTITHREADING */
+
+/* More slices than threads balance the load when some operations are slow
+ * (e.g. DataSources that access a device) */
+#define UA_OPERATIONSLICES_PER_THREAD 4
+
+/* The slices are claimed by the thread processing the request and by helper
+ * callbacks dispatched to the worker threads. The request thread processes
+ * all slices that were not yet claimed. So it never waits for a helper that
+ * is still queued behind it. Helpers that are dequeued late find no slices
+ * left. The job is freed by the last one to release it. The request (and the
+ * setup arguments) may already be gone when a late helper is dequeued. So the
+ * helpers run the setup only once they have claimed a slice. */
+typedef struct {
+    UA_Session *session;
+    UA_ServiceOperationsSetup setup;
+    const void *request;
+    UA_ServiceOperation operationCallback;
+    uintptr_t reqOp;
+    const UA_DataType *requestOperationsType;
+    uintptr_t respOp;
+    const UA_DataType *responseOperationsType;
+    size_t ops;
+    size_t sliceSize;
+    UA_UInt32 slicesSize;
+
+    volatile UA_UInt32 nextSlice; /* Atomic */
+    UA_UInt32 finishedSlices;     /* Protected by the mutex */
+    UA_UInt32 refCount;           /* Protected by the mutex */
+    pthread_mutex_t mutex;
+    pthread_cond_t finished;
+} UA_OperationsJob;
+
+static void
+processOperationSlices(UA_Server *server, UA_OperationsJob *job, UA_Boolean helper) {
+    UA_Boolean setupDone = false;
+    while(true) {
+        UA_UInt32 slice = UA_atomic_add(&job->nextSlice, 1) - 1;
+        if(slice >= job->slicesSize)
+            break;
+
+        /* The request remains valid until the claimed slice has finished */
+        if(helper && !setupDone && job->setup) {
+            job->setup(job->request);
+            setupDone = true;
+        }
+
+        size_t begin = slice * job->sliceSize;
+        size_t ops = job->sliceSize;
+        if(begin + ops > job->ops)
+            ops = job->ops - begin;
+        processOperations(server, job->session, job->operationCallback,
+                          job->reqOp + (begin * job->requestOperationsType->memSize),
+                          job->requestOperationsType,
+                          job->respOp + (begin * job->responseOperationsType->memSize),
+                          job->responseOperationsType, ops);
+
+        pthread_mutex_lock(&job->mutex);
+        job->finishedSlices++;
+        if(job->finishedSlices == job->slicesSize)
+            pthread_cond_signal(&job->finished);
+        pthread_mutex_unlock(&job->mutex);
     }
+
+    /* Don't keep pointers into the request in the thread-local variables */
+    if(setupDone)
+        job->setup(NULL);
+}
+
+static void
+releaseOperationsJob(UA_OperationsJob *job) {
+    pthread_mutex_lock(&job->mutex);
+    UA_Boolean last = (--job->refCount == 0);
+    pthread_mutex_unlock(&job->mutex);
+    if(!last)
+        return;
+    pthread_cond_destroy(&job->finished);
+    pthread_mutex_destroy(&job->mutex);
+    UA_free(job);
+}
+
+static void
+workerProcessOperations(UA_Server *server, UA_OperationsJob *job) {
+    processOperationSlices(server, job, true);
+    releaseOperationsJob(job);
+}
+
+UA_StatusCode
+UA_Server_processServiceOperationsParallel(UA_Server *server, UA_Session *session,
+                                           UA_ServiceOperation operationCallback,
+                                           const size_t *requestOperations,
+                                           const UA_DataType *requestOperationsType,
+                                           size_t *responseOperations,
+                                           const UA_DataType *responseOperationsType,
+                                           UA_ServiceOperationsSetup setup,
+                                           const void *request) {
+    /* Process in the current thread if the request is small or the workers
+     * are not running */
+    size_t ops = *requestOperations;
+    size_t batchSize = server->config.parallelOperationsBatchSize;
+    if(batchSize == 0 || ops / batchSize < 2 ||
+       !server->workers || server->config.nThreads == 0)
+        return UA_Server_processServiceOperations(server, session, operationCallback,
+                                                  requestOperations, requestOperationsType,
+                                                  responseOperations, responseOperationsType);
+
+    uintptr_t reqOp, respOp;
+    UA_StatusCode retval =
+        prepareServiceOperations(requestOperations, responseOperations,
+                                 responseOperationsType, &reqOp, &respOp);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    /* Fall back to sequential processing if memory could not be allocated */
+    UA_OperationsJob *job = (UA_OperationsJob*)UA_malloc(sizeof(UA_OperationsJob));
+    if(!job) {
+        processOperations(server, session, operationCallback,
+                          reqOp, requestOperationsType,
+                          respOp, responseOperationsType, ops);
+        return UA_STATUSCODE_GOOD;
+    }
+
+    /* Split into slices */
+    size_t slicesSize = ops / batchSize;
+    size_t maxSlices = ((size_t)server->config.nThreads + 1) *
+        UA_OPERATIONSLICES_PER_THREAD;
+    if(slicesSize > maxSlices)
+        slicesSize = maxSlices;
+    size_t helpers = slicesSize - 1;
+    if(helpers > server->config.nThreads)
+        helpers = server->config.nThreads;
+
+    job->session = session;
+    job->setup = setup;
+    job->request = request;
+    job->operationCallback = operationCallback;
+    job->reqOp = reqOp;
+    job->requestOperationsType = requestOperationsType;
+    job->respOp = respOp;
+    job->responseOperationsType = responseOperationsType;
+    job->ops = ops;
+    job->sliceSize = (ops + slicesSize - 1) / slicesSize;
+    job->slicesSize = (UA_UInt32)((ops + job->sliceSize - 1) / job->sliceSize);
+    job->nextSlice = 0;
+    job->finishedSlices = 0;
+    job->refCount = (UA_UInt32)helpers + 1;
+    pthread_mutex_init(&job->mutex, NULL);
+    pthread_cond_init(&job->finished, NULL);
+
+    /* Dispatch the helpers and process slices in the current thread */
+    for(size_t i = 0; i < helpers; i++)
+        UA_Server_workerCallback(server, (UA_ServerCallback)workerProcessOperations, job);
+    processOperationSlices(server, job, false);
+
+    /* Wait for the slices that are processed by the workers */
+    pthread_mutex_lock(&job->mutex);
+    while(job->finishedSlices < job->slicesSize)
+        pthread_cond_wait(&job->finished, &job->mutex);
+    pthread_mutex_unlock(&job->mutex);
+
+    releaseOperationsJob(job);
+    return UA_STATUSCODE_GOOD;
+}
+
+#endif /* UA_ENABLE_MULTITHREADING */
+
+/***********************/
+/* ReferenceType Cache */
+/***********************/
+
+#define REFTYPECACHE_MINSIZE 64
+
+void
+UA_ReferenceTypeCache_delete(UA_ReferenceTypeCache *cache) {
+    if(!cache)
+        return;
+    UA_Array_delete(cache->types, cache->typesSize, &UA_TYPES[UA_TYPES_NODEID]);
+    UA_free(cache->subtypes);
+    UA_free(cache->index);
+    UA_free(cache);
+}
+
+static void
+freeReferenceTypeCache(UA_Server *server, void *data) {
+    UA_ReferenceTypeCache_delete((UA_ReferenceTypeCache*)data);
+}
+
+/* Readers may still use the old cache */
+static void
+refTypeCacheRetire(UA_Server *server, UA_ReferenceTypeCache *cache) {
+    if(!cache)
+        return;
+#ifdef UA_ENABLE_MULTITHREADING
+    if(server->workers) {
+        UA_Server_delayedCallback(server, freeReferenceTypeCache, cache);
+        return;
+    }
+#endif
+    freeReferenceTypeCache(server, cache);
+}
+
+void
+UA_ReferenceTypeCache_invalidate(UA_Server *server) {
+    /* Advance the version first. So a concurrent rebuild that started before
+     * the change notices that its cache is outdated. */
+    UA_atomic_add(&server->referenceTypeCacheVersion, 1);
+    refTypeCacheRetire(server, (UA_ReferenceTypeCache*)
+                       UA_atomic_xchg((void * volatile *)&server->referenceTypeCache, NULL));
+}
+
+/* Returns the type index + 1 or zero if the NodeId is unknown */
+static UA_UInt32
+refTypeCacheFind(const UA_ReferenceTypeCache *cache, const UA_NodeId *id) {
+    size_t mask = cache->indexSize - 1;
+    for(size_t pos = UA_NodeId_hash(id) & mask;; pos = (pos + 1) & mask) {
+        UA_UInt32 entry = cache->index[pos];
+        if(entry == 0 || UA_NodeId_equal(&cache->types[entry - 1], id))
+            return entry;
+    }
+}
+
+typedef struct {
+    UA_UInt32 parent;
+    UA_UInt32 child;
+} RefTypeEdge;
+
+static UA_StatusCode
+refTypeCacheBuild(UA_Server *server, UA_ReferenceTypeCache *cache) {
+    size_t typesCapacity = REFTYPECACHE_MINSIZE;
+    size_t edgesSize = 0, edgesCapacity = REFTYPECACHE_MINSIZE;
+    cache->indexSize = REFTYPECACHE_MINSIZE * 2;
+    cache->types = (UA_NodeId*)UA_malloc(typesCapacity * sizeof(UA_NodeId));
+    cache->index = (UA_UInt32*)UA_calloc(cache->indexSize, sizeof(UA_UInt32));
+    RefTypeEdge *edges = (RefTypeEdge*)UA_malloc(edgesCapacity * sizeof(RefTypeEdge));
+    UA_StatusCode retval = UA_STATUSCODE_BADOUTOFMEMORY;
+    if(!cache->types || !cache->index || !edges)
+        goto cleanup;
+
+    /* Breadth-first search along the forward HasSubtype references. The types
+     * array doubles as the queue. */
+    const UA_NodeId references = UA_NODEID_NUMERIC(0, UA_NS0ID_REFERENCES);
+    const UA_Node *root = UA_Nodestore_get(server, &references);
+    if(!root) {
+        retval = UA_STATUSCODE_BADNOTFOUND;
+        goto cleanup;
+    }
+    UA_Nodestore_release(server, root);
+    cache->types[0] = references;
+    cache->index[UA_NodeId_hash(&references) & (cache->indexSize - 1)] = 1;
+    cache->typesSize = 1;
+
+    for(size_t i = 0; i < cache->typesSize; ++i) {
+        const UA_Node *node = UA_Nodestore_get(server, &cache->types[i]);
+        if(!node)
+            continue;
+        for(size_t j = 0; j < node->referencesSize; ++j) {
+            UA_NodeReferenceKind *refs = &node->references[j];
+            if(refs->isInverse || !UA_NodeId_equal(&refs->referenceTypeId, &subtypeId))
+                continue;
+            for(size_t k = 0; k < refs->targetIdsSize; ++k) {
+                const UA_NodeId *target = &refs->targetIds[k].nodeId;
+                UA_UInt32 child = refTypeCacheFind(cache, target);
+                if(child == 0) {
+                    /* Grow the types array and keep the index at most half full */
+                    if(cache->typesSize >= typesCapacity) {
+                        UA_NodeId *types = (UA_NodeId*)
+                            UA_realloc(cache->types, typesCapacity * 2 * sizeof(UA_NodeId));
+                        UA_UInt32 *index = (UA_UInt32*)
+                            UA_calloc(cache->indexSize * 2, sizeof(UA_UInt32));
+                        if(!types || !index) {
+                            if(types)
+                                cache->types = types;
+                            UA_free(index);
+                            UA_Nodestore_release(server, node);
+                            goto cleanup;
+                        }
+                        cache->types = types;
+                        typesCapacity *= 2;
+                        UA_free(cache->index);
+                        cache->index = index;
+                        cache->indexSize *= 2;
+                        size_t mask = cache->indexSize - 1;
+                        for(size_t l = 0; l < cache->typesSize; ++l) {
+                            size_t pos = UA_NodeId_hash(&cache->types[l]) & mask;
+                            while(index[pos] != 0)
+                                pos = (pos + 1) & mask;
+                            index[pos] = (UA_UInt32)l + 1;
+                        }
+                    }
+                    if(UA_NodeId_copy(target, &cache->types[cache->typesSize]) !=
+                       UA_STATUSCODE_GOOD) {
+                        UA_Nodestore_release(server, node);
+                        goto cleanup;
+                    }
+                    child = (UA_UInt32)++cache->typesSize;
+                    size_t mask = cache->indexSize - 1;
+                    size_t pos = UA_NodeId_hash(target) & mask;
+                    while(cache->index[pos] != 0)
+                        pos = (pos + 1) & mask;
+                    cache->index[pos] = child;
+                }
+
+                /* Store the edge */
+                if(edgesSize >= edgesCapacity) {
+                    RefTypeEdge *e = (RefTypeEdge*)
+                        UA_realloc(edges, edgesCapacity * 2 * sizeof(RefTypeEdge));
+                    if(!e) {
+                        UA_Nodestore_release(server, node);
+                        goto cleanup;
+                    }
+                    edges = e;
+                    edgesCapacity *= 2;
+                }
+                edges[edgesSize].parent = (UA_UInt32)i;
+                edges[edgesSize].child = child - 1;
+                ++edgesSize;
+            }
+        }
+        UA_Nodestore_release(server, node);
+    }
+
+    /* Every type contains itself. Then propagate the subtypes upwards until a
+     * fixpoint is reached. Multiple inheritance is allowed for ReferenceTypes,
+     * so the edges are not necessarily sorted. */
+    size_t words = (cache->typesSize + 31) / 32;
+    cache->subtypesWords = words;
+    cache->subtypes = (UA_UInt32*)UA_calloc(cache->typesSize * words, sizeof(UA_UInt32));
+    if(!cache->subtypes)
+        goto cleanup;
+    for(size_t i = 0; i < cache->typesSize; ++i)
+        cache->subtypes[i * words + i / 32] |= (UA_UInt32)1 << (i % 32);
+    UA_Boolean changed = true;
+    while(changed) {
+        changed = false;
+        for(size_t i = 0; i < edgesSize; ++i) {
+            UA_UInt32 *parent = &cache->subtypes[edges[i].parent * words];
+            const UA_UInt32 *child = &cache->subtypes[edges[i].child * words];
+            for(size_t j = 0; j < words; ++j) {
+                UA_UInt32 merged = parent[j] | child[j];
+                if(merged != parent[j]) {
+                    parent[j] = merged;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    UA_free(edges);
+    return UA_STATUSCODE_GOOD;
+
+ cleanup:
+    UA_free(edges);
+    return retval;
+}
+
+/* Builds a new cache and publishes it. Returns NULL if the build failed or the
+ * hierarchy changed during the build. */
+static UA_ReferenceTypeCache *
+refTypeCacheRebuild(UA_Server *server) {
+    UA_UInt32 version = UA_atomic_load(&server->referenceTypeCacheVersion);
+    UA_ReferenceTypeCache *cache = (UA_ReferenceTypeCache*)
+        UA_calloc(1, sizeof(UA_ReferenceTypeCache));
+    if(!cache)
+        return NULL;
+    if(refTypeCacheBuild(server, cache) != UA_STATUSCODE_GOOD) {
+        UA_ReferenceTypeCache_delete(cache);
+        return NULL;
+    }
+
+    /* Another thread was faster */
+    UA_ReferenceTypeCache *current = (UA_ReferenceTypeCache*)
+        UA_atomic_cmpxchg((void * volatile *)&server->referenceTypeCache, NULL, cache);
+    if(current) {
+        UA_ReferenceTypeCache_delete(cache);
+        return current;
+    }
+
+    /* The cache may miss a change that was made during the build */
+    if(UA_atomic_load(&server->referenceTypeCacheVersion) != version) {
+        refTypeCacheRetire(server, (UA_ReferenceTypeCache*)
+                           UA_atomic_xchg((void * volatile *)&server->referenceTypeCache, NULL));
+        return NULL;
+    }
+    return cache;
+}
+
+UA_Boolean
+isReferenceTypeSubtype(UA_Server *server, const UA_NodeId *rootRef,
+                       const UA_NodeId *testRef) {
+    if(UA_NodeId_equal(rootRef, testRef))
+        return true;
+
+    UA_ReferenceTypeCache *cache = (UA_ReferenceTypeCache*)
+        UA_atomic_load(&server->referenceTypeCache);
+    if(!cache)
+        cache = refTypeCacheRebuild(server);
+    if(cache) {
+        UA_UInt32 root = refTypeCacheFind(cache, rootRef);
+        UA_UInt32 test = refTypeCacheFind(cache, testRef);
+        if(root != 0 && test != 0) {
+            --root;
+            --test;
+            return (cache->subtypes[root * cache->subtypesWords + test / 32] &
+                    ((UA_UInt32)1 << (test % 32))) != 0;
+        }
+    }
+
+    return isNodeInTree(&server->config.nodestore, testRef, rootRef, &subtypeId, 1);
+}
+
+/********************/
+/* DataSource Cache */
+/********************/
+
+void
+UA_DataSourceCache_init(UA_DataSourceCache *cache, size_t entriesSize,
+                        UA_Boolean perSession) {
+    memset(cache, 0, sizeof(UA_DataSourceCache));
+    if(entriesSize == 0)
+        return;
+    /* The cache is disabled if the allocation fails */
+    cache->entries = (UA_DataSourceCacheEntry*)
+        UA_calloc(entriesSize, sizeof(UA_DataSourceCacheEntry));
+    cache->generations = (UA_UInt32*)UA_calloc(entriesSize, sizeof(UA_UInt32));
+    if(!cache->entries || !cache->generations) {
+        UA_free(cache->entries);
+        UA_free(cache->generations);
+        cache->entries = NULL;
+        cache->generations = NULL;
+        return;
+    }
+    cache->entriesSize = entriesSize;
+    cache->perSession = perSession;
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_init(&cache->mutex, NULL);
+#endif
+}
+
+void
+UA_DataSourceCache_deleteMembers(UA_DataSourceCache *cache) {
+    if(!cache->entries)
+        return;
+    for(size_t i = 0; i < cache->entriesSize; i++) {
+        UA_NodeId_deleteMembers(&cache->entries[i].nodeId);
+        UA_NodeId_deleteMembers(&cache->entries[i].sessionId);
+        UA_DataValue_deleteMembers(&cache->entries[i].value);
+    }
+    UA_free(cache->entries);
+    UA_free(cache->generations);
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_destroy(&cache->mutex);
+#endif
+    memset(cache, 0, sizeof(UA_DataSourceCache));
+}
+
+static UA_UInt32 *
+dataSourceCacheGeneration(UA_DataSourceCache *cache, const UA_NodeId *nodeId) {
+    return &cache->generations[UA_NodeId_hash(nodeId) % cache->entriesSize];
+}
+
+/* In the per-session mode, the values of a variable for different sessions
+ * are spread over the slots */
+static UA_DataSourceCacheEntry *
+dataSourceCacheSlot(UA_DataSourceCache *cache, const UA_NodeId *nodeId,
+                    const UA_NodeId *sessionId) {
+    UA_UInt32 hash = UA_NodeId_hash(nodeId);
+    if(cache->perSession)
+        hash ^= UA_NodeId_hash(sessionId) * 2654435761u;
+    return &cache->entries[hash % cache->entriesSize];
+}
+
+static void
+dataSourceCacheClear(UA_DataSourceCacheEntry *entry) {
+    UA_NodeId_deleteMembers(&entry->nodeId);
+    UA_NodeId_deleteMembers(&entry->sessionId);
+    UA_DataValue_deleteMembers(&entry->value);
+}
+
+static void
+dataSourceCacheLock(UA_DataSourceCache *cache) {
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_lock(&cache->mutex);
+#endif
+}
+
+static void
+dataSourceCacheUnlock(UA_DataSourceCache *cache) {
+#ifdef UA_ENABLE_MULTITHREADING
+    pthread_mutex_unlock(&cache->mutex);
+#endif
+}
+
+UA_UInt32
+UA_DataSourceCache_generation(UA_DataSourceCache *cache, const UA_NodeId *nodeId) {
+    if(cache->entriesSize == 0)
+        return 0;
+    dataSourceCacheLock(cache);
+    UA_UInt32 generation = *dataSourceCacheGeneration(cache, nodeId);
+    dataSourceCacheUnlock(cache);
+    return generation;
+}
+
+UA_Boolean
+UA_DataSourceCache_get(UA_DataSourceCache *cache, const UA_NodeId *nodeId,
+                       const UA_NodeId *sessionId, UA_DateTime minReadTime,
+                       UA_DataValue *value) {
+    if(cache->entriesSize == 0)
+        return false;
+    UA_Boolean found = false;
+    dataSourceCacheLock(cache);
+    UA_DataSourceCacheEntry *entry = dataSourceCacheSlot(cache, nodeId, sessionId);
+    if(entry->readTime >= minReadTime &&
+       entry->generation == *dataSourceCacheGeneration(cache, nodeId) &&
+       UA_NodeId_equal(&entry->nodeId, nodeId) &&
+       (!cache->perSession || UA_NodeId_equal(&entry->sessionId, sessionId)))
+        found = (UA_DataValue_copy(&entry->value, value) == UA_STATUSCODE_GOOD);
+    dataSourceCacheUnlock(cache);
+    return found;
+}
+
+void
+UA_DataSourceCache_put(UA_DataSourceCache *cache, const UA_NodeId *nodeId,
+                       const UA_NodeId *sessionId, UA_UInt32 generation,
+                       UA_DateTime readTime, const UA_DataValue *value) {
+    if(cache->entriesSize == 0)
+        return;
+    dataSourceCacheLock(cache);
+    /* The value was changed while it was read */
+    if(generation != *dataSourceCacheGeneration(cache, nodeId)) {
+        dataSourceCacheUnlock(cache);
+        return;
+    }
+    UA_DataSourceCacheEntry *entry = dataSourceCacheSlot(cache, nodeId, sessionId);
+    dataSourceCacheClear(entry);
+    entry->generation = generation;
+    entry->readTime = readTime;
+    UA_StatusCode retval = UA_NodeId_copy(nodeId, &entry->nodeId);
+    if(cache->perSession)
+        retval |= UA_NodeId_copy(sessionId, &entry->sessionId);
+    retval |= UA_DataValue_copy(value, &entry->value);
+    if(retval != UA_STATUSCODE_GOOD)
+        dataSourceCacheClear(entry);
+    dataSourceCacheUnlock(cache);
+}
+
+/* In the per-session mode, the values for the sessions are in different
+ * slots. They are invalidated only by the generation. */
+void
+UA_DataSourceCache_remove(UA_DataSourceCache *cache, const UA_NodeId *nodeId) {
+    if(cache->entriesSize == 0)
+        return;
+    dataSourceCacheLock(cache);
+    (*dataSourceCacheGeneration(cache, nodeId))++;
+    if(!cache->perSession) {
+        UA_DataSourceCacheEntry *entry = dataSourceCacheSlot(cache, nodeId, NULL);
+        if(UA_NodeId_equal(&entry->nodeId, nodeId))
+            dataSourceCacheClear(entry);
+    }
+    dataSourceCacheUnlock(cache);
+}
+
+/******************/
+/* Batched Values */
+/******************/
+
+UA_Boolean
+UA_BatchedNodes_contains(const UA_BatchedNodes *bn, const UA_NodeId *nodeId) {
+    UA_UInt32 hash = UA_NodeId_hash(nodeId);
+    size_t lo = 0, hi = bn->hashesSize;
+    while(lo < hi) {
+        size_t mid = lo + ((hi - lo) / 2);
+        if(bn->hashes[mid] < hash)
+            lo = mid + 1;
+        else if(bn->hashes[mid] > hash)
+            hi = mid;
+        else
+            return true;
+    }
+    return false;
+}
+
+static void
+freeBatchedNodes(UA_Server *server, void *data) {
+    UA_free(data);
+}
+
+/* A hash appears once for every batched variable with that hash. So removing
+ * a variable keeps the colliding ones in the set. */
+UA_StatusCode
+UA_Server_updateBatchedNodes(UA_Server *server, const UA_NodeId *nodeId,
+                             UA_Boolean batched) {
+    UA_UInt32 hash = UA_NodeId_hash(nodeId);
+    UA_BatchedNodes *bn;
+    UA_BatchedNodes *newBn;
+    do {
+        bn = (UA_BatchedNodes*)UA_atomic_load(&server->batchedNodes);
+        size_t oldSize = bn ? bn->hashesSize : 0;
+        size_t pos = 0; /* First hash that is not smaller */
+        while(pos < oldSize && bn->hashes[pos] < hash)
+            pos++;
+        if(!batched && (pos == oldSize || bn->hashes[pos] != hash))
+            return UA_STATUSCODE_GOOD; /* Not contained */
+
+        /* The set is empty after the last variable is removed */
+        size_t newSize = batched ? oldSize + 1 : oldSize - 1;
+        newBn = NULL;
+        if(newSize > 0) {
+            newBn = (UA_BatchedNodes*)
+                UA_malloc(sizeof(UA_BatchedNodes) + (newSize * sizeof(UA_UInt32)));
+            if(!newBn)
+                return UA_STATUSCODE_BADOUTOFMEMORY;
+            newBn->hashesSize = newSize;
+            if(pos > 0)
+                memcpy(newBn->hashes, bn->hashes, pos * sizeof(UA_UInt32));
+            if(batched) {
+                newBn->hashes[pos] = hash;
+                if(oldSize > pos)
+                    memcpy(&newBn->hashes[pos+1], &bn->hashes[pos],
+                           (oldSize - pos) * sizeof(UA_UInt32));
+            } else if(oldSize > pos + 1) {
+                memcpy(&newBn->hashes[pos], &bn->hashes[pos+1],
+                       (oldSize - pos - 1) * sizeof(UA_UInt32));
+            }
+        }
+
+        /* Retry if the set was replaced concurrently */
+        if(UA_atomic_cmpxchg((void * volatile *)&server->batchedNodes,
+                             bn, newBn) == bn)
+            break;
+        UA_free(newBn);
+    } while(true);
+
+    if(!bn)
+        return UA_STATUSCODE_GOOD;
+
+    /* Readers may still use the old set */
+#ifdef UA_ENABLE_MULTITHREADING
+    if(server->workers) {
+        UA_Server_delayedCallback(server, freeBatchedNodes, bn);
+        return UA_STATUSCODE_GOOD;
+    }
+#endif
+    freeBatchedNodes(server, bn);
     return UA_STATUSCODE_GOOD;
 }
 
@@ -2,97 +2,432 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+/* Enable POSIX features */
+#ifndef _XOPEN_SOURCE
+# define _XOPEN_SOURCE 600
+#endif
+#ifndef _DEFAULT_SOURCE
+# define _DEFAULT_SOURCE
+#endif
+/* On older systems we need to define _BSD_SOURCE.
+ * _DEFAULT_SOURCE is an alias for that. */
+#ifndef _BSD_SOURCE
+# define _BSD_SOURCE
+#endif
+
 #include "ua_util.h"
 #include "ua_server_internal.h"
 
+#ifdef UA_ENABLE_MULTITHREADING
+# include <time.h>
+#endif
+
 #define UA_MAXTIMEOUT 50 /* Max timeout in ms between main-loop iterations */
 
 /**
- * Worker Threads and Dispatch Queue
- * ---------------------------------
- * The worker threads dequeue callbacks from a central Multi-Producer
- * Multi-Consumer Queue (MPMC). When there are no callbacks, workers go idle.
- * The condition to wake them up is triggered whenever a callback is
- * dispatched.
+ * Worker Threads and Work Stealing
+ * --------------------------------
+ * Every worker thread has its own queue of dispatched callbacks. Callbacks
+ * dispatched from a worker thread go to the queue of that worker. Callbacks
+ * dispatched from other threads (e.g. the network layer in the main loop) are
+ * distributed round-robin. A worker takes the callbacks from the front of its
+ * own queue. When its queue is empty, the worker steals from the front of the
+ * other queues. Only then does it go idle. Every dispatch wakes up at most one
+ * idle worker: the owner of the queue if it sleeps, otherwise one of the idle
+ * workers to steal the callback.
+ *
+ * Every queue has its own mutex. So the workers only contend when they steal
+ * from each other. The queues are FIFO also for the owner. Then requests are
+ * processed in the order of arrival and the progress of the queues can be
+ * tracked for the delayed callbacks (see below).
+ *
+ * Callbacks with an affinity (the messages of a connection) go to a second
+ * queue of the worker selected by the affinity. That queue is never stolen
+ * from. So the messages of a SecureChannel are processed in order by the same
+ * thread and the channel state stays in the caches of one core.
  *
- * Future Plans: Use work-stealing to load-balance between cores.
- * Le, Nhat Minh, et al. "Correct and efficient work-stealing for weak memory
- * models." ACM SIGPLAN Notices. Vol. 48. No. 8. ACM, 2013. */
+ * The callback entries are pooled. Every worker keeps a small cache of free
+ * entries. Entries beyond that are returned to a pool shared by all threads.
+ *
+ * The first entry of a queue and the sleeping flag are peeked at without the
+ * lock. They are written with atomic stores. */
 
 #ifdef UA_ENABLE_MULTITHREADING
 
+#define UA_WORKER_CACHESIZE 64     /* Free entries cached per worker */
+#define UA_CALLBACKPOOL_MAXSIZE 1024 /* Free entries in the shared pool */
+#define UA_DELAYED_CHECKINTERVAL 1 /* Max ms between checks of parked delayed
+                                    * callbacks in an idle worker */
+
+typedef struct {
+    UA_WorkerCallback * volatile first;
+    UA_WorkerCallback *last;
+    volatile size_t enqueued; /* Callbacks that were ever enqueued */
+    volatile size_t dequeued; /* Callbacks that were ever dequeued */
+} UA_WorkerQueue;
+
 struct UA_Worker {
     UA_Server *server;
     pthread_t thr;
-    UA_UInt32 counter;
+    volatile UA_UInt32 counter; /* Advanced in every iteration of the loop */
     volatile UA_Boolean running;
 
-    /* separate cache lines */
-    char padding[64 - sizeof(void*) - sizeof(pthread_t) -
-                 sizeof(UA_UInt32) - sizeof(UA_Boolean)];
+    /* The queues and the sleeping flag are protected by the mutex. Peek with
+     * UA_atomic_load. */
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    volatile UA_Boolean sleeping;
+    UA_WorkerQueue queue;  /* Can be stolen from */
+    UA_WorkerQueue pinned; /* Callbacks with an affinity to the worker */
+
+    /* Free entries. Only accessed from the worker thread. */
+    UA_WorkerCallback *cache;
+    size_t cacheSize;
+
+    /* Delayed callbacks that are not ready yet. Only accessed from the worker
+     * thread. */
+    UA_WorkerCallback *parked;
 };
 
+/* Position of the queue and counter of a worker when a delayed callback was
+ * dispatched */
 typedef struct {
-    struct cds_wfcq_node node;
+    size_t enqueued;
+    size_t pinnedEnqueued;
+    UA_UInt32 counter;
+} UA_WorkerMark;
+
+struct UA_WorkerCallback {
+    UA_WorkerCallback *next;
     UA_ServerCallback callback;
     void *data;
 
     UA_Boolean delayed;         /* Is it a delayed callback? */
-    UA_Boolean countersSampled; /* Have the worker counters been sampled? */
-    UA_UInt32 workerCounters[]; /* Counter value for each worker */
-} WorkerCallback; 
+    UA_Boolean queuesPassed;    /* Were all prior callbacks dequeued? */
+    UA_WorkerMark marks[];      /* For each worker (only for delayed callbacks) */
+};
+
+/* The worker of the current thread */
+static UA_THREAD_LOCAL UA_Worker *currentWorker;
+
+static UA_Worker *
+getCurrentWorker(UA_Server *server) {
+    if(currentWorker && currentWorker->server == server)
+        return currentWorker;
+    return NULL;
+}
+
+static UA_WorkerCallback *
+newCallbackEntry(UA_Server *server) {
+    UA_WorkerCallback *wc;
+    UA_Worker *worker = getCurrentWorker(server);
+    if(worker && worker->cache) {
+        wc = worker->cache;
+        worker->cache = wc->next;
+        worker->cacheSize--;
+        return wc;
+    }
+
+    pthread_mutex_lock(&server->callbackPoolMutex);
+    wc = server->callbackPool;
+    if(wc) {
+        server->callbackPool = wc->next;
+        server->callbackPoolSize--;
+    }
+    pthread_mutex_unlock(&server->callbackPoolMutex);
+    if(wc)
+        return wc;
+    return (UA_WorkerCallback*)UA_malloc(sizeof(UA_WorkerCallback));
+}
+
+static void
+releaseCallbackEntry(UA_Server *server, UA_WorkerCallback *wc) {
+    /* Delayed callbacks have a different size */
+    if(wc->delayed) {
+        UA_free(wc);
+        return;
+    }
+
+    UA_Worker *worker = getCurrentWorker(server);
+    if(worker && worker->cacheSize < UA_WORKER_CACHESIZE) {
+        wc->next = worker->cache;
+        worker->cache = wc;
+        worker->cacheSize++;
+        return;
+    }
+
+    pthread_mutex_lock(&server->callbackPoolMutex);
+    if(server->callbackPoolSize < UA_CALLBACKPOOL_MAXSIZE) {
+        wc->next = server->callbackPool;
+        server->callbackPool = wc;
+        server->callbackPoolSize++;
+        wc = NULL;
+    }
+    pthread_mutex_unlock(&server->callbackPoolMutex);
+    UA_free(wc);
+}
+
+static void
+queuePush(UA_WorkerQueue *queue, UA_WorkerCallback *wc) {
+    wc->next = NULL;
+    if(queue->last)
+        queue->last->next = wc;
+    else
+        UA_atomic_store(&queue->first, wc);
+    queue->last = wc;
+    queue->enqueued++;
+}
+
+static UA_WorkerCallback *
+queuePop(UA_WorkerQueue *queue) {
+    UA_WorkerCallback *wc = queue->first;
+    if(wc) {
+        UA_atomic_store(&queue->first, wc->next);
+        if(!wc->next)
+            queue->last = NULL;
+        queue->dequeued++;
+    }
+    return wc;
+}
+
+/* The pinned callbacks come first. Only the owner takes them. */
+static UA_WorkerCallback *
+dequeueCallback(UA_Worker *worker, UA_Boolean owner) {
+    pthread_mutex_lock(&worker->mutex);
+    UA_WorkerCallback *wc = NULL;
+    if(owner)
+        wc = queuePop(&worker->pinned);
+    if(!wc)
+        wc = queuePop(&worker->queue);
+    pthread_mutex_unlock(&worker->mutex);
+    return wc;
+}
+
+/* Steal from the other workers, starting with the next one */
+static UA_WorkerCallback *
+stealCallback(UA_Server *server, UA_Worker *thief) {
+    size_t nThreads = server->config.nThreads;
+    size_t index = (size_t)(thief - server->workers);
+    for(size_t i = 1; i < nThreads; i++) {
+        UA_Worker *victim = &server->workers[(index + i) % nThreads];
+        if(!UA_atomic_load(&victim->queue.first))
+            continue; /* Don't take the lock if the queue looks empty */
+        UA_WorkerCallback *wc = dequeueCallback(victim, false);
+        if(wc)
+            return wc;
+    }
+    return NULL;
+}
+
+/* Returns whether the worker was sleeping */
+static UA_Boolean
+wakeWorker(UA_Worker *worker) {
+    pthread_mutex_lock(&worker->mutex);
+    UA_Boolean sleeping = worker->sleeping;
+    if(sleeping) {
+        /* Claim the worker. So that other dispatches wake up another one. */
+        UA_atomic_store(&worker->sleeping, false);
+        pthread_cond_signal(&worker->condition);
+    }
+    pthread_mutex_unlock(&worker->mutex);
+    return sleeping;
+}
+
+static void
+wakeIdleWorker(UA_Server *server, UA_Worker *except) {
+    for(size_t i = 0; i < server->config.nThreads; i++) {
+        UA_Worker *worker = &server->workers[i];
+        if(worker == except || !UA_atomic_load(&worker->sleeping))
+            continue; /* Don't take the lock if the worker looks busy */
+        if(wakeWorker(worker))
+            return;
+    }
+}
+
+static void
+enqueueCallback(UA_Server *server, UA_WorkerCallback *wc, UA_Boolean wakeup) {
+    /* Keep the callback in the current worker or distribute round-robin */
+    UA_Worker *worker = getCurrentWorker(server);
+    if(!worker) {
+        UA_UInt32 next = UA_atomic_add(&server->nextWorker, 1);
+        worker = &server->workers[next % server->config.nThreads];
+    }
+
+    pthread_mutex_lock(&worker->mutex);
+    queuePush(&worker->queue, wc);
+    UA_Boolean sleeping = worker->sleeping;
+    if(sleeping && wakeup) {
+        UA_atomic_store(&worker->sleeping, false);
+        pthread_cond_signal(&worker->condition);
+    }
+    pthread_mutex_unlock(&worker->mutex);
+
+    /* The owner is busy. Wake up an idle worker to steal the callback. */
+    if(!sleeping && wakeup)
+        wakeIdleWorker(server, worker);
+}
+
+/* The callback can only be executed by the selected worker. So the owner is
+ * woken up if it sleeps. But not the others. */
+static void
+enqueuePinnedCallback(UA_Server *server, UA_WorkerCallback *wc, UA_UInt32 affinity) {
+    UA_Worker *worker = &server->workers[affinity % server->config.nThreads];
+    pthread_mutex_lock(&worker->mutex);
+    queuePush(&worker->pinned, wc);
+    if(worker->sleeping) {
+        UA_atomic_store(&worker->sleeping, false);
+        pthread_cond_signal(&worker->condition);
+    }
+    pthread_mutex_unlock(&worker->mutex);
+}
 
 /* Forward Declaration */
+static UA_Boolean
+delayedCallbackReady(UA_Server *server, UA_WorkerCallback *wc);
+
+/* Execute the parked delayed callbacks that have become ready */
 static void
-processDelayedCallback(UA_Server *server, WorkerCallback *dc);
+processParkedCallbacks(UA_Server *server, UA_Worker *worker) {
+    UA_WorkerCallback **next = &worker->parked;
+    while(*next) {
+        UA_WorkerCallback *wc = *next;
+        if(!delayedCallbackReady(server, wc)) {
+            next = &wc->next;
+            continue;
+        }
+        *next = wc->next;
+        wc->callback(server, wc->data);
+        UA_free(wc);
+    }
+}
+
+/* Sleep until a callback is dispatched to this worker or the worker is woken
+ * up to steal. With parked delayed callbacks, wake up regularly to check them
+ * again. */
+static void
+workerSleep(UA_Worker *worker) {
+    pthread_mutex_lock(&worker->mutex);
+    UA_atomic_store(&worker->sleeping, true);
+    if(!worker->parked) {
+        while(worker->sleeping && worker->running &&
+              !worker->queue.first && !worker->pinned.first)
+            pthread_cond_wait(&worker->condition, &worker->mutex);
+    } else if(worker->running && !worker->queue.first && !worker->pinned.first) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += UA_DELAYED_CHECKINTERVAL * 1000000L;
+        if(ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&worker->condition, &worker->mutex, &ts);
+    }
+    UA_atomic_store(&worker->sleeping, false);
+    pthread_mutex_unlock(&worker->mutex);
+}
 
 static void *
 workerLoop(UA_Worker *worker) {
     UA_Server *server = worker->server;
-    UA_UInt32 *counter = &worker->counter;
-    volatile UA_Boolean *running = &worker->running;
+    currentWorker = worker;
 
     /* Initialize the (thread local) random seed with the ram address
      * of the worker. Not for security-critical entropy! */
     UA_random_seed((uintptr_t)worker);
 
-    while(*running) {
-        UA_atomic_add(counter, 1);
-        WorkerCallback *dc = (WorkerCallback*)
-            cds_wfcq_dequeue_blocking(&server->dispatchQueue_head,
-                                      &server->dispatchQueue_tail);
-        if(!dc) {
-            /* Nothing to do. Sleep until a callback is dispatched */
-            pthread_mutex_lock(&server->dispatchQueue_mutex);
-            pthread_cond_wait(&server->dispatchQueue_condition,
-                              &server->dispatchQueue_mutex);
-            pthread_mutex_unlock(&server->dispatchQueue_mutex);
+    while(UA_atomic_load(&worker->running)) {
+        UA_atomic_add(&worker->counter, 1);
+        if(worker->parked)
+            processParkedCallbacks(server, worker);
+
+        UA_WorkerCallback *wc = dequeueCallback(worker, true);
+        if(!wc)
+            wc = stealCallback(server, worker);
+
+        if(!wc) {
+            workerSleep(worker);
             continue;
         }
 
-        if(dc->delayed) {
-            processDelayedCallback(server, dc);
+        /* Park the delayed callback until it is ready */
+        if(wc->delayed) {
+            wc->next = worker->parked;
+            worker->parked = wc;
             continue;
         }
-        
-        dc->callback(server, dc->data);
-        UA_free(dc);
+
+        wc->callback(server, wc->data);
+        releaseCallbackEntry(server, wc);
     }
 
+    currentWorker = NULL;
     UA_LOG_DEBUG(server->config.logger, UA_LOGCATEGORY_SERVER,
                  "Worker shut down");
     return NULL;
 }
 
+/* Move the parked callbacks of a worker to the end of the queue. The parked
+ * list has the newest callback first. */
 static void
-emptyDispatchQueue(UA_Server *server) {
-    while(!cds_wfcq_empty(&server->dispatchQueue_head,
-                          &server->dispatchQueue_tail)) {
-        WorkerCallback *dc = (WorkerCallback*)
-            cds_wfcq_dequeue_blocking(&server->dispatchQueue_head,
-                                      &server->dispatchQueue_tail);
-        dc->callback(server, dc->data);
-        UA_free(dc);
+moveParkedCallbacks(UA_Worker *worker, UA_WorkerQueue *queue) {
+    UA_WorkerCallback *reversed = NULL;
+    while(worker->parked) {
+        UA_WorkerCallback *wc = worker->parked;
+        worker->parked = wc->next;
+        wc->next = reversed;
+        reversed = wc;
+    }
+    while(reversed) {
+        UA_WorkerCallback *wc = reversed;
+        reversed = wc->next;
+        queuePush(queue, wc);
+    }
+}
+
+/* Execute the remaining callbacks after the workers have stopped. The
+ * callbacks may dispatch further callbacks. The delayed callbacks are set aside
+ * when they are dequeued. One delayed callback is executed only when all
+ * (pinned) queues are empty. So it still runs after the callbacks that were
+ * dispatched before it, also when these are in the queue of another worker. */
+static void
+emptyWorkerQueues(UA_Server *server) {
+    UA_WorkerQueue delayed;
+    memset(&delayed, 0, sizeof(UA_WorkerQueue));
+    for(size_t i = 0; i < server->config.nThreads; ++i)
+        moveParkedCallbacks(&server->workers[i], &delayed);
+
+    while(true) {
+        UA_Boolean found = false;
+        for(size_t i = 0; i < server->config.nThreads; ++i) {
+            UA_WorkerCallback *wc;
+            while((wc = dequeueCallback(&server->workers[i], true))) {
+                found = true;
+                if(wc->delayed) {
+                    queuePush(&delayed, wc);
+                    continue;
+                }
+                wc->callback(server, wc->data);
+                releaseCallbackEntry(server, wc);
+            }
+        }
+        if(found)
+            continue;
+
+        /* The queues are empty. Execute the oldest delayed callback. */
+        UA_WorkerCallback *wc = queuePop(&delayed);
+        if(!wc)
+            break;
+        wc->callback(server, wc->data);
+        UA_free(wc);
+    }
+}
+
+static void
+deleteCallbackEntries(UA_WorkerCallback *wc) {
+    while(wc) {
+        UA_WorkerCallback *next = wc->next;
+        UA_free(wc);
+        wc = next;
     }
 }
 
@@ -108,28 +443,42 @@ emptyDispatchQueue(UA_Server *server) {
 void
 UA_Server_workerCallback(UA_Server *server, UA_ServerCallback callback,
                          void *data) {
-#ifndef UA_ENABLE_MULTITHREADING
-    /* Execute immediately */
-    callback(server, data);
-#else
-    /* Execute immediately if memory could not be allocated */
-    WorkerCallback *dc = (WorkerCallback*)UA_malloc(sizeof(WorkerCallback));
-    if(!dc) {
-        callback(server, data);
-        return;
+#ifdef UA_ENABLE_MULTITHREADING
+    /* Enqueue for the worker threads */
+    if(server->workers) {
+        UA_WorkerCallback *wc = newCallbackEntry(server);
+        if(wc) {
+            wc->callback = callback;
+            wc->data = data;
+            wc->delayed = false;
+            enqueueCallback(server, wc, true);
+            return;
+        }
     }
+#endif
 
-    /* Enqueue for the worker threads */
-    dc->callback = callback;
-    dc->data = data;
-    dc->delayed = false;
-    cds_wfcq_node_init(&dc->node);
-    cds_wfcq_enqueue(&server->dispatchQueue_head,
-                     &server->dispatchQueue_tail, &dc->node);
+    /* Execute immediately if the workers are not running or if memory could
+     * not be allocated */
+    callback(server, data);
+}
 
-    /* Wake up sleeping workers */
-    pthread_cond_broadcast(&server->dispatchQueue_condition);
+void
+UA_Server_workerCallbackAffine(UA_Server *server, UA_UInt32 affinity,
+                               UA_ServerCallback callback, void *data) {
+#ifdef UA_ENABLE_MULTITHREADING
+    if(server->workers) {
+        UA_WorkerCallback *wc = newCallbackEntry(server);
+        if(wc) {
+            wc->callback = callback;
+            wc->data = data;
+            wc->delayed = false;
+            enqueuePinnedCallback(server, wc, affinity);
+            return;
+        }
+    }
 #endif
+
+    callback(server, data);
 }
 
 /**
@@ -139,18 +488,25 @@ UA_Server_workerCallback(UA_Server *server, UA_ServerCallback callback,
  * Delayed Callbacks are called only when all callbacks that were dispatched
  * prior are finished. In the single-threaded case, the callback is added to a
  * singly-linked list that is processed at the end of the server's main-loop. In
- * the multi-threaded case, the delay is ensure by a three-step procedure:
+ * the multi-threaded case, the delay is ensured by a three-step procedure:
  *
- * 1. The delayed callback is dispatched to the worker queue. So it is only
- *    dequeued when all prior callbacks have been dequeued.
+ * 1. When the callback is dispatched, the number of callbacks that were ever
+ *    enqueued is sampled for every worker queue (including the pinned ones).
  *
- * 2. When the callback is first dequeued by a worker, sample the counter of all
- *    workers. Once all counters have advanced, the callback is ready.
+ * 2. The callback is checked by a worker. Once every queue has dequeued the
+ *    sampled number of callbacks, the prior callbacks have all started. Then
+ *    the counters of all workers are sampled. Once all counters have advanced
+ *    (or the worker sleeps), the prior callbacks have finished and the callback
+ *    is ready.
  *
- * 3. Check regularly if the callback is ready by adding it back to the dispatch
- *    queue. */
-
-#ifndef UA_ENABLE_MULTITHREADING
+ * 3. The worker that takes the callback from the queue parks it in a list of
+ *    pending delayed callbacks. The list is checked in every iteration of the
+ *    worker loop. An idle worker with parked callbacks does not sleep
+ *    indefinitely but wakes up every UA_DELAYED_CHECKINTERVAL ms to check
+ *    them again.
+ *
+ * When the workers are not running, the delayed callbacks are kept in the
+ * list until the server is started or stopped. */
 
 typedef struct UA_DelayedCallback {
     SLIST_ENTRY(UA_DelayedCallback) next;
@@ -158,9 +514,8 @@ typedef struct UA_DelayedCallback {
     void *data;
 } UA_DelayedCallback;
 
-UA_StatusCode
-UA_Server_delayedCallback(UA_Server *server, UA_ServerCallback callback,
-                          void *data) {
+static UA_StatusCode
+addDelayedCallback(UA_Server *server, UA_ServerCallback callback, void *data) {
     UA_DelayedCallback *dc =
         (UA_DelayedCallback*)UA_malloc(sizeof(UA_DelayedCallback));
     if(!dc)
@@ -182,75 +537,88 @@ processDelayedCallbacks(UA_Server *server) {
     }
 }
 
+#ifndef UA_ENABLE_MULTITHREADING
+
+UA_StatusCode
+UA_Server_delayedCallback(UA_Server *server, UA_ServerCallback callback,
+                          void *data) {
+    return addDelayedCallback(server, callback, data);
+}
+
 #else /* UA_ENABLE_MULTITHREADING */
 
 UA_StatusCode
 UA_Server_delayedCallback(UA_Server *server, UA_ServerCallback callback,
                           void *data) {
-    size_t dcsize = sizeof(WorkerCallback) +
-        (sizeof(UA_UInt32) * server->config.nThreads);
-    WorkerCallback *dc = (WorkerCallback*)UA_malloc(dcsize);
-    if(!dc)
+    if(!server->workers)
+        return addDelayedCallback(server, callback, data);
+
+    size_t wcsize = sizeof(UA_WorkerCallback) +
+        (sizeof(UA_WorkerMark) * server->config.nThreads);
+    UA_WorkerCallback *wc = (UA_WorkerCallback*)UA_malloc(wcsize);
+    if(!wc)
         return UA_STATUSCODE_BADOUTOFMEMORY;
 
-    /* Enqueue for the worker threads */
-    dc->callback = callback;
-    dc->data = data;
-    dc->delayed = true;
-    dc->countersSampled = false;
-    cds_wfcq_node_init(&dc->node);
-    cds_wfcq_enqueue(&server->dispatchQueue_head,
-                     &server->dispatchQueue_tail, &dc->node);
-
-    /* Wake up sleeping workers */
-    pthread_cond_broadcast(&server->dispatchQueue_condition);
-    return UA_STATUSCODE_GOOD;
-}
+    wc->callback = callback;
+    wc->data = data;
+    wc->delayed = true;
+    wc->queuesPassed = false;
 
-/* Called from the worker loop */
-static void
-processDelayedCallback(UA_Server *server, WorkerCallback *dc) {
-    /* Set the worker counters */
-    if(!dc->countersSampled) {
-        for(size_t i = 0; i < server->config.nThreads; ++i)
-            dc->workerCounters[i] = server->workers[i].counter;
-        dc->countersSampled = true;
+    /* Sample the queue positions */
+    for(size_t i = 0; i < server->config.nThreads; ++i) {
+        UA_Worker *worker = &server->workers[i];
+        pthread_mutex_lock(&worker->mutex);
+        wc->marks[i].enqueued = worker->queue.enqueued;
+        wc->marks[i].pinnedEnqueued = worker->pinned.enqueued;
+        pthread_mutex_unlock(&worker->mutex);
+    }
 
-        /* Re-add to the dispatch queue */
-        cds_wfcq_node_init(&dc->node);
-        cds_wfcq_enqueue(&server->dispatchQueue_head,
-                         &server->dispatchQueue_tail, &dc->node);
+    enqueueCallback(server, wc, true);
+    return UA_STATUSCODE_GOOD;
+}
 
-        /* Wake up sleeping workers */
-        pthread_cond_broadcast(&server->dispatchQueue_condition);
-        return;
-    }
+/* Are callbacks up to the sampled position still in the queue? The counters
+ * may wrap around. */
+static UA_Boolean
+queuePending(size_t enqueued, const UA_WorkerQueue *queue) {
+    size_t pending = enqueued - queue->dequeued;
+    return (pending != 0 && pending <= (~(size_t)0) / 2);
+}
 
-    /* Have all other jobs finished? */
-    UA_Boolean ready = true;
-    for(size_t i = 0; i < server->config.nThreads; ++i) {
-        if(dc->workerCounters[i] == server->workers[i].counter) {
-            ready = false;
-            break;
+/* Called from the worker loop for the parked callbacks. Advances the state of
+ * the callback and returns whether it is ready for execution. */
+static UA_Boolean
+delayedCallbackReady(UA_Server *server, UA_WorkerCallback *wc) {
+    size_t nThreads = server->config.nThreads;
+
+    /* Have all prior callbacks been dequeued? */
+    if(!wc->queuesPassed) {
+        for(size_t i = 0; i < nThreads; ++i) {
+            UA_Worker *worker = &server->workers[i];
+            pthread_mutex_lock(&worker->mutex);
+            UA_Boolean pending =
+                queuePending(wc->marks[i].enqueued, &worker->queue) ||
+                queuePending(wc->marks[i].pinnedEnqueued, &worker->pinned);
+            pthread_mutex_unlock(&worker->mutex);
+            if(pending)
+                return false;
         }
-    }
 
-    /* Re-add to the dispatch queue.
-     * TODO: What is the impact of this loop?
-     * Can we add a small delay here? */
-    if(!ready) {
-        cds_wfcq_node_init(&dc->node);
-        cds_wfcq_enqueue(&server->dispatchQueue_head,
-                         &server->dispatchQueue_tail, &dc->node);
+        /* Sample the worker counters. Check again in the next iteration. */
+        for(size_t i = 0; i < nThreads; ++i)
+            wc->marks[i].counter = UA_atomic_load(&server->workers[i].counter);
+        wc->queuesPassed = true;
+        return false;
+    }
 
-        /* Wake up sleeping workers */
-        pthread_cond_broadcast(&server->dispatchQueue_condition);
-        return;
+    /* Have all prior callbacks finished? */
+    for(size_t i = 0; i < nThreads; ++i) {
+        UA_Worker *worker = &server->workers[i];
+        if(wc->marks[i].counter == UA_atomic_load(&worker->counter) &&
+           !UA_atomic_load(&worker->sleeping))
+            return false;
     }
-        
-    /* Execute the callback */
-    dc->callback(server, dc->data);
-    UA_free(dc);
+    return true;
 }
 
 #endif
@@ -285,22 +653,30 @@ UA_Server_run_startup(UA_Server *server) {
         result |= nl->start(nl, &server->config.customHostname);
     }
 
+    /* Nothing can be pending when the workers are not running */
+    processDelayedCallbacks(server);
+
     /* Spin up the worker threads */
 #ifdef UA_ENABLE_MULTITHREADING
+    if(server->config.nThreads == 0)
+        return result;
     UA_LOG_INFO(server->config.logger, UA_LOGCATEGORY_SERVER,
                 "Spinning up %u worker thread(s)", server->config.nThreads);
-    pthread_cond_init(&server->dispatchQueue_condition, 0);
-    pthread_mutex_init(&server->dispatchQueue_mutex, 0);
-    server->workers = (UA_Worker*)UA_malloc(server->config.nThreads * sizeof(UA_Worker));
-    if(!server->workers)
+    UA_Worker *workers = (UA_Worker*)
+        UA_calloc(server->config.nThreads, sizeof(UA_Worker));
+    if(!workers)
         return UA_STATUSCODE_BADOUTOFMEMORY;
+    pthread_mutex_init(&server->callbackPoolMutex, NULL);
     for(size_t i = 0; i < server->config.nThreads; ++i) {
-        UA_Worker *worker = &server->workers[i];
+        UA_Worker *worker = &workers[i];
         worker->server = server;
-        worker->counter = 0;
         worker->running = true;
-        pthread_create(&worker->thr, NULL, (void* (*)(void*))workerLoop, worker);
+        pthread_mutex_init(&worker->mutex, NULL);
+        pthread_cond_init(&worker->condition, NULL);
     }
+    server->workers = workers;
+    for(size_t i = 0; i < server->config.nThreads; ++i)
+        pthread_create(&workers[i].thr, NULL, (void* (*)(void*))workerLoop, &workers[i]);
 #endif
 
     /* Start the multicast discovery server */
@@ -375,30 +751,44 @@ UA_Server_run_shutdown(UA_Server *server) {
         nl->stop(nl, server);
     }
 
-#ifndef UA_ENABLE_MULTITHREADING
-    /* Process remaining delayed callbacks */
-    processDelayedCallbacks(server);
-#else
+#ifdef UA_ENABLE_MULTITHREADING
     /* Shut down the workers */
     if(server->workers) {
         UA_LOG_INFO(server->config.logger, UA_LOGCATEGORY_SERVER,
                     "Shutting down %u worker thread(s)",
                     server->config.nThreads);
-        for(size_t i = 0; i < server->config.nThreads; ++i)
-            server->workers[i].running = false;
-        pthread_cond_broadcast(&server->dispatchQueue_condition);
+        for(size_t i = 0; i < server->config.nThreads; ++i) {
+            UA_Worker *worker = &server->workers[i];
+            pthread_mutex_lock(&worker->mutex);
+            UA_atomic_store(&worker->running, false);
+            pthread_cond_signal(&worker->condition);
+            pthread_mutex_unlock(&worker->mutex);
+        }
         for(size_t i = 0; i < server->config.nThreads; ++i)
             pthread_join(server->workers[i].thr, NULL);
+
+        /* Execute the remaining callbacks in the worker queues.
+         * This also executes the delayed callbacks. */
+        emptyWorkerQueues(server);
+
+        for(size_t i = 0; i < server->config.nThreads; ++i) {
+            UA_Worker *worker = &server->workers[i];
+            deleteCallbackEntries(worker->cache);
+            pthread_cond_destroy(&worker->condition);
+            pthread_mutex_destroy(&worker->mutex);
+        }
         UA_free(server->workers);
         server->workers = NULL;
+        deleteCallbackEntries(server->callbackPool);
+        server->callbackPool = NULL;
+        server->callbackPoolSize = 0;
+        pthread_mutex_destroy(&server->callbackPoolMutex);
     }
-
-    /* Execute the remaining callbacks in the dispatch queue.
-     * This also executes the delayed callbacks. */
-    emptyDispatchQueue(server);
-    
 #endif
 
+    /* Process remaining delayed callbacks */
+    processDelayedCallbacks(server);
+
     /* Stop multicast discovery */
 #ifdef UA_ENABLE_DISCOVERY_MULTICAST
     if(server->config.applicationDescription.applicationType ==
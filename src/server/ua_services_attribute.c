@@ -4,6 +4,9 @@
 
 #include "ua_server_internal.h"
 #include "ua_services.h"
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+#include "ua_subscription.h"
+#endif
 
 /******************/
 /* Access Control */
@@ -37,6 +40,21 @@ getUserAccessLevel(UA_Server *server, const UA_Session *session,
                                                         &node->nodeId, node->context);
 }
 
+UA_Boolean
+readValueAllowed(UA_Server *server, UA_Session *session, const UA_NodeId *nodeId) {
+    if(session == &adminSession)
+        return true;
+    const UA_Node *node = UA_Nodestore_get(server, nodeId);
+    if(!node)
+        return true; /* The read itself returns the error */
+    UA_Boolean allowed = true;
+    if(node->nodeClass == UA_NODECLASS_VARIABLE)
+        allowed = (getUserAccessLevel(server, session, (const UA_VariableNode*)node) &
+                   UA_ACCESSLEVELMASK_READ) != 0;
+    UA_Nodestore_release(server, node);
+    return allowed;
+}
+
 static UA_Boolean
 getUserExecutable(UA_Server *server, const UA_Session *session,
                   const UA_MethodNode *node) {
@@ -102,23 +120,65 @@ readValueAttributeFromNode(UA_Server *server, UA_Session *session,
     return UA_STATUSCODE_GOOD;
 }
 
+/* Can the value be served from the DataSource cache? Then returns the oldest
+ * read time of a cached value that is fresh enough. Only entire values are
+ * cached. */
+static UA_Boolean
+dataSourceCacheMinReadTime(UA_Server *server, const UA_VariableNode *vn,
+                           UA_Double maxAge, UA_DateTime now,
+                           UA_DateTime *minReadTime) {
+    /* A maxAge of zero always reads a new value */
+    if(maxAge <= 0.0 || vn->nodeClass != UA_NODECLASS_VARIABLE ||
+       server->dataSourceCache.entriesSize == 0)
+        return false;
+
+    /* A maxAge of Int32 max and more accepts any cached value */
+    if(maxAge > UA_INT32_MAX)
+        maxAge = UA_INT32_MAX;
+    *minReadTime = now - (UA_DateTime)(maxAge * UA_MSEC_TO_DATETIME);
+    return true;
+}
+
 static UA_StatusCode
 readValueAttributeFromDataSource(UA_Server *server, UA_Session *session,
                                  const UA_VariableNode *vn, UA_DataValue *v,
                                  UA_TimestampsToReturn timestamps,
-                                 UA_NumericRange *rangeptr) {
+                                 UA_NumericRange *rangeptr, UA_Double maxAge) {
     if(!vn->value.dataSource.read)
         return UA_STATUSCODE_BADINTERNALERROR;
-    UA_Boolean sourceTimeStamp = (timestamps == UA_TIMESTAMPSTORETURN_SOURCE ||
-                                  timestamps == UA_TIMESTAMPSTORETURN_BOTH);
-    return vn->value.dataSource.read(server, &session->sessionId, session->sessionHandle,
-                                     &vn->nodeId, vn->context, sourceTimeStamp, rangeptr, v);
+
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    UA_DateTime minReadTime;
+    if(rangeptr || !dataSourceCacheMinReadTime(server, vn, maxAge, now, &minReadTime)) {
+        UA_Boolean sourceTimeStamp = (timestamps == UA_TIMESTAMPSTORETURN_SOURCE ||
+                                      timestamps == UA_TIMESTAMPSTORETURN_BOTH);
+        return vn->value.dataSource.read(server, &session->sessionId, session->sessionHandle,
+                                         &vn->nodeId, vn->context, sourceTimeStamp,
+                                         rangeptr, v);
+    }
+
+    /* Serve from the cache if the value is fresh enough */
+    UA_DataSourceCache *cache = &server->dataSourceCache;
+    UA_UInt32 generation = UA_DataSourceCache_generation(cache, &vn->nodeId);
+    if(UA_DataSourceCache_get(cache, &vn->nodeId, &session->sessionId, minReadTime, v))
+        return UA_STATUSCODE_GOOD;
+
+    /* The cached value contains the source timestamp. It is removed afterwards
+     * if not requested. */
+    UA_StatusCode retval =
+        vn->value.dataSource.read(server, &session->sessionId, session->sessionHandle,
+                                  &vn->nodeId, vn->context, true, NULL, v);
+    if(retval == UA_STATUSCODE_GOOD)
+        UA_DataSourceCache_put(cache, &vn->nodeId, &session->sessionId,
+                               generation, now, v);
+    return retval;
 }
 
 static UA_StatusCode
 readValueAttributeComplete(UA_Server *server, UA_Session *session,
                            const UA_VariableNode *vn, UA_TimestampsToReturn timestamps,
-                           const UA_String *indexRange, UA_DataValue *v) {
+                           const UA_String *indexRange, UA_Double maxAge,
+                           UA_DataValue *v) {
     /* Compute the index range */
     UA_NumericRange range;
     UA_NumericRange *rangeptr = NULL;
@@ -134,7 +194,8 @@ readValueAttributeComplete(UA_Server *server, UA_Session *session,
     if(vn->valueSource == UA_VALUESOURCE_DATA)
         retval = readValueAttributeFromNode(server, session, vn, v, rangeptr);
     else
-        retval = readValueAttributeFromDataSource(server, session, vn, v, timestamps, rangeptr);
+        retval = readValueAttributeFromDataSource(server, session, vn, v, timestamps,
+                                                  rangeptr, maxAge);
 
     /* Clean up */
     if(rangeptr)
@@ -145,7 +206,8 @@ readValueAttributeComplete(UA_Server *server, UA_Session *session,
 UA_StatusCode
 readValueAttribute(UA_Server *server, UA_Session *session,
                    const UA_VariableNode *vn, UA_DataValue *v) {
-    return readValueAttributeComplete(server, session, vn, UA_TIMESTAMPSTORETURN_NEITHER, NULL, v);
+    return readValueAttributeComplete(server, session, vn, UA_TIMESTAMPSTORETURN_NEITHER,
+                                      NULL, 0.0, v);
 }
 
 static const UA_String binEncoding = {sizeof("Default Binary")-1, (UA_Byte*)"Default Binary"};
@@ -153,6 +215,152 @@ static const UA_String binEncoding = {sizeof("Default Binary")-1, (UA_Byte*)"Def
 
 /* Thread-local variables to pass additional arguments into the operation */
 static UA_THREAD_LOCAL UA_TimestampsToReturn op_timestampsToReturn;
+static UA_THREAD_LOCAL UA_Double op_maxAge;
+static UA_THREAD_LOCAL const UA_ReadValueId *op_readIds;
+static UA_THREAD_LOCAL UA_ReadAheadValue *op_readAhead;
+
+/* Is the value of the variable read with a UA_DataSourceBatch? */
+static UA_Boolean
+readAheadPossible(UA_Server *server, UA_Session *session,
+                  const UA_ReadValueId *id, const UA_Node *node) {
+    if(id->attributeId != UA_ATTRIBUTEID_VALUE || id->dataEncoding.name.length > 0 ||
+       node->nodeClass != UA_NODECLASS_VARIABLE)
+        return false;
+    const UA_VariableNode *vn = (const UA_VariableNode*)node;
+    if(vn->valueSource != UA_VALUESOURCE_DATASOURCE ||
+       !vn->dataSourceBatch || !vn->dataSourceBatch->read)
+        return false;
+    /* Don't read values that cannot be returned */
+    return ((getAccessLevel(server, session, vn) & UA_ACCESSLEVELMASK_READ) &&
+            (getUserAccessLevel(server, session, vn) & UA_ACCESSLEVELMASK_READ));
+}
+
+UA_ReadAheadValue *
+UA_Server_readAhead(UA_Server *server, UA_Session *session,
+                    size_t idsSize, const UA_ReadValueId *ids,
+                    UA_TimestampsToReturn timestamps, UA_Double maxAge) {
+    const UA_BatchedNodes *bn =
+        (const UA_BatchedNodes*)UA_atomic_load(&server->batchedNodes);
+    if(!bn || idsSize == 0)
+        return NULL;
+
+    /* Most requests contain no batched variable. Don't allocate for them. */
+    size_t first = 0;
+    for(; first < idsSize; first++) {
+        if(ids[first].attributeId == UA_ATTRIBUTEID_VALUE &&
+           UA_BatchedNodes_contains(bn, &ids[first].nodeId))
+            break;
+    }
+    if(first == idsSize)
+        return NULL;
+
+    /* If the allocation fails, all values are read individually */
+    UA_ReadAheadValue *readAhead = (UA_ReadAheadValue*)
+        UA_calloc(idsSize, sizeof(UA_ReadAheadValue));
+    if(!readAhead)
+        return NULL;
+
+    /* Find the variables with a batch. Only the candidates from the set are
+     * looked up. Values from the DataSource cache are not read again. */
+    UA_DataSourceCache *cache = &server->dataSourceCache;
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    UA_Boolean cacheable = false;
+    size_t batched = 0;
+    for(size_t i = first; i < idsSize; i++) {
+        if(ids[i].attributeId != UA_ATTRIBUTEID_VALUE ||
+           !UA_BatchedNodes_contains(bn, &ids[i].nodeId))
+            continue;
+        const UA_Node *node = UA_Nodestore_get(server, &ids[i].nodeId);
+        if(!node)
+            continue;
+        UA_ReadAheadValue *ra = &readAhead[i];
+        if(readAheadPossible(server, session, &ids[i], node) &&
+           (ids[i].indexRange.length == 0 ||
+            UA_NumericRange_parseFromString(&ra->range, &ids[i].indexRange) ==
+            UA_STATUSCODE_GOOD)) {
+            const UA_VariableNode *vn = (const UA_VariableNode*)node;
+            ra->batch = vn->dataSourceBatch;
+            ra->nodeContext = node->context;
+            UA_DateTime minReadTime;
+            if(ra->range.dimensionsSize == 0 &&
+               dataSourceCacheMinReadTime(server, vn, maxAge, now, &minReadTime)) {
+                ra->cacheable = true;
+                ra->generation = UA_DataSourceCache_generation(cache, &vn->nodeId);
+                ra->processed = UA_DataSourceCache_get(cache, &vn->nodeId, &session->sessionId,
+                                                       minReadTime, &ra->value);
+                cacheable = true;
+            }
+            if(!ra->processed)
+                batched++;
+        }
+        UA_Nodestore_release(server, node);
+    }
+
+    /* All values are served from the cache */
+    if(batched == 0)
+        return readAhead;
+
+    UA_DataSourceReadItem *items = (UA_DataSourceReadItem*)
+        UA_malloc(batched * sizeof(UA_DataSourceReadItem));
+    if(!items) {
+        UA_ReadAheadValues_delete(readAhead, idsSize);
+        return NULL;
+    }
+
+    /* One call for all values of a batch. The cached values contain the source
+     * timestamp. It is removed afterwards if not requested. */
+    UA_Boolean sourceTimeStamp = (cacheable || timestamps == UA_TIMESTAMPSTORETURN_SOURCE ||
+                                  timestamps == UA_TIMESTAMPSTORETURN_BOTH);
+    for(size_t i = first; i < idsSize; i++) {
+        const UA_DataSourceBatch *batch = readAhead[i].batch;
+        if(!batch || readAhead[i].processed)
+            continue;
+
+        size_t itemsSize = 0;
+        for(size_t j = i; j < idsSize; j++) {
+            UA_ReadAheadValue *ra = &readAhead[j];
+            if(ra->batch != batch || ra->processed)
+                continue;
+            ra->processed = true;
+            ra->pending = true;
+            UA_DataSourceReadItem *item = &items[itemsSize++];
+            item->nodeId = &ids[j].nodeId;
+            item->nodeContext = ra->nodeContext;
+            item->range = (ra->range.dimensionsSize > 0) ? &ra->range : NULL;
+            item->value = &ra->value;
+        }
+
+        UA_StatusCode retval = batch->read(server, &session->sessionId, session->sessionHandle,
+                                           batch->context, sourceTimeStamp, itemsSize, items);
+        for(size_t j = i; j < idsSize; j++) {
+            UA_ReadAheadValue *ra = &readAhead[j];
+            if(ra->batch != batch || !ra->pending)
+                continue;
+            ra->pending = false;
+            if(retval != UA_STATUSCODE_GOOD) {
+                /* The values are not released after an error */
+                UA_DataValue_init(&ra->value);
+                ra->status = retval;
+            } else if(ra->cacheable && (!ra->value.hasStatus ||
+                                        ra->value.status == UA_STATUSCODE_GOOD)) {
+                UA_DataSourceCache_put(cache, &ids[j].nodeId, &session->sessionId,
+                                       ra->generation, now, &ra->value);
+            }
+        }
+    }
+
+    UA_free(items);
+    return readAhead;
+}
+
+void
+UA_ReadAheadValues_delete(UA_ReadAheadValue *readAhead, size_t readAheadSize) {
+    for(size_t i = 0; i < readAheadSize; i++) {
+        UA_DataValue_deleteMembers(&readAhead[i].value);
+        UA_free(readAhead[i].range.dimensions);
+    }
+    UA_free(readAhead);
+}
 
 #define CHECK_NODECLASS(CLASS)                                  \
     if(!(node->nodeClass & (CLASS))) {                          \
@@ -161,8 +369,8 @@ static UA_THREAD_LOCAL UA_TimestampsToReturn op_timestampsToReturn;
     }
 
 static void
-Operation_Read(UA_Server *server, UA_Session *session,
-               const UA_ReadValueId *id, UA_DataValue *v) {
+readWithReadAhead(UA_Server *server, UA_Session *session, const UA_ReadValueId *id,
+                  UA_ReadAheadValue *readAhead, UA_DataValue *v) {
     UA_LOG_DEBUG_SESSION(server->config.logger, session,
                          "Read the attribute %i", id->attributeId);
 
@@ -255,8 +463,16 @@ Operation_Read(UA_Server *server, UA_Session *session,
                 break;
             }
         }
+        if(readAhead && readAhead->batch) {
+            /* The value was read together with the other values of the batch */
+            retval = readAhead->status;
+            *v = readAhead->value;
+            UA_DataValue_init(&readAhead->value);
+            break;
+        }
         retval = readValueAttributeComplete(server, session, (const UA_VariableNode*)node,
-                                            op_timestampsToReturn, &id->indexRange, v);
+                                            op_timestampsToReturn, &id->indexRange,
+                                            op_maxAge, v);
         break;
     }
     case UA_ATTRIBUTEID_DATATYPE:
@@ -341,6 +557,33 @@ Operation_Read(UA_Server *server, UA_Session *session,
     }
 }
 
+static void
+Operation_Read(UA_Server *server, UA_Session *session,
+               const UA_ReadValueId *id, UA_DataValue *v) {
+    UA_ReadAheadValue *readAhead = NULL;
+    if(op_readAhead)
+        readAhead = &op_readAhead[id - op_readIds];
+    readWithReadAhead(server, session, id, readAhead, v);
+}
+
+typedef struct {
+    const UA_ReadRequest *request;
+    UA_ReadAheadValue *readAhead;
+} UA_ReadContext;
+
+static void
+setupRead(const UA_ReadContext *ctx) {
+    if(!ctx) {
+        op_readIds = NULL;
+        op_readAhead = NULL;
+        return;
+    }
+    op_timestampsToReturn = ctx->request->timestampsToReturn;
+    op_maxAge = ctx->request->maxAge;
+    op_readIds = ctx->request->nodesToRead;
+    op_readAhead = ctx->readAhead;
+}
+
 void Service_Read(UA_Server *server, UA_Session *session,
                   const UA_ReadRequest *request, UA_ReadResponse *response) {
     UA_LOG_DEBUG_SESSION(server->config.logger, session,
@@ -359,24 +602,46 @@ void Service_Read(UA_Server *server, UA_Session *session,
         return;
     }
 
+    /* Read the values of batched DataSources ahead of the operations */
+    UA_ReadContext ctx;
+    ctx.request = request;
+    ctx.readAhead = UA_Server_readAhead(server, session, request->nodesToReadSize,
+                                        request->nodesToRead, request->timestampsToReturn,
+                                        request->maxAge);
+    setupRead(&ctx);
+
     response->responseHeader.serviceResult = 
-        UA_Server_processServiceOperations(server, session,
+        UA_Server_processServiceOperationsParallel(server, session,
                   (UA_ServiceOperation)Operation_Read,
                   &request->nodesToReadSize, &UA_TYPES[UA_TYPES_READVALUEID],
-                  &response->resultsSize, &UA_TYPES[UA_TYPES_DATAVALUE]);
+                  &response->resultsSize, &UA_TYPES[UA_TYPES_DATAVALUE],
+                  (UA_ServiceOperationsSetup)setupRead, &ctx);
+
+    op_readAhead = NULL;
+    if(ctx.readAhead)
+        UA_ReadAheadValues_delete(ctx.readAhead, request->nodesToReadSize);
 }
 
 UA_DataValue
-UA_Server_readWithSession(UA_Server *server, UA_Session *session,
-                          const UA_ReadValueId *item,
-                          UA_TimestampsToReturn timestamps) {
+UA_Server_readWithReadAhead(UA_Server *server, UA_Session *session,
+                            const UA_ReadValueId *item,
+                            UA_TimestampsToReturn timestamps,
+                            UA_ReadAheadValue *readAhead) {
     UA_DataValue dv;
     UA_DataValue_init(&dv);
     op_timestampsToReturn = timestamps;
-    Operation_Read(server, session, item, &dv);
+    op_maxAge = 0.0;
+    readWithReadAhead(server, session, item, readAhead, &dv);
     return dv;
 }
 
+UA_DataValue
+UA_Server_readWithSession(UA_Server *server, UA_Session *session,
+                          const UA_ReadValueId *item,
+                          UA_TimestampsToReturn timestamps) {
+    return UA_Server_readWithReadAhead(server, session, item, timestamps, NULL);
+}
+
 /* Exposes the Read service to local users */
 UA_DataValue
 UA_Server_read(UA_Server *server, const UA_ReadValueId *item,
@@ -946,6 +1211,7 @@ writeValueAttribute(UA_Server *server, UA_Session *session,
             retval = node->value.dataSource.write(server, &session->sessionId,
                                                   session->sessionHandle, &node->nodeId,
                                                   node->context, rangeptr, &adjustedValue);
+            UA_DataSourceCache_remove(&server->dataSourceCache, &node->nodeId);
         } else {
             retval = UA_STATUSCODE_BADWRITENOTSUPPORTED;
         }
@@ -1181,6 +1447,10 @@ Operation_Write(UA_Server *server, UA_Session *session,
                 UA_WriteValue *wv, UA_StatusCode *result) {
     *result = UA_Server_editNode(server, session, &wv->nodeId,
                         (UA_EditNodeCallback)copyAttributeIntoNode, wv);
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    if(*result == UA_STATUSCODE_GOOD && wv->attributeId == UA_ATTRIBUTEID_VALUE)
+        UA_SamplingGroups_notifyWrite(server, &wv->nodeId);
+#endif
 }
 
 void
@@ -1190,6 +1460,8 @@ Service_Write(UA_Server *server, UA_Session *session,
     UA_LOG_DEBUG_SESSION(server->config.logger, session,
                          "Processing WriteRequest");
 
+    /* Not processed in parallel. Writes to the same node have to be applied
+     * in the order of the request and exactly once. */
     response->responseHeader.serviceResult = 
         UA_Server_processServiceOperations(server, session,
                   (UA_ServiceOperation)Operation_Write,
@@ -1202,6 +1474,10 @@ UA_Server_write(UA_Server *server, const UA_WriteValue *value) {
     UA_StatusCode retval =
         UA_Server_editNode(server, &adminSession, &value->nodeId,
                   (UA_EditNodeCallback)copyAttributeIntoNode, value);
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    if(retval == UA_STATUSCODE_GOOD && value->attributeId == UA_ATTRIBUTEID_VALUE)
+        UA_SamplingGroups_notifyWrite(server, &value->nodeId);
+#endif
     return retval;
 }
 
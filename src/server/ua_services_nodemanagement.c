@@ -4,6 +4,7 @@
 
 #include "ua_server_internal.h"
 #include "ua_services.h"
+#include "ua_subscription.h"
 
 /*********************/
 /* Edit Node Context */
@@ -119,8 +120,7 @@ checkParentReference(UA_Server *server, UA_Session *session, UA_NodeClass nodeCl
     /* Test if the referencetype is hierarchical */
     const UA_NodeId hierarchicalReference =
         UA_NODEID_NUMERIC(0, UA_NS0ID_HIERARCHICALREFERENCES);
-    if(!isNodeInTree(&server->config.nodestore, referenceTypeId,
-                     &hierarchicalReference, &subtypeId, 1)) {
+    if(!isReferenceTypeSubtype(server, &hierarchicalReference, referenceTypeId)) {
         UA_LOG_INFO_SESSION(server->config.logger, session,
                             "AddNodes: Reference type is not hierarchical");
         return UA_STATUSCODE_BADREFERENCETYPEIDINVALID;
@@ -362,7 +362,7 @@ static void deleteReferencesSubset(UA_Node *node, size_t referencesSkipSize, UA_
     }
 
     /* Now copy the remaining references to a new array */
-    UA_NodeReferenceKind *newReferences = (UA_NodeReferenceKind *)UA_malloc(sizeof(UA_NodeReferenceKind) * (newSize));
+    UA_NodeReferenceKind *newReferences = (UA_NodeReferenceKind *)UA_calloc(newSize, sizeof(UA_NodeReferenceKind));
     size_t curr = 0;
     UA_StatusCode retval = UA_STATUSCODE_GOOD;
     for(size_t i = 0; i < node->referencesSize && retval == UA_STATUSCODE_GOOD; ++i) {
@@ -383,6 +383,7 @@ static void deleteReferencesSubset(UA_Node *node, size_t referencesSkipSize, UA_
             if(retval != UA_STATUSCODE_GOOD)
                 break;
             drefs->targetIdsSize = srefs->targetIdsSize;
+            drefs->targetIdsCapacity = srefs->targetIdsSize;
             break;
         }
         if (retval != UA_STATUSCODE_GOOD) {
@@ -529,24 +530,97 @@ copyChildNodes(UA_Server *server, UA_Session *session,
     return retval;
 }
 
+/* The children of a type and all its supertypes. They are browsed once and
+ * then instantiated for every instance of the type. */
+typedef struct {
+    UA_ReferenceDescription *children;
+    size_t childrenSize;
+} TypeChildren;
+
 static UA_StatusCode
-addChildren(UA_Server *server, UA_Session *session,
-            const UA_Node *node, const UA_Node *type) {
+browseTypeChildren(UA_Server *server, UA_Session *session,
+                   const UA_NodeId *typeId, TypeChildren *tc) {
+    tc->children = NULL;
+    tc->childrenSize = 0;
+
     /* Get the hierarchy of the type and all its supertypes */
     UA_NodeId *hierarchy = NULL;
     size_t hierarchySize = 0;
-    UA_StatusCode retval = getTypeHierarchy(&server->config.nodestore, &type->nodeId,
+    UA_StatusCode retval = getTypeHierarchy(&server->config.nodestore, typeId,
                                             &hierarchy, &hierarchySize);
     if(retval != UA_STATUSCODE_GOOD)
         return retval;
 
-    /* Copy members of the type and supertypes (and instantiate them) */
-    for(size_t i = 0; i < hierarchySize; ++i)
-        retval |= copyChildNodes(server, session, &hierarchy[i], &node->nodeId);
+    UA_BrowseDescription bd;
+    UA_BrowseDescription_init(&bd);
+    bd.referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_AGGREGATES);
+    bd.includeSubtypes = true;
+    bd.browseDirection = UA_BROWSEDIRECTION_FORWARD;
+    bd.nodeClassMask = UA_NODECLASS_OBJECT | UA_NODECLASS_VARIABLE | UA_NODECLASS_METHOD;
+    bd.resultMask = UA_BROWSERESULTMASK_REFERENCETYPEID | UA_BROWSERESULTMASK_NODECLASS |
+        UA_BROWSERESULTMASK_BROWSENAME;
+
+    /* Collect the members of the type and the supertypes. The members of the
+     * most specific type come first. */
+    for(size_t i = 0; i < hierarchySize; ++i) {
+        bd.nodeId = hierarchy[i];
+        UA_BrowseResult br;
+        UA_BrowseResult_init(&br);
+        Service_Browse_single(server, session, NULL, &bd, 0, &br);
+        if(br.statusCode != UA_STATUSCODE_GOOD) {
+            retval |= br.statusCode;
+            continue;
+        }
+        if(br.referencesSize == 0) {
+            UA_BrowseResult_deleteMembers(&br);
+            continue;
+        }
+
+        UA_ReferenceDescription *children = (UA_ReferenceDescription*)
+            UA_realloc(tc->children, sizeof(UA_ReferenceDescription) *
+                       (tc->childrenSize + br.referencesSize));
+        if(!children) {
+            UA_BrowseResult_deleteMembers(&br);
+            retval |= UA_STATUSCODE_BADOUTOFMEMORY;
+            continue;
+        }
+
+        /* Move the references over */
+        memcpy(&children[tc->childrenSize], br.references,
+               sizeof(UA_ReferenceDescription) * br.referencesSize);
+        tc->children = children;
+        tc->childrenSize += br.referencesSize;
+        UA_free(br.references);
+        br.references = NULL;
+        br.referencesSize = 0;
+        UA_BrowseResult_deleteMembers(&br);
+    }
+
     UA_Array_delete(hierarchy, hierarchySize, &UA_TYPES[UA_TYPES_NODEID]);
     return retval;
 }
 
+static UA_StatusCode
+instantiateTypeChildren(UA_Server *server, UA_Session *session,
+                        const UA_Node *node, const TypeChildren *tc) {
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    for(size_t i = 0; i < tc->childrenSize; ++i)
+        retval |= copyChildNode(server, session, &node->nodeId, &tc->children[i]);
+    return retval;
+}
+
+static UA_StatusCode
+addChildren(UA_Server *server, UA_Session *session,
+            const UA_Node *node, const UA_Node *type) {
+    /* Copy members of the type and supertypes (and instantiate them) */
+    TypeChildren tc;
+    UA_StatusCode retval = browseTypeChildren(server, session, &type->nodeId, &tc);
+    retval |= instantiateTypeChildren(server, session, node, &tc);
+    UA_Array_delete(tc.children, tc.childrenSize,
+                    &UA_TYPES[UA_TYPES_REFERENCEDESCRIPTION]);
+    return retval;
+}
+
 /* Calls the global destructor internally of the global constructor succeeds and
  * the type-level constructor fails. */
 static UA_StatusCode callConstructors(UA_Server *server, UA_Session *session,
@@ -601,6 +675,9 @@ addTypeDefRef(UA_Server *server, UA_Session *session,
     addref.isForward = true;
     addref.targetNodeId.nodeId = type->nodeId;
     addReference(server, session, &addref, &retval);
+    /* The reference may have been added between _begin and _finish */
+    if(retval == UA_STATUSCODE_BADDUPLICATEREFERENCENOTALLOWED)
+        retval = UA_STATUSCODE_GOOD;
     return retval;
 }
 
@@ -617,6 +694,8 @@ addParentRef(UA_Server *server, UA_Session *session,
     ref_item.isForward = false;
     ref_item.targetNodeId.nodeId = *parentNodeId;
     addReference(server, session, &ref_item, &retval);
+    if(retval == UA_STATUSCODE_BADDUPLICATEREFERENCENOTALLOWED)
+        retval = UA_STATUSCODE_GOOD;
     return retval;
 }
 
@@ -706,62 +785,75 @@ removeDeconstructedNode(UA_Server *server, UA_Session *session,
 
 static const UA_NodeId hasSubtype = {0, UA_NODEIDTYPE_NUMERIC, {UA_NS0ID_HASSUBTYPE}};
 
-/* Children, references, type-checking, constructors. */
-UA_StatusCode
-Operation_addNode_finish(UA_Server *server, UA_Session *session, const UA_NodeId *nodeId,
-                         const UA_NodeId *parentNodeId, const UA_NodeId *referenceTypeId,
-                         const UA_NodeId *typeDefinitionId) {
-    UA_StatusCode retval = UA_STATUSCODE_GOOD;
-    const UA_Node *type = NULL;
-
-    /* Get the node */
-    const UA_Node *node = UA_Nodestore_get(server, nodeId);
-    if(!node)
-        return UA_STATUSCODE_BADNODEIDUNKNOWN;
-
-    /* Use the typeDefinition as parent for type-nodes */
+/* Use the typeDefinition as parent for type-nodes. Replace an empty
+ * typeDefinition of variables and objects with the most permissive default. */
+static void
+resolveTypeDefinition(UA_Server *server, UA_Session *session, const UA_Node *node,
+                      const UA_NodeId *parentNodeId, const UA_NodeId **referenceTypeId,
+                      const UA_NodeId **typeDefinitionId) {
     if(node->nodeClass == UA_NODECLASS_VARIABLETYPE ||
        node->nodeClass == UA_NODECLASS_OBJECTTYPE ||
        node->nodeClass == UA_NODECLASS_REFERENCETYPE ||
        node->nodeClass == UA_NODECLASS_DATATYPE) {
-        if (UA_NodeId_equal(referenceTypeId, &UA_NODEID_NULL))
-            referenceTypeId = &hasSubtype;
+        if (UA_NodeId_equal(*referenceTypeId, &UA_NODEID_NULL))
+            *referenceTypeId = &hasSubtype;
         const UA_Node *parentNode = UA_Nodestore_get(server, parentNodeId);
         if (parentNode) {
             if (parentNode->nodeClass == node->nodeClass)
-                typeDefinitionId = parentNodeId;
+                *typeDefinitionId = parentNodeId;
             UA_Nodestore_release(server, parentNode);
         }
     }
 
     if(server->bootstrapNS0)
-        goto get_type;
-
-    /* Check parent reference. Objects may have no parent. */
-    retval = checkParentReference(server, session, node->nodeClass,
-                                  parentNodeId, referenceTypeId);
-    if(retval != UA_STATUSCODE_GOOD) {
-        UA_LOG_INFO_SESSION(server->config.logger, session,
-                            "AddNodes: The parent reference is invalid");
-        UA_Nodestore_release(server, node);
-        UA_Server_deleteNode(server, *nodeId, true);
-        return retval;
-    }
+        return;
 
-    /* Replace empty typeDefinition with the most permissive default */
     if((node->nodeClass == UA_NODECLASS_VARIABLE ||
         node->nodeClass == UA_NODECLASS_OBJECT) &&
-       UA_NodeId_isNull(typeDefinitionId)) {
+       UA_NodeId_isNull(*typeDefinitionId)) {
         UA_LOG_INFO_SESSION(server->config.logger, session,
                             "AddNodes: No TypeDefinition; Use the default "
                             "TypeDefinition for the Variable/Object");
         if(node->nodeClass == UA_NODECLASS_VARIABLE)
-            typeDefinitionId = &baseDataVariableType;
+            *typeDefinitionId = &baseDataVariableType;
         else
-            typeDefinitionId = &baseObjectType;
+            *typeDefinitionId = &baseObjectType;
+    }
+}
+
+/* Children, references, type-checking, constructors. The references to the
+ * parent and the type definition are not added if they already were added in
+ * bulk. If typeChildren is set, the members of the type definition were
+ * already browsed for all instances of the type. */
+static UA_StatusCode
+finishAddNode(UA_Server *server, UA_Session *session, const UA_NodeId *nodeId,
+              const UA_NodeId *parentNodeId, const UA_NodeId *referenceTypeId,
+              const UA_NodeId *typeDefinitionId, UA_Boolean addReferences,
+              const TypeChildren *typeChildren) {
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    const UA_Node *type = NULL;
+
+    /* Get the node */
+    const UA_Node *node = UA_Nodestore_get(server, nodeId);
+    if(!node)
+        return UA_STATUSCODE_BADNODEIDUNKNOWN;
+
+    resolveTypeDefinition(server, session, node, parentNodeId,
+                          &referenceTypeId, &typeDefinitionId);
+
+    /* Check parent reference. Objects may have no parent. */
+    if(!server->bootstrapNS0) {
+        retval = checkParentReference(server, session, node->nodeClass,
+                                      parentNodeId, referenceTypeId);
+        if(retval != UA_STATUSCODE_GOOD) {
+            UA_LOG_INFO_SESSION(server->config.logger, session,
+                                "AddNodes: The parent reference is invalid");
+            UA_Nodestore_release(server, node);
+            UA_Server_deleteNode(server, *nodeId, true);
+            return retval;
+        }
     }
 
- get_type:
     /* Get the node type. There must be a typedefinition for variables, objects
      * and type-nodes. See the above checks. */
     if(!UA_NodeId_isNull(typeDefinitionId)) {
@@ -873,8 +965,11 @@ Operation_addNode_finish(UA_Server *server, UA_Session *session, const UA_NodeId
        node->nodeClass == UA_NODECLASS_OBJECT) {
         UA_assert(type != NULL); /* see above */
         /* Add (mandatory) child nodes from the type definition */
-        if (!server->bootstrapNS0) {
-            retval = addChildren(server, session, node, type);
+        if(!server->bootstrapNS0) {
+            if(typeChildren)
+                retval = instantiateTypeChildren(server, session, node, typeChildren);
+            else
+                retval = addChildren(server, session, node, type);
             if(retval != UA_STATUSCODE_GOOD) {
                 UA_LOG_INFO_SESSION(server->config.logger, session,
                                     "AddNodes: Adding child nodes failed with error code %s",
@@ -884,7 +979,8 @@ Operation_addNode_finish(UA_Server *server, UA_Session *session, const UA_NodeId
         }
 
         /* Add a hasTypeDefinition reference */
-        retval = addTypeDefRef(server, session, node, type);
+        if(addReferences)
+            retval = addTypeDefRef(server, session, node, type);
         if(retval != UA_STATUSCODE_GOOD) {
             UA_LOG_INFO_SESSION(server->config.logger, session,
                                 "AddNodes: Adding a reference to the type "
@@ -903,7 +999,8 @@ Operation_addNode_finish(UA_Server *server, UA_Session *session, const UA_NodeId
             goto cleanup;
         }
 
-        retval = addParentRef(server, session, nodeId, referenceTypeId, parentNodeId);
+        if(addReferences)
+            retval = addParentRef(server, session, nodeId, referenceTypeId, parentNodeId);
         if(retval != UA_STATUSCODE_GOOD) {
             UA_LOG_INFO_SESSION(server->config.logger, session,
                                 "AddNodes: Adding reference to parent failed");
@@ -928,6 +1025,14 @@ Operation_addNode_finish(UA_Server *server, UA_Session *session, const UA_NodeId
     return retval;
 }
 
+UA_StatusCode
+Operation_addNode_finish(UA_Server *server, UA_Session *session, const UA_NodeId *nodeId,
+                         const UA_NodeId *parentNodeId, const UA_NodeId *referenceTypeId,
+                         const UA_NodeId *typeDefinitionId) {
+    return finishAddNode(server, session, nodeId, parentNodeId, referenceTypeId,
+                          typeDefinitionId, true, NULL);
+}
+
 static void
 Operation_addNode(UA_Server *server, UA_Session *session, const UA_AddNodesItem *item,
                   void *nodeContext, UA_AddNodesResult *result) {
@@ -1037,6 +1142,388 @@ UA_Server_addNode_finish(UA_Server *server, const UA_NodeId nodeId,
                                     &referenceTypeId, &typeDefinitionId);
 }
 
+/**************************/
+/* Add Nodes in Bulk Mode */
+/**************************/
+
+static UA_StatusCode
+addOneWayReference(UA_Server *server, UA_Session *session,
+                   UA_Node *node, const UA_AddReferencesItem *item);
+
+static const UA_NodeId hasTypeDefinition =
+    {0, UA_NODEIDTYPE_NUMERIC, {UA_NS0ID_HASTYPEDEFINITION}};
+
+typedef struct {
+    UA_NodeId nodeId; /* The added NodeId */
+    const UA_NodeId *referenceTypeId;
+    const UA_NodeId *typeDefinitionId;
+} AddNodesBulkNode;
+
+/* One direction of a reference to the parent or the type definition */
+typedef struct {
+    UA_AddReferencesItem item;
+    size_t nodeIndex; /* The added node that requires the reference */
+} AddNodesBulkReference;
+
+/* The references are either consecutive or selected by their index */
+typedef struct {
+    AddNodesBulkReference *refs;
+    const size_t *order;
+    size_t refsSize;
+    UA_StatusCode *results;
+} AddNodesBulkReferences;
+
+/* A total order of NodeIds to group the references by the source node */
+static int
+compareNodeIds(const UA_NodeId *n1, const UA_NodeId *n2) {
+    if(n1->namespaceIndex != n2->namespaceIndex)
+        return (n1->namespaceIndex < n2->namespaceIndex) ? -1 : 1;
+    if(n1->identifierType != n2->identifierType)
+        return (n1->identifierType < n2->identifierType) ? -1 : 1;
+    switch(n1->identifierType) {
+    case UA_NODEIDTYPE_NUMERIC:
+        if(n1->identifier.numeric == n2->identifier.numeric)
+            return 0;
+        return (n1->identifier.numeric < n2->identifier.numeric) ? -1 : 1;
+    case UA_NODEIDTYPE_GUID:
+        return memcmp(&n1->identifier.guid, &n2->identifier.guid, sizeof(UA_Guid));
+    default: {
+        const UA_String *s1 = &n1->identifier.string;
+        const UA_String *s2 = &n2->identifier.string;
+        if(s1->length != s2->length)
+            return (s1->length < s2->length) ? -1 : 1;
+        if(s1->length == 0)
+            return 0;
+        return memcmp(s1->data, s2->data, s1->length);
+    }
+    }
+}
+
+/* Order the references by their source node. References with the same source
+ * keep the order of the nodes. The source nodes are mapped to their group in a
+ * hash map, so the references are grouped in linear time. The groups begin at
+ * the indices in groupStart. Returns the number of groups. */
+static size_t
+groupBulkReferences(const AddNodesBulkReference *refs, size_t refsSize,
+                    size_t *order, size_t *groupStart) {
+    size_t mapSize = 2;
+    while(mapSize < refsSize * 2)
+        mapSize *= 2;
+    size_t *map = (size_t*)UA_calloc(mapSize, sizeof(size_t)); /* group + 1 */
+    size_t *groupOf = (size_t*)UA_malloc(refsSize * sizeof(size_t));
+    if(!map || !groupOf) {
+        UA_free(map);
+        UA_free(groupOf);
+        return 0;
+    }
+
+    /* Count the references per group. groupStart temporarily holds the first
+     * reference of every group. */
+    size_t groupsSize = 0;
+    size_t *groupCount = order;
+    for(size_t i = 0; i < refsSize; i++) {
+        const UA_NodeId *source = &refs[i].item.sourceNodeId;
+        size_t slot = UA_NodeId_hash(source) & (mapSize - 1);
+        while(map[slot] != 0 &&
+              !UA_NodeId_equal(source, &refs[groupStart[map[slot]-1]].item.sourceNodeId))
+            slot = (slot + 1) & (mapSize - 1);
+        if(map[slot] == 0) {
+            groupStart[groupsSize] = i;
+            groupCount[groupsSize] = 0;
+            map[slot] = ++groupsSize;
+        }
+        groupOf[i] = map[slot] - 1;
+        groupCount[groupOf[i]]++;
+    }
+    UA_free(map);
+
+    /* Compute the start of every group */
+    size_t pos = 0;
+    for(size_t g = 0; g < groupsSize; g++) {
+        groupStart[g] = pos;
+        pos += groupCount[g];
+    }
+    groupStart[groupsSize] = pos;
+
+    /* Sort the reference indices into the groups. Use the group starts as
+     * insert positions and restore them afterwards. */
+    for(size_t i = 0; i < refsSize; i++)
+        order[groupStart[groupOf[i]]++] = i;
+    for(size_t g = groupsSize; g > 0; g--)
+        groupStart[g] = groupStart[g-1];
+    groupStart[0] = 0;
+    UA_free(groupOf);
+    return groupsSize;
+}
+
+static UA_StatusCode
+addBulkReferences(UA_Server *server, UA_Session *session, UA_Node *node,
+                  AddNodesBulkReferences *refs) {
+    for(size_t i = 0; i < refs->refsSize; i++) {
+        AddNodesBulkReference *ref = &refs->refs[refs->order ? refs->order[i] : i];
+        UA_StatusCode retval = addOneWayReference(server, session, node, &ref->item);
+        if(retval != UA_STATUSCODE_GOOD &&
+           retval != UA_STATUSCODE_BADDUPLICATEREFERENCENOTALLOWED &&
+           refs->results[ref->nodeIndex] == UA_STATUSCODE_GOOD)
+            refs->results[ref->nodeIndex] = retval;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+addBulkReference(AddNodesBulkReference *ref, size_t nodeIndex,
+                 const UA_NodeId *sourceNodeId, const UA_NodeId *referenceTypeId,
+                 UA_Boolean isForward, const UA_NodeId *targetNodeId) {
+    UA_AddReferencesItem_init(&ref->item);
+    ref->item.sourceNodeId = *sourceNodeId;
+    ref->item.referenceTypeId = *referenceTypeId;
+    ref->item.isForward = isForward;
+    ref->item.targetNodeId.nodeId = *targetNodeId;
+    ref->nodeIndex = nodeIndex;
+}
+
+/* Add the references from the new node to the parent and the type definition.
+ * The references in the opposite direction are collected to be added grouped
+ * by their source node. Returns the number of collected references. */
+static size_t
+addOwnBulkReferences(UA_Server *server, UA_Session *session,
+                     const UA_AddNodesItem *item, AddNodesBulkNode *bn,
+                     size_t nodeIndex, AddNodesBulkReference *refs,
+                     UA_StatusCode *results) {
+    const UA_Node *node = UA_Nodestore_get(server, &bn->nodeId);
+    if(!node)
+        return 0;
+    bn->referenceTypeId = &item->referenceTypeId;
+    bn->typeDefinitionId = &item->typeDefinition.nodeId;
+    resolveTypeDefinition(server, session, node, &item->parentNodeId.nodeId,
+                          &bn->referenceTypeId, &bn->typeDefinitionId);
+    UA_Boolean hasType = ((node->nodeClass == UA_NODECLASS_VARIABLE ||
+                           node->nodeClass == UA_NODECLASS_OBJECT) &&
+                          !UA_NodeId_isNull(bn->typeDefinitionId));
+    UA_Boolean hasParent = (!UA_NodeId_isNull(&item->parentNodeId.nodeId) &&
+                            !UA_NodeId_isNull(bn->referenceTypeId));
+    UA_Nodestore_release(server, node);
+
+    AddNodesBulkReference own[2];
+    size_t ownSize = 0;
+    size_t refsSize = 0;
+    if(hasType) {
+        addBulkReference(&own[ownSize++], nodeIndex, &bn->nodeId,
+                         &hasTypeDefinition, true, bn->typeDefinitionId);
+        addBulkReference(&refs[refsSize++], nodeIndex, bn->typeDefinitionId,
+                         &hasTypeDefinition, false, &bn->nodeId);
+    }
+    if(hasParent) {
+        addBulkReference(&own[ownSize++], nodeIndex, &bn->nodeId,
+                         bn->referenceTypeId, false, &item->parentNodeId.nodeId);
+        addBulkReference(&refs[refsSize++], nodeIndex, &item->parentNodeId.nodeId,
+                         bn->referenceTypeId, true, &bn->nodeId);
+    }
+    if(ownSize == 0)
+        return 0;
+
+    AddNodesBulkReferences group = {own, NULL, ownSize, results};
+    UA_StatusCode retval = UA_Server_editNode(server, session, &bn->nodeId,
+                                              (UA_EditNodeCallback)addBulkReferences,
+                                              &group);
+    if(retval != UA_STATUSCODE_GOOD && results[nodeIndex] == UA_STATUSCODE_GOOD)
+        results[nodeIndex] = retval;
+    return refsSize;
+}
+
+/* The members of a type definition are browsed when the first instance of the
+ * type is finished. Then they are reused for all instances of the type. */
+typedef struct {
+    const UA_NodeId *typeDefinitionId;
+    UA_Boolean browsed;
+    UA_StatusCode retval;
+    TypeChildren children;
+} AddNodesBulkType;
+
+static int
+compareBulkTypes(const void *p1, const void *p2) {
+    const AddNodesBulkType *t1 = (const AddNodesBulkType*)p1;
+    const AddNodesBulkType *t2 = (const AddNodesBulkType*)p2;
+    return compareNodeIds(t1->typeDefinitionId, t2->typeDefinitionId);
+}
+
+/* Returns the number of distinct type definitions of the instances */
+static size_t
+collectBulkTypes(size_t itemsSize, const UA_AddNodesItem *items,
+                 const AddNodesBulkNode *nodes, const UA_StatusCode *res,
+                 AddNodesBulkType *types) {
+    size_t typesSize = 0;
+    for(size_t i = 0; i < itemsSize; i++) {
+        if(res[i] != UA_STATUSCODE_GOOD || !nodes[i].typeDefinitionId ||
+           (items[i].nodeClass != UA_NODECLASS_VARIABLE &&
+            items[i].nodeClass != UA_NODECLASS_OBJECT))
+            continue;
+        memset(&types[typesSize], 0, sizeof(AddNodesBulkType));
+        types[typesSize].typeDefinitionId = nodes[i].typeDefinitionId;
+        typesSize++;
+    }
+    if(typesSize == 0)
+        return 0;
+
+    qsort(types, typesSize, sizeof(AddNodesBulkType), compareBulkTypes);
+    size_t distinct = 1;
+    for(size_t i = 1; i < typesSize; i++) {
+        if(!UA_NodeId_equal(types[i].typeDefinitionId,
+                            types[distinct-1].typeDefinitionId))
+            types[distinct++] = types[i];
+    }
+    return distinct;
+}
+
+static const TypeChildren *
+getBulkTypeChildren(UA_Server *server, UA_Session *session,
+                    AddNodesBulkType *types, size_t typesSize,
+                    const UA_NodeId *typeDefinitionId) {
+    AddNodesBulkType key;
+    key.typeDefinitionId = typeDefinitionId;
+    AddNodesBulkType *type = (AddNodesBulkType*)
+        bsearch(&key, types, typesSize, sizeof(AddNodesBulkType), compareBulkTypes);
+    if(!type)
+        return NULL;
+    if(!type->browsed) {
+        type->retval = browseTypeChildren(server, session, typeDefinitionId,
+                                          &type->children);
+        type->browsed = true;
+    }
+    /* Browse again for every instance to get the same error */
+    if(type->retval != UA_STATUSCODE_GOOD)
+        return NULL;
+    return &type->children;
+}
+
+UA_StatusCode
+UA_Server_addNodesBulk(UA_Server *server, size_t itemsSize,
+                       const UA_AddNodesItem *items, void **nodeContexts,
+                       UA_StatusCode *results, UA_NodeId *outNewNodeIds) {
+    if(itemsSize == 0)
+        return UA_STATUSCODE_GOOD;
+
+    UA_Session *session = &adminSession;
+    AddNodesBulkNode *nodes = (AddNodesBulkNode*)
+        UA_calloc(itemsSize, sizeof(AddNodesBulkNode));
+    AddNodesBulkReference *refs = (AddNodesBulkReference*)
+        UA_malloc(itemsSize * 2 * sizeof(AddNodesBulkReference));
+    size_t *order = (size_t*)UA_malloc(itemsSize * 2 * sizeof(size_t));
+    size_t *groupStart = (size_t*)UA_malloc((itemsSize * 2 + 1) * sizeof(size_t));
+    UA_StatusCode *res = results;
+    if(!res)
+        res = (UA_StatusCode*)UA_malloc(itemsSize * sizeof(UA_StatusCode));
+    if(!nodes || !refs || !order || !groupStart || !res) {
+        UA_free(nodes);
+        UA_free(refs);
+        UA_free(order);
+        UA_free(groupStart);
+        if(res != results)
+            UA_free(res);
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+
+    /* Create all nodes first. So the parents and types may come later in the
+     * array. */
+    for(size_t i = 0; i < itemsSize; i++) {
+        void *nodeContext = nodeContexts ? nodeContexts[i] : NULL;
+        res[i] = Operation_addNode_begin(server, session, &items[i], nodeContext,
+                                         &nodes[i].nodeId);
+    }
+
+    /* Add the references to the parents and type definitions. The references
+     * in the opposite direction are grouped by the source node. So every
+     * parent and type definition is edited only once. */
+    size_t refsSize = 0;
+    for(size_t i = 0; i < itemsSize; i++) {
+        if(res[i] == UA_STATUSCODE_GOOD)
+            refsSize += addOwnBulkReferences(server, session, &items[i], &nodes[i],
+                                             i, &refs[refsSize], res);
+    }
+    size_t groupsSize = 0;
+    if(refsSize > 0)
+        groupsSize = groupBulkReferences(refs, refsSize, order, groupStart);
+    if(groupsSize == 0) {
+        /* Out of memory for the grouping. Edit the source node of every
+         * reference separately. */
+        for(size_t i = 0; i < refsSize; i++) {
+            order[i] = i;
+            groupStart[i] = i;
+        }
+        groupsSize = refsSize;
+        groupStart[groupsSize] = refsSize;
+    }
+    for(size_t g = 0; g < groupsSize; g++) {
+        AddNodesBulkReferences group = {refs, &order[groupStart[g]],
+                                        groupStart[g+1] - groupStart[g], res};
+        /* An unknown source node (parent or type) is detected in the
+         * consistency checks */
+        const UA_NodeId *source = &refs[group.order[0]].item.sourceNodeId;
+        UA_StatusCode retval =
+            UA_Server_editNode(server, session, source,
+                               (UA_EditNodeCallback)addBulkReferences, &group);
+        if(retval != UA_STATUSCODE_GOOD && retval != UA_STATUSCODE_BADNODEIDUNKNOWN) {
+            for(size_t j = 0; j < group.refsSize; j++) {
+                size_t nodeIndex = refs[group.order[j]].nodeIndex;
+                if(res[nodeIndex] == UA_STATUSCODE_GOOD)
+                    res[nodeIndex] = retval;
+            }
+        }
+    }
+    UA_free(refs);
+    UA_free(order);
+    UA_free(groupStart);
+
+    /* The members of every type definition are browsed only once. If the
+     * array cannot be allocated, they are browsed for every instance. */
+    size_t typesSize = 0;
+    AddNodesBulkType *types = (AddNodesBulkType*)
+        UA_malloc(itemsSize * sizeof(AddNodesBulkType));
+    if(types)
+        typesSize = collectBulkTypes(itemsSize, items, nodes, res, types);
+
+    /* Consistency checks, children, type-checking and constructors */
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    for(size_t i = 0; i < itemsSize; i++) {
+        if(res[i] == UA_STATUSCODE_GOOD) {
+            const TypeChildren *typeChildren = NULL;
+            if(typesSize > 0 && nodes[i].typeDefinitionId)
+                typeChildren = getBulkTypeChildren(server, session, types, typesSize,
+                                                   nodes[i].typeDefinitionId);
+            res[i] = finishAddNode(server, session, &nodes[i].nodeId,
+                                   &items[i].parentNodeId.nodeId,
+                                   nodes[i].referenceTypeId,
+                                   nodes[i].typeDefinitionId, false, typeChildren);
+        } else if(!UA_NodeId_isNull(&nodes[i].nodeId)) {
+            /* Adding a reference failed */
+            const UA_Node *node = UA_Nodestore_get(server, &nodes[i].nodeId);
+            if(node) {
+                removeDeconstructedNode(server, session, node, true);
+                UA_Nodestore_release(server, node);
+            }
+        }
+
+        if(res[i] != UA_STATUSCODE_GOOD) {
+            UA_NodeId_deleteMembers(&nodes[i].nodeId);
+            if(retval == UA_STATUSCODE_GOOD)
+                retval = res[i];
+        }
+        if(outNewNodeIds)
+            outNewNodeIds[i] = nodes[i].nodeId;
+        else
+            UA_NodeId_deleteMembers(&nodes[i].nodeId);
+    }
+
+    for(size_t i = 0; i < typesSize; i++)
+        UA_Array_delete(types[i].children.children, types[i].children.childrenSize,
+                        &UA_TYPES[UA_TYPES_REFERENCEDESCRIPTION]);
+    UA_free(types);
+    UA_free(nodes);
+    if(res != results)
+        UA_free(res);
+    return retval;
+}
+
 /****************/
 /* Delete Nodes */
 /****************/
@@ -1145,6 +1632,10 @@ removeDeconstructedNode(UA_Server *server, UA_Session *session,
         removeIncomingReferences(server, session, node);
 
     /* Remove the node in the nodestore */
+    if(node->nodeClass == UA_NODECLASS_REFERENCETYPE)
+        UA_ReferenceTypeCache_invalidate(server);
+    if(node->nodeClass == UA_NODECLASS_VARIABLE)
+        UA_DataSourceCache_remove(&server->dataSourceCache, &node->nodeId);
     UA_Nodestore_remove(server, &node->nodeId);
 }
 
@@ -1212,13 +1703,19 @@ UA_Server_deleteNode(UA_Server *server, const UA_NodeId nodeId,
 
 static UA_StatusCode
 addOneWayReference(UA_Server *server, UA_Session *session,
-             UA_Node *node, const UA_AddReferencesItem *item) {
+                   UA_Node *node, const UA_AddReferencesItem *item) {
+    if(node->nodeClass == UA_NODECLASS_REFERENCETYPE &&
+       UA_NodeId_equal(&item->referenceTypeId, &subtypeId))
+        UA_ReferenceTypeCache_invalidate(server);
     return UA_Node_addReference(node, item);
 }
 
 static UA_StatusCode
 deleteOneWayReference(UA_Server *server, UA_Session *session, UA_Node *node,
                       const UA_DeleteReferencesItem *item) {
+    if(node->nodeClass == UA_NODECLASS_REFERENCETYPE &&
+       UA_NodeId_equal(&item->referenceTypeId, &subtypeId))
+        UA_ReferenceTypeCache_invalidate(server);
     return UA_Node_deleteReference(node, item);
 }
 
@@ -1383,8 +1880,15 @@ UA_StatusCode
 UA_Server_setVariableNode_valueCallback(UA_Server *server,
                                         const UA_NodeId nodeId,
                                         const UA_ValueCallback callback) {
-    return UA_Server_editNode(server, &adminSession, &nodeId,
-                              (UA_EditNodeCallback)setValueCallback, &callback);
+    UA_StatusCode retval =
+        UA_Server_editNode(server, &adminSession, &nodeId,
+                           (UA_EditNodeCallback)setValueCallback, &callback);
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    /* The value can change without a write */
+    if(retval == UA_STATUSCODE_GOOD && callback.onRead)
+        UA_SamplingGroups_stopNotifyOnWrite(server, &nodeId);
+#endif
+    return retval;
 }
 
 /***************************************************/
@@ -1434,15 +1938,51 @@ setDataSource(UA_Server *server, UA_Session *session,
         UA_DataValue_deleteMembers(&node->value.data.value);
     node->value.dataSource = *dataSource;
     node->valueSource = UA_VALUESOURCE_DATASOURCE;
+    UA_DataSourceCache_remove(&server->dataSourceCache, &node->nodeId);
     return UA_STATUSCODE_GOOD;
 }
 
 UA_StatusCode
 UA_Server_setVariableNode_dataSource(UA_Server *server, const UA_NodeId nodeId,
                                      const UA_DataSource dataSource) {
-    return UA_Server_editNode(server, &adminSession, &nodeId,
-                              (UA_EditNodeCallback)setDataSource,
-                              &dataSource);
+    UA_StatusCode retval =
+        UA_Server_editNode(server, &adminSession, &nodeId,
+                           (UA_EditNodeCallback)setDataSource, &dataSource);
+#ifdef UA_ENABLE_SUBSCRIPTIONS
+    /* The value can change without a write */
+    if(retval == UA_STATUSCODE_GOOD)
+        UA_SamplingGroups_stopNotifyOnWrite(server, &nodeId);
+#endif
+    return retval;
+}
+
+typedef struct {
+    const UA_DataSourceBatch *batch;
+    UA_Boolean wasBatched;
+} SetDataSourceBatchContext;
+
+static UA_StatusCode
+setDataSourceBatch(UA_Server *server, UA_Session *session, UA_VariableNode *node,
+                   SetDataSourceBatchContext *ctx) {
+    if(node->nodeClass != UA_NODECLASS_VARIABLE)
+        return UA_STATUSCODE_BADNODECLASSINVALID;
+    ctx->wasBatched = (node->dataSourceBatch != NULL);
+    node->dataSourceBatch = ctx->batch;
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+UA_Server_setVariableNode_dataSourceBatch(UA_Server *server, const UA_NodeId nodeId,
+                                          const UA_DataSourceBatch *batch) {
+    SetDataSourceBatchContext ctx;
+    ctx.batch = batch;
+    ctx.wasBatched = false;
+    UA_StatusCode retval =
+        UA_Server_editNode(server, &adminSession, &nodeId,
+                           (UA_EditNodeCallback)setDataSourceBatch, &ctx);
+    if(retval != UA_STATUSCODE_GOOD || ctx.wasBatched == (batch != NULL))
+        return retval;
+    return UA_Server_updateBatchedNodes(server, &nodeId, batch != NULL);
 }
 
 /************************************/
@@ -253,11 +253,12 @@ Service_ActivateSession(UA_Server *server, UA_SecureChannel *channel,
     if(session->channel && session->channel != channel) {
         UA_LOG_INFO_SESSION(server->config.logger, session,
                             "ActivateSession: Detach from old channel");
-        UA_SecureChannel_detachSession(session->channel, session);
+        UA_SecureChannelManager_detachSession(&server->secureChannelManager,
+                                              session->channel, session);
     }
 
     /* Attach to the SecureChannel and activate */
-    UA_SecureChannel_attachSession(channel, session);
+    UA_SecureChannelManager_attachSession(&server->secureChannelManager, channel, session);
     session->activated = true;
     UA_Session_updateLifetime(session);
     UA_LOG_INFO_SESSION(server->config.logger, session,
@@ -144,10 +144,20 @@ Service_SetPublishingMode(UA_Server *server, UA_Session *session,
                   &response->resultsSize, &UA_TYPES[UA_TYPES_STATUSCODE]);
 }
 
-static void
+static UA_StatusCode
 setMonitoredItemSettings(UA_Server *server, UA_MonitoredItem *mon,
                          UA_MonitoringMode monitoringMode,
                          const UA_MonitoringParameters *params) {
+    /* QueueSize. Resize the sample queue first. The settings are unchanged if
+     * this fails. */
+    UA_UInt32 queueSize;
+    UA_BOUNDEDVALUE_SETWBOUNDS(server->config.queueSizeLimits,
+                               params->queueSize, queueSize);
+    UA_StatusCode retval = MonitoredItem_setQueueSize(mon, queueSize,
+                                                      params->discardOldest);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
     MonitoredItem_unregisterSampleCallback(server, mon);
     mon->monitoringMode = monitoringMode;
 
@@ -156,6 +166,7 @@ setMonitoredItemSettings(UA_Server *server, UA_MonitoredItem *mon,
 
     /* SamplingInterval */
     UA_Double samplingInterval = params->samplingInterval;
+    UA_Boolean notifyOnWrite = false;
     if(mon->attributeID == UA_ATTRIBUTEID_VALUE) {
         const UA_VariableNode *vn = (const UA_VariableNode*)
             UA_Nodestore_get(server, &mon->monitoredNodeId);
@@ -163,6 +174,12 @@ setMonitoredItemSettings(UA_Server *server, UA_MonitoredItem *mon,
             if(vn->nodeClass == UA_NODECLASS_VARIABLE &&
                samplingInterval <  vn->minimumSamplingInterval)
                 samplingInterval = vn->minimumSamplingInterval;
+            /* The value changes only when it is written */
+            if(server->config.monitoredItemsNotifyOnWrite &&
+               samplingInterval == 0.0 && vn->nodeClass == UA_NODECLASS_VARIABLE &&
+               vn->valueSource == UA_VALUESOURCE_DATA &&
+               !vn->value.data.callback.onRead)
+                notifyOnWrite = true;
             UA_Nodestore_release(server, (const UA_Node*)vn);
         }
     } else if(mon->attributeID == UA_ATTRIBUTEID_EVENTNOTIFIER) {
@@ -174,6 +191,8 @@ setMonitoredItemSettings(UA_Server *server, UA_MonitoredItem *mon,
         samplingInterval, mon->samplingInterval);
     if(samplingInterval != samplingInterval) /* Check for nan */
         mon->samplingInterval = server->config.samplingIntervalLimits.min;
+    if(notifyOnWrite)
+        mon->samplingInterval = 0.0;
 
     /* Filter */
     if(params->filter.encoding != UA_EXTENSIONOBJECT_DECODED ||
@@ -185,16 +204,13 @@ setMonitoredItemSettings(UA_Server *server, UA_MonitoredItem *mon,
         mon->trigger = filter->trigger;
     }
 
-    /* QueueSize */
-    UA_BOUNDEDVALUE_SETWBOUNDS(server->config.queueSizeLimits,
-                               params->queueSize, mon->maxQueueSize);
-
     /* DiscardOldest */
     mon->discardOldest = params->discardOldest;
 
     /* Register sample callback if reporting is enabled */
     if(monitoringMode == UA_MONITORINGMODE_REPORTING)
         MonitoredItem_registerSampleCallback(server, mon);
+    return UA_STATUSCODE_GOOD;
 }
 
 static const UA_String binaryEncoding = {sizeof("Default Binary")-1, (UA_Byte*)"Default Binary"};
@@ -240,12 +256,14 @@ Operation_CreateMonitoredItem(UA_Server *server, UA_Session *session,
         return;
     }
 
-    /* Create the monitoreditem */
+    /* Create the monitoreditem. Add it to the subscription right away, so that
+     * MonitoredItem_delete can remove it if the initialization fails. */
     UA_MonitoredItem *newMon = UA_MonitoredItem_new();
     if(!newMon) {
         result->statusCode = UA_STATUSCODE_BADOUTOFMEMORY;
         return;
     }
+    LIST_INSERT_HEAD(&op_sub->monitoredItems, newMon, listEntry);
     UA_StatusCode retval = UA_NodeId_copy(&request->itemToMonitor.nodeId,
                                           &newMon->monitoredNodeId);
     if(retval != UA_STATUSCODE_GOOD) {
@@ -253,20 +271,29 @@ Operation_CreateMonitoredItem(UA_Server *server, UA_Session *session,
         MonitoredItem_delete(server, newMon);
         return;
     }
+    retval = UA_String_copy(&request->itemToMonitor.indexRange, &newMon->indexRange);
+    if(retval != UA_STATUSCODE_GOOD) {
+        result->statusCode = retval;
+        MonitoredItem_delete(server, newMon);
+        return;
+    }
     newMon->subscription = op_sub;
     newMon->attributeID = request->itemToMonitor.attributeId;
     newMon->itemId = ++(op_sub->lastMonitoredItemId);
     newMon->timestampsToReturn = op_timestampsToReturn2;
-    setMonitoredItemSettings(server, newMon, request->monitoringMode,
-                             &request->requestedParameters);
-    LIST_INSERT_HEAD(&op_sub->monitoredItems, newMon, listEntry);
+    retval = setMonitoredItemSettings(server, newMon, request->monitoringMode,
+                                      &request->requestedParameters);
+    if(retval != UA_STATUSCODE_GOOD) {
+        result->statusCode = retval;
+        MonitoredItem_delete(server, newMon);
+        return;
+    }
 
     /* Create the first sample */
     if(request->monitoringMode == UA_MONITORINGMODE_REPORTING)
         UA_MoniteredItem_SampleCallback(server, newMon);
 
     /* Prepare the response */
-    UA_String_copy(&request->itemToMonitor.indexRange, &newMon->indexRange);
     result->revisedSamplingInterval = newMon->samplingInterval;
     result->revisedQueueSize = newMon->maxQueueSize;
     result->monitoredItemId = newMon->itemId;
@@ -315,8 +342,8 @@ Operation_ModifyMonitoredItem(UA_Server *server, UA_Session *session,
         return;
     }
 
-    setMonitoredItemSettings(server, mon, mon->monitoringMode,
-                             &request->requestedParameters);
+    result->statusCode = setMonitoredItemSettings(server, mon, mon->monitoringMode,
+                                                  &request->requestedParameters);
     result->revisedSamplingInterval = mon->samplingInterval;
     result->revisedQueueSize = mon->maxQueueSize;
 }
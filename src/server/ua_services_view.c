@@ -50,8 +50,7 @@ relevantReference(UA_Server *server, UA_Boolean includeSubtypes,
     if(!includeSubtypes)
         return UA_NodeId_equal(rootRef, testRef);
 
-    const UA_NodeId hasSubType = UA_NODEID_NUMERIC(0, UA_NS0ID_HASSUBTYPE);
-    return isNodeInTree(&server->config.nodestore, testRef, rootRef, &hasSubType, 1);
+    return isReferenceTypeSubtype(server, rootRef, testRef);
 }
 
 /* Returns whether the node / continuationpoint is done */
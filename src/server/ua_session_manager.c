@@ -5,11 +5,36 @@
 #include "ua_session_manager.h"
 #include "ua_server_internal.h"
 
+/* Minimum number of buckets in the hash indices */
+#define SESSION_INDEX_MINSIZE 16
+
 UA_StatusCode
 UA_SessionManager_init(UA_SessionManager *sm, UA_Server *server) {
     LIST_INIT(&sm->sessions);
     sm->currentSessionCount = 0;
     sm->server = server;
+    sm->lookups = 0;
+    sm->lookupComparisons = 0;
+
+    /* Size the indices for the maximum number of sessions */
+    sm->indexSize = SESSION_INDEX_MINSIZE;
+    while(sm->indexSize < server->config.maxSessions)
+        sm->indexSize *= 2;
+    sm->tokenIndex = (struct session_list*)
+        UA_malloc(sizeof(struct session_list) * sm->indexSize);
+    sm->idIndex = (struct session_list*)
+        UA_malloc(sizeof(struct session_list) * sm->indexSize);
+    if(!sm->tokenIndex || !sm->idIndex) {
+        UA_free(sm->tokenIndex);
+        UA_free(sm->idIndex);
+        sm->tokenIndex = NULL;
+        sm->idIndex = NULL;
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    }
+    for(size_t i = 0; i < sm->indexSize; i++) {
+        LIST_INIT(&sm->tokenIndex[i]);
+        LIST_INIT(&sm->idIndex[i]);
+    }
     return UA_STATUSCODE_GOOD;
 }
 
@@ -20,12 +45,25 @@ void UA_SessionManager_deleteMembers(UA_SessionManager *sm) {
         UA_Session_deleteMembersCleanup(&current->session, sm->server);
         UA_free(current);
     }
+    UA_free(sm->tokenIndex);
+    UA_free(sm->idIndex);
+    sm->tokenIndex = NULL;
+    sm->idIndex = NULL;
+}
+
+static struct session_list *
+sessionIndexBucket(const UA_SessionManager *sm, struct session_list *index,
+            const UA_NodeId *id) {
+    return &index[UA_NodeId_hash(id) & (sm->indexSize - 1)];
 }
 
 /* Delayed callback to free the session memory */
 static void
 removeSessionCallback(UA_Server *server, void *entry) {
     session_list_entry *sentry = (session_list_entry*)entry;
+    if(sentry->session.channel)
+        UA_SecureChannelManager_detachSession(&server->secureChannelManager,
+                                              sentry->session.channel, &sentry->session);
     UA_Session_deleteMembersCleanup(&sentry->session, server);
     UA_free(sentry);
 }
@@ -47,6 +85,8 @@ removeSession(UA_SessionManager *sm, session_list_entry *sentry) {
 
     /* Detach the session and make the capacity available */
     LIST_REMOVE(sentry, pointers);
+    LIST_REMOVE(sentry, tokenPointers);
+    LIST_REMOVE(sentry, idPointers);
     UA_atomic_add(&sm->currentSessionCount, (UA_UInt32)-1);
     return UA_STATUSCODE_GOOD;
 }
@@ -69,8 +109,11 @@ UA_SessionManager_cleanupTimedOut(UA_SessionManager *sm,
 
 UA_Session *
 UA_SessionManager_getSessionByToken(UA_SessionManager *sm, const UA_NodeId *token) {
+    ++sm->lookups;
     session_list_entry *current = NULL;
-    LIST_FOREACH(current, &sm->sessions, pointers) {
+    LIST_FOREACH(current, sessionIndexBucket(sm, sm->tokenIndex, token), tokenPointers) {
+        ++sm->lookupComparisons;
+
         /* Token does not match */
         if(!UA_NodeId_equal(&current->session.authenticationToken, token))
             continue;
@@ -95,8 +138,11 @@ UA_SessionManager_getSessionByToken(UA_SessionManager *sm, const UA_NodeId *toke
 
 UA_Session *
 UA_SessionManager_getSessionById(UA_SessionManager *sm, const UA_NodeId *sessionId) {
+    ++sm->lookups;
     session_list_entry *current = NULL;
-    LIST_FOREACH(current, &sm->sessions, pointers) {
+    LIST_FOREACH(current, sessionIndexBucket(sm, sm->idIndex, sessionId), idPointers) {
+        ++sm->lookupComparisons;
+
         /* Token does not match */
         if(!UA_NodeId_equal(&current->session.sessionId, sessionId))
             continue;
@@ -143,6 +189,10 @@ UA_SessionManager_createSession(UA_SessionManager *sm, UA_SecureChannel *channel
 
     UA_Session_updateLifetime(&newentry->session);
     LIST_INSERT_HEAD(&sm->sessions, newentry, pointers);
+    LIST_INSERT_HEAD(sessionIndexBucket(sm, sm->tokenIndex, &newentry->session.authenticationToken),
+                     newentry, tokenPointers);
+    LIST_INSERT_HEAD(sessionIndexBucket(sm, sm->idIndex, &newentry->session.sessionId),
+                     newentry, idPointers);
     *session = &newentry->session;
     return UA_STATUSCODE_GOOD;
 }
@@ -150,7 +200,7 @@ UA_SessionManager_createSession(UA_SessionManager *sm, UA_SecureChannel *channel
 UA_StatusCode
 UA_SessionManager_removeSession(UA_SessionManager *sm, const UA_NodeId *token) {
     session_list_entry *current;
-    LIST_FOREACH(current, &sm->sessions, pointers) {
+    LIST_FOREACH(current, sessionIndexBucket(sm, sm->tokenIndex, token), tokenPointers) {
         if(UA_NodeId_equal(&current->session.authenticationToken, token))
             break;
     }
@@ -16,13 +16,29 @@ extern "C" {
 
 typedef struct session_list_entry {
     LIST_ENTRY(session_list_entry) pointers;
+    LIST_ENTRY(session_list_entry) tokenPointers; /* Bucket in the token index */
+    LIST_ENTRY(session_list_entry) idPointers;    /* Bucket in the id index */
     UA_Session session;
 } session_list_entry;
 
+LIST_HEAD(session_list, session_list_entry);
+
 typedef struct UA_SessionManager {
-    LIST_HEAD(session_list, session_list_entry) sessions; // doubly-linked list of sessions
+    struct session_list sessions; // doubly-linked list of sessions
     UA_UInt32 currentSessionCount;
     UA_Server *server;
+
+    /* Hash indices (with chaining) of the sessions by the authentication token
+     * and by the session id. The number of buckets is a power of two. */
+    struct session_list *tokenIndex;
+    struct session_list *idIndex;
+    size_t indexSize;
+
+    /* Metrics for the session lookup, see UA_Server_getSessionStatistics. The
+     * session manager is not locked. So the plain counters are approximate
+     * when sessions are looked up from several worker threads. */
+    UA_UInt64 lookups;
+    UA_UInt64 lookupComparisons;
 } UA_SessionManager;
 
 UA_StatusCode
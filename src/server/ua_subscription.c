@@ -84,13 +84,11 @@ countQueuedNotifications(UA_Subscription *sub,
     size_t notifications = 0;
     UA_MonitoredItem *mon;
     LIST_FOREACH(mon, &sub->monitoredItems, listEntry) {
-        MonitoredItem_queuedValue *qv;
-        TAILQ_FOREACH(qv, &mon->queue, listEntry) {
-            if(notifications >= sub->notificationsPerPublish) {
-                *moreNotifications = true;
-                break;
-            }
-            ++notifications;
+        notifications += mon->currentQueueSize;
+        if(notifications > sub->notificationsPerPublish) {
+            notifications = sub->notificationsPerPublish;
+            *moreNotifications = true;
+            break;
         }
     }
     return notifications;
@@ -156,18 +154,12 @@ static void
 moveNotificationsFromMonitoredItems(UA_Subscription *sub, UA_MonitoredItem *mon,
                                     UA_MonitoredItemNotification *mins, size_t minsSize,
                                     size_t *pos) {
-    MonitoredItem_queuedValue *qv, *qv_tmp;
     while(mon) {
         sub->lastSendMonitoredItemId = mon->itemId;
-        TAILQ_FOREACH_SAFE(qv, &mon->queue, listEntry, qv_tmp) {
+        while(mon->currentQueueSize > 0) {
             if(*pos >= minsSize)
                 return;
-            UA_MonitoredItemNotification *min = &mins[*pos];
-            min->clientHandle = qv->clientHandle;
-            min->value = qv->value;
-            TAILQ_REMOVE(&mon->queue, qv, listEntry);
-            UA_free(qv);
-            --mon->currentQueueSize;
+            MonitoredItem_dequeueNotification(mon, &mins[*pos]);
             ++(*pos);
         }
         mon = LIST_NEXT(mon, listEntry);
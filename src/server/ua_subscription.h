@@ -20,13 +20,22 @@ typedef enum {
     UA_MONITOREDITEMTYPE_EVENTNOTIFY = 4
 } UA_MonitoredItemType;
 
+/* Slot in the sample queue. Scalars of small pointer-free types are stored in
+ * the slot itself, so that sampling does not allocate. */
 typedef struct MonitoredItem_queuedValue {
-    TAILQ_ENTRY(MonitoredItem_queuedValue) listEntry;
     UA_UInt32 clientHandle;
     UA_DataValue value;
+    union {
+        UA_Byte data[16];
+        UA_UInt64 alignInteger;
+        UA_Double alignDouble;
+    } scalar;
 } MonitoredItem_queuedValue;
 
-typedef TAILQ_HEAD(QueuedValueQueue, MonitoredItem_queuedValue) QueuedValueQueue;
+struct UA_SamplingGroup;
+typedef struct UA_SamplingGroup UA_SamplingGroup;
+struct UA_SamplingTick;
+typedef struct UA_SamplingTick UA_SamplingTick;
 
 typedef struct UA_MonitoredItem {
     LIST_ENTRY(UA_MonitoredItem) listEntry;
@@ -48,21 +57,78 @@ typedef struct UA_MonitoredItem {
     // TODO: dataEncoding is hardcoded to UA binary
     UA_DataChangeTrigger trigger;
 
-    /* Sample Callback */
-    UA_UInt64 sampleCallbackId;
+    /* Sample Callback. The MonitoredItem is sampled by the callback of its
+     * SamplingGroup. */
+    UA_SamplingGroup *samplingGroup;
+    LIST_ENTRY(UA_MonitoredItem) samplingGroupEntry;
     UA_Boolean sampleCallbackIsRegistered;
 
-    /* Sample Queue */
-    UA_ByteString lastSampledValue;
-    QueuedValueQueue queue;
+    /* Sample Queue. A ring buffer with maxQueueSize slots that are reused
+     * between the samples. Only the hash of the last sample is kept for the
+     * change detection. */
+    UA_UInt64 lastSampledHash;
+    UA_Boolean hasLastSampledHash;
+    MonitoredItem_queuedValue *queue;
+    UA_UInt32 queueStart; /* Slot of the oldest sample */
 } UA_MonitoredItem;
 
+/* MonitoredItems that sample the same attribute at the same interval share a
+ * SamplingGroup. The group reads the value once per interval and hands the
+ * sample to each of its MonitoredItems. The read is done with the admin
+ * session. For the attributes whose value depends on the session (including
+ * the value of DataSource variables), the session is part of the key of the
+ * group and the read is done with that session. Groups with a samplingInterval
+ * of zero are not part of a tick. They are sampled after every write to the
+ * value. */
+struct UA_SamplingGroup {
+    LIST_ENTRY(UA_SamplingGroup) listEntry;
+    UA_NodeId nodeId;
+    UA_UInt32 attributeId;
+    UA_String indexRange;
+    UA_Double samplingInterval;
+    UA_Session *session; /* NULL if the group is shared between sessions */
+    UA_SamplingTick *tick; /* NULL for a samplingInterval of zero */
+    LIST_ENTRY(UA_SamplingGroup) tickEntry;
+    LIST_HEAD(, UA_MonitoredItem) monitoredItems;
+};
+
+/* The groups with the same samplingInterval share a repeated callback. So the
+ * values of batched DataSources are read with one call per tick. */
+struct UA_SamplingTick {
+    LIST_ENTRY(UA_SamplingTick) listEntry;
+    UA_Double samplingInterval;
+    UA_UInt64 callbackId;
+    size_t groupsSize;
+    LIST_HEAD(, UA_SamplingGroup) groups;
+};
+
 UA_MonitoredItem * UA_MonitoredItem_new(void);
 void MonitoredItem_delete(UA_Server *server, UA_MonitoredItem *monitoredItem);
 void UA_MoniteredItem_SampleCallback(UA_Server *server, UA_MonitoredItem *monitoredItem);
 UA_StatusCode MonitoredItem_registerSampleCallback(UA_Server *server, UA_MonitoredItem *mon);
 UA_StatusCode MonitoredItem_unregisterSampleCallback(UA_Server *server, UA_MonitoredItem *mon);
 
+/* Resize the sample queue. Surplus samples are discarded according to
+ * discardOldest. */
+UA_StatusCode MonitoredItem_setQueueSize(UA_MonitoredItem *mon, UA_UInt32 queueSize,
+                                         UA_Boolean discardOldest);
+
+/* Move the oldest sample from the queue into the notification */
+void MonitoredItem_dequeueNotification(UA_MonitoredItem *mon,
+                                       UA_MonitoredItemNotification *min);
+
+/* Remove all SamplingGroups when the server is deleted */
+void UA_SamplingGroups_delete(UA_Server *server);
+
+/* Sample the groups that are notified on write after the value of the node
+ * was written */
+void UA_SamplingGroups_notifyWrite(UA_Server *server, const UA_NodeId *nodeId);
+
+/* Move the MonitoredItems that are notified on write back to the sampling by
+ * the timer. For example after the node got a DataSource or an onRead
+ * callback. Then the value can change without a write. */
+void UA_SamplingGroups_stopNotifyOnWrite(UA_Server *server, const UA_NodeId *nodeId);
+
 /****************/
 /* Subscription */
 /****************/
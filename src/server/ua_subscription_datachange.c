@@ -9,6 +9,7 @@
 #ifdef UA_ENABLE_SUBSCRIPTIONS /* conditional compilation */
 
 #define UA_VALUENCODING_MAXSTACK 512
+#define UA_VALUEHASH_SEED 0xcbf29ce484222325 /* FNV-1a offset basis */
 
 UA_MonitoredItem *
 UA_MonitoredItem_new(void) {
@@ -21,28 +22,138 @@ UA_MonitoredItem_new(void) {
     /* Remaining members are covered by calloc zeroing out the memory */
     newItem->monitoredItemType = UA_MONITOREDITEMTYPE_CHANGENOTIFY; /* currently hardcoded */
     newItem->timestampsToReturn = UA_TIMESTAMPSTORETURN_SOURCE;
-    TAILQ_INIT(&newItem->queue);
     return newItem;
 }
 
+/****************/
+/* Sample Queue */
+/****************/
+
+/* Slot at the position counted from the oldest sample */
+static MonitoredItem_queuedValue *
+queueSlot(const UA_MonitoredItem *mon, UA_UInt32 pos) {
+    return &mon->queue[(mon->queueStart + pos) % mon->maxQueueSize];
+}
+
+static UA_Boolean
+isStoredInPlace(const MonitoredItem_queuedValue *qv) {
+    return qv->value.value.data == qv->scalar.data;
+}
+
+/* Remove the oldest or the newest sample */
+static void
+discardQueuedValue(UA_MonitoredItem *mon, UA_Boolean discardOldest) {
+    UA_assert(mon->currentQueueSize > 0);
+    MonitoredItem_queuedValue *qv;
+    if(discardOldest) {
+        qv = queueSlot(mon, 0);
+        mon->queueStart = (mon->queueStart + 1) % mon->maxQueueSize;
+    } else {
+        qv = queueSlot(mon, mon->currentQueueSize - 1);
+    }
+    UA_DataValue_deleteMembers(&qv->value); /* Does not touch in-place data */
+    --mon->currentQueueSize;
+}
+
+/* Store the sample in the slot. Returns whether the value was moved into the
+ * slot. Otherwise the slot holds a copy. */
+static UA_StatusCode
+storeQueuedValue(MonitoredItem_queuedValue *qv, const UA_DataValue *value,
+                 UA_Boolean *moved) {
+    *moved = false;
+    qv->value = *value;
+    const UA_Variant *v = &value->value;
+
+    /* Small scalars are copied in place */
+    if(value->hasValue && v->type && v->type->pointerFree &&
+       v->type->memSize <= sizeof(qv->scalar) && UA_Variant_isScalar(v) &&
+       v->data > UA_EMPTY_ARRAY_SENTINEL) {
+        memcpy(qv->scalar.data, v->data, v->type->memSize);
+        qv->value.value.data = qv->scalar.data;
+        qv->value.value.storageType = UA_VARIANT_DATA_NODELETE;
+        return UA_STATUSCODE_GOOD;
+    }
+
+    /* Make a deep copy of a shared value */
+    if(value->hasValue && v->storageType == UA_VARIANT_DATA_NODELETE)
+        return UA_DataValue_copy(value, &qv->value);
+
+    /* Take over the value */
+    *moved = true;
+    return UA_STATUSCODE_GOOD;
+}
+
+UA_StatusCode
+MonitoredItem_setQueueSize(UA_MonitoredItem *mon, UA_UInt32 queueSize,
+                           UA_Boolean discardOldest) {
+    if(queueSize == 0)
+        queueSize = 1;
+    if(queueSize == mon->maxQueueSize)
+        return UA_STATUSCODE_GOOD;
+
+    MonitoredItem_queuedValue *queue = (MonitoredItem_queuedValue*)
+        UA_calloc(queueSize, sizeof(MonitoredItem_queuedValue));
+    if(!queue)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    /* Discard the samples that don't fit */
+    while(mon->currentQueueSize > queueSize)
+        discardQueuedValue(mon, discardOldest);
+
+    /* Move the remaining samples to the start of the new ring buffer */
+    for(UA_UInt32 i = 0; i < mon->currentQueueSize; i++) {
+        MonitoredItem_queuedValue *qv = queueSlot(mon, i);
+        queue[i] = *qv;
+        if(isStoredInPlace(qv))
+            queue[i].value.value.data = queue[i].scalar.data;
+    }
+
+    UA_free(mon->queue);
+    mon->queue = queue;
+    mon->queueStart = 0;
+    mon->maxQueueSize = queueSize;
+    return UA_STATUSCODE_GOOD;
+}
+
+void
+MonitoredItem_dequeueNotification(UA_MonitoredItem *mon,
+                                  UA_MonitoredItemNotification *min) {
+    UA_assert(mon->currentQueueSize > 0);
+    MonitoredItem_queuedValue *qv = queueSlot(mon, 0);
+    min->clientHandle = qv->clientHandle;
+    min->value = qv->value;
+
+    /* The notification outlives the slot. Copy the in-place value. */
+    if(isStoredInPlace(qv)) {
+        UA_StatusCode retval = UA_Variant_setScalarCopy(&min->value.value, qv->scalar.data,
+                                                        qv->value.value.type);
+        if(retval != UA_STATUSCODE_GOOD) {
+            UA_Variant_init(&min->value.value);
+            min->value.hasValue = false;
+            min->value.hasStatus = true;
+            min->value.status = retval;
+        }
+    }
+
+    UA_DataValue_init(&qv->value);
+    mon->queueStart = (mon->queueStart + 1) % mon->maxQueueSize;
+    --mon->currentQueueSize;
+}
+
 void
 MonitoredItem_delete(UA_Server *server, UA_MonitoredItem *monitoredItem) {
     /* Remove the sampling callback */
     MonitoredItem_unregisterSampleCallback(server, monitoredItem);
 
     /* Clear the queued samples */
-    MonitoredItem_queuedValue *val, *val_tmp;
-    TAILQ_FOREACH_SAFE(val, &monitoredItem->queue, listEntry, val_tmp) {
-        TAILQ_REMOVE(&monitoredItem->queue, val, listEntry);
-        UA_DataValue_deleteMembers(&val->value);
-        UA_free(val);
-    }
-    monitoredItem->currentQueueSize = 0;
+    while(monitoredItem->currentQueueSize > 0)
+        discardQueuedValue(monitoredItem, true);
+    UA_free(monitoredItem->queue);
+    monitoredItem->queue = NULL;
 
     /* Remove the monitored item */
     LIST_REMOVE(monitoredItem, listEntry);
     UA_String_deleteMembers(&monitoredItem->indexRange);
-    UA_ByteString_deleteMembers(&monitoredItem->lastSampledValue);
     UA_NodeId_deleteMembers(&monitoredItem->monitoredNodeId);
     UA_free(monitoredItem); // TODO: Use a delayed free
 }
@@ -52,53 +163,108 @@ ensureSpaceInMonitoredItemQueue(UA_MonitoredItem *mon) {
     /* Enough space, nothing to do here */
     if(mon->currentQueueSize < mon->maxQueueSize)
         return;
+    discardQueuedValue(mon, mon->discardOldest);
+}
+
+/* Mix the bytes into the 64-bit hash. Eight bytes are processed at a time. */
+static UA_UInt64
+hashBytes(UA_UInt64 h, const UA_Byte *data, size_t length) {
+    for(; length >= 8; length -= 8, data += 8) {
+        UA_UInt64 word;
+        memcpy(&word, data, 8);
+        h = (h ^ word) * 0x9e3779b97f4a7c15;
+        h ^= h >> 29;
+    }
+    for(; length > 0; --length, ++data)
+        h = (h ^ *data) * 0x100000001b3; /* FNV-1a prime */
+    return h;
+}
+
+/* Used as the callback for the "chunking" of the encoding. Every time the
+ * stack buffer is full, the content is hashed and the buffer is reused. */
+typedef struct {
+    UA_Byte *buf;
+    UA_UInt64 hash;
+} ValueHashContext;
+
+static UA_StatusCode
+hashEncodedChunk(void *handle, UA_Byte **bufPos, const UA_Byte **bufEnd) {
+    ValueHashContext *ctx = (ValueHashContext*)handle;
+    ctx->hash = hashBytes(ctx->hash, ctx->buf, (uintptr_t)*bufPos - (uintptr_t)ctx->buf);
+    *bufPos = ctx->buf;
+    *bufEnd = &ctx->buf[UA_VALUENCODING_MAXSTACK];
+    return UA_STATUSCODE_GOOD;
+}
 
-    /* Get the item to remove */
-    MonitoredItem_queuedValue *queueItem;
-    if(mon->discardOldest)
-        queueItem = TAILQ_FIRST(&mon->queue);
+/* Overlayable values (scalars and arrays of numerical types) are hashed
+ * directly from memory. The encoding of the remaining fields is short. */
+static UA_StatusCode
+hashValueOverlayable(const UA_DataValue *value, UA_UInt64 *hash) {
+    const UA_Variant *v = &value->value;
+    UA_DataValue header = *value;
+    header.hasValue = false;
+    UA_Byte buf[64];
+    UA_Byte *bufPos = buf;
+    const UA_Byte *bufEnd = &buf[sizeof(buf)];
+    UA_StatusCode retval = UA_encodeBinary(&header, &UA_TYPES[UA_TYPES_DATAVALUE],
+                                           &bufPos, &bufEnd, NULL, NULL);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+
+    size_t length = UA_Variant_isScalar(v) ? 1 : v->arrayLength;
+    UA_UInt64 h = hashBytes(UA_VALUEHASH_SEED, buf, (uintptr_t)bufPos - (uintptr_t)buf);
+    h = hashBytes(h, (const UA_Byte*)&v->type, sizeof(const UA_DataType*));
+    h = hashBytes(h, (const UA_Byte*)&length, sizeof(size_t));
+    if(v->data > UA_EMPTY_ARRAY_SENTINEL)
+        h = hashBytes(h, (const UA_Byte*)v->data, v->type->memSize * length);
     else
-        queueItem = TAILQ_LAST(&mon->queue, QueuedValueQueue);
-    UA_assert(queueItem);
+        h = hashBytes(h, (const UA_Byte*)&v->data, sizeof(void*)); /* NULL or empty */
+    *hash = h;
+    return UA_STATUSCODE_GOOD;
+}
 
-    /* Remove the item */
-    TAILQ_REMOVE(&mon->queue, queueItem, listEntry);
-    UA_DataValue_deleteMembers(&queueItem->value);
-    UA_free(queueItem);
-    --mon->currentQueueSize;
+/* Compute a 64-bit hash over the binary encoding of the (filtered) value.
+ * Instead of the full encoding, only the hash is stored for the comparison with
+ * the next sample. */
+static UA_StatusCode
+hashValue(const UA_DataValue *value, UA_UInt64 *hash) {
+    /* Fast path */
+    const UA_Variant *v = &value->value;
+    if(value->hasValue && v->type && v->type->overlayable &&
+       v->arrayDimensionsSize == 0)
+        return hashValueOverlayable(value, hash);
+
+    /* Stream the encoding through a small buffer on the stack */
+    UA_Byte buf[UA_VALUENCODING_MAXSTACK];
+    ValueHashContext ctx;
+    ctx.buf = buf;
+    ctx.hash = UA_VALUEHASH_SEED;
+    UA_Byte *bufPos = buf;
+    const UA_Byte *bufEnd = &buf[UA_VALUENCODING_MAXSTACK];
+    UA_StatusCode retval = UA_encodeBinary(value, &UA_TYPES[UA_TYPES_DATAVALUE],
+                                           &bufPos, &bufEnd, hashEncodedChunk, &ctx);
+    if(retval != UA_STATUSCODE_GOOD)
+        return retval;
+    hashEncodedChunk(&ctx, &bufPos, &bufEnd);
+    *hash = ctx.hash;
+    return UA_STATUSCODE_GOOD;
 }
 
 /* Errors are returned as no change detected */
 static UA_Boolean
 detectValueChangeWithFilter(UA_MonitoredItem *mon, UA_DataValue *value,
-                            UA_ByteString *encoding) {
-    /* Encode the data for comparison */
-    size_t binsize = UA_calcSizeBinary(value, &UA_TYPES[UA_TYPES_DATAVALUE]);
-    if(binsize == 0)
-        return false;
-
-    /* Allocate buffer on the heap if necessary */
-    if(binsize > UA_VALUENCODING_MAXSTACK &&
-       UA_ByteString_allocBuffer(encoding, binsize) != UA_STATUSCODE_GOOD)
-        return false;
-
-    /* Encode the value */
-    UA_Byte *bufPos = encoding->data;
-    const UA_Byte *bufEnd = &encoding->data[encoding->length];
-    UA_StatusCode retval = UA_encodeBinary(value, &UA_TYPES[UA_TYPES_DATAVALUE],
-                                           &bufPos, &bufEnd, NULL, NULL);
-    if(retval != UA_STATUSCODE_GOOD)
+                            UA_UInt64 *hash) {
+    if(hashValue(value, hash) != UA_STATUSCODE_GOOD)
         return false;
 
     /* The value has changed */
-    encoding->length = (uintptr_t)bufPos - (uintptr_t)encoding->data;
-    return !mon->lastSampledValue.data || !UA_String_equal(encoding, &mon->lastSampledValue);
+    return !mon->hasLastSampledHash || *hash != mon->lastSampledHash;
 }
 
-/* Has this sample changed from the last one? The method may allocate additional
- * space for the encoding buffer. Detect the change in encoding->data. */
+/* Has this sample changed from the last one? The hash of the sample is
+ * returned for the comparison with the next sample. */
 static UA_Boolean
-detectValueChange(UA_MonitoredItem *mon, UA_DataValue *value, UA_ByteString *encoding) {
+detectValueChange(UA_MonitoredItem *mon, UA_DataValue *value, UA_UInt64 *hash) {
     /* Apply Filter */
     UA_Boolean hasValue = value->hasValue;
     if(mon->trigger == UA_DATACHANGETRIGGER_STATUS)
@@ -117,7 +283,7 @@ detectValueChange(UA_MonitoredItem *mon, UA_DataValue *value, UA_ByteString *enc
     }
 
     /* Detect the Value Change */
-    UA_Boolean res = detectValueChangeWithFilter(mon, value, encoding);
+    UA_Boolean res = detectValueChangeWithFilter(mon, value, hash);
 
     /* Reset the filter */
     value->hasValue = hasValue;
@@ -128,62 +294,34 @@ detectValueChange(UA_MonitoredItem *mon, UA_DataValue *value, UA_ByteString *enc
     return res;
 }
 
-/* Returns whether a new sample was created */
+/* Returns whether the value was moved into the queue. Otherwise the caller
+ * keeps the ownership of the value. */
 static UA_Boolean
 sampleCallbackWithValue(UA_Server *server, UA_Subscription *sub,
                         UA_MonitoredItem *monitoredItem,
-                        UA_DataValue *value,
-                        UA_ByteString *valueEncoding) {
-    /* Store the pointer to the stack-allocated bytestring to see if a heap-allocation
-     * was necessary */
-    UA_Byte *stackValueEncoding = valueEncoding->data;
-
+                        UA_DataValue *value) {
     /* Has the value changed? */
-    UA_Boolean changed = detectValueChange(monitoredItem, value, valueEncoding);
-    if(!changed)
+    UA_UInt64 hash = 0;
+    UA_Boolean changed = detectValueChange(monitoredItem, value, &hash);
+    if(!changed || monitoredItem->maxQueueSize == 0)
         return false;
 
-    /* Allocate the entry for the publish queue */
-    MonitoredItem_queuedValue *newQueueItem =
-        (MonitoredItem_queuedValue *)UA_malloc(sizeof(MonitoredItem_queuedValue));
-    if(!newQueueItem) {
+    /* Reuse the slot after the newest sample. The queue does not grow beyond
+     * maxQueueSize. */
+    ensureSpaceInMonitoredItemQueue(monitoredItem);
+    MonitoredItem_queuedValue *qv =
+        queueSlot(monitoredItem, monitoredItem->currentQueueSize);
+    UA_Boolean moved = false;
+    UA_StatusCode retval = storeQueuedValue(qv, value, &moved);
+    if(retval != UA_STATUSCODE_GOOD) {
         UA_LOG_WARNING_SESSION(server->config.logger, sub->session,
                                "Subscription %u | MonitoredItem %i | "
-                               "Item for the publishing queue could not be allocated",
+                               "Item for the publishing queue could not be prepared",
                                sub->subscriptionID, monitoredItem->itemId);
+        UA_DataValue_init(&qv->value);
         return false;
     }
-
-    /* Copy valueEncoding on the heap for the next comparison (if not already done) */
-    if(valueEncoding->data == stackValueEncoding) {
-        UA_ByteString cbs;
-        if(UA_ByteString_copy(valueEncoding, &cbs) != UA_STATUSCODE_GOOD) {
-            UA_LOG_WARNING_SESSION(server->config.logger, sub->session,
-                                   "Subscription %u | MonitoredItem %i | "
-                                   "ByteString to compare values could not be created",
-                                   sub->subscriptionID, monitoredItem->itemId);
-            UA_free(newQueueItem);
-            return false;
-        }
-        *valueEncoding = cbs;
-    }
-
-    /* Prepare the newQueueItem */
-    if(value->hasValue && value->value.storageType == UA_VARIANT_DATA_NODELETE) {
-        /* Make a deep copy of the value */
-        UA_StatusCode retval = UA_DataValue_copy(value, &newQueueItem->value);
-        if(retval != UA_STATUSCODE_GOOD) {
-            UA_LOG_WARNING_SESSION(server->config.logger, sub->session,
-                                   "Subscription %u | MonitoredItem %i | "
-                                   "Item for the publishing queue could not be prepared",
-                                   sub->subscriptionID, monitoredItem->itemId);
-            UA_free(newQueueItem);
-            return false;
-        }
-    } else {
-        newQueueItem->value = *value; /* Just copy the value and do not release it */
-    }
-    newQueueItem->clientHandle = monitoredItem->clientHandle;
+    qv->clientHandle = monitoredItem->clientHandle;
 
     /* <-- Point of no return --> */
 
@@ -191,15 +329,13 @@ sampleCallbackWithValue(UA_Server *server, UA_Subscription *sub,
                          "Subscription %u | MonitoredItem %u | Sampled a new value",
                          sub->subscriptionID, monitoredItem->itemId);
 
-    /* Replace the encoding for comparison */
-    UA_ByteString_deleteMembers(&monitoredItem->lastSampledValue);
-    monitoredItem->lastSampledValue = *valueEncoding;
+    /* Replace the hash for comparison */
+    monitoredItem->lastSampledHash = hash;
+    monitoredItem->hasLastSampledHash = true;
 
     /* Add the sample to the queue for publication */
-    ensureSpaceInMonitoredItemQueue(monitoredItem);
-    TAILQ_INSERT_TAIL(&monitoredItem->queue, newQueueItem, listEntry);
     ++monitoredItem->currentQueueSize;
-    return true;;
+    return moved;
 }
 
 void
@@ -224,34 +360,387 @@ UA_MoniteredItem_SampleCallback(UA_Server *server,
         UA_Server_readWithSession(server, sub->session,
                                   &rvid, monitoredItem->timestampsToReturn);
 
-    /* Stack-allocate some memory for the value encoding. We might heap-allocate
-     * more memory if needed. This is just enough for scalars and small
-     * structures. */
-    UA_Byte *stackValueEncoding = (UA_Byte *)UA_alloca(UA_VALUENCODING_MAXSTACK);
-    UA_ByteString valueEncoding;
-    valueEncoding.data = stackValueEncoding;
-    valueEncoding.length = UA_VALUENCODING_MAXSTACK;
-
     /* Create a sample and compare with the last value */
-    UA_Boolean newNotification = sampleCallbackWithValue(server, sub, monitoredItem,
-                                                         &value, &valueEncoding);
+    UA_Boolean movedIntoQueue = sampleCallbackWithValue(server, sub, monitoredItem,
+                                                        &value);
 
     /* Clean up */
-    if(!newNotification) {
-        if(valueEncoding.data != stackValueEncoding)
-            UA_ByteString_deleteMembers(&valueEncoding);
+    if(!movedIntoQueue)
         UA_DataValue_deleteMembers(&value);
+}
+
+/******************/
+/* Sampling Group */
+/******************/
+
+/* The value of these attributes depends on the session that reads */
+static UA_Boolean
+isSessionDependentAttribute(UA_UInt32 attributeId) {
+    return (attributeId == UA_ATTRIBUTEID_USERWRITEMASK ||
+            attributeId == UA_ATTRIBUTEID_USERACCESSLEVEL ||
+            attributeId == UA_ATTRIBUTEID_USEREXECUTABLE);
+}
+
+/* A DataSource can return a different value to every session. So the value is
+ * sampled with the session of the MonitoredItem. */
+static UA_Boolean
+isSessionDependentValue(UA_Server *server, const UA_NodeId *nodeId) {
+    const UA_Node *node = UA_Nodestore_get(server, nodeId);
+    if(!node)
+        return false;
+    UA_Boolean dependent =
+        ((node->nodeClass == UA_NODECLASS_VARIABLE ||
+          node->nodeClass == UA_NODECLASS_VARIABLETYPE) &&
+         ((const UA_VariableNode*)node)->valueSource == UA_VALUESOURCE_DATASOURCE);
+    UA_Nodestore_release(server, node);
+    return dependent;
+}
+
+static void
+samplingGroupReadValueId(const UA_SamplingGroup *group, UA_ReadValueId *rvid) {
+    UA_ReadValueId_init(rvid);
+    rvid->nodeId = group->nodeId;
+    rvid->attributeId = group->attributeId;
+    rvid->indexRange = group->indexRange;
+}
+
+static void
+samplingGroupCallback(UA_Server *server, UA_SamplingGroup *group,
+                      UA_ReadAheadValue *readAhead) {
+    /* Read the value once for all MonitoredItems of the group. All timestamps
+     * are read and then filtered for the individual MonitoredItems. */
+    UA_Session *session = group->session ? group->session : &adminSession;
+    UA_ReadValueId rvid;
+    samplingGroupReadValueId(group, &rvid);
+    UA_DataValue value =
+        UA_Server_readWithReadAhead(server, session, &rvid,
+                                    UA_TIMESTAMPSTORETURN_BOTH, readAhead);
+
+    /* Forward the sample. The MonitoredItems copy the value only if it has
+     * changed from their last sample. */
+    UA_MonitoredItem *mon, *mon_tmp;
+    LIST_FOREACH_SAFE(mon, &group->monitoredItems, samplingGroupEntry, mon_tmp) {
+        UA_Subscription *sub = mon->subscription;
+        if(mon->monitoredItemType != UA_MONITOREDITEMTYPE_CHANGENOTIFY) {
+            UA_LOG_DEBUG_SESSION(server->config.logger, sub->session,
+                                 "Subscription %u | MonitoredItem %i | "
+                                 "Not a data change notification",
+                                 sub->subscriptionID, mon->itemId);
+            continue;
+        }
+
+        UA_DataValue sample = value;
+        sample.value.storageType = UA_VARIANT_DATA_NODELETE;
+
+        /* Check the access rights of the session for the shared sample */
+        if(!group->session && group->attributeId == UA_ATTRIBUTEID_VALUE &&
+           value.hasValue && !readValueAllowed(server, sub->session, &group->nodeId)) {
+            UA_DataValue_init(&sample);
+            sample.hasStatus = true;
+            sample.status = UA_STATUSCODE_BADUSERACCESSDENIED;
+        }
+
+        /* Filter the timestamps */
+        if(mon->timestampsToReturn == UA_TIMESTAMPSTORETURN_SERVER ||
+           mon->timestampsToReturn == UA_TIMESTAMPSTORETURN_NEITHER) {
+            sample.hasSourceTimestamp = false;
+            sample.hasSourcePicoseconds = false;
+        }
+        if(mon->timestampsToReturn == UA_TIMESTAMPSTORETURN_SOURCE ||
+           mon->timestampsToReturn == UA_TIMESTAMPSTORETURN_NEITHER) {
+            sample.hasServerTimestamp = false;
+            sample.hasServerPicoseconds = false;
+        }
+
+        sampleCallbackWithValue(server, sub, mon, &sample);
+    }
+
+    UA_DataValue_deleteMembers(&value);
+}
+
+/* Read the values of batched DataSources ahead. The values are read with the
+ * session of the group. So there is one batched read per session. Returns NULL
+ * if there are no batches or the allocation fails. Then all values are read
+ * individually. */
+static UA_ReadAheadValue *
+samplingTickReadAhead(UA_Server *server, UA_SamplingTick *tick) {
+    size_t groupsSize = tick->groupsSize;
+    if(!UA_atomic_load(&server->batchedNodes) || groupsSize == 0)
+        return NULL;
+
+    UA_ReadAheadValue *readAhead = (UA_ReadAheadValue*)
+        UA_calloc(groupsSize, sizeof(UA_ReadAheadValue));
+    UA_SamplingGroup **groups = (UA_SamplingGroup**)
+        UA_malloc(groupsSize * sizeof(UA_SamplingGroup*));
+    UA_ReadValueId *rvids = (UA_ReadValueId*)
+        UA_malloc(groupsSize * sizeof(UA_ReadValueId));
+    size_t *indices = (size_t*)UA_malloc(groupsSize * sizeof(size_t));
+    UA_Boolean *done = (UA_Boolean*)UA_calloc(groupsSize, sizeof(UA_Boolean));
+    if(!readAhead || !groups || !rvids || !indices || !done) {
+        UA_free(readAhead);
+        UA_free(groups);
+        UA_free(rvids);
+        UA_free(indices);
+        UA_free(done);
+        return NULL;
+    }
+
+    size_t i = 0;
+    UA_SamplingGroup *group;
+    LIST_FOREACH(group, &tick->groups, tickEntry)
+        groups[i++] = group;
+
+    for(i = 0; i < groupsSize; i++) {
+        if(done[i])
+            continue;
+
+        /* Collect the groups of the session */
+        size_t idsSize = 0;
+        UA_Session *session = groups[i]->session;
+        for(size_t j = i; j < groupsSize; j++) {
+            if(done[j] || groups[j]->session != session)
+                continue;
+            done[j] = true;
+            samplingGroupReadValueId(groups[j], &rvids[idsSize]);
+            indices[idsSize++] = j;
+        }
+
+        /* Move the values into the slots of the groups */
+        UA_ReadAheadValue *sessionReadAhead =
+            UA_Server_readAhead(server, session ? session : &adminSession,
+                                idsSize, rvids, UA_TIMESTAMPSTORETURN_BOTH, 0.0);
+        if(!sessionReadAhead)
+            continue;
+        for(size_t j = 0; j < idsSize; j++)
+            readAhead[indices[j]] = sessionReadAhead[j];
+        UA_free(sessionReadAhead);
+    }
+
+    UA_free(groups);
+    UA_free(rvids);
+    UA_free(indices);
+    UA_free(done);
+    return readAhead;
+}
+
+static void
+samplingTickCallback(UA_Server *server, UA_SamplingTick *tick) {
+    size_t groupsSize = tick->groupsSize;
+    UA_ReadAheadValue *readAhead = samplingTickReadAhead(server, tick);
+
+    /* The sampling does not add or remove groups */
+    size_t i = 0;
+    UA_SamplingGroup *group;
+    LIST_FOREACH(group, &tick->groups, tickEntry) {
+        samplingGroupCallback(server, group, readAhead ? &readAhead[i] : NULL);
+        i++;
+    }
+
+    if(readAhead)
+        UA_ReadAheadValues_delete(readAhead, groupsSize);
+}
+
+static UA_ListOfSamplingGroups *
+onWriteSamplingGroups(UA_Server *server, const UA_NodeId *nodeId) {
+    return &server->onWriteSamplingGroups[UA_NodeId_hash(nodeId) %
+                                          UA_ONWRITE_SAMPLINGGROUPS_HASH_PRIME];
+}
+
+static UA_SamplingGroup *
+findSamplingGroup(UA_Server *server, const UA_MonitoredItem *mon,
+                  const UA_Session *session) {
+    UA_SamplingGroup *group;
+    UA_ListOfSamplingGroups *groups = &server->samplingGroups;
+    if(mon->samplingInterval == 0.0)
+        groups = onWriteSamplingGroups(server, &mon->monitoredNodeId);
+    LIST_FOREACH(group, groups, listEntry) {
+        if(group->samplingInterval == mon->samplingInterval &&
+           group->attributeId == mon->attributeID &&
+           group->session == session &&
+           UA_NodeId_equal(&group->nodeId, &mon->monitoredNodeId) &&
+           UA_String_equal(&group->indexRange, &mon->indexRange))
+            return group;
+    }
+    return NULL;
+}
+
+static UA_StatusCode
+joinSamplingTick(UA_Server *server, UA_SamplingGroup *group) {
+    UA_SamplingTick *tick;
+    LIST_FOREACH(tick, &server->samplingTicks, listEntry) {
+        if(tick->samplingInterval == group->samplingInterval)
+            break;
+    }
+
+    if(!tick) {
+        tick = (UA_SamplingTick*)UA_calloc(1, sizeof(UA_SamplingTick));
+        if(!tick)
+            return UA_STATUSCODE_BADOUTOFMEMORY;
+        tick->samplingInterval = group->samplingInterval;
+        LIST_INIT(&tick->groups);
+        UA_StatusCode retval =
+            UA_Server_addRepeatedCallback(server, (UA_ServerCallback)samplingTickCallback,
+                                          tick, (UA_UInt32)group->samplingInterval,
+                                          &tick->callbackId);
+        if(retval != UA_STATUSCODE_GOOD) {
+            UA_free(tick);
+            return retval;
+        }
+        LIST_INSERT_HEAD(&server->samplingTicks, tick, listEntry);
     }
+
+    LIST_INSERT_HEAD(&tick->groups, group, tickEntry);
+    tick->groupsSize++;
+    group->tick = tick;
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+leaveSamplingTick(UA_Server *server, UA_SamplingGroup *group) {
+    UA_SamplingTick *tick = group->tick;
+    LIST_REMOVE(group, tickEntry);
+    group->tick = NULL;
+    tick->groupsSize--;
+    if(tick->groupsSize > 0)
+        return;
+    UA_Server_removeRepeatedCallback(server, tick->callbackId);
+    LIST_REMOVE(tick, listEntry);
+    UA_free(tick);
+}
+
+static void
+deleteSamplingGroup(UA_Server *server, UA_SamplingGroup *group) {
+    if(group->tick)
+        leaveSamplingTick(server, group);
+    LIST_REMOVE(group, listEntry);
+    UA_NodeId_deleteMembers(&group->nodeId);
+    UA_String_deleteMembers(&group->indexRange);
+    UA_free(group);
+}
+
+static UA_StatusCode
+newSamplingGroup(UA_Server *server, const UA_MonitoredItem *mon,
+                 UA_Session *session, UA_SamplingGroup **outGroup) {
+    UA_SamplingGroup *group = (UA_SamplingGroup*)UA_calloc(1, sizeof(UA_SamplingGroup));
+    if(!group)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    UA_StatusCode retval = UA_NodeId_copy(&mon->monitoredNodeId, &group->nodeId);
+    retval |= UA_String_copy(&mon->indexRange, &group->indexRange);
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_NodeId_deleteMembers(&group->nodeId);
+        UA_String_deleteMembers(&group->indexRange);
+        UA_free(group);
+        return retval;
+    }
+    group->attributeId = mon->attributeID;
+    group->samplingInterval = mon->samplingInterval;
+    group->session = session;
+    LIST_INIT(&group->monitoredItems);
+
+    /* Sampled on write */
+    if(mon->samplingInterval == 0.0) {
+        LIST_INSERT_HEAD(onWriteSamplingGroups(server, &group->nodeId), group, listEntry);
+        *outGroup = group;
+        return UA_STATUSCODE_GOOD;
+    }
+
+    retval = joinSamplingTick(server, group);
+    if(retval != UA_STATUSCODE_GOOD) {
+        UA_NodeId_deleteMembers(&group->nodeId);
+        UA_String_deleteMembers(&group->indexRange);
+        UA_free(group);
+        return retval;
+    }
+
+    LIST_INSERT_HEAD(&server->samplingGroups, group, listEntry);
+    *outGroup = group;
+    return UA_STATUSCODE_GOOD;
 }
 
 UA_StatusCode
 MonitoredItem_registerSampleCallback(UA_Server *server, UA_MonitoredItem *mon) {
-    UA_StatusCode retval =
-        UA_Server_addRepeatedCallback(server, (UA_ServerCallback)UA_MoniteredItem_SampleCallback,
-                                      mon, (UA_UInt32)mon->samplingInterval, &mon->sampleCallbackId);
-    if(retval == UA_STATUSCODE_GOOD)
-        mon->sampleCallbackIsRegistered = true;
-    return retval;
+    if(mon->sampleCallbackIsRegistered)
+        return UA_STATUSCODE_GOOD;
+
+    /* Join an existing group or create a new one */
+    UA_Session *session = NULL;
+    if(isSessionDependentAttribute(mon->attributeID) ||
+       (mon->attributeID == UA_ATTRIBUTEID_VALUE &&
+        isSessionDependentValue(server, &mon->monitoredNodeId)))
+        session = mon->subscription->session;
+    UA_SamplingGroup *group = findSamplingGroup(server, mon, session);
+    if(!group) {
+        UA_StatusCode retval = newSamplingGroup(server, mon, session, &group);
+        if(retval != UA_STATUSCODE_GOOD)
+            return retval;
+    }
+
+    LIST_INSERT_HEAD(&group->monitoredItems, mon, samplingGroupEntry);
+    mon->samplingGroup = group;
+    mon->sampleCallbackIsRegistered = true;
+    return UA_STATUSCODE_GOOD;
+}
+
+static void
+deleteSamplingGroups(UA_Server *server, UA_ListOfSamplingGroups *groups) {
+    UA_SamplingGroup *group, *group_tmp;
+    LIST_FOREACH_SAFE(group, groups, listEntry, group_tmp) {
+        UA_MonitoredItem *mon, *mon_tmp;
+        LIST_FOREACH_SAFE(mon, &group->monitoredItems, samplingGroupEntry, mon_tmp) {
+            LIST_REMOVE(mon, samplingGroupEntry);
+            mon->samplingGroup = NULL;
+            mon->sampleCallbackIsRegistered = false;
+        }
+        deleteSamplingGroup(server, group);
+    }
+}
+
+void
+UA_SamplingGroups_delete(UA_Server *server) {
+    /* Detach the remaining MonitoredItems (e.g. of the admin session that
+     * outlives the server) */
+    deleteSamplingGroups(server, &server->samplingGroups);
+    for(size_t i = 0; i < UA_ONWRITE_SAMPLINGGROUPS_HASH_PRIME; i++)
+        deleteSamplingGroups(server, &server->onWriteSamplingGroups[i]);
+}
+
+void
+UA_SamplingGroups_notifyWrite(UA_Server *server, const UA_NodeId *nodeId) {
+    UA_SamplingGroup *group, *group_tmp;
+    LIST_FOREACH_SAFE(group, onWriteSamplingGroups(server, nodeId), listEntry, group_tmp) {
+        if(UA_NodeId_equal(&group->nodeId, nodeId))
+            samplingGroupCallback(server, group, NULL);
+    }
+}
+
+void
+UA_SamplingGroups_stopNotifyOnWrite(UA_Server *server, const UA_NodeId *nodeId) {
+    /* Sample with the fastest interval that is allowed */
+    UA_Double samplingInterval = 0.0;
+    const UA_VariableNode *vn = (const UA_VariableNode*)UA_Nodestore_get(server, nodeId);
+    if(vn) {
+        if(vn->nodeClass == UA_NODECLASS_VARIABLE)
+            samplingInterval = vn->minimumSamplingInterval;
+        UA_Nodestore_release(server, (const UA_Node*)vn);
+    }
+    if(samplingInterval < server->config.samplingIntervalLimits.min)
+        samplingInterval = server->config.samplingIntervalLimits.min;
+    else if(samplingInterval > server->config.samplingIntervalLimits.max)
+        samplingInterval = server->config.samplingIntervalLimits.max;
+
+    /* The group is removed with its last MonitoredItem. The MonitoredItems
+     * join the timed groups. */
+    UA_SamplingGroup *group, *group_tmp;
+    LIST_FOREACH_SAFE(group, onWriteSamplingGroups(server, nodeId), listEntry, group_tmp) {
+        if(!UA_NodeId_equal(&group->nodeId, nodeId))
+            continue;
+        UA_MonitoredItem *mon, *mon_tmp;
+        LIST_FOREACH_SAFE(mon, &group->monitoredItems, samplingGroupEntry, mon_tmp) {
+            MonitoredItem_unregisterSampleCallback(server, mon);
+            mon->samplingInterval = samplingInterval;
+            MonitoredItem_registerSampleCallback(server, mon);
+        }
+    }
 }
 
 UA_StatusCode
@@ -259,7 +748,14 @@ MonitoredItem_unregisterSampleCallback(UA_Server *server, UA_MonitoredItem *mon)
     if(!mon->sampleCallbackIsRegistered)
         return UA_STATUSCODE_GOOD;
     mon->sampleCallbackIsRegistered = false;
-    return UA_Server_removeRepeatedCallback(server, mon->sampleCallbackId);
+
+    /* Leave the group. Remove the group if it was the last MonitoredItem. */
+    UA_SamplingGroup *group = mon->samplingGroup;
+    LIST_REMOVE(mon, samplingGroupEntry);
+    mon->samplingGroup = NULL;
+    if(LIST_EMPTY(&group->monitoredItems))
+        deleteSamplingGroup(server, group);
+    return UA_STATUSCODE_GOOD;
 }
 
 #endif /* UA_ENABLE_SUBSCRIPTIONS */
@@ -22,6 +22,10 @@
     (UA_SECURE_CONVERSATION_MESSAGE_HEADER_LENGTH + \
     UA_SYMMETRIC_ALG_SECURITY_HEADER_LENGTH)
 
+/* Maximum number of chunks that are queued before they are handed to
+ * connection->sendMultiple. Stays below the minimum IOV_MAX of POSIX. */
+#define UA_CHUNKINFO_MAXQUEUED 16
+
 const UA_ByteString
     UA_SECURITY_POLICY_NONE_URI = {47, (UA_Byte *) "http://opcfoundation.org/UA/SecurityPolicy#None"};
 
@@ -42,6 +46,11 @@ typedef struct {
 
     UA_ByteString messageBuffer;
     UA_Boolean final;
+
+    /* Finished chunks that are not yet sent (only if the connection has
+     * sendMultiple) */
+    UA_ByteString queued[UA_CHUNKINFO_MAXQUEUED];
+    size_t queuedSize;
 } UA_ChunkInfo;
 
 UA_StatusCode
@@ -434,6 +443,17 @@ calculatePaddingSym(const UA_SecurityPolicy *securityPolicy, const void *channel
     return padding;
 }
 
+/* Send the queued chunks in one operation */
+static UA_StatusCode
+flushChunksSymmetric(UA_ChunkInfo *ci) {
+    if(ci->queuedSize == 0)
+        return UA_STATUSCODE_GOOD;
+    UA_Connection *connection = ci->channel->connection;
+    UA_StatusCode res = connection->sendMultiple(connection, ci->queued, ci->queuedSize);
+    ci->queuedSize = 0;
+    return res;
+}
+
 /* Sends a message using symmetric encryption if defined
  *
  * @param ci the chunk information that is used to send the chunk.
@@ -548,9 +568,19 @@ sendChunkSymmetric(UA_ChunkInfo *ci, UA_Byte **buf_pos, const UA_Byte **buf_end)
         return res;
     }
 
-    /* Send the chunk, the buffer is freed in the network layer */
+    /* Send the chunk, the buffer is freed in the network layer. If the
+     * connection can send several buffers at once, the chunk is queued and the
+     * queue is flushed with the final chunk or when it is full. */
     ci->messageBuffer.length = respHeader.messageHeader.messageSize;
-    res = connection->send(channel->connection, &ci->messageBuffer);
+    if(connection->sendMultiple) {
+        ci->queued[ci->queuedSize] = ci->messageBuffer;
+        ci->queuedSize++;
+        ci->messageBuffer = UA_BYTESTRING_NULL;
+        if(ci->final || ci->queuedSize == UA_CHUNKINFO_MAXQUEUED)
+            res = flushChunksSymmetric(ci);
+    } else {
+        res = connection->send(channel->connection, &ci->messageBuffer);
+    }
     if(res != UA_STATUSCODE_GOOD)
         return res;
 
@@ -600,6 +630,7 @@ UA_SecureChannel_sendSymmetricMessage(UA_SecureChannel *channel, UA_UInt32 reque
     ci.final = false;
     ci.messageBuffer = UA_BYTESTRING_NULL;
     ci.messageType = messageType;
+    ci.queuedSize = 0;
 
     /* Allocate the message buffer */
     UA_StatusCode retval =
@@ -639,13 +670,18 @@ UA_SecureChannel_sendSymmetricMessage(UA_SecureChannel *channel, UA_UInt32 reque
         /* the abort message was not sent */
         if(!ci.final)
             sendChunkSymmetric(&ci, &buf_start, &buf_end);
+        flushChunksSymmetric(&ci);
 		connection->releaseSendBuffer(connection, &ci.messageBuffer);
         return retval;
     }
 
     /* Encoding finished, send the final chunk */
     ci.final = UA_TRUE;
-    return sendChunkSymmetric(&ci, &buf_start, &buf_end);
+    retval = sendChunkSymmetric(&ci, &buf_start, &buf_end);
+
+    /* Send the chunks that remain queued if the final chunk failed */
+    flushChunksSymmetric(&ci);
+    return retval;
 }
 
 /*****************************/
@@ -11,19 +11,26 @@
  * by Dmitry Vyukov.
  * http://www.1024cores.net/home/lock-free-algorithms/queues/intrusive-mpsc-node-based-queue
  *
- * The RepeatedCallback structure is used both in the sorted list of callbacks
+ * The RepeatedCallback structure is used both in the binary heap of callbacks
  * and in the MPSC changes queue. For the changes queue, we differentiate
  * between three cases encoded in the callback pointer.
  *
- * callback > 0x01: add the new repeated callback to the sorted list
+ * callback > 0x01: add the new repeated callback to the heap
  * callback == 0x00: remove the callback with the same id
  * callback == 0x01: change the interval of the existing callback */
 
 #define REMOVE_SENTINEL 0x00
 #define CHANGE_SENTINEL 0x01
 
+/* Initial number of heap slots (and index buckets). Must be a power of two. */
+#define UA_TIMER_INITIAL_CAPACITY 64
+
 struct UA_TimerCallbackEntry {
-    SLIST_ENTRY(UA_TimerCallbackEntry) next; /* Next element in the list */
+    SLIST_ENTRY(UA_TimerCallbackEntry) next; /* Next element in the changes
+                                              * queue */
+    UA_TimerCallbackEntry *idNext;           /* Next element in the same bucket
+                                              * of the id index */
+    size_t heapIndex;                        /* Current position in the heap */
     UA_DateTime nextTime;                    /* The next time when the callbacks
                                               * are to be executed */
     UA_UInt64 interval;                      /* Interval in 100ns resolution */
@@ -35,7 +42,10 @@ struct UA_TimerCallbackEntry {
 
 void
 UA_Timer_init(UA_Timer *t) {
-    SLIST_INIT(&t->repeatedCallbacks);
+    t->heap = NULL;
+    t->heapSize = 0;
+    t->heapCapacity = 0;
+    t->idIndex = NULL;
     t->changes_head = (UA_TimerCallbackEntry*)&t->changes_stub;
     t->changes_tail = (UA_TimerCallbackEntry*)&t->changes_stub;
     t->changes_stub = NULL;
@@ -80,6 +90,135 @@ dequeueChange(UA_Timer *t) {
     return NULL;
 }
 
+/***************/
+/* Binary Heap */
+/***************/
+
+/* Entries with the same execution timestamp are ordered by their id. So
+ * callbacks that were added first are also executed first. */
+static UA_Boolean
+executedBefore(const UA_TimerCallbackEntry *a, const UA_TimerCallbackEntry *b) {
+    if(a->nextTime != b->nextTime)
+        return a->nextTime < b->nextTime;
+    return a->id < b->id;
+}
+
+static void
+timerHeapSet(UA_Timer *t, size_t pos, UA_TimerCallbackEntry *tc) {
+    t->heap[pos] = tc;
+    tc->heapIndex = pos;
+}
+
+static void
+timerHeapSiftUp(UA_Timer *t, size_t pos) {
+    UA_TimerCallbackEntry *tc = t->heap[pos];
+    while(pos > 0) {
+        size_t parent = (pos - 1) / 2;
+        if(!executedBefore(tc, t->heap[parent]))
+            break;
+        timerHeapSet(t, pos, t->heap[parent]);
+        pos = parent;
+    }
+    timerHeapSet(t, pos, tc);
+}
+
+static void
+timerHeapSiftDown(UA_Timer *t, size_t pos) {
+    UA_TimerCallbackEntry *tc = t->heap[pos];
+    while(true) {
+        size_t child = (2 * pos) + 1;
+        if(child >= t->heapSize)
+            break;
+        if(child + 1 < t->heapSize &&
+           executedBefore(t->heap[child + 1], t->heap[child]))
+            child++;
+        if(!executedBefore(t->heap[child], tc))
+            break;
+        timerHeapSet(t, pos, t->heap[child]);
+        pos = child;
+    }
+    timerHeapSet(t, pos, tc);
+}
+
+/* Restore the heap property after the nextTime of the entry was changed */
+static void
+timerHeapUpdate(UA_Timer *t, UA_TimerCallbackEntry *tc) {
+    size_t pos = tc->heapIndex;
+    if(pos > 0 && executedBefore(tc, t->heap[(pos - 1) / 2]))
+        timerHeapSiftUp(t, pos);
+    else
+        timerHeapSiftDown(t, pos);
+}
+
+static void
+timerHeapRemove(UA_Timer *t, UA_TimerCallbackEntry *tc) {
+    size_t pos = tc->heapIndex;
+    t->heapSize--;
+    if(pos == t->heapSize)
+        return;
+    timerHeapSet(t, pos, t->heap[t->heapSize]);
+    timerHeapUpdate(t, t->heap[pos]);
+}
+
+/************/
+/* Id Index */
+/************/
+
+static UA_TimerCallbackEntry **
+timerIndexBucket(UA_Timer *t, UA_UInt64 callbackId) {
+    /* The ids are handed out sequentially. So the lower bits are already
+     * uniformly distributed. */
+    return &t->idIndex[callbackId & (UA_UInt64)(t->heapCapacity - 1)];
+}
+
+static UA_TimerCallbackEntry *
+timerIndexFind(UA_Timer *t, UA_UInt64 callbackId) {
+    if(!t->idIndex)
+        return NULL;
+    UA_TimerCallbackEntry *tc = *timerIndexBucket(t, callbackId);
+    while(tc && tc->id != callbackId)
+        tc = tc->idNext;
+    return tc;
+}
+
+static void
+timerIndexRemove(UA_Timer *t, UA_TimerCallbackEntry *tc) {
+    UA_TimerCallbackEntry **prev = timerIndexBucket(t, tc->id);
+    while(*prev != tc)
+        prev = &(*prev)->idNext;
+    *prev = tc->idNext;
+}
+
+/* Double the capacity of the heap and the number of buckets in the index */
+static UA_StatusCode
+growTimer(UA_Timer *t) {
+    size_t newCapacity = UA_TIMER_INITIAL_CAPACITY;
+    if(t->heapCapacity > 0)
+        newCapacity = t->heapCapacity * 2;
+
+    UA_TimerCallbackEntry **newHeap = (UA_TimerCallbackEntry**)
+        UA_realloc(t->heap, sizeof(UA_TimerCallbackEntry*) * newCapacity);
+    if(!newHeap)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    t->heap = newHeap;
+
+    UA_TimerCallbackEntry **newIndex = (UA_TimerCallbackEntry**)
+        UA_calloc(newCapacity, sizeof(UA_TimerCallbackEntry*));
+    if(!newIndex)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+    UA_free(t->idIndex);
+    t->idIndex = newIndex;
+    t->heapCapacity = newCapacity;
+
+    /* Rehash the existing entries */
+    for(size_t i = 0; i < t->heapSize; i++) {
+        UA_TimerCallbackEntry **bucket = timerIndexBucket(t, t->heap[i]->id);
+        t->heap[i]->idNext = *bucket;
+        *bucket = t->heap[i];
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
 /* Adding repeated callbacks: Add an entry with the "nextTime" timestamp in the
  * future. This will be picked up in the next iteration and inserted at the
  * correct place. So that the next execution takes place ät "nextTime". */
@@ -119,28 +258,21 @@ UA_Timer_addRepeatedCallback(UA_Timer *t, UA_TimerCallback callback,
 
 static void
 addTimerCallbackEntry(UA_Timer *t, UA_TimerCallbackEntry * UA_RESTRICT tc) {
-    /* Find the last entry before this callback */
-    UA_TimerCallbackEntry *tmpTc, *afterTc = NULL;
-    SLIST_FOREACH(tmpTc, &t->repeatedCallbacks, next) {
-        if(tmpTc->nextTime >= tc->nextTime)
-            break;
-        afterTc = tmpTc;
-
-        /* The goal is to have many repeated callbacks with the same repetition
-         * interval in a "block" in order to reduce linear search for re-entry
-         * to the sorted list after processing. Allow the first execution to lie
-         * between "nextTime - 1s" and "nextTime" if this adjustment groups
-         * callbacks with the same repetition interval. */
-        if(tmpTc->interval == tc->interval &&
-           tmpTc->nextTime > (tc->nextTime - UA_SEC_TO_DATETIME))
-            tc->nextTime = tmpTc->nextTime;
+    /* Make room in the heap. Without memory, the callback cannot be added. */
+    if(t->heapSize == t->heapCapacity && growTimer(t) != UA_STATUSCODE_GOOD) {
+        UA_free(tc);
+        return;
     }
 
-    /* Add the repeated callback */
-    if(afterTc)
-        SLIST_INSERT_AFTER(afterTc, tc, next);
-    else
-        SLIST_INSERT_HEAD(&t->repeatedCallbacks, tc, next);
+    /* Add to the id index */
+    UA_TimerCallbackEntry **bucket = timerIndexBucket(t, tc->id);
+    tc->idNext = *bucket;
+    *bucket = tc;
+
+    /* Add to the heap */
+    t->heap[t->heapSize] = tc;
+    t->heapSize++;
+    timerHeapSiftUp(t, t->heapSize - 1);
 }
 
 UA_StatusCode
@@ -170,18 +302,7 @@ UA_Timer_changeRepeatedCallbackInterval(UA_Timer *t, UA_UInt64 callbackId,
 static void
 changeTimerCallbackEntryInterval(UA_Timer *t, UA_UInt64 callbackId,
                                  UA_UInt64 interval, UA_DateTime nextTime) {
-    /* Remove from the sorted list */
-    UA_TimerCallbackEntry *tc, *prev = NULL;
-    SLIST_FOREACH(tc, &t->repeatedCallbacks, next) {
-        if(callbackId == tc->id) {
-            if(prev)
-                SLIST_REMOVE_AFTER(prev, next);
-            else
-                SLIST_REMOVE_HEAD(&t->repeatedCallbacks, next);
-            break;
-        }
-        prev = tc;
-    }
+    UA_TimerCallbackEntry *tc = timerIndexFind(t, callbackId);
     if(!tc)
         return;
 
@@ -189,13 +310,13 @@ changeTimerCallbackEntryInterval(UA_Timer *t, UA_UInt64 callbackId,
     tc->interval = interval;
     tc->nextTime = nextTime;
 
-    /* Reinsert at the new position */
-    addTimerCallbackEntry(t, tc);
+    /* Move to the new position in the heap */
+    timerHeapUpdate(t, tc);
 }
 
 /* Removing a repeated callback: Add an entry with the "nextTime" timestamp set
  * to UA_INT64_MAX. The next iteration picks this up and removes the repated
- * callback from the linked list. */
+ * callback from the heap. */
 UA_StatusCode
 UA_Timer_removeRepeatedCallback(UA_Timer *t, UA_UInt64 callbackId) {
     /* Allocate the repeated callback structure */
@@ -215,18 +336,12 @@ UA_Timer_removeRepeatedCallback(UA_Timer *t, UA_UInt64 callbackId) {
 
 static void
 removeRepeatedCallback(UA_Timer *t, UA_UInt64 callbackId) {
-    UA_TimerCallbackEntry *tc, *prev = NULL;
-    SLIST_FOREACH(tc, &t->repeatedCallbacks, next) {
-        if(callbackId == tc->id) {
-            if(prev)
-                SLIST_REMOVE_AFTER(prev, next);
-            else
-                SLIST_REMOVE_HEAD(&t->repeatedCallbacks, next);
-            UA_free(tc);
-            break;
-        }
-        prev = tc;
-    }
+    UA_TimerCallbackEntry *tc = timerIndexFind(t, callbackId);
+    if(!tc)
+        return;
+    timerHeapRemove(t, tc);
+    timerIndexRemove(t, tc);
+    UA_free(tc);
 }
 
 /* Process the changes that were added to the MPSC queue (by other threads) */
@@ -257,37 +372,12 @@ UA_Timer_process(UA_Timer *t, UA_DateTime nowMonotonic,
     /* Insert and remove callbacks */
     processChanges(t);
 
-    /* Find the last callback to be executed now */
-    UA_TimerCallbackEntry *firstAfter, *lastNow = NULL;
-    SLIST_FOREACH(firstAfter, &t->repeatedCallbacks, next) {
-        if(firstAfter->nextTime > nowMonotonic)
+    /* Dispatch the callbacks at the top of the heap until the first one lies
+     * in the future */
+    while(t->heapSize > 0) {
+        UA_TimerCallbackEntry *tc = t->heap[0];
+        if(tc->nextTime > nowMonotonic)
             break;
-        lastNow = firstAfter;
-    }
-
-    /* Nothing to do */
-    if(!lastNow) {
-        if(firstAfter)
-            return firstAfter->nextTime;
-        return UA_INT64_MAX;
-    }
-
-    /* Put the callbacks that are executed now in a separate list */
-    UA_TimerCallbackList executedNowList;
-    executedNowList.slh_first = SLIST_FIRST(&t->repeatedCallbacks);
-    lastNow->next.sle_next = NULL;
-
-    /* Fake entry to represent the first element in the newly-sorted list */
-    UA_TimerCallbackEntry tmp_first;
-    tmp_first.nextTime = nowMonotonic - 1; /* never matches for last_dispatched */
-    tmp_first.next.sle_next = firstAfter;
-    UA_TimerCallbackEntry *last_dispatched = &tmp_first;
-
-    /* Iterate over the list of callbacks to process now */
-    UA_TimerCallbackEntry *tc;
-    while((tc = SLIST_FIRST(&executedNowList))) {
-        /* Remove from the list */
-        SLIST_REMOVE_HEAD(&executedNowList, next);
 
         /* Dispatch/process callback */
         dispatchCallback(application, tc->callback, tc->data);
@@ -298,49 +388,18 @@ UA_Timer_process(UA_Timer *t, UA_DateTime nowMonotonic,
         if(tc->nextTime < nowMonotonic)
             tc->nextTime = nowMonotonic + 1;
 
-        /* Find the new position for tc to keep the list sorted */
-        UA_TimerCallbackEntry *prev_tc;
-        if(last_dispatched->nextTime == tc->nextTime) {
-            /* We try to "batch" repeatedCallbacks with the same interval. This
-             * saves a linear search when the last dispatched entry has the same
-             * nextTime timestamp as this entry. */
-            UA_assert(last_dispatched != &tmp_first);
-            prev_tc = last_dispatched;
-        } else {
-            /* Find the position for the next execution by a linear search
-             * starting at last_dispatched or the first element */
-            if(last_dispatched->nextTime < tc->nextTime)
-                prev_tc = last_dispatched;
-            else
-                prev_tc = &tmp_first;
-
-            while(true) {
-                UA_TimerCallbackEntry *n = SLIST_NEXT(prev_tc, next);
-                if(!n || n->nextTime >= tc->nextTime)
-                    break;
-                prev_tc = n;
-            }
-
-            /* Update last_dispatched */
-            last_dispatched = tc;
-        }
-
-        /* Add entry to the new position in the sorted list */
-        SLIST_INSERT_AFTER(prev_tc, tc, next);
+        /* Move to the new position in the heap */
+        timerHeapSiftDown(t, 0);
     }
 
-    /* Set the entry-point for the newly sorted list */
-    t->repeatedCallbacks.slh_first = tmp_first.next.sle_next;
-
     /* Re-repeat processAddRemoved since one of the callbacks might have removed
      * or added a callback. So we return a correct timeout. */
     processChanges(t);
 
     /* Return timestamp of next repetition */
-    tc = SLIST_FIRST(&t->repeatedCallbacks);
-    if(!tc)
+    if(t->heapSize == 0)
         return UA_INT64_MAX; /* Main-loop has a max timeout / will continue earlier */
-    return tc->nextTime;
+    return t->heap[0]->nextTime;
 }
 
 void
@@ -349,9 +408,12 @@ UA_Timer_deleteMembers(UA_Timer *t) {
     processChanges(t);
 
     /* Remove repeated callbacks */
-    UA_TimerCallbackEntry *current;
-    while((current = SLIST_FIRST(&t->repeatedCallbacks))) {
-        SLIST_REMOVE_HEAD(&t->repeatedCallbacks, next);
-        UA_free(current);
-    }
+    for(size_t i = 0; i < t->heapSize; i++)
+        UA_free(t->heap[i]);
+    UA_free(t->heap);
+    UA_free(t->idIndex);
+    t->heap = NULL;
+    t->heapSize = 0;
+    t->heapCapacity = 0;
+    t->idIndex = NULL;
 }
@@ -20,12 +20,17 @@ extern "C" {
 struct UA_TimerCallbackEntry;
 typedef struct UA_TimerCallbackEntry UA_TimerCallbackEntry;
 
-/* Linked-list definition */
-typedef SLIST_HEAD(UA_TimerCallbackList, UA_TimerCallbackEntry) UA_TimerCallbackList;
-
 typedef struct {
-    /* The linked list of callbacks is sorted according to the execution timestamp. */
-    UA_TimerCallbackList repeatedCallbacks;
+    /* The repeated callbacks are stored in a binary min-heap ordered by the
+     * execution timestamp. Adding, removing and rescheduling a callback is
+     * O(log n). */
+    UA_TimerCallbackEntry **heap;
+    size_t heapSize;
+    size_t heapCapacity;
+
+    /* Hash index (with chaining) from the callbackId to the heap entry. The
+     * number of buckets is a power of two and equal to the heap capacity. */
+    UA_TimerCallbackEntry **idIndex;
 
     /* Changes to the repeated callbacks in a multi-producer single-consumer queue */
     UA_TimerCallbackEntry * volatile changes_head;
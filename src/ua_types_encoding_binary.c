@@ -63,6 +63,15 @@ extern const UA_calcSizeBinarySignature calcSizeBinaryJumpTable[UA_BUILTIN_TYPES
  * UA_decodeBinary */
 static UA_THREAD_LOCAL size_t g_customTypesArraySize;
 static UA_THREAD_LOCAL const UA_DataType *g_customTypesArray;
+static UA_THREAD_LOCAL const UA_UInt16 *g_customTypesIndex;
+
+/* Arena for the memory of decoded values. Set inside UA_decodeBinary. If an
+ * arena is used, decoded members are not freed individually on errors. */
+static UA_THREAD_LOCAL UA_Arena *g_arena;
+
+/* Overlayable arrays (including strings) point into the source buffer instead
+ * of being copied. Only used together with an arena. */
+static UA_THREAD_LOCAL UA_Boolean g_zeroCopy;
 
 /* Pointers to the current position and the last position in the buffer */
 static UA_THREAD_LOCAL u8 *g_pos;
@@ -521,6 +530,20 @@ Array_encodeBinary(const void *src, size_t length, const UA_DataType *type) {
     return Array_encodeBinaryOverlayable((uintptr_t)src, length, type->memSize);
 }
 
+/* Memory handling during decoding */
+static void *
+decodeCalloc(size_t nmemb, size_t size) {
+    if(g_arena)
+        return UA_Arena_calloc(g_arena, nmemb, size);
+    return UA_calloc(nmemb, size);
+}
+
+static void
+decodeDeleteMembers(void *p, const UA_DataType *type) {
+    if(!g_arena)
+        UA_deleteMembers(p, type);
+}
+
 static status
 Array_decodeBinary(void *UA_RESTRICT *UA_RESTRICT dst,
                    size_t *out_length, const UA_DataType *type) {
@@ -547,15 +570,27 @@ Array_decodeBinary(void *UA_RESTRICT *UA_RESTRICT dst,
     if(g_pos + ((type->memSize * length) / 32) > g_end)
         return UA_STATUSCODE_BADDECODINGERROR;
 
+    /* Point into the source buffer if the position is aligned for the type */
+    if(g_zeroCopy && type->overlayable &&
+       (type->memSize == 1 || (uintptr_t)g_pos % MIN(type->memSize, 8) == 0)) {
+        if(g_end < g_pos + (type->memSize * length))
+            return UA_STATUSCODE_BADDECODINGERROR;
+        *dst = g_pos;
+        g_pos += type->memSize * length;
+        *out_length = length;
+        return UA_STATUSCODE_GOOD;
+    }
+
     /* Allocate memory */
-    *dst = UA_calloc(length, type->memSize);
+    *dst = decodeCalloc(length, type->memSize);
     if(!*dst)
         return UA_STATUSCODE_BADOUTOFMEMORY;
 
     if(type->overlayable) {
         /* memcpy overlayable array */
         if(g_end < g_pos + (type->memSize * length)) {
-            UA_free(*dst);
+            if(!g_arena)
+                UA_free(*dst);
             *dst = NULL;
             return UA_STATUSCODE_BADDECODINGERROR;
         }
@@ -569,7 +604,8 @@ Array_decodeBinary(void *UA_RESTRICT *UA_RESTRICT dst,
             ret = decodeBinaryJumpTable[decode_index]((void*)ptr, type);
             if(ret != UA_STATUSCODE_GOOD) {
                 // +1 because last element is also already initialized
-                UA_Array_delete(*dst, i+1, type);
+                if(!g_arena)
+                    UA_Array_delete(*dst, i+1, type);
                 *dst = NULL;
                 return ret;
             }
@@ -848,6 +884,36 @@ LocalizedText_decodeBinary(UA_LocalizedText *dst, const UA_DataType *_) {
     return ret;
 }
 
+/* Orders types by the binary encoding id and then by the namespace index.
+ * Returns -1, 0 or 1 if the type is less, equal or more than the key. */
+static int
+binaryEncodingOrder(const UA_DataType *type, u32 binaryEncodingId, u16 namespaceIndex) {
+    if(type->binaryEncodingId != binaryEncodingId)
+        return (type->binaryEncodingId < binaryEncodingId) ? -1 : 1;
+    if(type->typeId.namespaceIndex != namespaceIndex)
+        return (type->typeId.namespaceIndex < namespaceIndex) ? -1 : 1;
+    return 0;
+}
+
+/* Binary search for the first matching type in a sorted index */
+static const UA_DataType *
+findDataTypeInIndex(const UA_DataType *types, size_t typesSize, const u16 *index,
+                    u32 binaryEncodingId, u16 namespaceIndex) {
+    size_t lo = 0, hi = typesSize;
+    while(lo < hi) {
+        size_t mid = lo + ((hi - lo) / 2);
+        if(binaryEncodingOrder(&types[index[mid]], binaryEncodingId,
+                               namespaceIndex) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if(lo < typesSize && binaryEncodingOrder(&types[index[lo]], binaryEncodingId,
+                                             namespaceIndex) == 0)
+        return &types[index[lo]];
+    return NULL;
+}
+
 /* The binary encoding has a different nodeid from the data type. So it is not
  * possible to reuse UA_findDataType */
 const UA_DataType *
@@ -856,21 +922,59 @@ UA_findDataTypeByBinary(const UA_NodeId *typeId) {
     if(typeId->identifierType != UA_NODEIDTYPE_NUMERIC)
         return NULL;
 
-    /* Custom or standard data type? */
-    const UA_DataType *types = UA_TYPES;
-    size_t typesSize = UA_TYPES_COUNT;
-    if(typeId->namespaceIndex != 0) {
-        types = g_customTypesArray;
-        typesSize = g_customTypesArraySize;
+    /* Standard data type */
+    if(typeId->namespaceIndex == 0)
+        return findDataTypeInIndex(UA_TYPES, UA_TYPES_COUNT,
+                                   UA_TYPES_BINARYENCODINGID_INDEX,
+                                   typeId->identifier.numeric, 0);
+
+    /* Custom data type with an index */
+    if(g_customTypesIndex)
+        return findDataTypeInIndex(g_customTypesArray, g_customTypesArraySize,
+                                   g_customTypesIndex, typeId->identifier.numeric,
+                                   typeId->namespaceIndex);
+
+    /* Iterate over the custom types */
+    for(size_t i = 0; i < g_customTypesArraySize; ++i) {
+        if(g_customTypesArray[i].binaryEncodingId == typeId->identifier.numeric &&
+           g_customTypesArray[i].typeId.namespaceIndex == typeId->namespaceIndex)
+            return &g_customTypesArray[i];
     }
+    return NULL;
+}
 
-    /* Iterate over the array */
+void
+UA_DataTypeIndex_init(UA_DataTypeIndex *index, size_t typesSize,
+                      const UA_DataType *types) {
+    index->typesSize = typesSize;
+    index->types = types;
+    index->binaryEncodingIndex = NULL;
+    if(typesSize == 0 || typesSize > UA_UINT16_MAX)
+        return;
+    u16 *sorted = (u16*)UA_malloc(typesSize * sizeof(u16));
+    if(!sorted)
+        return; /* Fall back to the linear search */
+
+    /* Insertion sort. Equal keys keep the order of the type array, so that the
+     * lookup returns the same type as the linear search. */
     for(size_t i = 0; i < typesSize; ++i) {
-        if(types[i].binaryEncodingId == typeId->identifier.numeric &&
-           types[i].typeId.namespaceIndex == typeId->namespaceIndex)
-            return &types[i];
+        size_t j = i;
+        for(; j > 0; --j) {
+            const UA_DataType *prev = &types[sorted[j - 1]];
+            if(binaryEncodingOrder(prev, types[i].binaryEncodingId,
+                                   types[i].typeId.namespaceIndex) <= 0)
+                break;
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = (u16)i;
     }
-    return NULL;
+    index->binaryEncodingIndex = sorted;
+}
+
+void
+UA_DataTypeIndex_deleteMembers(UA_DataTypeIndex *index) {
+    UA_free(index->binaryEncodingIndex);
+    index->binaryEncodingIndex = NULL;
 }
 
 /* ExtensionObject */
@@ -936,19 +1040,20 @@ ExtensionObject_encodeBinary(UA_ExtensionObject const *src, const UA_DataType *_
 }
 
 static status
-ExtensionObject_decodeBinaryContent(UA_ExtensionObject *dst, const UA_NodeId *typeId) {
+ExtensionObject_decodeBinaryContent(UA_ExtensionObject *dst, UA_NodeId *typeId) {
     /* Lookup the datatype */
     const UA_DataType *type = UA_findDataTypeByBinary(typeId);
 
     /* Unknown type, just take the binary content */
     if(!type) {
         dst->encoding = UA_EXTENSIONOBJECT_ENCODED_BYTESTRING;
-        UA_NodeId_copy(typeId, &dst->content.encoded.typeId);
+        dst->content.encoded.typeId = *typeId; /* move to dst */
+        UA_NodeId_init(typeId);
         return ByteString_decodeBinary(&dst->content.encoded.body);
     }
 
     /* Allocate memory */
-    dst->content.decoded.data = UA_new(type);
+    dst->content.decoded.data = decodeCalloc(1, type->memSize);
     if(!dst->content.decoded.data)
         return UA_STATUSCODE_BADOUTOFMEMORY;
 
@@ -974,13 +1079,13 @@ ExtensionObject_decodeBinary(UA_ExtensionObject *dst, const UA_DataType *_) {
     status ret = NodeId_decodeBinary(&binTypeId, NULL);
     ret |= Byte_decodeBinary(&encoding, NULL);
     if(ret != UA_STATUSCODE_GOOD) {
-        UA_NodeId_deleteMembers(&binTypeId);
+        decodeDeleteMembers(&binTypeId, &UA_TYPES[UA_TYPES_NODEID]);
         return ret;
     }
 
     if(encoding == UA_EXTENSIONOBJECT_ENCODED_BYTESTRING) {
         ret = ExtensionObject_decodeBinaryContent(dst, &binTypeId);
-        UA_NodeId_deleteMembers(&binTypeId);
+        decodeDeleteMembers(&binTypeId, &UA_TYPES[UA_TYPES_NODEID]);
     } else if(encoding == UA_EXTENSIONOBJECT_ENCODED_NOBODY) {
         dst->encoding = (UA_ExtensionObjectEncoding)encoding;
         dst->content.encoded.typeId = binTypeId; /* move to dst */
@@ -990,9 +1095,9 @@ ExtensionObject_decodeBinary(UA_ExtensionObject *dst, const UA_DataType *_) {
         dst->content.encoded.typeId = binTypeId; /* move to dst */
         ret = ByteString_decodeBinary(&dst->content.encoded.body);
         if(ret != UA_STATUSCODE_GOOD)
-            UA_NodeId_deleteMembers(&dst->content.encoded.typeId);
+            decodeDeleteMembers(&dst->content.encoded.typeId, &UA_TYPES[UA_TYPES_NODEID]);
     } else {
-        UA_NodeId_deleteMembers(&binTypeId);
+        decodeDeleteMembers(&binTypeId, &UA_TYPES[UA_TYPES_NODEID]);
         ret = UA_STATUSCODE_BADDECODINGERROR;
     }
 
@@ -1102,7 +1207,7 @@ Variant_decodeBinaryUnwrapExtensionObject(UA_Variant *dst) {
     u8 encoding;
     ret = Byte_decodeBinary(&encoding, NULL);
     if(ret != UA_STATUSCODE_GOOD) {
-        UA_NodeId_deleteMembers(&typeId);
+        decodeDeleteMembers(&typeId, &UA_TYPES[UA_TYPES_NODEID]);
         return ret;
     }
 
@@ -1115,11 +1220,11 @@ Variant_decodeBinaryUnwrapExtensionObject(UA_Variant *dst) {
         /* Reset and decode as ExtensionObject */
         dst->type = &UA_TYPES[UA_TYPES_EXTENSIONOBJECT];
         g_pos = old_pos;
-        UA_NodeId_deleteMembers(&typeId);
+        decodeDeleteMembers(&typeId, &UA_TYPES[UA_TYPES_NODEID]);
     }
 
     /* Allocate memory */
-    dst->data = UA_new(dst->type);
+    dst->data = decodeCalloc(1, dst->type->memSize);
     if(!dst->data)
         return UA_STATUSCODE_BADOUTOFMEMORY;
 
@@ -1157,7 +1262,7 @@ Variant_decodeBinary(UA_Variant *dst, const UA_DataType *_) {
     if(isArray) {
         ret = Array_decodeBinary(&dst->data, &dst->arrayLength, dst->type);
     } else if(typeIndex != UA_TYPES_EXTENSIONOBJECT) {
-        dst->data = UA_new(dst->type);
+        dst->data = decodeCalloc(1, dst->type->memSize);
         if(!dst->data)
             return UA_STATUSCODE_BADOUTOFMEMORY;
         ret = decodeBinaryJumpTable[typeIndex](dst->data, dst->type);
@@ -1345,7 +1450,7 @@ DiagnosticInfo_decodeBinary(UA_DiagnosticInfo *dst, const UA_DataType *_) {
     if(encodingMask & 0x40) {
         /* innerDiagnosticInfo is allocated on the heap */
         dst->innerDiagnosticInfo = (UA_DiagnosticInfo*)
-            UA_calloc(1, sizeof(UA_DiagnosticInfo));
+            decodeCalloc(1, sizeof(UA_DiagnosticInfo));
         if(!dst->innerDiagnosticInfo)
             return UA_STATUSCODE_BADOUTOFMEMORY;
         dst->hasInnerDiagnosticInfo = true;
@@ -1516,18 +1621,31 @@ UA_decodeBinaryInternal(void *dst, const UA_DataType *type) {
 }
 
 status
-UA_decodeBinary(const UA_ByteString *src, size_t *offset, void *dst,
-                const UA_DataType *type, size_t customTypesSize,
-                const UA_DataType *customTypes) {
+UA_decodeBinaryWithOptions(const UA_ByteString *src, size_t *offset, void *dst,
+                           const UA_DataType *type,
+                           const UA_DecodeBinaryOptions *options) {
     /* Save global (thread-local) values to make UA_decodeBinary reentrant */
     size_t save_customTypesArraySize = g_customTypesArraySize;
     const UA_DataType * save_customTypesArray = g_customTypesArray;
+    const u16 *save_customTypesIndex = g_customTypesIndex;
+    UA_Arena *save_arena = g_arena;
+    UA_Boolean save_zeroCopy = g_zeroCopy;
     u8 *save_pos = g_pos;
     const u8 *save_end = g_end;
 
     /* Global pointers to the custom datatypes. */
-    g_customTypesArraySize = customTypesSize;
-    g_customTypesArray = customTypes;
+    g_customTypesArraySize = 0;
+    g_customTypesArray = NULL;
+    g_customTypesIndex = NULL;
+    if(options->customTypes) {
+        g_customTypesArraySize = options->customTypes->typesSize;
+        g_customTypesArray = options->customTypes->types;
+        g_customTypesIndex = options->customTypes->binaryEncodingIndex;
+    }
+
+    /* Global pointer to the arena */
+    g_arena = options->arena;
+    g_zeroCopy = (options->arena != NULL && options->zeroCopy);
 
     /* Global position pointers */
     g_pos = &src->data[*offset];
@@ -1544,19 +1662,37 @@ UA_decodeBinary(const UA_ByteString *src, size_t *offset, void *dst,
         *offset = (size_t)(g_pos - src->data) / sizeof(u8);
     } else {
         /* Clean up */
-        UA_deleteMembers(dst, type);
+        decodeDeleteMembers(dst, type);
         memset(dst, 0, type->memSize);
     }
 
     /* Restore global (thread-local) values */
     g_customTypesArraySize = save_customTypesArraySize;
     g_customTypesArray = save_customTypesArray;
+    g_customTypesIndex = save_customTypesIndex;
+    g_arena = save_arena;
+    g_zeroCopy = save_zeroCopy;
     g_pos = save_pos;
     g_end = save_end;
 
     return ret;
 }
 
+status
+UA_decodeBinary(const UA_ByteString *src, size_t *offset, void *dst,
+                const UA_DataType *type, size_t customTypesSize,
+                const UA_DataType *customTypes) {
+    /* Linear search in the custom types without an index */
+    UA_DataTypeIndex customTypesIndex;
+    customTypesIndex.typesSize = customTypesSize;
+    customTypesIndex.types = customTypes;
+    customTypesIndex.binaryEncodingIndex = NULL;
+    UA_DecodeBinaryOptions options;
+    memset(&options, 0, sizeof(UA_DecodeBinaryOptions));
+    options.customTypes = &customTypesIndex;
+    return UA_decodeBinaryWithOptions(src, offset, dst, type, &options);
+}
+
 /**
  * Compute the Message Size
  * ------------------------
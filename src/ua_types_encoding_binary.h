@@ -10,6 +10,7 @@ extern "C" {
 #endif
 
 #include "ua_types.h"
+#include "ua_util.h"
 
 typedef UA_StatusCode (*UA_exchangeEncodeBuffer)(void *handle, UA_Byte **bufPos,
                                                  const UA_Byte **bufEnd);
@@ -60,6 +61,45 @@ UA_decodeBinary(const UA_ByteString *src, size_t *offset, void *dst,
                 const UA_DataType *type, size_t customTypesSize,
                 const UA_DataType *customTypes) UA_FUNC_ATTR_WARN_UNUSED_RESULT;
 
+/* Lookup index for an array of custom datatypes, sorted by the binary encoding
+ * id. The index is created once when the server or client is initialized. If
+ * no index could be allocated, the lookup falls back to a linear search. */
+typedef struct {
+    size_t typesSize;
+    const UA_DataType *types;
+    UA_UInt16 *binaryEncodingIndex;
+} UA_DataTypeIndex;
+
+void
+UA_DataTypeIndex_init(UA_DataTypeIndex *index, size_t typesSize,
+                      const UA_DataType *types);
+
+void
+UA_DataTypeIndex_deleteMembers(UA_DataTypeIndex *index);
+
+typedef struct {
+    /* Lookup index for the custom datatypes. Can be NULL. */
+    const UA_DataTypeIndex *customTypes;
+
+    /* Take the memory of the decoded value from an arena. The value must then
+     * not be deleted with _deleteMembers and becomes invalid when the arena is
+     * reset. If decoding fails, the arena may contain partially decoded data.
+     * Can be NULL. */
+    UA_Arena *arena;
+
+    /* Strings, ByteStrings and arrays of overlayable types point into the
+     * source buffer instead of being copied. The source buffer must then
+     * outlive the decoded value. Only used together with an arena, as the
+     * decoded value is never deleted member by member. */
+    UA_Boolean zeroCopy;
+} UA_DecodeBinaryOptions;
+
+/* Same as UA_decodeBinary, but with additional decoding options */
+UA_StatusCode
+UA_decodeBinaryWithOptions(const UA_ByteString *src, size_t *offset, void *dst,
+                           const UA_DataType *type,
+                           const UA_DecodeBinaryOptions *options) UA_FUNC_ATTR_WARN_UNUSED_RESULT;
+
 /* Returns the number of bytes the value p takes in binary encoding. Returns
  * zero if an error occurs. UA_calcSizeBinary is thread-safe and reentrant since
  * it does not access global (thread-local) variables. */
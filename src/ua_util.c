@@ -86,3 +86,79 @@ UA_parseEndpointUrl(const UA_String *endpointUrl, UA_String *outHostname,
 
     return UA_STATUSCODE_GOOD;
 }
+
+/*******************/
+/* Arena Allocator */
+/*******************/
+
+/* Alignment of the returned pointers, sufficient for all builtin types */
+#define UA_ARENA_ALIGNMENT 8
+#define UA_ARENA_ALIGN(SIZE) \
+    (((SIZE) + (UA_ARENA_ALIGNMENT - 1)) & ~(size_t)(UA_ARENA_ALIGNMENT - 1))
+#define UA_ARENA_HEADERSIZE UA_ARENA_ALIGN(sizeof(UA_ArenaBlock))
+
+void
+UA_Arena_init(UA_Arena *arena, size_t blockSize) {
+    arena->blockSize = blockSize;
+    arena->blocks = NULL;
+}
+
+void *
+UA_Arena_calloc(UA_Arena *arena, size_t nmemb, size_t size) {
+    if(size > 0 && nmemb > (SIZE_MAX - UA_ARENA_HEADERSIZE - UA_ARENA_ALIGNMENT) / size)
+        return NULL;
+    size_t total = UA_ARENA_ALIGN(nmemb * size);
+
+    /* Take from the current block */
+    UA_ArenaBlock *block = arena->blocks;
+    if(block && block->size - block->used >= total) {
+        u8 *p = (u8*)block + UA_ARENA_HEADERSIZE + block->used;
+        block->used += total;
+        memset(p, 0, total);
+        return p;
+    }
+
+    /* Add a new block */
+    size_t blockSize = MAX(arena->blockSize, total);
+    block = (UA_ArenaBlock*)UA_malloc(UA_ARENA_HEADERSIZE + blockSize);
+    if(!block)
+        return NULL;
+    block->size = blockSize;
+    block->used = total;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    u8 *p = (u8*)block + UA_ARENA_HEADERSIZE;
+    memset(p, 0, total);
+    return p;
+}
+
+void
+UA_Arena_reset(UA_Arena *arena) {
+    /* Free all but the oldest block at the end of the list */
+    UA_ArenaBlock *block = arena->blocks;
+    while(block && block->next) {
+        UA_ArenaBlock *next = block->next;
+        UA_free(block);
+        block = next;
+    }
+
+    /* Do not keep oversized blocks */
+    if(block && block->size != arena->blockSize) {
+        UA_free(block);
+        block = NULL;
+    }
+    if(block)
+        block->used = 0;
+    arena->blocks = block;
+}
+
+void
+UA_Arena_deleteMembers(UA_Arena *arena) {
+    UA_ArenaBlock *block = arena->blocks;
+    while(block) {
+        UA_ArenaBlock *next = block->next;
+        UA_free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+}
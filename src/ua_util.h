@@ -66,6 +66,20 @@ typedef UA_StatusCode status;
 # endif
 #endif
 
+/* Load and store of variables that are also accessed without a lock */
+#ifndef UA_ENABLE_MULTITHREADING
+# define UA_atomic_load(addr) (*(addr))
+# define UA_atomic_store(addr, value) (*(addr) = (value))
+#else
+# ifdef _MSC_VER /* Visual Studio (volatile has acquire/release semantics) */
+#  define UA_atomic_load(addr) (*(addr))
+#  define UA_atomic_store(addr, value) (*(addr) = (value))
+# else /* GCC/Clang */
+#  define UA_atomic_load(addr) __atomic_load_n(addr, __ATOMIC_ACQUIRE)
+#  define UA_atomic_store(addr, value) __atomic_store_n(addr, value, __ATOMIC_RELEASE)
+# endif
+#endif
+
 static UA_INLINE void *
 UA_atomic_xchg(void * volatile * addr, void *newptr) {
 #ifndef UA_ENABLE_MULTITHREADING
@@ -112,6 +126,46 @@ UA_atomic_add(volatile uint32_t *addr, uint32_t increase) {
 #endif
 }
 
+static UA_INLINE size_t
+UA_atomic_addSize(volatile size_t *addr, size_t increase) {
+#ifndef UA_ENABLE_MULTITHREADING
+    *addr += increase;
+    return *addr;
+#else
+# ifdef _MSC_VER /* Visual Studio */
+#  ifdef _WIN64
+    return (size_t)_InterlockedExchangeAdd64((volatile __int64*)addr,
+                                             (__int64)increase) + increase;
+#  else
+    return (size_t)_InterlockedExchangeAdd((volatile long*)addr,
+                                           (long)increase) + increase;
+#  endif
+# else /* GCC/Clang */
+    return __sync_add_and_fetch(addr, increase);
+# endif
+#endif
+}
+
+static UA_INLINE size_t
+UA_atomic_subSize(volatile size_t *addr, size_t decrease) {
+#ifndef UA_ENABLE_MULTITHREADING
+    *addr -= decrease;
+    return *addr;
+#else
+# ifdef _MSC_VER /* Visual Studio */
+#  ifdef _WIN64
+    return (size_t)_InterlockedExchangeAdd64((volatile __int64*)addr,
+                                             -(__int64)decrease) - decrease;
+#  else
+    return (size_t)_InterlockedExchangeAdd((volatile long*)addr,
+                                           -(long)decrease) - decrease;
+#  endif
+# else /* GCC/Clang */
+    return __sync_sub_and_fetch(addr, decrease);
+# endif
+#endif
+}
+
 /* Utility Functions
  * ----------------- */
 
@@ -123,6 +177,34 @@ size_t UA_readNumber(u8 *buf, size_t buflen, u32 *number);
 #define MIN(A,B) (A > B ? B : A)
 #define MAX(A,B) (A > B ? A : B)
 
+/* Arena Allocator
+ * ---------------
+ * A bump allocator for short-lived memory. Allocations are taken from large
+ * blocks and are not freed individually. Instead, the arena is reset as a
+ * whole. After a reset, the first block is kept for reuse if it has the
+ * default size. Larger allocations get a dedicated block. */
+
+typedef struct UA_ArenaBlock {
+    struct UA_ArenaBlock *next;
+    size_t size;
+    size_t used;
+} UA_ArenaBlock;
+
+typedef struct {
+    size_t blockSize;
+    UA_ArenaBlock *blocks; /* The current block is the head of the list */
+} UA_Arena;
+
+void UA_Arena_init(UA_Arena *arena, size_t blockSize);
+
+/* Returns zeroed memory or NULL if out of memory */
+void * UA_Arena_calloc(UA_Arena *arena, size_t nmemb, size_t size);
+
+/* Invalidates all memory taken from the arena */
+void UA_Arena_reset(UA_Arena *arena);
+
+void UA_Arena_deleteMembers(UA_Arena *arena);
+
 #ifdef UA_DEBUG_DUMP_PKGS
 void UA_EXPORT UA_dump_hex_pkg(UA_Byte* buffer, size_t bufferLen);
 #endif
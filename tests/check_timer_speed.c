@@ -0,0 +1,72 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+/* This benchmark shows how fast the timer processes a large number of repeated
+   callbacks. The testing clock is advanced manually, so no real time passes
+   between the iterations. */
+
+#include <time.h>
+#include <stdio.h>
+
+#include "ua_types.h"
+#include "ua_timer.h"
+#include "testing_clock.h"
+
+#define CALLBACKS 100000
+#define ITERATIONS 1000
+
+static size_t executions = 0;
+
+static void
+countCallback(void *application, void *data) {
+    executions++;
+}
+
+static void
+dispatchCallback(void *application, UA_TimerCallback callback, void *data) {
+    callback(application, data);
+}
+
+int main(int argc, char** argv) {
+    UA_Timer timer;
+    UA_Timer_init(&timer);
+
+    /* Add callbacks with intervals between 10ms and 1s */
+    UA_UInt64 *ids = (UA_UInt64*)UA_malloc(CALLBACKS * sizeof(UA_UInt64));
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    for(size_t i = 0; i < CALLBACKS; i++)
+        retval |= UA_Timer_addRepeatedCallback(&timer, countCallback, NULL,
+                                               10 + (UA_UInt32)(i % 100) * 10,
+                                               &ids[i]);
+
+    clock_t begin, finish;
+    begin = clock();
+
+    for(size_t i = 0; i < ITERATIONS; i++) {
+        UA_fakeSleep(5);
+
+        /* Every tenth iteration change the interval of some callbacks and
+         * replace others */
+        if(i % 10 == 0) {
+            for(size_t j = i; j < CALLBACKS; j += 1000) {
+                retval |= UA_Timer_changeRepeatedCallbackInterval(&timer, ids[j], 50);
+                size_t k = (j + 500) % CALLBACKS;
+                retval |= UA_Timer_removeRepeatedCallback(&timer, ids[k]);
+                retval |= UA_Timer_addRepeatedCallback(&timer, countCallback, NULL,
+                                                       20, &ids[k]);
+            }
+        }
+
+        UA_Timer_process(&timer, UA_DateTime_nowMonotonic(), dispatchCallback, NULL);
+    }
+
+    finish = clock();
+    double time_spent = (double)(finish - begin) / CLOCKS_PER_SEC;
+    printf("duration was %f s for %lu callback executions\n", time_spent,
+           (unsigned long)executions);
+    printf("retval is %s\n", UA_StatusCode_name(retval));
+
+    UA_Timer_deleteMembers(&timer);
+    UA_free(ids);
+    return (int)retval;
+}
@@ -193,12 +193,91 @@ START_TEST(parseCustomArray) {
     UA_ByteString_deleteMembers(&buf);
 } END_TEST
 
+START_TEST(findStandardDataTypes) {
+    /* The binary search returns the same type as the linear search, i.e. the
+     * first type in the array with a matching id */
+    for(size_t i = 0; i < UA_TYPES_COUNT; ++i) {
+        const UA_DataType *type = UA_findDataType(&UA_TYPES[i].typeId);
+        ck_assert_ptr_ne(type, NULL);
+        ck_assert(type <= &UA_TYPES[i]);
+        ck_assert_uint_eq(type->typeId.identifier.numeric,
+                          UA_TYPES[i].typeId.identifier.numeric);
+
+        UA_NodeId encodingId = UA_NODEID_NUMERIC(0, UA_TYPES[i].binaryEncodingId);
+        type = UA_findDataTypeByBinary(&encodingId);
+        ck_assert_ptr_ne(type, NULL);
+        ck_assert(type <= &UA_TYPES[i]);
+        ck_assert_uint_eq(type->binaryEncodingId, UA_TYPES[i].binaryEncodingId);
+    }
+
+    UA_NodeId unknown = UA_NODEID_NUMERIC(0, 1234567);
+    ck_assert_ptr_eq(UA_findDataType(&unknown), NULL);
+    ck_assert_ptr_eq(UA_findDataTypeByBinary(&unknown), NULL);
+} END_TEST
+
+START_TEST(parseCustomArrayIndexed) {
+    /* Several custom types that differ only in the binary encoding id */
+    UA_DataType types[4];
+    const UA_UInt16 encodingIds[4] = {7, 2, 5, 3};
+    for(size_t i = 0; i < 4; ++i) {
+        types[i] = PointType;
+        types[i].typeIndex = (UA_UInt16)i;
+        types[i].binaryEncodingId = encodingIds[i];
+    }
+
+    UA_DataTypeIndex index;
+    UA_DataTypeIndex_init(&index, 4, types);
+    ck_assert_ptr_ne(index.binaryEncodingIndex, NULL);
+
+    Point p;
+    p.x = 1.0;
+    p.y = 2.0;
+    p.z = 3.0;
+
+    for(size_t i = 0; i < 4; ++i) {
+        UA_ExtensionObject eo;
+        UA_ExtensionObject_init(&eo);
+        eo.encoding = UA_EXTENSIONOBJECT_DECODED_NODELETE;
+        eo.content.decoded.data = &p;
+        eo.content.decoded.type = &types[i];
+
+        size_t buflen = UA_calcSizeBinary(&eo, &UA_TYPES[UA_TYPES_EXTENSIONOBJECT]);
+        UA_ByteString buf;
+        UA_StatusCode retval = UA_ByteString_allocBuffer(&buf, buflen);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+
+        UA_Byte *bufPos = buf.data;
+        const UA_Byte *bufEnd = &buf.data[buf.length];
+        retval = UA_encodeBinary(&eo, &UA_TYPES[UA_TYPES_EXTENSIONOBJECT],
+                                 &bufPos, &bufEnd, NULL, NULL);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+
+        UA_ExtensionObject eo2;
+        size_t offset = 0;
+        UA_DecodeBinaryOptions options;
+        memset(&options, 0, sizeof(UA_DecodeBinaryOptions));
+        options.customTypes = &index;
+        retval = UA_decodeBinaryWithOptions(&buf, &offset, &eo2,
+                                            &UA_TYPES[UA_TYPES_EXTENSIONOBJECT], &options);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+        ck_assert_int_eq(eo2.encoding, UA_EXTENSIONOBJECT_DECODED);
+        ck_assert_ptr_eq(eo2.content.decoded.type, &types[i]);
+
+        UA_ExtensionObject_deleteMembers(&eo2);
+        UA_ByteString_deleteMembers(&buf);
+    }
+
+    UA_DataTypeIndex_deleteMembers(&index);
+} END_TEST
+
 int main(void) {
     Suite *s  = suite_create("Test Custom DataType Encoding");
     TCase *tc = tcase_create("test cases");
     tcase_add_test(tc, parseCustomScalar);
     tcase_add_test(tc, parseCustomScalarExtensionObject);
     tcase_add_test(tc, parseCustomArray);
+    tcase_add_test(tc, findStandardDataTypes);
+    tcase_add_test(tc, parseCustomArrayIndexed);
     suite_add_tcase(s, tc);
 
     SRunner *sr = srunner_create(s);
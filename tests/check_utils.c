@@ -7,6 +7,9 @@
 #include "ua_types.h"
 #include "ua_client.h"
 #include "ua_util.h"
+#include "ua_types_encoding_binary.h"
+#include "ua_timer.h"
+#include "testing_clock.h"
 #include "check.h"
 
 START_TEST(EndpointUrl_split) {
@@ -155,6 +158,183 @@ START_TEST(StatusCode_msg) {
 }
 END_TEST
 
+START_TEST(Arena_calloc) {
+    UA_Arena arena;
+    UA_Arena_init(&arena, 64);
+
+    /* Small allocations share a block */
+    UA_Byte *a = (UA_Byte*)UA_Arena_calloc(&arena, 3, 1);
+    UA_Byte *b = (UA_Byte*)UA_Arena_calloc(&arena, 1, 8);
+    ck_assert_ptr_ne(a, NULL);
+    ck_assert_ptr_ne(b, NULL);
+    ck_assert_uint_eq((uintptr_t)b % 8, 0);
+    ck_assert(b > a && b < a + 64);
+    for(size_t i = 0; i < 8; i++)
+        ck_assert_uint_eq(b[i], 0);
+    memset(b, 0xff, 8);
+
+    /* Large allocations get their own block */
+    UA_Byte *c = (UA_Byte*)UA_Arena_calloc(&arena, 100, 10);
+    ck_assert_ptr_ne(c, NULL);
+    ck_assert_ptr_ne(arena.blocks->next, NULL);
+
+    /* After the reset, the first block is reused and zeroed */
+    UA_Arena_reset(&arena);
+    ck_assert_ptr_eq(arena.blocks->next, NULL);
+    ck_assert_uint_eq(arena.blocks->used, 0);
+    UA_Byte *d = (UA_Byte*)UA_Arena_calloc(&arena, 1, 16);
+    ck_assert_ptr_eq(d, a);
+    for(size_t i = 0; i < 16; i++)
+        ck_assert_uint_eq(d[i], 0);
+
+    /* Overflowing sizes are rejected */
+    ck_assert_ptr_eq(UA_Arena_calloc(&arena, SIZE_MAX / 2, 4), NULL);
+
+    UA_Arena_deleteMembers(&arena);
+    ck_assert_ptr_eq(arena.blocks, NULL);
+}
+END_TEST
+
+START_TEST(Arena_decode) {
+    /* Encode a variant with an array of strings */
+    UA_String strings[3];
+    strings[0] = UA_STRING("first");
+    strings[1] = UA_STRING("second");
+    strings[2] = UA_STRING("third");
+    UA_Variant var;
+    UA_Variant_setArray(&var, strings, 3, &UA_TYPES[UA_TYPES_STRING]);
+    UA_ByteString buf;
+    UA_StatusCode retval =
+        UA_ByteString_allocBuffer(&buf, UA_calcSizeBinary(&var, &UA_TYPES[UA_TYPES_VARIANT]));
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    UA_Byte *pos = buf.data;
+    const UA_Byte *end = &buf.data[buf.length];
+    retval = UA_encodeBinary(&var, &UA_TYPES[UA_TYPES_VARIANT], &pos, &end, NULL, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    /* Decode into the arena */
+    UA_Arena arena;
+    UA_Arena_init(&arena, 1024);
+    UA_DecodeBinaryOptions options;
+    memset(&options, 0, sizeof(UA_DecodeBinaryOptions));
+    options.arena = &arena;
+    UA_Variant out;
+    size_t offset = 0;
+    retval = UA_decodeBinaryWithOptions(&buf, &offset, &out,
+                                        &UA_TYPES[UA_TYPES_VARIANT], &options);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(offset, buf.length);
+    ck_assert_uint_eq(out.arrayLength, 3);
+    ck_assert(UA_String_equal(&((UA_String*)out.data)[1], &strings[1]));
+
+    /* All memory is in the arena */
+    ck_assert_ptr_ne(arena.blocks, NULL);
+    ck_assert_ptr_eq(arena.blocks->next, NULL);
+    ck_assert((UA_Byte*)out.data > (UA_Byte*)arena.blocks &&
+              (UA_Byte*)out.data < (UA_Byte*)arena.blocks + 1024);
+
+    /* Decode without copying the strings */
+    options.zeroCopy = true;
+    offset = 0;
+    retval = UA_decodeBinaryWithOptions(&buf, &offset, &out,
+                                        &UA_TYPES[UA_TYPES_VARIANT], &options);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    UA_String *outStrings = (UA_String*)out.data;
+    ck_assert(UA_String_equal(&outStrings[2], &strings[2]));
+    ck_assert(outStrings[2].data > buf.data && outStrings[2].data < buf.data + buf.length);
+    options.zeroCopy = false;
+
+    /* A truncated message fails without freeing into the arena */
+    buf.length -= 2;
+    offset = 0;
+    retval = UA_decodeBinaryWithOptions(&buf, &offset, &out,
+                                        &UA_TYPES[UA_TYPES_VARIANT], &options);
+    ck_assert_uint_ne(retval, UA_STATUSCODE_GOOD);
+    buf.length += 2;
+
+    UA_Arena_deleteMembers(&arena);
+    UA_ByteString_deleteMembers(&buf);
+}
+END_TEST
+
+#define TIMER_CALLBACKS 100
+#define TIMER_STEPS 100
+
+static size_t timerExecutions[TIMER_CALLBACKS];
+static size_t timerLastIndex;
+static UA_Boolean timerInOrder;
+
+static void
+timerCallback(void *application, void *data) {
+    size_t index = (size_t)((size_t*)data - timerExecutions);
+    if(index < timerLastIndex)
+        timerInOrder = false;
+    timerLastIndex = index;
+    timerExecutions[index]++;
+}
+
+static void
+timerDispatch(void *application, UA_TimerCallback callback, void *data) {
+    callback(application, data);
+}
+
+/* Advance the clock in steps of 10ms and process the timer after each step */
+static void
+runTimer(UA_Timer *timer) {
+    memset(timerExecutions, 0, sizeof(timerExecutions));
+    for(size_t i = 0; i < TIMER_STEPS; i++) {
+        UA_fakeSleep(10);
+        timerLastIndex = 0;
+        UA_DateTime now = UA_DateTime_nowMonotonic();
+        UA_DateTime next = UA_Timer_process(timer, now, timerDispatch, NULL);
+        ck_assert(next > now);
+    }
+}
+
+START_TEST(Timer_repeatedCallbacks) {
+    UA_Timer timer;
+    UA_Timer_init(&timer);
+    timerInOrder = true;
+
+    /* Intervals between 10ms and 100ms. Callbacks that are due at the same
+     * time are executed in the order of their id. */
+    UA_UInt64 ids[TIMER_CALLBACKS];
+    for(size_t i = 0; i < TIMER_CALLBACKS; i++) {
+        UA_StatusCode retval =
+            UA_Timer_addRepeatedCallback(&timer, timerCallback, &timerExecutions[i],
+                                         10 + (UA_UInt32)(i % 10) * 10, &ids[i]);
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    }
+
+    runTimer(&timer);
+    for(size_t i = 0; i < TIMER_CALLBACKS; i++)
+        ck_assert_uint_eq(timerExecutions[i], TIMER_STEPS / (i % 10 + 1));
+
+    /* Remove every tenth callback and change the interval of the next one from
+     * 20ms to 50ms. The other callbacks keep their schedule. */
+    for(size_t i = 0; i < TIMER_CALLBACKS; i += 10) {
+        UA_StatusCode retval = UA_Timer_removeRepeatedCallback(&timer, ids[i]);
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+        retval = UA_Timer_changeRepeatedCallbackInterval(&timer, ids[i + 1], 50);
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    }
+
+    runTimer(&timer);
+    for(size_t i = 0; i < TIMER_CALLBACKS; i++) {
+        size_t k = i % 10 + 1;
+        size_t expected = (2 * TIMER_STEPS) / k - TIMER_STEPS / k;
+        if(k == 1)
+            expected = 0;
+        else if(k == 2)
+            expected = TIMER_STEPS / 5;
+        ck_assert_uint_eq(timerExecutions[i], expected);
+    }
+    ck_assert(timerInOrder);
+
+    UA_Timer_deleteMembers(&timer);
+}
+END_TEST
+
 static Suite* testSuite_Utils(void) {
     Suite *s = suite_create("Utils");
     TCase *tc_endpointUrl_split = tcase_create("EndpointUrl_split");
@@ -163,6 +343,9 @@ static Suite* testSuite_Utils(void) {
     TCase *tc_utils = tcase_create("Utils");
     tcase_add_test(tc_utils, readNumber);
     tcase_add_test(tc_utils, StatusCode_msg);
+    tcase_add_test(tc_utils, Arena_calloc);
+    tcase_add_test(tc_utils, Arena_decode);
+    tcase_add_test(tc_utils, Timer_repeatedCallbacks);
     suite_add_tcase(s,tc_utils);
     return s;
 }
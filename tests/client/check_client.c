@@ -22,14 +22,13 @@ UA_ServerNetworkLayer nl;
 THREAD_HANDLE server_thread;
 
 static void
-addVariable(size_t size) {
+addVariable(size_t size, char *name) {
     /* Define the attribute of the myInteger variable node */
     UA_VariableAttributes attr = UA_VariableAttributes_default;
     UA_Int32* array = (UA_Int32*)UA_malloc(size * sizeof(UA_Int32));
     memset(array, 0, size * sizeof(UA_Int32));
     UA_Variant_setArray(&attr.value, array, size, &UA_TYPES[UA_TYPES_INT32]);
 
-    char name[] = "my.variable";
     attr.description = UA_LOCALIZEDTEXT("en-US", name);
     attr.displayName = UA_LOCALIZEDTEXT("en-US", name);
     attr.dataType = UA_TYPES[UA_TYPES_INT32].typeId;
@@ -59,7 +58,8 @@ static void setup(void) {
     config = UA_ServerConfig_new_default();
     server = UA_Server_new(config);
     UA_Server_run_startup(server);
-    addVariable(16366);
+    addVariable(16366, "my.variable");
+    addVariable(300000, "my.largevariable"); /* More than 16 chunks */
     THREAD_CREATE(server_thread, serverloop);
 }
 
@@ -100,6 +100,61 @@ START_TEST(Client_read) {
 }
 END_TEST
 
+START_TEST(Client_read_bufferPool) {
+    UA_Client *client = UA_Client_new(UA_ClientConfig_default);
+    UA_StatusCode retval = UA_Client_connect(client, "opc.tcp://localhost:4840");
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    /* The first read allocates the slabs */
+    UA_Variant val;
+    UA_NodeId nodeId = UA_NODEID_STRING(1, "my.variable");
+    retval = UA_Client_readValueAttribute(client, nodeId, &val);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    UA_Variant_deleteMembers(&val);
+
+    UA_NetworkBufferPoolStatistics before;
+    UA_ServerNetworkLayerTCP_getBufferPoolStatistics(&config->networkLayers[0], &before);
+
+    /* Further reads reuse the slabs */
+    for(size_t i = 0; i < 20; i++) {
+        retval = UA_Client_readValueAttribute(client, nodeId, &val);
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+        UA_Variant_deleteMembers(&val);
+    }
+
+    UA_NetworkBufferPoolStatistics after;
+    UA_ServerNetworkLayerTCP_getBufferPoolStatistics(&config->networkLayers[0], &after);
+#ifndef UA_ENABLE_MULTITHREADING
+    ck_assert_uint_eq(after.misses, before.misses);
+#else
+    /* A worker may still hold the receive buffer of the last request when the
+     * next one arrives. Then one more buffer is allocated once. */
+    ck_assert_uint_le(after.misses, before.misses + 1);
+#endif
+    ck_assert_uint_gt(after.hits, before.hits);
+
+    UA_Client_disconnect(client);
+    UA_Client_delete(client);
+}
+END_TEST
+
+START_TEST(Client_read_manyChunks) {
+    UA_Client *client = UA_Client_new(UA_ClientConfig_default);
+    UA_StatusCode retval = UA_Client_connect(client, "opc.tcp://localhost:4840");
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    UA_Variant val;
+    UA_NodeId nodeId = UA_NODEID_STRING(1, "my.largevariable");
+    retval = UA_Client_readValueAttribute(client, nodeId, &val);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(val.arrayLength, 300000);
+    UA_Variant_deleteMembers(&val);
+
+    UA_Client_disconnect(client);
+    UA_Client_delete(client);
+}
+END_TEST
+
 START_TEST(Client_renewSecureChannel) {
     UA_Client *client = UA_Client_new(UA_ClientConfig_default);
     UA_StatusCode retval = UA_Client_connect(client, "opc.tcp://localhost:4840");
@@ -158,6 +213,8 @@ static Suite* testSuite_Client(void) {
     tcase_add_checked_fixture(tc_client, setup, teardown);
     tcase_add_test(tc_client, Client_connect);
     tcase_add_test(tc_client, Client_read);
+    tcase_add_test(tc_client, Client_read_bufferPool);
+    tcase_add_test(tc_client, Client_read_manyChunks);
     suite_add_tcase(s,tc_client);
     TCase *tc_client_reconnect = tcase_create("Client Reconnect");
     tcase_add_checked_fixture(tc_client_reconnect, setup, teardown);
@@ -0,0 +1,178 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ua_types.h"
+#include "ua_server.h"
+#include "ua_client.h"
+#include "ua_config_default.h"
+#include "ua_client_highlevel.h"
+#include "ua_network_tcp.h"
+#include "check.h"
+#include "thread_wrapper.h"
+
+/* The same round-trips as in check_client.c. But the server uses the
+ * epoll-based network layer. */
+
+UA_Server *server;
+UA_ServerConfig *config;
+UA_Boolean *running;
+THREAD_HANDLE server_thread;
+
+static void
+addVariable(size_t size, char *name) {
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    UA_Int32* array = (UA_Int32*)UA_malloc(size * sizeof(UA_Int32));
+    memset(array, 0, size * sizeof(UA_Int32));
+    UA_Variant_setArray(&attr.value, array, size, &UA_TYPES[UA_TYPES_INT32]);
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", name);
+    attr.dataType = UA_TYPES[UA_TYPES_INT32].typeId;
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
+
+    UA_Server_addVariableNode(server, UA_NODEID_STRING(1, name),
+                              UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                              UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                              UA_QUALIFIEDNAME(1, name),
+                              UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                              attr, NULL, NULL);
+    UA_free(array);
+}
+
+THREAD_CALLBACK(serverloop) {
+    while(*running)
+        UA_Server_run_iterate(server, true);
+    return 0;
+}
+
+static void setup(void) {
+    running = UA_Boolean_new();
+    *running = true;
+    config = UA_ServerConfig_new_default();
+
+    /* Replace the select-based network layer */
+    config->networkLayers[0].deleteMembers(&config->networkLayers[0]);
+    config->networkLayers[0] =
+        UA_ServerNetworkLayerTCP_epoll(UA_ConnectionConfig_default, 4840);
+
+    server = UA_Server_new(config);
+    UA_Server_run_startup(server);
+    addVariable(16366, "my.variable");
+    addVariable(300000, "my.largevariable"); /* More than 16 chunks */
+    THREAD_CREATE(server_thread, serverloop);
+}
+
+static void teardown(void) {
+    *running = false;
+    THREAD_JOIN(server_thread);
+    UA_Server_run_shutdown(server);
+    UA_Boolean_delete(running);
+    UA_Server_delete(server);
+    UA_ServerConfig_delete(config);
+}
+
+START_TEST(Client_epoll_read) {
+    UA_Client *client = UA_Client_new(UA_ClientConfig_default);
+    UA_StatusCode retval = UA_Client_connect(client, "opc.tcp://localhost:4840");
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    UA_Variant val;
+    UA_NodeId nodeId = UA_NODEID_STRING(1, "my.variable");
+    retval = UA_Client_readValueAttribute(client, nodeId, &val);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(val.arrayLength, 16366);
+    UA_Variant_deleteMembers(&val);
+
+    UA_Client_disconnect(client);
+    UA_Client_delete(client);
+}
+END_TEST
+
+/* The request has more chunks than the server reads from one socket per
+ * notification. So the socket has to be re-armed until the request is
+ * complete. */
+START_TEST(Client_epoll_writeManyChunks) {
+    UA_Client *client = UA_Client_new(UA_ClientConfig_default);
+    UA_StatusCode retval = UA_Client_connect(client, "opc.tcp://localhost:4840");
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    size_t size = 300000;
+    UA_Int32 *array = (UA_Int32*)UA_malloc(size * sizeof(UA_Int32));
+    for(size_t i = 0; i < size; i++)
+        array[i] = (UA_Int32)i;
+    UA_Variant val;
+    UA_Variant_setArray(&val, array, size, &UA_TYPES[UA_TYPES_INT32]);
+    UA_NodeId nodeId = UA_NODEID_STRING(1, "my.largevariable");
+    retval = UA_Client_writeValueAttribute(client, nodeId, &val);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    UA_Variant_deleteMembers(&val);
+
+    retval = UA_Client_readValueAttribute(client, nodeId, &val);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(val.arrayLength, size);
+    ck_assert_int_eq(((UA_Int32*)val.data)[size-1], (UA_Int32)(size-1));
+    UA_Variant_deleteMembers(&val);
+
+    UA_Client_disconnect(client);
+    UA_Client_delete(client);
+}
+END_TEST
+
+START_TEST(Client_epoll_manyClients) {
+    UA_Client *clients[8];
+    for(size_t i = 0; i < 8; i++) {
+        clients[i] = UA_Client_new(UA_ClientConfig_default);
+        UA_StatusCode retval = UA_Client_connect(clients[i], "opc.tcp://localhost:4840");
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    }
+
+    /* Interleave the requests of the clients */
+    UA_NodeId nodeId = UA_NODEID_STRING(1, "my.variable");
+    for(size_t round = 0; round < 5; round++) {
+        for(size_t i = 0; i < 8; i++) {
+            UA_Variant val;
+            UA_StatusCode retval = UA_Client_readValueAttribute(clients[i], nodeId, &val);
+            ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+            UA_Variant_deleteMembers(&val);
+        }
+    }
+
+    /* Closed connections are removed from the epoll set. The remaining
+     * clients are still served. */
+    for(size_t i = 0; i < 4; i++) {
+        UA_Client_disconnect(clients[i]);
+        UA_Client_delete(clients[i]);
+    }
+    for(size_t i = 4; i < 8; i++) {
+        UA_Variant val;
+        UA_StatusCode retval = UA_Client_readValueAttribute(clients[i], nodeId, &val);
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+        UA_Variant_deleteMembers(&val);
+        UA_Client_disconnect(clients[i]);
+        UA_Client_delete(clients[i]);
+    }
+}
+END_TEST
+
+static Suite* testSuite_Client(void) {
+    Suite *s = suite_create("Client epoll");
+    TCase *tc_client = tcase_create("Client Basic");
+    tcase_add_checked_fixture(tc_client, setup, teardown);
+    tcase_add_test(tc_client, Client_epoll_read);
+    tcase_add_test(tc_client, Client_epoll_writeManyChunks);
+    tcase_add_test(tc_client, Client_epoll_manyClients);
+    suite_add_tcase(s,tc_client);
+    return s;
+}
+
+int main(void) {
+    Suite *s = testSuite_Client();
+    SRunner *sr = srunner_create(s);
+    srunner_set_fork_status(sr, CK_NOFORK);
+    srunner_run_all(sr,CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -9,6 +9,10 @@
 #include "ua_types.h"
 #include "ua_plugin_nodestore.h"
 #include "ua_nodestore_default.h"
+#include "ua_nodestore_robinhood.h"
+#include "ua_nodestore_image.h"
+#include "ua_server.h"
+#include "ua_config_default.h"
 #include "ua_util.h"
 #include "check.h"
 
@@ -24,8 +28,10 @@
  * released */
 typedef struct UA_NodeMapEntry {
     struct UA_NodeMapEntry *orig; /* the version this is a copy from (or NULL) */
-    UA_UInt16 refCount; /* How many consumers have a reference to the node? */
-    UA_Boolean deleted; /* Node was marked as deleted and can be deleted when refCount == 0 */
+#ifdef UA_ENABLE_MULTITHREADING
+    struct UA_NodeMapEntry *nextRetired;
+#endif
+    UA_UInt32 refCount; /* How many consumers have a reference to the node? */
     UA_Node node;
 } UA_NodeMapEntry;
 
@@ -34,6 +40,19 @@ static void checkAllReleased(void *context, const UA_Node* node) {
     ck_assert_int_eq(entry->refCount, 1); /* The count is increased when the visited node is checked out */
 }
 
+/* Dirty redifinition from ua_nodestore_robinhood.c */
+typedef struct UA_NodeTableEntry {
+    struct UA_NodeTableEntry *orig;
+    UA_UInt32 refCount;
+    UA_Boolean deleted;
+    UA_Node node;
+} UA_NodeTableEntry;
+
+static void checkAllReleasedRobinHood(void *context, const UA_Node* node) {
+    UA_NodeTableEntry *entry = container_of(node, UA_NodeTableEntry, node);
+    ck_assert_int_eq(entry->refCount, 1);
+}
+
 UA_Nodestore ns;
 
 static void setup(void) {
@@ -45,6 +64,32 @@ static void teardown(void) {
     ns.deleteNodestore(ns.context);
 }
 
+static void setupRobinHood(void) {
+    UA_Nodestore_robinhood_new(&ns);
+}
+
+static void teardownRobinHood(void) {
+    ns.iterate(ns.context, NULL, checkAllReleasedRobinHood);
+    ns.deleteNodestore(ns.context);
+}
+
+/* The image nodestore decodes the nodes into a default nodestore */
+static UA_ByteString emptyImage;
+
+static void setupImage(void) {
+    UA_Nodestore empty;
+    UA_Nodestore_default_new(&empty);
+    UA_Nodestore_image_encode(&empty, &emptyImage);
+    empty.deleteNodestore(empty.context);
+    UA_Nodestore_image_new(&ns, &emptyImage);
+}
+
+static void teardownImage(void) {
+    ns.iterate(ns.context, NULL, checkAllReleased);
+    ns.deleteNodestore(ns.context);
+    UA_ByteString_deleteMembers(&emptyImage);
+}
+
 static int zeroCnt = 0;
 static int visitCnt = 0;
 static void checkZeroVisitor(void *context, const UA_Node* node) {
@@ -200,6 +245,129 @@ START_TEST(failToFindNonExistantNodeInUA_NodeStoreWithSeveralEntries) {
 }
 END_TEST
 
+static UA_NodeId
+mixedNodeId(UA_UInt32 i, char *buf) {
+    switch(i % 4) {
+    case 0:
+        return UA_NODEID_NUMERIC(1, i);
+    case 1:
+        snprintf(buf, 32, "n%u", i); /* Stored inline */
+        return UA_NODEID_STRING(1, buf);
+    case 2:
+        snprintf(buf, 32, "a.long.string.node.%u", i);
+        return UA_NODEID_STRING(1, buf);
+    default: {
+        UA_Guid guid = {i, 0, 0, {0, 0, 0, 0, 0, 0, 0, (UA_Byte)i}};
+        return UA_NODEID_GUID(1, guid);
+    }
+    }
+}
+
+START_TEST(findAndRemoveMixedIdentifiers) {
+    char buf[32];
+    for(UA_UInt32 i = 0; i < 1000; i++) {
+        UA_Node *n = ns.newNode(ns.context, UA_NODECLASS_VARIABLE);
+        UA_NodeId id = mixedNodeId(i + 1, buf);
+        UA_NodeId_copy(&id, &n->nodeId);
+        ck_assert_int_eq(ns.insertNode(ns.context, n, NULL), UA_STATUSCODE_GOOD);
+    }
+
+    /* Remove every second node */
+    for(UA_UInt32 i = 0; i < 1000; i += 2) {
+        UA_NodeId id = mixedNodeId(i + 1, buf);
+        ck_assert_int_eq(ns.removeNode(ns.context, &id), UA_STATUSCODE_GOOD);
+    }
+
+    for(UA_UInt32 i = 0; i < 1000; i++) {
+        UA_NodeId id = mixedNodeId(i + 1, buf);
+        const UA_Node *n = ns.getNode(ns.context, &id);
+        if(i % 2 == 0) {
+            ck_assert_ptr_eq(n, NULL);
+            continue;
+        }
+        ck_assert_ptr_ne(n, NULL);
+        ck_assert(UA_NodeId_equal(&n->nodeId, &id));
+        ns.releaseNode(ns.context, n);
+    }
+
+    /* A different string with the same prefix is not found */
+    UA_NodeId other = UA_NODEID_STRING(1, "a.long.string.node.x");
+    ck_assert_ptr_eq(ns.getNode(ns.context, &other), NULL);
+    other = UA_NODEID_STRING(2, "n2");
+    ck_assert_ptr_eq(ns.getNode(ns.context, &other), NULL);
+
+    zeroCnt = 0;
+    visitCnt = 0;
+    ns.iterate(ns.context, NULL, checkZeroVisitor);
+    ck_assert_int_eq(zeroCnt, 0);
+    ck_assert_int_eq(visitCnt, 500);
+}
+END_TEST
+
+START_TEST(findAndRemoveNumericIdentifiers) {
+    /* Sparse identifiers, large identifiers and large namespace indices */
+    UA_UInt32 ids[] = {1, 63, 64, 12169, 1000000, 16777215, 16777216, 4294967295};
+    UA_UInt16 nsIndices[] = {0, 1, 15, 16, 200};
+    for(size_t i = 0; i < sizeof(nsIndices) / sizeof(UA_UInt16); i++) {
+        for(size_t j = 0; j < sizeof(ids) / sizeof(UA_UInt32); j++) {
+            UA_Node *n = createNode((UA_Int16)nsIndices[i], 0);
+            n->nodeId.identifier.numeric = ids[j];
+            ck_assert_int_eq(ns.insertNode(ns.context, n, NULL), UA_STATUSCODE_GOOD);
+        }
+    }
+
+    /* Inserting again fails */
+    UA_Node *n = createNode(1, 64);
+    ck_assert_int_eq(ns.insertNode(ns.context, n, NULL), UA_STATUSCODE_BADNODEIDEXISTS);
+
+    /* Remove every second identifier */
+    for(size_t i = 0; i < sizeof(nsIndices) / sizeof(UA_UInt16); i++) {
+        for(size_t j = 0; j < sizeof(ids) / sizeof(UA_UInt32); j += 2) {
+            UA_NodeId id = UA_NODEID_NUMERIC(nsIndices[i], ids[j]);
+            ck_assert_int_eq(ns.removeNode(ns.context, &id), UA_STATUSCODE_GOOD);
+        }
+    }
+
+    for(size_t i = 0; i < sizeof(nsIndices) / sizeof(UA_UInt16); i++) {
+        for(size_t j = 0; j < sizeof(ids) / sizeof(UA_UInt32); j++) {
+            UA_NodeId id = UA_NODEID_NUMERIC(nsIndices[i], ids[j]);
+            const UA_Node *nr = ns.getNode(ns.context, &id);
+            if(j % 2 == 0) {
+                ck_assert_ptr_eq(nr, NULL);
+                continue;
+            }
+            ck_assert_ptr_ne(nr, NULL);
+            ck_assert(UA_NodeId_equal(&nr->nodeId, &id));
+            ns.releaseNode(ns.context, nr);
+        }
+    }
+
+    /* A fresh identifier is assigned */
+    UA_NodeId added;
+    n = createNode(1, 0);
+    ck_assert_int_eq(ns.insertNode(ns.context, n, &added), UA_STATUSCODE_GOOD);
+    ck_assert_uint_ne(added.identifier.numeric, 0);
+    const UA_Node *nr = ns.getNode(ns.context, &added);
+    ck_assert_ptr_ne(nr, NULL);
+    ns.releaseNode(ns.context, nr);
+
+    /* A replaced node is found in the index */
+    UA_NodeId id = UA_NODEID_NUMERIC(15, 63);
+    UA_Node *copy;
+    ck_assert_int_eq(ns.getNodeCopy(ns.context, &id, &copy), UA_STATUSCODE_GOOD);
+    ck_assert_int_eq(ns.replaceNode(ns.context, copy), UA_STATUSCODE_GOOD);
+    nr = ns.getNode(ns.context, &id);
+    ck_assert_ptr_eq(nr, copy);
+    ns.releaseNode(ns.context, nr);
+
+    zeroCnt = 0;
+    visitCnt = 0;
+    ns.iterate(ns.context, NULL, checkZeroVisitor);
+    ck_assert_int_eq(zeroCnt, 0);
+    ck_assert_int_eq(visitCnt, 21);
+}
+END_TEST
+
 /************************************/
 /* Performance Profiling Test Cases */
 /************************************/
@@ -264,6 +432,281 @@ START_TEST(profileGetDelete) {
 }
 END_TEST
 
+#ifdef UA_ENABLE_MULTITHREADING
+static volatile UA_Boolean readersRunning;
+
+static void *replaceReaderThread(void *arg) {
+    UA_NodeId id = UA_NODEID_NUMERIC(0, 2253);
+    while(UA_atomic_load(&readersRunning)) {
+        const UA_Node *n = ns.getNode(ns.context, &id);
+        ck_assert_ptr_ne(n, NULL);
+        ck_assert_int_eq(n->nodeClass, UA_NODECLASS_VARIABLE);
+        ns.releaseNode(ns.context, n);
+    }
+    return NULL;
+}
+#endif
+
+#define REPLACEMENTS 10000
+#define REPLACE_THREADS 32 /* More than reader stripes. So they are shared. */
+
+/* The readers never pause at the same time. So the retired versions are only
+ * released when the writer waits for the readers. */
+START_TEST(replaceWhileReading) {
+    UA_Node *n1 = createNode(0, 2253);
+    ns.insertNode(ns.context, n1, NULL);
+
+#ifdef UA_ENABLE_MULTITHREADING
+    readersRunning = true;
+    pthread_t t[REPLACE_THREADS];
+    for(size_t i = 0; i < REPLACE_THREADS; i++)
+        pthread_create(&t[i], NULL, replaceReaderThread, NULL);
+#endif
+
+    UA_NodeId id = UA_NODEID_NUMERIC(0, 2253);
+    for(size_t i = 0; i < REPLACEMENTS; i++) {
+        UA_Node *n2;
+        UA_StatusCode retval = ns.getNodeCopy(ns.context, &id, &n2);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+        retval = ns.replaceNode(ns.context, n2);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    }
+
+#ifdef UA_ENABLE_MULTITHREADING
+    UA_atomic_store(&readersRunning, false);
+    for(size_t i = 0; i < REPLACE_THREADS; i++)
+        pthread_join(t[i], NULL);
+#endif
+}
+END_TEST
+
+#define REPLACE_NODES 1000
+
+#ifdef UA_ENABLE_MULTITHREADING
+static void *replaceManyReaderThread(void *arg) {
+    UA_UInt32 random = (UA_UInt32)(uintptr_t)arg;
+    while(UA_atomic_load(&readersRunning)) {
+        random = random * 1103515245 + 12345;
+        UA_NodeId id = UA_NODEID_NUMERIC(1, 1 + ((random >> 8) % REPLACE_NODES));
+        const UA_Node *n = ns.getNode(ns.context, &id);
+        ck_assert_ptr_ne(n, NULL);
+        ck_assert(UA_NodeId_equal(&n->nodeId, &id));
+        ns.releaseNode(ns.context, n);
+    }
+    return NULL;
+}
+#endif
+
+/* Replacing nodes does not hide the other nodes from concurrent readers */
+START_TEST(replaceManyWhileReading) {
+    for(UA_Int32 i = 1; i <= REPLACE_NODES; i++) {
+        UA_StatusCode retval = ns.insertNode(ns.context, createNode(1, i), NULL);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    }
+
+#ifdef UA_ENABLE_MULTITHREADING
+    readersRunning = true;
+    pthread_t t[REPLACE_THREADS];
+    for(size_t i = 0; i < REPLACE_THREADS; i++)
+        pthread_create(&t[i], NULL, replaceManyReaderThread, (void*)(uintptr_t)(i + 1));
+#endif
+
+    UA_UInt32 random = 42;
+    for(size_t i = 0; i < REPLACEMENTS; i++) {
+        random = random * 1103515245 + 12345;
+        UA_NodeId id = UA_NODEID_NUMERIC(1, 1 + ((random >> 8) % REPLACE_NODES));
+        UA_Node *n2;
+        UA_StatusCode retval = ns.getNodeCopy(ns.context, &id, &n2);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+        n2->writeMask = random;
+        retval = ns.replaceNode(ns.context, n2);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    }
+
+#ifdef UA_ENABLE_MULTITHREADING
+    UA_atomic_store(&readersRunning, false);
+    for(size_t i = 0; i < REPLACE_THREADS; i++)
+        pthread_join(t[i], NULL);
+#endif
+}
+END_TEST
+
+START_TEST(findAndRemoveImageNodes) {
+    /* Encode nodes with mixed identifiers and a value */
+    char buf[32];
+    UA_Nodestore source;
+    UA_Nodestore_default_new(&source);
+    UA_Int32 value = 42;
+    for(UA_UInt32 i = 0; i < 1000; i++) {
+        UA_VariableNode *n = (UA_VariableNode*)
+            source.newNode(source.context, UA_NODECLASS_VARIABLE);
+        UA_NodeId id = mixedNodeId(i + 1, buf);
+        UA_NodeId_copy(&id, &n->nodeId);
+        UA_Variant_setScalarCopy(&n->value.data.value.value, &value,
+                                 &UA_TYPES[UA_TYPES_INT32]);
+        n->value.data.value.hasValue = true;
+        ck_assert_int_eq(source.insertNode(source.context, (UA_Node*)n, NULL),
+                         UA_STATUSCODE_GOOD);
+    }
+    UA_ByteString image;
+    ck_assert_int_eq(UA_Nodestore_image_encode(&source, &image), UA_STATUSCODE_GOOD);
+    source.deleteNodestore(source.context);
+
+    /* Corrupted images are rejected */
+    UA_Nodestore ins;
+    UA_ByteString truncated = image;
+    truncated.length -= 1;
+    ck_assert_int_ne(UA_Nodestore_image_new(&ins, &truncated), UA_STATUSCODE_GOOD);
+
+    /* A corrupted index is rejected */
+    UA_ByteString corrupted;
+    UA_ByteString_copy(&image, &corrupted);
+    size_t lastEntry = 20 + (999 * 12);
+    corrupted.data[lastEntry + 8] ^= 0x01;
+    ck_assert_int_ne(UA_Nodestore_image_new(&ins, &corrupted), UA_STATUSCODE_GOOD);
+    corrupted.data[lastEntry + 8] ^= 0x01;
+
+    /* The records are checked on access. A corrupted record hides the node. */
+    size_t lastRecord = (size_t)corrupted.data[lastEntry + 4] |
+        ((size_t)corrupted.data[lastEntry + 5] << 8) |
+        ((size_t)corrupted.data[lastEntry + 6] << 16) |
+        ((size_t)corrupted.data[lastEntry + 7] << 24);
+    corrupted.data[lastRecord + 8 + 6] ^= 0x01;
+    ck_assert_int_eq(UA_Nodestore_image_new(&ins, &corrupted), UA_STATUSCODE_GOOD);
+    size_t missing = 0;
+    for(UA_UInt32 i = 0; i < 1000; i++) {
+        UA_NodeId id = mixedNodeId(i + 1, buf);
+        const UA_Node *n = ins.getNode(ins.context, &id);
+        if(!n) {
+            missing++;
+            continue;
+        }
+        ck_assert(UA_NodeId_equal(&n->nodeId, &id));
+        ins.releaseNode(ins.context, n);
+    }
+    ck_assert_uint_eq(missing, 1);
+    zeroCnt = 0;
+    visitCnt = 0;
+    ins.iterate(ins.context, NULL, checkZeroVisitor);
+    ck_assert_int_eq(visitCnt, 999);
+    ins.deleteNodestore(ins.context);
+    UA_ByteString_deleteMembers(&corrupted);
+
+    ck_assert_int_eq(UA_Nodestore_image_new(&ins, &image), UA_STATUSCODE_GOOD);
+
+    /* Remove every second node */
+    for(UA_UInt32 i = 0; i < 1000; i += 2) {
+        UA_NodeId id = mixedNodeId(i + 1, buf);
+        ck_assert_int_eq(ins.removeNode(ins.context, &id), UA_STATUSCODE_GOOD);
+        ck_assert_int_eq(ins.removeNode(ins.context, &id), UA_STATUSCODE_BADNODEIDUNKNOWN);
+    }
+
+    for(UA_UInt32 i = 0; i < 1000; i++) {
+        UA_NodeId id = mixedNodeId(i + 1, buf);
+        const UA_Node *n = ins.getNode(ins.context, &id);
+        if(i % 2 == 0) {
+            ck_assert_ptr_eq(n, NULL);
+            continue;
+        }
+        ck_assert_ptr_ne(n, NULL);
+        ck_assert(UA_NodeId_equal(&n->nodeId, &id));
+        const UA_VariableNode *vn = (const UA_VariableNode*)n;
+        ck_assert_int_eq(*(UA_Int32*)vn->value.data.value.value.data, 42);
+        ins.releaseNode(ins.context, n);
+    }
+
+    /* Existing nodes cannot be inserted again. Removed nodes can. */
+    for(UA_UInt32 i = 0; i < 4; i++) {
+        UA_Node *n = ins.newNode(ins.context, UA_NODECLASS_VARIABLE);
+        UA_NodeId id = mixedNodeId(i + 1, buf);
+        UA_NodeId_copy(&id, &n->nodeId);
+        UA_StatusCode expected = (i % 2 == 0) ? UA_STATUSCODE_GOOD :
+            UA_STATUSCODE_BADNODEIDEXISTS;
+        ck_assert_int_eq(ins.insertNode(ins.context, n, NULL), expected);
+    }
+
+    /* Edit a node that was not decoded yet */
+    UA_NodeId id = mixedNodeId(10, buf);
+    UA_Node *copy;
+    ck_assert_int_eq(ins.getNodeCopy(ins.context, &id, &copy), UA_STATUSCODE_GOOD);
+    copy->writeMask = 7;
+    ck_assert_int_eq(ins.replaceNode(ins.context, copy), UA_STATUSCODE_GOOD);
+    const UA_Node *n = ins.getNode(ins.context, &id);
+    ck_assert_uint_eq(n->writeMask, 7);
+    ins.releaseNode(ins.context, n);
+
+    /* Fresh identifiers do not collide with the image */
+    UA_Node *fresh = ins.newNode(ins.context, UA_NODECLASS_VARIABLE);
+    fresh->nodeId = UA_NODEID_NUMERIC(1, 0);
+    UA_NodeId freshId;
+    ck_assert_int_eq(ins.insertNode(ins.context, fresh, &freshId), UA_STATUSCODE_GOOD);
+    ck_assert_uint_ne(freshId.identifier.numeric, 0);
+
+    zeroCnt = 0;
+    visitCnt = 0;
+    ins.iterate(ins.context, NULL, checkZeroVisitor);
+    ck_assert_int_eq(zeroCnt, 0);
+    ck_assert_int_eq(visitCnt, 503);
+
+    ins.deleteNodestore(ins.context);
+    UA_ByteString_deleteMembers(&image);
+}
+END_TEST
+
+START_TEST(serverFromImage) {
+    /* Encode the namespace zero of a server */
+    UA_ServerConfig *config = UA_ServerConfig_new_default();
+    UA_Server *server = UA_Server_new(config);
+    UA_ByteString image;
+    ck_assert_int_eq(UA_Nodestore_image_encode(&config->nodestore, &image),
+                     UA_STATUSCODE_GOOD);
+    UA_Server_delete(server);
+    UA_ServerConfig_delete(config);
+
+    /* Start a server from the image */
+    config = UA_ServerConfig_new_default();
+    config->nodestore.deleteNodestore(config->nodestore.context);
+    ck_assert_int_eq(UA_Nodestore_image_new(&config->nodestore, &image),
+                     UA_STATUSCODE_GOOD);
+    server = UA_Server_new(config);
+
+    /* The DataSources are attached */
+    UA_Variant value;
+    UA_StatusCode retval =
+        UA_Server_readValue(server, UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_NAMESPACEARRAY),
+                            &value);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(value.arrayLength, 2);
+    UA_Variant_deleteMembers(&value);
+
+    /* Values of non-builtin types are decoded with their type */
+    retval = UA_Server_readValue(server,
+                                 UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER_SERVERCAPABILITIES_LOCALEIDARRAY),
+                                 &value);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_ptr_eq(value.type, &UA_TYPES[UA_TYPES_LOCALEID]);
+    ck_assert_uint_eq(value.arrayLength, 1);
+    UA_String en = UA_STRING("en");
+    ck_assert(UA_String_equal((UA_String*)value.data, &en));
+    UA_Variant_deleteMembers(&value);
+
+    /* The references are taken from the image */
+    UA_BrowseDescription bd;
+    UA_BrowseDescription_init(&bd);
+    bd.nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+    bd.browseDirection = UA_BROWSEDIRECTION_FORWARD;
+    bd.resultMask = UA_BROWSERESULTMASK_ALL;
+    UA_BrowseResult br = UA_Server_browse(server, 0, &bd);
+    ck_assert_int_eq(br.statusCode, UA_STATUSCODE_GOOD);
+    ck_assert_uint_gt(br.referencesSize, 0);
+    UA_BrowseResult_deleteMembers(&br);
+
+    UA_Server_delete(server);
+    UA_ServerConfig_delete(config);
+    UA_ByteString_deleteMembers(&image);
+}
+END_TEST
+
 static Suite * namespace_suite (void) {
     Suite *s = suite_create ("UA_NodeStore");
 
@@ -274,12 +717,16 @@ static Suite * namespace_suite (void) {
     tcase_add_test (tc_find, findNodeInExpandedNamespace);
     tcase_add_test (tc_find, failToFindNonExistantNodeInUA_NodeStoreWithSeveralEntries);
     tcase_add_test (tc_find, failToFindNodeInOtherUA_NodeStore);
+    tcase_add_test (tc_find, findAndRemoveMixedIdentifiers);
+    tcase_add_test (tc_find, findAndRemoveNumericIdentifiers);
     suite_add_tcase (s, tc_find);
 
     TCase *tc_replace = tcase_create("Replace");
     tcase_add_checked_fixture(tc_replace, setup, teardown);
     tcase_add_test (tc_replace, replaceExistingNode);
     tcase_add_test (tc_replace, replaceOldNode);
+    tcase_add_test (tc_replace, replaceWhileReading);
+    tcase_add_test (tc_replace, replaceManyWhileReading);
     suite_add_tcase (s, tc_replace);
 
     TCase* tc_iterate = tcase_create ("Iterate");
@@ -293,6 +740,39 @@ static Suite * namespace_suite (void) {
     tcase_add_test (tc_profile, profileGetDelete);
     suite_add_tcase (s, tc_profile);
 
+    TCase* tc_robinhood = tcase_create ("Robin Hood Nodestore");
+    tcase_add_checked_fixture(tc_robinhood, setupRobinHood, teardownRobinHood);
+    tcase_add_test (tc_robinhood, findNodeInUA_NodeStoreWithSingleEntry);
+    tcase_add_test (tc_robinhood, findNodeInUA_NodeStoreWithSeveralEntries);
+    tcase_add_test (tc_robinhood, findNodeInExpandedNamespace);
+    tcase_add_test (tc_robinhood, failToFindNonExistantNodeInUA_NodeStoreWithSeveralEntries);
+    tcase_add_test (tc_robinhood, failToFindNodeInOtherUA_NodeStore);
+    tcase_add_test (tc_robinhood, findAndRemoveMixedIdentifiers);
+    tcase_add_test (tc_robinhood, findAndRemoveNumericIdentifiers);
+    tcase_add_test (tc_robinhood, replaceExistingNode);
+    tcase_add_test (tc_robinhood, replaceOldNode);
+    tcase_add_test (tc_robinhood, iterateOverUA_NodeStoreShallNotVisitEmptyNodes);
+    tcase_add_test (tc_robinhood, iterateOverExpandedNamespaceShallNotVisitEmptyNodes);
+    tcase_add_test (tc_robinhood, profileGetDelete);
+    suite_add_tcase (s, tc_robinhood);
+
+    TCase* tc_image = tcase_create ("Image Nodestore");
+    tcase_add_checked_fixture(tc_image, setupImage, teardownImage);
+    tcase_add_test (tc_image, findNodeInUA_NodeStoreWithSingleEntry);
+    tcase_add_test (tc_image, findNodeInUA_NodeStoreWithSeveralEntries);
+    tcase_add_test (tc_image, findNodeInExpandedNamespace);
+    tcase_add_test (tc_image, failToFindNonExistantNodeInUA_NodeStoreWithSeveralEntries);
+    tcase_add_test (tc_image, failToFindNodeInOtherUA_NodeStore);
+    tcase_add_test (tc_image, findAndRemoveMixedIdentifiers);
+    tcase_add_test (tc_image, findAndRemoveNumericIdentifiers);
+    tcase_add_test (tc_image, replaceExistingNode);
+    tcase_add_test (tc_image, replaceOldNode);
+    tcase_add_test (tc_image, iterateOverUA_NodeStoreShallNotVisitEmptyNodes);
+    tcase_add_test (tc_image, iterateOverExpandedNamespaceShallNotVisitEmptyNodes);
+    tcase_add_test (tc_image, findAndRemoveImageNodes);
+    tcase_add_test (tc_image, serverFromImage);
+    suite_add_tcase (s, tc_image);
+
     return s;
 }
 
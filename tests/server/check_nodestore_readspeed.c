@@ -0,0 +1,109 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+/* This benchmark shows how the reads from the default nodestore scale with the
+   number of threads. The readers do not take a lock. A concurrent writer
+   replaces nodes with an edited copy during the reads. */
+
+#ifndef _POSIX_C_SOURCE
+# define _POSIX_C_SOURCE 200112L /* clock_gettime */
+#endif
+
+#include <time.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "ua_types.h"
+#include "ua_plugin_nodestore.h"
+#include "ua_nodestore_default.h"
+
+#define NODES 100000
+#define READS 2000000
+#define MAXTHREADS 8
+
+static UA_Nodestore ns;
+static UA_Boolean running;
+
+static void *
+readNodes(void *data) {
+    size_t *failed = (size_t*)data;
+    UA_UInt32 random = (UA_UInt32)(uintptr_t)data;
+    for(size_t i = 0; i < READS; i++) {
+        random = random * 1103515245 + 12345;
+        UA_NodeId id = UA_NODEID_NUMERIC(1, 1 + ((random >> 8) % NODES));
+        const UA_Node *node = ns.getNode(ns.context, &id);
+        if(!node) {
+            (*failed)++;
+            continue;
+        }
+        ns.releaseNode(ns.context, node);
+    }
+    return NULL;
+}
+
+static void *
+replaceNodes(void *data) {
+    size_t *replaced = (size_t*)data;
+    UA_UInt32 random = 42;
+    while(__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+        random = random * 1103515245 + 12345;
+        UA_NodeId id = UA_NODEID_NUMERIC(1, 1 + ((random >> 8) % NODES));
+        UA_Node *node;
+        if(ns.getNodeCopy(ns.context, &id, &node) != UA_STATUSCODE_GOOD)
+            continue;
+        node->writeMask = random;
+        if(ns.replaceNode(ns.context, node) == UA_STATUSCODE_GOOD)
+            (*replaced)++;
+    }
+    return NULL;
+}
+
+static double
+now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+int main(int argc, char** argv) {
+    UA_StatusCode retval = UA_Nodestore_default_new(&ns);
+    for(UA_UInt32 i = 1; i <= NODES && retval == UA_STATUSCODE_GOOD; i++) {
+        UA_Node *node = ns.newNode(ns.context, UA_NODECLASS_OBJECT);
+        node->nodeId = UA_NODEID_NUMERIC(1, i);
+        retval = ns.insertNode(ns.context, node, NULL);
+    }
+
+    size_t failed[MAXTHREADS];
+    pthread_t threads[MAXTHREADS];
+    for(size_t nThreads = 1; nThreads <= MAXTHREADS && retval == UA_STATUSCODE_GOOD;
+        nThreads *= 2) {
+        size_t replaced = 0;
+        __atomic_store_n(&running, true, __ATOMIC_RELAXED);
+        pthread_t writer;
+        pthread_create(&writer, NULL, replaceNodes, &replaced);
+
+        double begin = now();
+        for(size_t i = 0; i < nThreads; i++) {
+            failed[i] = 0;
+            pthread_create(&threads[i], NULL, readNodes, &failed[i]);
+        }
+        for(size_t i = 0; i < nThreads; i++) {
+            pthread_join(threads[i], NULL);
+            if(failed[i] > 0)
+                retval = UA_STATUSCODE_BADINTERNALERROR;
+        }
+        double duration = now() - begin;
+
+        __atomic_store_n(&running, false, __ATOMIC_RELAXED);
+        pthread_join(writer, NULL);
+
+        printf("%lu threads: duration was %f s for %lu reads (%.2f million reads/s), "
+               "%lu nodes replaced\n", (unsigned long)nThreads, duration,
+               (unsigned long)(nThreads * READS),
+               (double)(nThreads * READS) / duration / 1e6, (unsigned long)replaced);
+    }
+
+    printf("retval is %s\n", UA_StatusCode_name(retval));
+    ns.deleteNodestore(ns.context);
+    return (int)retval;
+}
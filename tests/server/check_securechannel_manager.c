@@ -0,0 +1,291 @@
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ua_server_internal.h"
+#include "ua_transport_generated_handling.h"
+#include "ua_config_default.h"
+#include "testing_clock.h"
+#include "check.h"
+
+#define CHANNELS 6
+
+static UA_Server *server = NULL;
+static UA_ServerConfig *config = NULL;
+static UA_SecureChannelManager *cm = NULL;
+static UA_Connection connections[CHANNELS];
+
+static void setup(void) {
+    config = UA_ServerConfig_new_default();
+    server = UA_Server_new(config);
+    cm = &server->secureChannelManager;
+    /* The channels only attach to the connections */
+    memset(connections, 0, sizeof(connections));
+}
+
+static void teardown(void) {
+    /* Executes the delayed callbacks that free the removed channels */
+    UA_Server_run_shutdown(server);
+    UA_Server_delete(server);
+    UA_ServerConfig_delete(config);
+}
+
+static UA_SecureChannel *
+createChannel(size_t i) {
+    UA_AsymmetricAlgorithmSecurityHeader asymHeader;
+    UA_AsymmetricAlgorithmSecurityHeader_init(&asymHeader);
+    UA_StatusCode retval =
+        UA_SecureChannelManager_create(cm, &connections[i],
+                                       &config->endpoints[0].securityPolicy, &asymHeader);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    return connections[i].channel;
+}
+
+static UA_UInt32
+openChannel(size_t i, UA_UInt32 lifetime) {
+    UA_SecureChannel *channel = createChannel(i);
+    UA_OpenSecureChannelRequest request;
+    UA_OpenSecureChannelRequest_init(&request);
+    request.securityMode = UA_MESSAGESECURITYMODE_NONE;
+    request.requestedLifetime = lifetime;
+    UA_OpenSecureChannelResponse response;
+    UA_OpenSecureChannelResponse_init(&response);
+    UA_StatusCode retval = UA_SecureChannelManager_open(cm, channel, &request, &response);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    UA_OpenSecureChannelResponse_deleteMembers(&response);
+    return channel->securityToken.channelId;
+}
+
+static void
+renewChannel(UA_UInt32 channelId, UA_UInt32 lifetime) {
+    UA_OpenSecureChannelRequest request;
+    UA_OpenSecureChannelRequest_init(&request);
+    request.requestType = UA_SECURITYTOKENREQUESTTYPE_RENEW;
+    request.requestedLifetime = lifetime;
+    UA_OpenSecureChannelResponse response;
+    UA_OpenSecureChannelResponse_init(&response);
+    UA_StatusCode retval =
+        UA_SecureChannelManager_renew(cm, UA_SecureChannelManager_get(cm, channelId),
+                                      &request, &response);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    UA_OpenSecureChannelResponse_deleteMembers(&response);
+}
+
+static void
+cleanup(void) {
+    UA_SecureChannelManager_cleanupTimedOut(cm, UA_DateTime_nowMonotonic());
+}
+
+/* The heap property holds and every channel knows its position */
+static void
+checkHeap(void) {
+    for(size_t i = 0; i < cm->timeoutHeapSize; i++) {
+        ck_assert_uint_eq(cm->timeoutHeap[i]->heapIndex, i);
+        if(i > 0)
+            ck_assert(cm->timeoutHeap[(i - 1) / 2]->timeout <= cm->timeoutHeap[i]->timeout);
+    }
+}
+
+static UA_SecureChannel *
+topOfHeap(void) {
+    ck_assert_uint_gt(cm->timeoutHeapSize, 0);
+    return &cm->timeoutHeap[0]->channel;
+}
+
+START_TEST(SecureChannelManager_getAndCloseAfterReordering) {
+    UA_UInt32 lifetimes[CHANNELS] = {6000, 1000, 5000, 2000, 4000, 3000};
+    UA_UInt32 ids[CHANNELS];
+    for(size_t i = 0; i < CHANNELS; i++)
+        ids[i] = openChannel(i, lifetimes[i]);
+    checkHeap();
+    ck_assert_ptr_eq(topOfHeap(), connections[1].channel);
+
+    /* Reorder the heap */
+    UA_SecureChannel *closed = connections[4].channel;
+    UA_Connection_detachSecureChannel(&connections[4]);
+    UA_SecureChannelManager_connectionClosed(cm, closed);
+    checkHeap();
+    for(size_t i = 0; i < CHANNELS; i++) {
+        UA_SecureChannel *channel = UA_SecureChannelManager_get(cm, ids[i]);
+        ck_assert_ptr_ne(channel, NULL);
+        ck_assert_uint_eq(channel->securityToken.channelId, ids[i]);
+    }
+
+    /* Close from the top and from the middle of the heap */
+    ck_assert_uint_eq(UA_SecureChannelManager_close(cm, ids[4]), UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(UA_SecureChannelManager_close(cm, ids[5]), UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(UA_SecureChannelManager_close(cm, ids[5]), UA_STATUSCODE_BADINTERNALERROR);
+    checkHeap();
+    ck_assert_uint_eq(cm->timeoutHeapSize, CHANNELS - 2);
+    ck_assert_uint_eq(cm->currentChannelCount, CHANNELS - 2);
+    for(size_t i = 0; i < CHANNELS; i++) {
+        UA_SecureChannel *channel = UA_SecureChannelManager_get(cm, ids[i]);
+        if(i == 4 || i == 5) {
+            ck_assert_ptr_eq(channel, NULL);
+            continue;
+        }
+        ck_assert_ptr_eq(channel, connections[i].channel);
+    }
+    ck_assert_ptr_eq(topOfHeap(), connections[1].channel);
+}
+END_TEST
+
+START_TEST(SecureChannelManager_expiryAfterRenew) {
+    UA_UInt32 a = openChannel(0, 3000);
+    UA_UInt32 b = openChannel(1, 2000);
+
+    /* The next token has a shorter lifetime */
+    renewChannel(a, 500);
+    checkHeap();
+    ck_assert_uint_eq(topOfHeap()->securityToken.channelId, a);
+
+    /* The current token is still valid. The next token is revolved. */
+    UA_fakeSleep(600);
+    cleanup();
+    checkHeap();
+    ck_assert_ptr_ne(UA_SecureChannelManager_get(cm, a), NULL);
+    ck_assert_uint_eq(topOfHeap()->securityToken.channelId, a);
+
+    /* The revolved token has timed out */
+    UA_fakeSleep(1);
+    cleanup();
+    ck_assert_ptr_eq(UA_SecureChannelManager_get(cm, a), NULL);
+    ck_assert_ptr_ne(UA_SecureChannelManager_get(cm, b), NULL);
+
+    /* The token is revolved when the client uses it. Then the channel times
+     * out with the lifetime of the new token. */
+    UA_UInt32 c = openChannel(2, 5000);
+    renewChannel(c, 1000);
+    UA_SecureChannel_revolveTokens(UA_SecureChannelManager_get(cm, c));
+    UA_fakeSleep(1001);
+    cleanup();
+    ck_assert_ptr_eq(UA_SecureChannelManager_get(cm, c), NULL);
+    ck_assert_ptr_ne(UA_SecureChannelManager_get(cm, b), NULL);
+
+    /* A longer lifetime of the next token extends the channel */
+    renewChannel(b, 5000);
+    UA_fakeSleep(100);
+    cleanup();
+    UA_fakeSleep(1000);
+    cleanup();
+    ck_assert_ptr_ne(UA_SecureChannelManager_get(cm, b), NULL);
+    checkHeap();
+    UA_fakeSleep(5000);
+    cleanup();
+    ck_assert_ptr_eq(UA_SecureChannelManager_get(cm, b), NULL);
+    ck_assert_uint_eq(cm->timeoutHeapSize, 0);
+}
+END_TEST
+
+START_TEST(SecureChannelManager_closedConnectionToTop) {
+    UA_UInt32 ids[3];
+    for(size_t i = 0; i < 3; i++)
+        ids[i] = openChannel(i, (UA_UInt32)(i + 1) * 1000);
+
+    UA_SecureChannel *closed = connections[2].channel;
+    UA_Connection_detachSecureChannel(&connections[2]);
+    UA_SecureChannelManager_connectionClosed(cm, closed);
+    checkHeap();
+    ck_assert_ptr_eq(topOfHeap(), closed);
+
+    /* Removed without waiting for the timeout */
+    cleanup();
+    checkHeap();
+    ck_assert_ptr_eq(UA_SecureChannelManager_get(cm, ids[2]), NULL);
+    ck_assert_ptr_ne(UA_SecureChannelManager_get(cm, ids[0]), NULL);
+    ck_assert_ptr_ne(UA_SecureChannelManager_get(cm, ids[1]), NULL);
+    ck_assert_uint_eq(cm->currentChannelCount, 2);
+}
+END_TEST
+
+START_TEST(SecureChannelManager_cleanupOnlyTimedOut) {
+    UA_UInt32 ids[4];
+    UA_DateTime timeouts[4];
+    for(size_t i = 0; i < 4; i++) {
+        ids[i] = openChannel(i, (UA_UInt32)(i + 1) * 1000);
+        timeouts[i] = ((channel_list_entry*)connections[i].channel)->timeout;
+    }
+
+    UA_fakeSleep(2500);
+    cleanup();
+    checkHeap();
+    ck_assert_uint_eq(cm->timeoutHeapSize, 2);
+    ck_assert_uint_eq(cm->currentChannelCount, 2);
+    for(size_t i = 0; i < 4; i++) {
+        UA_SecureChannel *channel = UA_SecureChannelManager_get(cm, ids[i]);
+        if(i < 2) {
+            ck_assert_ptr_eq(channel, NULL);
+            continue;
+        }
+        /* The channels that have not timed out are unchanged */
+        ck_assert_ptr_eq(channel, connections[i].channel);
+        ck_assert_ptr_eq(channel->connection, &connections[i]);
+        ck_assert(((channel_list_entry*)channel)->timeout == timeouts[i]);
+    }
+}
+END_TEST
+
+START_TEST(SecureChannelManager_purgeWithoutSession) {
+    server->config.maxSecureChannels = 2;
+    UA_UInt32 a = openChannel(0, 10000);
+    UA_UInt32 b = openChannel(1, 10000);
+    UA_Session session;
+    UA_Session_init(&session);
+    UA_SecureChannelManager_attachSession(cm, connections[0].channel, &session);
+
+    /* The channel without a session is purged */
+    UA_UInt32 c = openChannel(2, 10000);
+    ck_assert_ptr_eq(UA_SecureChannelManager_get(cm, b), NULL);
+    ck_assert_ptr_ne(UA_SecureChannelManager_get(cm, a), NULL);
+    ck_assert_uint_eq(cm->currentChannelCount, 2);
+
+    /* The channel is purged once the session is detached */
+    UA_SecureChannelManager_detachSession(cm, connections[0].channel, &session);
+    UA_SecureChannelManager_attachSession(cm, connections[2].channel, &session);
+    UA_UInt32 d = openChannel(3, 10000);
+    ck_assert_ptr_eq(UA_SecureChannelManager_get(cm, a), NULL);
+    ck_assert_ptr_ne(UA_SecureChannelManager_get(cm, c), NULL);
+
+    /* No channel without a session left */
+    UA_Session session2;
+    UA_Session_init(&session2);
+    UA_SecureChannelManager_attachSession(cm, connections[3].channel, &session2);
+    UA_AsymmetricAlgorithmSecurityHeader asymHeader;
+    UA_AsymmetricAlgorithmSecurityHeader_init(&asymHeader);
+    UA_StatusCode retval =
+        UA_SecureChannelManager_create(cm, &connections[4],
+                                       &config->endpoints[0].securityPolicy, &asymHeader);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_BADOUTOFMEMORY);
+    ck_assert_ptr_ne(UA_SecureChannelManager_get(cm, c), NULL);
+    ck_assert_ptr_ne(UA_SecureChannelManager_get(cm, d), NULL);
+
+    UA_SecureChannelManager_detachSession(cm, connections[2].channel, &session);
+    UA_SecureChannelManager_detachSession(cm, connections[3].channel, &session2);
+}
+END_TEST
+
+static Suite* testSuite_SecureChannelManager(void) {
+    Suite *s = suite_create("SecureChannelManager");
+    TCase *tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, SecureChannelManager_getAndCloseAfterReordering);
+    tcase_add_test(tc_core, SecureChannelManager_expiryAfterRenew);
+    tcase_add_test(tc_core, SecureChannelManager_closedConnectionToTop);
+    tcase_add_test(tc_core, SecureChannelManager_cleanupOnlyTimedOut);
+    tcase_add_test(tc_core, SecureChannelManager_purgeWithoutSession);
+    suite_add_tcase(s, tc_core);
+    return s;
+}
+
+int main(void) {
+    Suite *s = testSuite_SecureChannelManager();
+    SRunner *sr = srunner_create(s);
+    srunner_set_fork_status(sr, CK_NOFORK);
+    srunner_run_all(sr, CK_NORMAL);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,121 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+/* This benchmark compares loading a large address space node by node with
+   UA_Server_addNodesBulk. The number of variables can be given as the first
+   argument (e.g. 1000000). The variables are distributed over 100 folders. */
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ua_server.h"
+#include "ua_config_default.h"
+
+#define FOLDERS 100
+#define FOLDERIDS 10000000
+
+static UA_StatusCode
+addSingle(UA_Server *server, UA_UInt32 variables,
+          UA_ObjectAttributes *oattr, UA_VariableAttributes *vattr) {
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    for(UA_UInt32 i = 1; i <= FOLDERS && retval == UA_STATUSCODE_GOOD; i++)
+        retval = UA_Server_addObjectNode(server, UA_NODEID_NUMERIC(1, FOLDERIDS + i),
+                                         UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                         UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                         UA_QUALIFIEDNAME(1, "Folder"),
+                                         UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                                         *oattr, NULL, NULL);
+    for(UA_UInt32 i = 1; i <= variables && retval == UA_STATUSCODE_GOOD; i++)
+        retval = UA_Server_addVariableNode(server, UA_NODEID_NUMERIC(1, i),
+                                           UA_NODEID_NUMERIC(1, FOLDERIDS + 1 + i % FOLDERS),
+                                           UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                                           UA_QUALIFIEDNAME(1, "Variable"),
+                                           UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                           *vattr, NULL, NULL);
+    return retval;
+}
+
+static UA_StatusCode
+addBulk(UA_Server *server, UA_UInt32 variables,
+        UA_ObjectAttributes *oattr, UA_VariableAttributes *vattr) {
+    size_t itemsSize = (size_t)variables + FOLDERS;
+    UA_AddNodesItem *items = (UA_AddNodesItem*)
+        UA_calloc(itemsSize, sizeof(UA_AddNodesItem));
+    if(!items)
+        return UA_STATUSCODE_BADOUTOFMEMORY;
+
+    /* The folders come after the variables */
+    for(size_t i = 0; i < itemsSize; i++) {
+        UA_AddNodesItem *item = &items[i];
+        item->nodeAttributes.encoding = UA_EXTENSIONOBJECT_DECODED_NODELETE;
+        if(i < variables) {
+            UA_UInt32 id = (UA_UInt32)i + 1;
+            item->nodeClass = UA_NODECLASS_VARIABLE;
+            item->requestedNewNodeId.nodeId = UA_NODEID_NUMERIC(1, id);
+            item->parentNodeId.nodeId = UA_NODEID_NUMERIC(1, FOLDERIDS + 1 + id % FOLDERS);
+            item->referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT);
+            item->browseName = UA_QUALIFIEDNAME(1, "Variable");
+            item->typeDefinition.nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE);
+            item->nodeAttributes.content.decoded.type = &UA_TYPES[UA_TYPES_VARIABLEATTRIBUTES];
+            item->nodeAttributes.content.decoded.data = vattr;
+        } else {
+            UA_UInt32 id = FOLDERIDS + 1 + (UA_UInt32)(i - variables);
+            item->nodeClass = UA_NODECLASS_OBJECT;
+            item->requestedNewNodeId.nodeId = UA_NODEID_NUMERIC(1, id);
+            item->parentNodeId.nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+            item->referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES);
+            item->browseName = UA_QUALIFIEDNAME(1, "Folder");
+            item->typeDefinition.nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE);
+            item->nodeAttributes.content.decoded.type = &UA_TYPES[UA_TYPES_OBJECTATTRIBUTES];
+            item->nodeAttributes.content.decoded.data = oattr;
+        }
+    }
+
+    UA_StatusCode retval = UA_Server_addNodesBulk(server, itemsSize, items,
+                                                  NULL, NULL, NULL);
+    UA_free(items);
+    return retval;
+}
+
+int main(int argc, char** argv) {
+#ifdef UA_ENABLE_MULTITHREADING
+    /* Adding node by node copies the growing reference arrays of the shared
+     * parents and types for every node. Keep the default run short. */
+    UA_UInt32 variables = 10000;
+#else
+    UA_UInt32 variables = 100000;
+#endif
+    if(argc > 1)
+        variables = (UA_UInt32)strtoul(argv[1], NULL, 10);
+
+    UA_ObjectAttributes oattr = UA_ObjectAttributes_default;
+    UA_VariableAttributes vattr = UA_VariableAttributes_default;
+    UA_Int32 value = 42;
+    UA_Variant_setScalar(&vattr.value, &value, &UA_TYPES[UA_TYPES_INT32]);
+    vattr.dataType = UA_TYPES[UA_TYPES_INT32].typeId;
+
+    UA_StatusCode retval = UA_STATUSCODE_GOOD;
+    for(size_t bulk = 0; bulk < 2 && retval == UA_STATUSCODE_GOOD; bulk++) {
+        UA_ServerConfig *config = UA_ServerConfig_new_default();
+        UA_Server *server = UA_Server_new(config);
+
+        clock_t begin = clock();
+        if(bulk)
+            retval = addBulk(server, variables, &oattr, &vattr);
+        else
+            retval = addSingle(server, variables, &oattr, &vattr);
+        double duration = (double)(clock() - begin) / CLOCKS_PER_SEC;
+
+        printf("%s: duration was %f s for %lu nodes (%.0f nodes/s)\n",
+               bulk ? "bulk" : "single", duration,
+               (unsigned long)variables + FOLDERS,
+               (double)(variables + FOLDERS) / duration);
+
+        UA_Server_delete(server);
+        UA_ServerConfig_delete(config);
+    }
+
+    printf("retval is %s\n", UA_StatusCode_name(retval));
+    return (int)retval;
+}
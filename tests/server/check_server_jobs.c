@@ -2,8 +2,11 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <time.h>
+
 #include "ua_server.h"
 #include "server/ua_server_internal.h"
+#include "server/ua_services.h"
 #include "ua_config_default.h"
 
 #include "check.h"
@@ -18,6 +21,24 @@ static void setup(void) {
     UA_Server_run_startup(server);
 }
 
+static void setupThreads(void) {
+    config = UA_ServerConfig_new_default();
+    config->nThreads = 4;
+    server = UA_Server_new(config);
+    UA_Server_run_startup(server);
+}
+
+#define PARALLELBATCHSIZE 10
+#define PARALLELOPS 5000
+
+static void setupParallel(void) {
+    config = UA_ServerConfig_new_default();
+    config->nThreads = 4;
+    config->parallelOperationsBatchSize = PARALLELBATCHSIZE;
+    server = UA_Server_new(config);
+    UA_Server_run_startup(server);
+}
+
 static void teardown(void) {
     UA_Server_run_shutdown(server);
     UA_Server_delete(server);
@@ -69,6 +90,414 @@ START_TEST(Server_repeatedCallbackRemoveItself) {
 }
 END_TEST
 
+#define SPAWNS 1000
+#define CHILDREN 10
+
+static volatile UA_UInt32 counter;
+static volatile UA_Boolean delayedExecuted;
+static UA_UInt32 counterAtDelayed;
+
+static void
+countCallback(UA_Server *serverPtr, void *data) {
+    UA_atomic_add(&counter, 1);
+}
+
+/* Callbacks dispatched from a worker stay in its queue unless stolen */
+static void
+spawnCallback(UA_Server *serverPtr, void *data) {
+    for(size_t i = 0; i < CHILDREN; i++)
+        UA_Server_workerCallback(serverPtr, countCallback, NULL);
+    UA_atomic_add(&counter, 1);
+}
+
+static void
+delayedCallback(UA_Server *serverPtr, void *data) {
+    counterAtDelayed = counter;
+    delayedExecuted = true;
+}
+
+START_TEST(Server_dispatchedCallbacksFinishBeforeDelayed) {
+    counter = 0;
+    delayedExecuted = false;
+    for(size_t i = 0; i < SPAWNS; i++)
+        UA_Server_workerCallback(server, spawnCallback, NULL);
+    UA_Server_delayedCallback(server, delayedCallback, NULL);
+
+    /* Wait until all callbacks were executed */
+    for(size_t i = 0; i < 1000; i++) {
+        UA_Server_run_iterate(server, false);
+        if(delayedExecuted && counter == SPAWNS * (CHILDREN + 1))
+            break;
+        UA_realSleep(10);
+    }
+
+    /* The delayed callback waited for the callbacks dispatched before */
+    ck_assert(delayedExecuted);
+    ck_assert_uint_ge(counterAtDelayed, SPAWNS);
+    ck_assert_uint_eq(counter, SPAWNS * (CHILDREN + 1));
+}
+END_TEST
+
+#ifdef UA_ENABLE_MULTITHREADING
+static void
+sleepCallback(UA_Server *serverPtr, void *data) {
+    UA_realSleep(200);
+    UA_atomic_add(&counter, 1);
+}
+
+/* The delayed callback waits for the running callback to finish. The idle
+ * workers don't spin on the delayed callback in the meantime. */
+START_TEST(Server_delayedCallbackNoBusyWait) {
+    counter = 0;
+    delayedExecuted = false;
+    UA_Server_workerCallback(server, sleepCallback, NULL);
+    UA_realSleep(20); /* Wait until the callback has started */
+    UA_Server_delayedCallback(server, delayedCallback, NULL);
+
+    clock_t start = clock();
+    for(size_t i = 0; i < 100 && !delayedExecuted; i++)
+        UA_realSleep(10);
+    clock_t used = clock() - start;
+
+    ck_assert(delayedExecuted);
+    ck_assert_uint_eq(counterAtDelayed, 1);
+    ck_assert_uint_lt((size_t)used, (size_t)(CLOCKS_PER_SEC / 10));
+}
+END_TEST
+#endif
+
+#ifdef UA_ENABLE_MULTITHREADING
+static volatile UA_Boolean pinnedExecuted;
+static volatile UA_Boolean pinnedBeforeDelayed;
+
+static void
+pinnedCallback(UA_Server *serverPtr, void *data) {
+    pinnedExecuted = true;
+}
+
+static void
+delayedAfterPinnedCallback(UA_Server *serverPtr, void *data) {
+    pinnedBeforeDelayed = pinnedExecuted;
+}
+
+/* The delayed callback is in the queue of the first worker. The pinned
+ * callback that was dispatched before is in the queue of the second worker.
+ * Both are still queued when the server stops. */
+START_TEST(Server_delayedCallbackWaitsOnShutdown) {
+    setupThreads();
+    pinnedExecuted = false;
+    pinnedBeforeDelayed = false;
+
+    /* Keep all workers busy */
+    for(UA_UInt32 i = 0; i < config->nThreads; i++)
+        UA_Server_workerCallbackAffine(server, i, sleepCallback, NULL);
+    UA_realSleep(20);
+
+    UA_Server_workerCallbackAffine(server, 1, pinnedCallback, NULL);
+    server->nextWorker = (UA_UInt32)(config->nThreads - 1); /* Dispatch to worker 0 */
+    UA_Server_delayedCallback(server, delayedAfterPinnedCallback, NULL);
+
+    UA_Server_run_shutdown(server);
+    ck_assert(pinnedExecuted);
+    ck_assert(pinnedBeforeDelayed);
+    UA_Server_delete(server);
+    UA_ServerConfig_delete(config);
+}
+END_TEST
+#endif
+
+START_TEST(Server_dispatchedCallbacksRunOnShutdown) {
+    setupThreads();
+    counter = 0;
+    delayedExecuted = false;
+    for(size_t i = 0; i < SPAWNS; i++)
+        UA_Server_workerCallback(server, spawnCallback, NULL);
+    UA_Server_delayedCallback(server, delayedCallback, NULL);
+
+    /* The remaining callbacks are executed when the server stops */
+    UA_Server_run_shutdown(server);
+    ck_assert(delayedExecuted);
+    ck_assert_uint_eq(counter, SPAWNS * (CHILDREN + 1));
+    UA_Server_delete(server);
+    UA_ServerConfig_delete(config);
+}
+END_TEST
+
+#define AFFINITIES 7
+#define AFFINECALLBACKS 10000
+
+typedef struct {
+    UA_UInt32 affinity;
+    UA_UInt32 sequence;
+} AffineEntry;
+
+static UA_UInt32 nextSequence[AFFINITIES];
+static volatile UA_Boolean outOfOrder;
+
+static void
+affineCallback(UA_Server *serverPtr, void *data) {
+    AffineEntry *e = (AffineEntry*)data;
+    if(nextSequence[e->affinity] != e->sequence)
+        outOfOrder = true;
+    nextSequence[e->affinity] = e->sequence + 1;
+    UA_atomic_add(&counter, 1);
+}
+
+START_TEST(Server_affineCallbacksExecuteInOrder) {
+    counter = 0;
+    outOfOrder = false;
+    memset(nextSequence, 0, sizeof(nextSequence));
+    AffineEntry *entries = (AffineEntry*)
+        UA_malloc(sizeof(AffineEntry) * AFFINECALLBACKS);
+    ck_assert_ptr_ne(entries, NULL);
+    for(UA_UInt32 i = 0; i < AFFINECALLBACKS; i++) {
+        entries[i].affinity = i % AFFINITIES;
+        entries[i].sequence = i / AFFINITIES;
+        UA_Server_workerCallbackAffine(server, entries[i].affinity,
+                                       affineCallback, &entries[i]);
+    }
+
+    /* Wait until all callbacks were executed */
+    for(size_t i = 0; i < 1000 && UA_atomic_load(&counter) < AFFINECALLBACKS; i++)
+        UA_realSleep(10);
+
+    /* The callbacks of an affinity were not executed concurrently */
+    ck_assert_uint_eq(UA_atomic_load(&counter), AFFINECALLBACKS);
+    ck_assert(!outOfOrder);
+    UA_free(entries);
+}
+END_TEST
+
+/* The operations are executed by the thread processing the request and by
+ * helpers on the worker threads. The first operation in the request thread
+ * waits until a helper has executed an operation. So the test fails if the
+ * operations are not processed in parallel. */
+static volatile UA_UInt32 helpersExecuted;
+static volatile UA_UInt32 operationsExecuted;
+#ifdef UA_ENABLE_MULTITHREADING
+static pthread_t requestThread;
+#endif
+
+static void
+parallelOperation(void) {
+    UA_atomic_add(&operationsExecuted, 1);
+#ifdef UA_ENABLE_MULTITHREADING
+    if(!pthread_equal(pthread_self(), requestThread)) {
+        UA_atomic_add(&helpersExecuted, 1);
+        return;
+    }
+    for(size_t i = 0; i < 1000 && UA_atomic_add(&helpersExecuted, 0) == 0; i++)
+        UA_realSleep(1);
+#endif
+}
+
+static void
+resetParallelOperations(void) {
+    helpersExecuted = 0;
+    operationsExecuted = 0;
+#ifdef UA_ENABLE_MULTITHREADING
+    requestThread = pthread_self();
+#endif
+}
+
+static void
+checkParallelOperations(void) {
+    ck_assert_uint_ge(operationsExecuted, PARALLELOPS);
+#ifdef UA_ENABLE_MULTITHREADING
+    ck_assert_uint_gt(helpersExecuted, 0);
+#endif
+}
+
+static UA_StatusCode
+readParallel(UA_Server *serverPtr, const UA_NodeId *sessionId, void *sessionContext,
+             const UA_NodeId *nodeId, void *nodeContext, UA_Boolean sourceTimeStamp,
+             const UA_NumericRange *range, UA_DataValue *value) {
+    parallelOperation();
+    UA_UInt32 v = *(UA_UInt32*)nodeContext;
+    value->hasValue = true;
+    return UA_Variant_setScalarCopy(&value->value, &v, &UA_TYPES[UA_TYPES_UINT32]);
+}
+
+/* Writes are not processed in parallel. Record the written values to check
+ * the order. */
+static UA_UInt32 *writtenValues;
+static size_t writtenValuesSize;
+
+static UA_StatusCode
+writeParallel(UA_Server *serverPtr, const UA_NodeId *sessionId, void *sessionContext,
+              const UA_NodeId *nodeId, void *nodeContext, const UA_NumericRange *range,
+              const UA_DataValue *value) {
+#ifdef UA_ENABLE_MULTITHREADING
+    if(!pthread_equal(pthread_self(), requestThread))
+        UA_atomic_add(&helpersExecuted, 1);
+#endif
+    if(writtenValuesSize < PARALLELOPS)
+        writtenValues[writtenValuesSize] = *(UA_UInt32*)value->value.data;
+    writtenValuesSize++;
+    return UA_STATUSCODE_GOOD;
+}
+
+static UA_UInt32 parallelValue = 42;
+
+static void
+addParallelVariable(void) {
+    UA_DataSource dataSource;
+    dataSource.read = readParallel;
+    dataSource.write = writeParallel;
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
+    attr.dataType = UA_TYPES[UA_TYPES_UINT32].typeId;
+    UA_StatusCode retval =
+        UA_Server_addDataSourceVariableNode(server, UA_NODEID_STRING(1, "parallel"),
+                                            UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                            UA_QUALIFIEDNAME(1, "parallel"),
+                                            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                            attr, dataSource, &parallelValue, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+}
+
+START_TEST(Server_parallelRead) {
+    addParallelVariable();
+    UA_ReadValueId *rvis = (UA_ReadValueId*)
+        UA_Array_new(PARALLELOPS, &UA_TYPES[UA_TYPES_READVALUEID]);
+    for(size_t i = 0; i < PARALLELOPS; i++) {
+        rvis[i].nodeId = UA_NODEID_STRING_ALLOC(1, "parallel");
+        rvis[i].attributeId = UA_ATTRIBUTEID_VALUE;
+    }
+    UA_ReadRequest request;
+    UA_ReadRequest_init(&request);
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_SERVER;
+    request.nodesToRead = rvis;
+    request.nodesToReadSize = PARALLELOPS;
+
+    resetParallelOperations();
+    UA_ReadResponse response;
+    UA_ReadResponse_init(&response);
+    Service_Read(server, &adminSession, &request, &response);
+    checkParallelOperations();
+    ck_assert_uint_eq(operationsExecuted, PARALLELOPS);
+
+    /* The TimestampsToReturn of the request is used in all threads */
+    ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.resultsSize, PARALLELOPS);
+    for(size_t i = 0; i < PARALLELOPS; i++) {
+        UA_DataValue *dv = &response.results[i];
+        ck_assert(!dv->hasStatus);
+        ck_assert(dv->hasServerTimestamp);
+        ck_assert(!dv->hasSourceTimestamp);
+        ck_assert_uint_eq(*(UA_UInt32*)dv->value.data, parallelValue);
+    }
+    UA_ReadRequest_deleteMembers(&request);
+    UA_ReadResponse_deleteMembers(&response);
+}
+END_TEST
+
+/* Large writes are processed in the request thread. Every write is applied
+ * exactly once and in the order of the request. */
+START_TEST(Server_sequentialWrite) {
+    addParallelVariable();
+    UA_WriteValue *wvs = (UA_WriteValue*)
+        UA_Array_new(PARALLELOPS, &UA_TYPES[UA_TYPES_WRITEVALUE]);
+    for(UA_UInt32 i = 0; i < PARALLELOPS; i++) {
+        wvs[i].nodeId = UA_NODEID_STRING_ALLOC(1, "parallel");
+        wvs[i].attributeId = UA_ATTRIBUTEID_VALUE;
+        wvs[i].value.hasValue = true;
+        UA_Variant_setScalarCopy(&wvs[i].value.value, &i, &UA_TYPES[UA_TYPES_UINT32]);
+    }
+    UA_WriteRequest request;
+    UA_WriteRequest_init(&request);
+    request.nodesToWrite = wvs;
+    request.nodesToWriteSize = PARALLELOPS;
+
+    resetParallelOperations();
+    writtenValues = (UA_UInt32*)UA_malloc(PARALLELOPS * sizeof(UA_UInt32));
+    writtenValuesSize = 0;
+    UA_WriteResponse response;
+    UA_WriteResponse_init(&response);
+    Service_Write(server, &adminSession, &request, &response);
+    ck_assert_uint_eq(helpersExecuted, 0);
+    ck_assert_uint_eq(writtenValuesSize, PARALLELOPS);
+    for(UA_UInt32 i = 0; i < PARALLELOPS; i++)
+        ck_assert_uint_eq(writtenValues[i], i);
+
+    ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.resultsSize, PARALLELOPS);
+    for(size_t i = 0; i < PARALLELOPS; i++)
+        ck_assert_uint_eq(response.results[i], UA_STATUSCODE_GOOD);
+    UA_free(writtenValues);
+    UA_WriteRequest_deleteMembers(&request);
+    UA_WriteResponse_deleteMembers(&response);
+}
+END_TEST
+
+#ifdef UA_ENABLE_METHODCALLS
+static UA_StatusCode
+doubleMethod(UA_Server *serverPtr, const UA_NodeId *sessionId, void *sessionContext,
+             const UA_NodeId *methodId, void *methodContext,
+             const UA_NodeId *objectId, void *objectContext,
+             size_t inputSize, const UA_Variant *input,
+             size_t outputSize, UA_Variant *output) {
+    parallelOperation();
+    UA_UInt32 v = *(UA_UInt32*)input->data * 2;
+    return UA_Variant_setScalarCopy(output, &v, &UA_TYPES[UA_TYPES_UINT32]);
+}
+
+START_TEST(Server_parallelCall) {
+    UA_Argument inputArgument;
+    UA_Argument_init(&inputArgument);
+    inputArgument.dataType = UA_TYPES[UA_TYPES_UINT32].typeId;
+    inputArgument.valueRank = -1;
+    UA_Argument outputArgument;
+    UA_Argument_init(&outputArgument);
+    outputArgument.dataType = UA_TYPES[UA_TYPES_UINT32].typeId;
+    outputArgument.valueRank = -1;
+    UA_MethodAttributes attr = UA_MethodAttributes_default;
+    attr.executable = true;
+    attr.userExecutable = true;
+    UA_StatusCode retval =
+        UA_Server_addMethodNode(server, UA_NODEID_STRING(1, "double"),
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                                UA_QUALIFIEDNAME(1, "double"), attr, doubleMethod,
+                                1, &inputArgument, 1, &outputArgument, NULL, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    UA_CallMethodRequest *cmrs = (UA_CallMethodRequest*)
+        UA_Array_new(PARALLELOPS, &UA_TYPES[UA_TYPES_CALLMETHODREQUEST]);
+    for(UA_UInt32 i = 0; i < PARALLELOPS; i++) {
+        cmrs[i].objectId = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+        cmrs[i].methodId = UA_NODEID_STRING_ALLOC(1, "double");
+        cmrs[i].inputArguments = UA_Variant_new();
+        cmrs[i].inputArgumentsSize = 1;
+        UA_Variant_setScalarCopy(cmrs[i].inputArguments, &i, &UA_TYPES[UA_TYPES_UINT32]);
+    }
+    UA_CallRequest request;
+    UA_CallRequest_init(&request);
+    request.methodsToCall = cmrs;
+    request.methodsToCallSize = PARALLELOPS;
+
+    resetParallelOperations();
+    UA_CallResponse response;
+    UA_CallResponse_init(&response);
+    Service_Call(server, &adminSession, &request, &response);
+    checkParallelOperations();
+    ck_assert_uint_eq(operationsExecuted, PARALLELOPS);
+
+    ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.resultsSize, PARALLELOPS);
+    for(UA_UInt32 i = 0; i < PARALLELOPS; i++) {
+        UA_CallMethodResult *cmr = &response.results[i];
+        ck_assert_uint_eq(cmr->statusCode, UA_STATUSCODE_GOOD);
+        ck_assert_uint_eq(cmr->outputArgumentsSize, 1);
+        ck_assert_uint_eq(*(UA_UInt32*)cmr->outputArguments[0].data, i * 2);
+    }
+    UA_CallRequest_deleteMembers(&request);
+    UA_CallResponse_deleteMembers(&response);
+}
+END_TEST
+#endif
+
 static Suite* testSuite_Client(void) {
     Suite *s = suite_create("Server Callbacks");
     TCase *tc_server = tcase_create("Server Repeated Callbacks");
@@ -76,6 +505,31 @@ static Suite* testSuite_Client(void) {
     tcase_add_test(tc_server, Server_addRemoveRepeatedCallback);
     tcase_add_test(tc_server, Server_repeatedCallbackRemoveItself);
     suite_add_tcase(s, tc_server);
+
+    TCase *tc_dispatch = tcase_create("Server Dispatched Callbacks");
+    tcase_add_checked_fixture(tc_dispatch, setupThreads, teardown);
+    tcase_add_test(tc_dispatch, Server_dispatchedCallbacksFinishBeforeDelayed);
+    tcase_add_test(tc_dispatch, Server_affineCallbacksExecuteInOrder);
+#ifdef UA_ENABLE_MULTITHREADING
+    tcase_add_test(tc_dispatch, Server_delayedCallbackNoBusyWait);
+#endif
+    suite_add_tcase(s, tc_dispatch);
+
+    TCase *tc_parallel = tcase_create("Server Parallel Operations");
+    tcase_add_checked_fixture(tc_parallel, setupParallel, teardown);
+    tcase_add_test(tc_parallel, Server_parallelRead);
+    tcase_add_test(tc_parallel, Server_sequentialWrite);
+#ifdef UA_ENABLE_METHODCALLS
+    tcase_add_test(tc_parallel, Server_parallelCall);
+#endif
+    suite_add_tcase(s, tc_parallel);
+
+    TCase *tc_shutdown = tcase_create("Server Shutdown");
+    tcase_add_test(tc_shutdown, Server_dispatchedCallbacksRunOnShutdown);
+#ifdef UA_ENABLE_MULTITHREADING
+    tcase_add_test(tc_shutdown, Server_delayedCallbackWaitsOnShutdown);
+#endif
+    suite_add_tcase(s, tc_shutdown);
     return s;
 }
 
@@ -12,6 +12,7 @@
 #include "ua_types.h"
 #include "ua_config_default.h"
 #include "server/ua_server_internal.h"
+#include "testing_clock.h"
 
 #ifdef __clang__
 //required for ck_assert_ptr_eq and const casting
@@ -21,6 +22,7 @@
 
 static UA_Server *server = NULL;
 static UA_ServerConfig *config = NULL;
+static size_t temperatureReads;
 
 static UA_StatusCode
 readCPUTemperature(UA_Server *server_,
@@ -28,6 +30,7 @@ readCPUTemperature(UA_Server *server_,
                    const UA_NodeId *nodeId, void *nodeContext,
                    UA_Boolean sourceTimeStamp, const UA_NumericRange *range,
                    UA_DataValue *dataValue) {
+    temperatureReads++;
     UA_Float temp = 20.5f;
     UA_Variant_setScalarCopy(&dataValue->value, &temp, &UA_TYPES[UA_TYPES_FLOAT]);
     dataValue->hasValue = true;
@@ -576,6 +579,251 @@ START_TEST (ReadSingleDataSourceAttributeArrayDimensionsWithoutTimestamp) {
     UA_DataValue_deleteMembers(&resp);
 } END_TEST
 
+static size_t batchReadCalls;
+static size_t batchReadItems;
+
+static UA_StatusCode
+readTemperatureBatch(UA_Server *server_, const UA_NodeId *sessionId,
+                     void *sessionContext, void *batchContext,
+                     UA_Boolean sourceTimeStamp, size_t itemsSize,
+                     const UA_DataSourceReadItem *items) {
+    batchReadCalls++;
+    batchReadItems += itemsSize;
+    UA_Double temp = 21.5;
+    for(size_t i = 0; i < itemsSize; i++) {
+        UA_Variant_setScalarCopy(&items[i].value->value, &temp, &UA_TYPES[UA_TYPES_DOUBLE]);
+        items[i].value->hasValue = true;
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+START_TEST(ReadDataSourceBatch) {
+    UA_DataSourceBatch batch;
+    batch.read = readTemperatureBatch;
+    batch.context = NULL;
+    UA_StatusCode retval =
+        UA_Server_setVariableNode_dataSourceBatch(server, UA_NODEID_STRING(1, "cpu.temperature"),
+                                                  &batch);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+
+    size_t readSize = 10;
+    UA_ReadValueId *rvis = (UA_ReadValueId*)
+        UA_Array_new(readSize, &UA_TYPES[UA_TYPES_READVALUEID]);
+    for(size_t i = 0; i < readSize; i++) {
+        if(i % 2 == 0)
+            rvis[i].nodeId = UA_NODEID_STRING_ALLOC(1, "the.answer");
+        else
+            rvis[i].nodeId = UA_NODEID_STRING_ALLOC(1, "cpu.temperature");
+        rvis[i].attributeId = UA_ATTRIBUTEID_VALUE;
+    }
+
+    UA_ReadRequest request;
+    UA_ReadRequest_init(&request);
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_NEITHER;
+    request.nodesToRead = rvis;
+    request.nodesToReadSize = readSize;
+
+    /* The values of the batch are read with one call */
+    batchReadCalls = 0;
+    batchReadItems = 0;
+    UA_ReadResponse response;
+    UA_ReadResponse_init(&response);
+    Service_Read(server, &adminSession, &request, &response);
+    ck_assert_int_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.resultsSize, readSize);
+    ck_assert_uint_eq(batchReadCalls, 1);
+    ck_assert_uint_eq(batchReadItems, readSize / 2);
+    for(size_t i = 0; i < readSize; i++) {
+        UA_DataValue *dv = &response.results[i];
+        ck_assert_int_eq(dv->hasStatus, false);
+        if(i % 2 == 0)
+            ck_assert_ptr_eq(dv->value.type, &UA_TYPES[UA_TYPES_INT32]);
+        else
+            ck_assert_ptr_eq(dv->value.type, &UA_TYPES[UA_TYPES_DOUBLE]);
+    }
+    UA_ReadRequest_deleteMembers(&request);
+    UA_ReadResponse_deleteMembers(&response);
+
+    /* Single reads use the read callback of the DataSource */
+    UA_Variant value;
+    retval = UA_Server_readValue(server, UA_NODEID_STRING(1, "cpu.temperature"), &value);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_ptr_eq(value.type, &UA_TYPES[UA_TYPES_FLOAT]);
+    ck_assert_uint_eq(batchReadCalls, 1);
+    UA_Variant_deleteMembers(&value);
+
+    /* Nothing is read ahead for requests without a batched variable */
+    UA_ReadValueId rvi;
+    UA_ReadValueId_init(&rvi);
+    rvi.nodeId = UA_NODEID_STRING(1, "the.answer");
+    rvi.attributeId = UA_ATTRIBUTEID_VALUE;
+    ck_assert_ptr_eq(UA_Server_readAhead(server, &adminSession, 1, &rvi,
+                                         UA_TIMESTAMPSTORETURN_NEITHER, 0.0), NULL);
+
+    /* Without batched variables, nothing is read ahead */
+    ck_assert_ptr_ne(server->batchedNodes, NULL);
+    retval = UA_Server_setVariableNode_dataSourceBatch(server, UA_NODEID_STRING(1, "cpu.temperature"),
+                                                       NULL);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_ptr_eq(server->batchedNodes, NULL);
+    rvi.nodeId = UA_NODEID_STRING(1, "cpu.temperature");
+    ck_assert_ptr_eq(UA_Server_readAhead(server, &adminSession, 1, &rvi,
+                                         UA_TIMESTAMPSTORETURN_NEITHER, 0.0), NULL);
+} END_TEST
+
+static size_t
+readTemperatureWithMaxAge(UA_Session *session, UA_Double maxAge) {
+    UA_ReadValueId rvi;
+    UA_ReadValueId_init(&rvi);
+    rvi.nodeId = UA_NODEID_STRING(1, "cpu.temperature");
+    rvi.attributeId = UA_ATTRIBUTEID_VALUE;
+    UA_ReadRequest request;
+    UA_ReadRequest_init(&request);
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_NEITHER;
+    request.maxAge = maxAge;
+    request.nodesToRead = &rvi;
+    request.nodesToReadSize = 1;
+
+    temperatureReads = 0;
+    UA_ReadResponse response;
+    UA_ReadResponse_init(&response);
+    Service_Read(server, session, &request, &response);
+    ck_assert_int_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.resultsSize, 1);
+    ck_assert_int_eq(response.results[0].hasStatus, false);
+    ck_assert_int_eq(response.results[0].hasSourceTimestamp, false);
+    ck_assert_ptr_eq(response.results[0].value.type, &UA_TYPES[UA_TYPES_FLOAT]);
+    UA_ReadResponse_deleteMembers(&response);
+    return temperatureReads;
+}
+
+START_TEST(ReadDataSourceMaxAge) {
+    /* Without a maxAge, the DataSource is always read */
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&adminSession, 0.0), 1);
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&adminSession, 0.0), 1);
+
+    /* The value is cached for reads with a maxAge */
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&adminSession, 100.0), 1);
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&adminSession, 100.0), 0);
+    UA_fakeSleep(50);
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&adminSession, 100.0), 0);
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&adminSession, 10.0), 1);
+
+    /* The cached value is shared by the sessions */
+    UA_Session otherSession = adminSession;
+    otherSession.sessionId = UA_NODEID_NUMERIC(0, 42);
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&otherSession, 100.0), 0);
+
+    /* The value is too old */
+    UA_fakeSleep(150);
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&adminSession, 100.0), 1);
+
+    /* The maxAge bounds the age of the value. Also if the
+     * minimumSamplingInterval is larger. */
+    UA_StatusCode retval =
+        UA_Server_writeMinimumSamplingInterval(server, UA_NODEID_STRING(1, "cpu.temperature"),
+                                               1000.0);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&adminSession, 10.0), 0);
+    UA_fakeSleep(20);
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&adminSession, 10.0), 1);
+
+    /* But a maxAge of zero always reads the DataSource */
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&adminSession, 0.0), 1);
+} END_TEST
+
+START_TEST(ReadDataSourceMaxAgePerSession) {
+    UA_DataSourceCache_deleteMembers(&server->dataSourceCache);
+    UA_DataSourceCache_init(&server->dataSourceCache, 16, true);
+
+    /* The cached value is only served to the session that has read it */
+    UA_Session otherSession = adminSession;
+    otherSession.sessionId = UA_NODEID_NUMERIC(0, 42);
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&adminSession, 100.0), 1);
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&otherSession, 100.0), 1);
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&otherSession, 100.0), 0);
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&adminSession, 100.0), 0);
+
+    /* A change removes the values of all sessions */
+    UA_NodeId nodeId = UA_NODEID_STRING(1, "cpu.temperature");
+    UA_DataSourceCache_remove(&server->dataSourceCache, &nodeId);
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&adminSession, 100.0), 1);
+    ck_assert_uint_eq(readTemperatureWithMaxAge(&otherSession, 100.0), 1);
+} END_TEST
+
+START_TEST(DataSourceCacheStalePut) {
+    UA_DataSourceCache *cache = &server->dataSourceCache;
+    UA_NodeId nodeId = UA_NODEID_STRING(1, "cpu.temperature");
+    UA_DataValue value;
+    UA_DataValue_init(&value);
+    UA_Double temp = 21.5;
+    UA_Variant_setScalar(&value.value, &temp, &UA_TYPES[UA_TYPES_DOUBLE]);
+    value.hasValue = true;
+
+    /* A read that started before the change does not put its value */
+    UA_UInt32 generation = UA_DataSourceCache_generation(cache, &nodeId);
+    UA_DataSourceCache_remove(cache, &nodeId);
+    UA_DateTime now = UA_DateTime_nowMonotonic();
+    UA_DataSourceCache_put(cache, &nodeId, &adminSession.sessionId, generation, now, &value);
+    UA_DataValue cached;
+    UA_DataValue_init(&cached);
+    ck_assert(!UA_DataSourceCache_get(cache, &nodeId, &adminSession.sessionId, now, &cached));
+
+    /* A read that started afterwards does */
+    generation = UA_DataSourceCache_generation(cache, &nodeId);
+    UA_DataSourceCache_put(cache, &nodeId, &adminSession.sessionId, generation, now, &value);
+    ck_assert(UA_DataSourceCache_get(cache, &nodeId, &adminSession.sessionId, now, &cached));
+    ck_assert_ptr_eq(cached.value.type, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_DataValue_deleteMembers(&cached);
+} END_TEST
+
+START_TEST(ReadDataSourceBatchMaxAge) {
+    UA_DataSourceBatch batch;
+    batch.read = readTemperatureBatch;
+    batch.context = NULL;
+    UA_StatusCode retval =
+        UA_Server_setVariableNode_dataSourceBatch(server, UA_NODEID_STRING(1, "cpu.temperature"),
+                                                  &batch);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+
+    UA_ReadValueId rvi;
+    UA_ReadValueId_init(&rvi);
+    rvi.nodeId = UA_NODEID_STRING(1, "cpu.temperature");
+    rvi.attributeId = UA_ATTRIBUTEID_VALUE;
+    UA_ReadRequest request;
+    UA_ReadRequest_init(&request);
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_NEITHER;
+    request.maxAge = 100.0;
+    request.nodesToRead = &rvi;
+    request.nodesToReadSize = 1;
+
+    /* The batched value is added to the cache and served from there */
+    batchReadCalls = 0;
+    for(size_t i = 0; i < 2; i++) {
+        UA_ReadResponse response;
+        UA_ReadResponse_init(&response);
+        Service_Read(server, &adminSession, &request, &response);
+        ck_assert_int_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+        ck_assert_uint_eq(response.resultsSize, 1);
+        ck_assert_int_eq(response.results[0].hasStatus, false);
+        ck_assert_int_eq(response.results[0].hasSourceTimestamp, false);
+        ck_assert_ptr_eq(response.results[0].value.type, &UA_TYPES[UA_TYPES_DOUBLE]);
+        UA_ReadResponse_deleteMembers(&response);
+    }
+    ck_assert_uint_eq(batchReadCalls, 1);
+
+    /* The cached value is still young enough for a smaller maxAge */
+    temperatureReads = 0;
+    UA_ReadResponse response;
+    UA_ReadResponse_init(&response);
+    request.maxAge = 50.0;
+    Service_Read(server, &adminSession, &request, &response);
+    ck_assert_ptr_eq(response.results[0].value.type, &UA_TYPES[UA_TYPES_DOUBLE]);
+    UA_ReadResponse_deleteMembers(&response);
+    ck_assert_uint_eq(batchReadCalls, 1);
+    ck_assert_uint_eq(temperatureReads, 0);
+} END_TEST
+
 /* Tests for writeValue method */
 
 START_TEST(WriteSingleAttributeNodeId) {
@@ -893,6 +1141,11 @@ static Suite * testSuite_services_attributes(void) {
     tcase_add_test(tc_readSingleAttributes, ReadSingleAttributeUserExecutableWithoutTimestamp);
     tcase_add_test(tc_readSingleAttributes, ReadSingleDataSourceAttributeValueWithoutTimestamp);
     tcase_add_test(tc_readSingleAttributes, ReadSingleDataSourceAttributeValueEmptyWithoutTimestamp);
+    tcase_add_test(tc_readSingleAttributes, ReadDataSourceBatch);
+    tcase_add_test(tc_readSingleAttributes, ReadDataSourceMaxAge);
+    tcase_add_test(tc_readSingleAttributes, ReadDataSourceMaxAgePerSession);
+    tcase_add_test(tc_readSingleAttributes, DataSourceCacheStalePut);
+    tcase_add_test(tc_readSingleAttributes, ReadDataSourceBatchMaxAge);
     tcase_add_test(tc_readSingleAttributes, ReadSingleDataSourceAttributeDataTypeWithoutTimestamp);
     tcase_add_test(tc_readSingleAttributes, ReadSingleDataSourceAttributeArrayDimensionsWithoutTimestamp);
 
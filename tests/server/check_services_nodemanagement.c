@@ -403,6 +403,237 @@ START_TEST(InstantiateObjectType) {
     ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
 } END_TEST
 
+static size_t
+countTargets(const UA_NodeId *nodeId, const UA_NodeId *referenceTypeId,
+             const UA_NodeId *target) {
+    size_t count = 0;
+    const UA_Node *node = UA_Nodestore_get(server, nodeId);
+    ck_assert_ptr_ne(node, NULL);
+    for(size_t i = 0; i < node->referencesSize; i++) {
+        UA_NodeReferenceKind *refs = &node->references[i];
+        if(refs->isInverse || !UA_NodeId_equal(&refs->referenceTypeId, referenceTypeId))
+            continue;
+        for(size_t j = 0; j < refs->targetIdsSize; j++) {
+            if(UA_NodeId_equal(&refs->targetIds[j].nodeId, target))
+                count++;
+        }
+    }
+    UA_Nodestore_release(server, node);
+    return count;
+}
+
+START_TEST(AddAndDeleteManyReferences) {
+    UA_ObjectAttributes attr = UA_ObjectAttributes_default;
+    UA_NodeId folderId = UA_NODEID_NUMERIC(1, 10000);
+    UA_StatusCode retval =
+        UA_Server_addObjectNode(server, folderId,
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                UA_QUALIFIEDNAME(1, "Folder"),
+                                UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE),
+                                attr, NULL, NULL);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+
+    UA_NodeId organizes = UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES);
+    for(UA_UInt32 i = 1; i <= 1000; i++) {
+        retval = UA_Server_addObjectNode(server, UA_NODEID_NUMERIC(1, i), folderId,
+                                         organizes, UA_QUALIFIEDNAME(1, "Child"),
+                                         UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+                                         attr, NULL, NULL);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    }
+
+    /* Duplicate references are rejected */
+    retval = UA_Server_addReference(server, folderId, organizes,
+                                    UA_EXPANDEDNODEID_NUMERIC(1, 500), true);
+    ck_assert_int_eq(retval, UA_STATUSCODE_BADDUPLICATEREFERENCENOTALLOWED);
+
+    /* Delete every second reference */
+    for(UA_UInt32 i = 1; i <= 1000; i += 2) {
+        retval = UA_Server_deleteReference(server, folderId, organizes, true,
+                                           UA_EXPANDEDNODEID_NUMERIC(1, i), true);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    }
+    retval = UA_Server_deleteReference(server, folderId, organizes, true,
+                                       UA_EXPANDEDNODEID_NUMERIC(1, 1), true);
+    ck_assert_int_eq(retval, UA_STATUSCODE_UNCERTAINREFERENCENOTDELETED);
+
+    for(UA_UInt32 i = 1; i <= 1000; i++) {
+        UA_NodeId target = UA_NODEID_NUMERIC(1, i);
+        ck_assert_uint_eq(countTargets(&folderId, &organizes, &target), i % 2 == 0);
+    }
+
+    /* Deleted references can be added again */
+    retval = UA_Server_addReference(server, folderId, organizes,
+                                    UA_EXPANDEDNODEID_NUMERIC(1, 1), true);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    UA_NodeId target = UA_NODEID_NUMERIC(1, 1);
+    ck_assert_uint_eq(countTargets(&folderId, &organizes, &target), 1);
+} END_TEST
+
+static void
+setObjectItem(UA_AddNodesItem *item, UA_ObjectAttributes *attr,
+              UA_UInt32 nodeId, UA_NodeId parentNodeId) {
+    UA_AddNodesItem_init(item);
+    item->nodeClass = UA_NODECLASS_OBJECT;
+    item->requestedNewNodeId.nodeId = UA_NODEID_NUMERIC(1, nodeId);
+    item->parentNodeId.nodeId = parentNodeId;
+    item->referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES);
+    item->browseName = UA_QUALIFIEDNAME(1, "Object");
+    item->typeDefinition.nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE);
+    item->nodeAttributes.encoding = UA_EXTENSIONOBJECT_DECODED_NODELETE;
+    item->nodeAttributes.content.decoded.type = &UA_TYPES[UA_TYPES_OBJECTATTRIBUTES];
+    item->nodeAttributes.content.decoded.data = attr;
+}
+
+START_TEST(AddNodesBulk) {
+    UA_ObjectAttributes attr = UA_ObjectAttributes_default;
+    UA_AddNodesItem items[4];
+    UA_StatusCode results[4];
+    UA_NodeId newNodeIds[4];
+
+    /* The children come before their parent */
+    setObjectItem(&items[0], &attr, 20001, UA_NODEID_NUMERIC(1, 20000));
+    setObjectItem(&items[1], &attr, 20002, UA_NODEID_NUMERIC(1, 20000));
+    setObjectItem(&items[2], &attr, 20000, UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER));
+    /* The parent does not exist */
+    setObjectItem(&items[3], &attr, 20003, UA_NODEID_NUMERIC(1, 29999));
+
+    UA_StatusCode retval =
+        UA_Server_addNodesBulk(server, 4, items, NULL, results, newNodeIds);
+    ck_assert_int_eq(retval, UA_STATUSCODE_BADPARENTNODEIDINVALID);
+    ck_assert_int_eq(results[0], UA_STATUSCODE_GOOD);
+    ck_assert_int_eq(results[1], UA_STATUSCODE_GOOD);
+    ck_assert_int_eq(results[2], UA_STATUSCODE_GOOD);
+    ck_assert_int_eq(results[3], UA_STATUSCODE_BADPARENTNODEIDINVALID);
+    UA_NodeId expected = UA_NODEID_NUMERIC(1, 20001);
+    ck_assert(UA_NodeId_equal(&newNodeIds[0], &expected));
+    ck_assert(UA_NodeId_isNull(&newNodeIds[3]));
+
+    /* The references are added in both directions */
+    UA_NodeId parentId = UA_NODEID_NUMERIC(1, 20000);
+    UA_NodeId organizes = UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES);
+    UA_NodeId hasTypeDefinition = UA_NODEID_NUMERIC(0, UA_NS0ID_HASTYPEDEFINITION);
+    UA_NodeId folderType = UA_NODEID_NUMERIC(0, UA_NS0ID_FOLDERTYPE);
+    UA_NodeId objectsFolder = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+    ck_assert_uint_eq(countTargets(&parentId, &organizes, &newNodeIds[0]), 1);
+    ck_assert_uint_eq(countTargets(&parentId, &organizes, &newNodeIds[1]), 1);
+    ck_assert_uint_eq(countTargets(&objectsFolder, &organizes, &parentId), 1);
+    ck_assert_uint_eq(countTargets(&newNodeIds[0], &hasTypeDefinition, &folderType), 1);
+
+    /* The failed node was removed */
+    UA_NodeId failedId = UA_NODEID_NUMERIC(1, 20003);
+    ck_assert_ptr_eq(UA_Nodestore_get(server, &failedId), NULL);
+
+    /* Adding the same nodes again fails */
+    retval = UA_Server_addNodesBulk(server, 1, items, NULL, NULL, NULL);
+    ck_assert_int_eq(retval, UA_STATUSCODE_BADNODEIDEXISTS);
+} END_TEST
+
+/* The members of the type are browsed once for all instances in the bulk */
+START_TEST(AddNodesBulkInstantiate) {
+    UA_NodeId typeId = UA_NODEID_NUMERIC(1, 21000);
+    UA_ObjectTypeAttributes otAttr = UA_ObjectTypeAttributes_default;
+    UA_StatusCode retval =
+        UA_Server_addObjectTypeNode(server, typeId,
+                                    UA_NODEID_NUMERIC(0, UA_NS0ID_BASEOBJECTTYPE),
+                                    UA_NODEID_NUMERIC(0, UA_NS0ID_HASSUBTYPE),
+                                    UA_QUALIFIEDNAME(1, "BulkType"), otAttr,
+                                    NULL, NULL);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+
+    UA_VariableAttributes vAttr = UA_VariableAttributes_default;
+    UA_NodeId memberId;
+    retval = UA_Server_addVariableNode(server, UA_NODEID_NULL, typeId,
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT),
+                                       UA_QUALIFIEDNAME(1, "Member"),
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                       vAttr, NULL, &memberId);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+    retval = UA_Server_addReference(server, memberId,
+                                    UA_NODEID_NUMERIC(0, UA_NS0ID_HASMODELLINGRULE),
+                                    UA_EXPANDEDNODEID_NUMERIC(0, UA_NS0ID_MODELLINGRULE_MANDATORY), true);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+
+    UA_ObjectAttributes attr = UA_ObjectAttributes_default;
+    UA_AddNodesItem items[3];
+    UA_NodeId newNodeIds[3];
+    for(UA_UInt32 i = 0; i < 3; i++) {
+        setObjectItem(&items[i], &attr, 21001 + i,
+                      UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER));
+        items[i].typeDefinition.nodeId = typeId;
+    }
+    retval = UA_Server_addNodesBulk(server, 3, items, NULL, NULL, newNodeIds);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+
+    /* Every instance has its own copy of the mandatory member */
+    UA_NodeId hasComponent = UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT);
+    UA_NodeId members[3];
+    for(size_t i = 0; i < 3; i++) {
+        const UA_Node *node = UA_Nodestore_get(server, &newNodeIds[i]);
+        ck_assert_ptr_ne(node, NULL);
+        size_t count = 0;
+        for(size_t j = 0; j < node->referencesSize; j++) {
+            UA_NodeReferenceKind *refs = &node->references[j];
+            if(refs->isInverse || !UA_NodeId_equal(&refs->referenceTypeId, &hasComponent))
+                continue;
+            count += refs->targetIdsSize;
+            members[i] = refs->targetIds[0].nodeId;
+        }
+        UA_Nodestore_release(server, node);
+        ck_assert_uint_eq(count, 1);
+        ck_assert(!UA_NodeId_equal(&members[i], &memberId));
+    }
+    ck_assert(!UA_NodeId_equal(&members[0], &members[1]));
+    ck_assert(!UA_NodeId_equal(&members[1], &members[2]));
+} END_TEST
+
+/* Variables with a value are added to folders that come later in the bulk */
+START_TEST(AddNodesBulkVariables) {
+    UA_ObjectAttributes oAttr = UA_ObjectAttributes_default;
+    UA_VariableAttributes vAttr = UA_VariableAttributes_default;
+    UA_Int32 value = 42;
+    UA_Variant_setScalar(&vAttr.value, &value, &UA_TYPES[UA_TYPES_INT32]);
+    vAttr.dataType = UA_TYPES[UA_TYPES_INT32].typeId;
+
+    UA_AddNodesItem items[12];
+    for(UA_UInt32 i = 0; i < 10; i++) {
+        UA_AddNodesItem *item = &items[i];
+        UA_AddNodesItem_init(item);
+        item->nodeClass = UA_NODECLASS_VARIABLE;
+        item->requestedNewNodeId.nodeId = UA_NODEID_NUMERIC(1, 22000 + i);
+        item->parentNodeId.nodeId = UA_NODEID_NUMERIC(1, 22100 + i % 2);
+        item->referenceTypeId = UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT);
+        item->browseName = UA_QUALIFIEDNAME(1, "Variable");
+        item->typeDefinition.nodeId = UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE);
+        item->nodeAttributes.encoding = UA_EXTENSIONOBJECT_DECODED_NODELETE;
+        item->nodeAttributes.content.decoded.type = &UA_TYPES[UA_TYPES_VARIABLEATTRIBUTES];
+        item->nodeAttributes.content.decoded.data = &vAttr;
+    }
+    setObjectItem(&items[10], &oAttr, 22100, UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER));
+    setObjectItem(&items[11], &oAttr, 22101, UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER));
+
+    UA_StatusCode retval = UA_Server_addNodesBulk(server, 12, items, NULL, NULL, NULL);
+    ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+
+    UA_NodeId hasComponent = UA_NODEID_NUMERIC(0, UA_NS0ID_HASCOMPONENT);
+    UA_NodeId hasTypeDefinition = UA_NODEID_NUMERIC(0, UA_NS0ID_HASTYPEDEFINITION);
+    UA_NodeId variableType = UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE);
+    for(UA_UInt32 i = 0; i < 10; i++) {
+        UA_NodeId id = UA_NODEID_NUMERIC(1, 22000 + i);
+        UA_NodeId parentId = UA_NODEID_NUMERIC(1, 22100 + i % 2);
+        ck_assert_uint_eq(countTargets(&parentId, &hasComponent, &id), 1);
+        ck_assert_uint_eq(countTargets(&id, &hasTypeDefinition, &variableType), 1);
+
+        UA_Variant out;
+        retval = UA_Server_readValue(server, id, &out);
+        ck_assert_int_eq(retval, UA_STATUSCODE_GOOD);
+        ck_assert(UA_Variant_hasScalarType(&out, &UA_TYPES[UA_TYPES_INT32]));
+        ck_assert_int_eq(*(UA_Int32*)out.data, 42);
+        UA_Variant_deleteMembers(&out);
+    }
+} END_TEST
+
 int main(void) {
     Suite *s = suite_create("services_nodemanagement");
 
@@ -414,12 +645,16 @@ int main(void) {
     tcase_add_test(tc_addnodes, AddNodeTwiceGivesError);
     tcase_add_test(tc_addnodes, AddObjectWithConstructor);
     tcase_add_test(tc_addnodes, InstantiateObjectType);
+    tcase_add_test(tc_addnodes, AddNodesBulk);
+    tcase_add_test(tc_addnodes, AddNodesBulkInstantiate);
+    tcase_add_test(tc_addnodes, AddNodesBulkVariables);
     suite_add_tcase(s, tc_addnodes);
 
     TCase *tc_deletenodes = tcase_create("deletenodes");
     tcase_add_checked_fixture(tc_deletenodes, setup, teardown);
     tcase_add_test(tc_deletenodes, DeleteObjectWithDestructor);
     tcase_add_test(tc_deletenodes, DeleteObjectAndReferences);
+    tcase_add_test(tc_deletenodes, AddAndDeleteManyReferences);
     suite_add_tcase(s, tc_deletenodes);
 
     SRunner *sr = srunner_create(s);
@@ -303,6 +303,402 @@ START_TEST(Server_deleteMonitoredItems) {
 }
 END_TEST
 
+static UA_MonitoredItem *
+createValueMonitoredItemWithSession(UA_Session *session, UA_NodeId nodeId) {
+    UA_CreateSubscriptionRequest subRequest;
+    UA_CreateSubscriptionRequest_init(&subRequest);
+    subRequest.publishingEnabled = true;
+    UA_CreateSubscriptionResponse subResponse;
+    UA_CreateSubscriptionResponse_init(&subResponse);
+    Service_CreateSubscription(server, session, &subRequest, &subResponse);
+    ck_assert_uint_eq(subResponse.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    UA_UInt32 subId = subResponse.subscriptionId;
+    UA_CreateSubscriptionResponse_deleteMembers(&subResponse);
+
+    UA_CreateMonitoredItemsRequest request;
+    UA_CreateMonitoredItemsRequest_init(&request);
+    request.subscriptionId = subId;
+    request.timestampsToReturn = UA_TIMESTAMPSTORETURN_SERVER;
+    UA_MonitoredItemCreateRequest item;
+    UA_MonitoredItemCreateRequest_init(&item);
+    item.itemToMonitor.nodeId = nodeId;
+    item.itemToMonitor.attributeId = UA_ATTRIBUTEID_VALUE;
+    item.monitoringMode = UA_MONITORINGMODE_REPORTING;
+    item.requestedParameters.queueSize = 10;
+    request.itemsToCreateSize = 1;
+    request.itemsToCreate = &item;
+
+    UA_CreateMonitoredItemsResponse response;
+    UA_CreateMonitoredItemsResponse_init(&response);
+    Service_CreateMonitoredItems(server, session, &request, &response);
+    ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.resultsSize, 1);
+    ck_assert_uint_eq(response.results[0].statusCode, UA_STATUSCODE_GOOD);
+    UA_UInt32 monId = response.results[0].monitoredItemId;
+    UA_CreateMonitoredItemsResponse_deleteMembers(&response);
+
+    UA_Subscription *sub = UA_Session_getSubscriptionByID(session, subId);
+    ck_assert_ptr_ne(sub, NULL);
+    UA_MonitoredItem *mon = UA_Subscription_getMonitoredItem(sub, monId);
+    ck_assert_ptr_ne(mon, NULL);
+    return mon;
+}
+
+static UA_MonitoredItem *
+createValueMonitoredItem(UA_NodeId nodeId) {
+    return createValueMonitoredItemWithSession(&adminSession, nodeId);
+}
+
+START_TEST(Server_monitoredItemDetectChange) {
+    /* Large array (hashed from memory) and long string (hashed from the
+     * streamed encoding) */
+    UA_Int32 array[2000];
+    memset(array, 0, sizeof(array));
+    char text[2000];
+    memset(text, 'a', sizeof(text));
+    UA_String str = {sizeof(text), (UA_Byte*)text};
+
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    UA_Variant_setArray(&attr.value, array, 2000, &UA_TYPES[UA_TYPES_INT32]);
+    UA_NodeId arrayId = UA_NODEID_STRING(1, "array");
+    UA_StatusCode retval =
+        UA_Server_addVariableNode(server, arrayId, UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                  UA_QUALIFIEDNAME(1, "array"),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                  attr, NULL, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    UA_Variant_setScalar(&attr.value, &str, &UA_TYPES[UA_TYPES_STRING]);
+    UA_NodeId stringId = UA_NODEID_STRING(1, "string");
+    retval = UA_Server_addVariableNode(server, stringId, UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                       UA_QUALIFIEDNAME(1, "string"),
+                                       UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                       attr, NULL, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    /* The first sample is taken when the item is created */
+    UA_MonitoredItem *arrayMon = createValueMonitoredItem(arrayId);
+    UA_MonitoredItem *stringMon = createValueMonitoredItem(stringId);
+    ck_assert_uint_eq(arrayMon->currentQueueSize, 1);
+    ck_assert_uint_eq(stringMon->currentQueueSize, 1);
+
+    /* Unchanged values are not sampled */
+    UA_MoniteredItem_SampleCallback(server, arrayMon);
+    UA_MoniteredItem_SampleCallback(server, stringMon);
+    ck_assert_uint_eq(arrayMon->currentQueueSize, 1);
+    ck_assert_uint_eq(stringMon->currentQueueSize, 1);
+
+    /* Change the last element / character */
+    array[1999] = 1;
+    text[1999] = 'b';
+    UA_Variant value;
+    UA_Variant_setArray(&value, array, 2000, &UA_TYPES[UA_TYPES_INT32]);
+    retval = UA_Server_writeValue(server, arrayId, value);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    UA_Variant_setScalar(&value, &str, &UA_TYPES[UA_TYPES_STRING]);
+    retval = UA_Server_writeValue(server, stringId, value);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    UA_MoniteredItem_SampleCallback(server, arrayMon);
+    UA_MoniteredItem_SampleCallback(server, stringMon);
+    ck_assert_uint_eq(arrayMon->currentQueueSize, 2);
+    ck_assert_uint_eq(stringMon->currentQueueSize, 2);
+}
+END_TEST
+
+START_TEST(Server_monitoredItemSharedSampling) {
+    UA_Int32 i = 0;
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    UA_Variant_setScalar(&attr.value, &i, &UA_TYPES[UA_TYPES_INT32]);
+    UA_NodeId nodeId = UA_NODEID_STRING(1, "shared");
+    UA_StatusCode retval =
+        UA_Server_addVariableNode(server, nodeId, UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                  UA_QUALIFIEDNAME(1, "shared"),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                  attr, NULL, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    /* Both MonitoredItems are sampled by the same group */
+    UA_MonitoredItem *mon1 = createValueMonitoredItem(nodeId);
+    UA_MonitoredItem *mon2 = createValueMonitoredItem(nodeId);
+    ck_assert_ptr_ne(mon1->samplingGroup, NULL);
+    ck_assert_ptr_eq(mon1->samplingGroup, mon2->samplingGroup);
+    ck_assert_uint_eq(mon1->currentQueueSize, 1);
+    ck_assert_uint_eq(mon2->currentQueueSize, 1);
+
+    /* The sample of the group reaches both MonitoredItems */
+    i = 1;
+    UA_Variant value;
+    UA_Variant_setScalar(&value, &i, &UA_TYPES[UA_TYPES_INT32]);
+    retval = UA_Server_writeValue(server, nodeId, value);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    UA_fakeSleep((UA_UInt32)mon1->samplingInterval + 1);
+    UA_Server_run_iterate(server, false);
+    UA_realSleep(100);
+    ck_assert_uint_eq(mon1->currentQueueSize, 2);
+    ck_assert_uint_eq(mon2->currentQueueSize, 2);
+
+    /* The group is removed with its last MonitoredItem */
+    MonitoredItem_unregisterSampleCallback(server, mon1);
+    ck_assert_ptr_eq(mon1->samplingGroup, NULL);
+    ck_assert_ptr_eq(LIST_FIRST(&server->samplingGroups), mon2->samplingGroup);
+    MonitoredItem_unregisterSampleCallback(server, mon2);
+    ck_assert_ptr_eq(LIST_FIRST(&server->samplingGroups), NULL);
+}
+END_TEST
+
+static UA_StatusCode
+readZero(UA_Server *server_, const UA_NodeId *sessionId, void *sessionContext,
+         const UA_NodeId *nodeId, void *nodeContext, UA_Boolean sourceTimeStamp,
+         const UA_NumericRange *range, UA_DataValue *value) {
+    UA_Int32 zero = 0;
+    value->hasValue = true;
+    return UA_Variant_setScalarCopy(&value->value, &zero, &UA_TYPES[UA_TYPES_INT32]);
+}
+
+static UA_Int32 batchReadCalls;
+static size_t batchReadItems;
+
+static UA_StatusCode
+readBatch(UA_Server *server_, const UA_NodeId *sessionId, void *sessionContext,
+          void *batchContext, UA_Boolean sourceTimeStamp,
+          size_t itemsSize, const UA_DataSourceReadItem *items) {
+    batchReadCalls++;
+    batchReadItems += itemsSize;
+    for(size_t i = 0; i < itemsSize; i++) {
+        items[i].value->hasValue = true;
+        UA_Variant_setScalarCopy(&items[i].value->value, &batchReadCalls,
+                                 &UA_TYPES[UA_TYPES_INT32]);
+    }
+    return UA_STATUSCODE_GOOD;
+}
+
+START_TEST(Server_monitoredItemBatchedSampling) {
+    UA_DataSourceBatch batch;
+    batch.read = readBatch;
+    batch.context = NULL;
+    UA_DataSource dataSource;
+    dataSource.read = readZero;
+    dataSource.write = NULL;
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    UA_NodeId nodeIds[2] = {UA_NODEID_STRING(1, "batched1"), UA_NODEID_STRING(1, "batched2")};
+    for(size_t i = 0; i < 2; i++) {
+        UA_StatusCode retval =
+            UA_Server_addDataSourceVariableNode(server, nodeIds[i],
+                                                UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                                UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                                UA_QUALIFIEDNAME(1, "batched"),
+                                                UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                                attr, dataSource, NULL, NULL);
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+        retval = UA_Server_setVariableNode_dataSourceBatch(server, nodeIds[i], &batch);
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    }
+
+    /* The groups of both nodes are sampled in the same tick */
+    UA_MonitoredItem *mon1 = createValueMonitoredItem(nodeIds[0]);
+    UA_MonitoredItem *mon2 = createValueMonitoredItem(nodeIds[1]);
+    ck_assert_ptr_ne(mon1->samplingGroup, mon2->samplingGroup);
+    ck_assert_ptr_ne(mon1->samplingGroup->tick, NULL);
+    ck_assert_ptr_eq(mon1->samplingGroup->tick, mon2->samplingGroup->tick);
+    ck_assert_uint_eq(mon1->currentQueueSize, 1);
+    ck_assert_uint_eq(mon2->currentQueueSize, 1);
+
+    /* Both values are read with one call */
+    batchReadCalls = 0;
+    batchReadItems = 0;
+    UA_fakeSleep((UA_UInt32)mon1->samplingInterval + 1);
+    UA_Server_run_iterate(server, false);
+    UA_realSleep(100);
+    ck_assert_int_eq(batchReadCalls, 1);
+    ck_assert_uint_eq(batchReadItems, 2);
+    ck_assert_uint_eq(mon1->currentQueueSize, 2);
+    ck_assert_uint_eq(mon2->currentQueueSize, 2);
+
+    /* The tick is removed with its last group */
+    MonitoredItem_unregisterSampleCallback(server, mon1);
+    MonitoredItem_unregisterSampleCallback(server, mon2);
+    ck_assert_ptr_eq(LIST_FIRST(&server->samplingTicks), NULL);
+}
+END_TEST
+
+/* Returns the numeric identifier of the reading session */
+static UA_StatusCode
+readSessionId(UA_Server *server_, const UA_NodeId *sessionId, void *sessionContext,
+              const UA_NodeId *nodeId, void *nodeContext, UA_Boolean sourceTimeStamp,
+              const UA_NumericRange *range, UA_DataValue *value) {
+    value->hasValue = true;
+    return UA_Variant_setScalarCopy(&value->value, &sessionId->identifier.numeric,
+                                    &UA_TYPES[UA_TYPES_UINT32]);
+}
+
+START_TEST(Server_monitoredItemDataSourceSamplingPerSession) {
+    UA_DataSource dataSource;
+    dataSource.read = readSessionId;
+    dataSource.write = NULL;
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    UA_NodeId nodeId = UA_NODEID_STRING(1, "persession");
+    UA_StatusCode retval =
+        UA_Server_addDataSourceVariableNode(server, nodeId,
+                                            UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                            UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                            UA_QUALIFIEDNAME(1, "persession"),
+                                            UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                            attr, dataSource, NULL, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    UA_Session session;
+    UA_Session_init(&session);
+    session.sessionId = UA_NODEID_NUMERIC(1, 4711);
+
+    /* The DataSource is sampled with the session of each MonitoredItem */
+    UA_MonitoredItem *mon1 = createValueMonitoredItem(nodeId);
+    UA_MonitoredItem *mon2 = createValueMonitoredItemWithSession(&session, nodeId);
+    ck_assert_ptr_ne(mon1->samplingGroup, mon2->samplingGroup);
+    ck_assert_uint_eq(mon1->currentQueueSize, 1);
+    ck_assert_uint_eq(mon2->currentQueueSize, 1);
+
+    UA_MonitoredItemNotification min;
+    MonitoredItem_dequeueNotification(mon2, &min);
+    ck_assert_ptr_eq(min.value.value.type, &UA_TYPES[UA_TYPES_UINT32]);
+    ck_assert_uint_eq(*(UA_UInt32*)min.value.value.data, 4711);
+    UA_MonitoredItemNotification_deleteMembers(&min);
+    MonitoredItem_dequeueNotification(mon1, &min);
+    ck_assert_uint_eq(*(UA_UInt32*)min.value.value.data,
+                      adminSession.sessionId.identifier.numeric);
+    UA_MonitoredItemNotification_deleteMembers(&min);
+
+    UA_Session_deleteMembersCleanup(&session, server);
+}
+END_TEST
+
+static void
+onReadNoop(UA_Server *s, const UA_NodeId *sessionId, void *sessionContext,
+           const UA_NodeId *nodeid, void *nodeContext,
+           const UA_NumericRange *range, const UA_DataValue *value) {}
+
+START_TEST(Server_monitoredItemNotifyOnWrite) {
+    server->config.monitoredItemsNotifyOnWrite = true;
+
+    UA_Int32 i = 0;
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    UA_Variant_setScalar(&attr.value, &i, &UA_TYPES[UA_TYPES_INT32]);
+    attr.accessLevel = UA_ACCESSLEVELMASK_READ | UA_ACCESSLEVELMASK_WRITE;
+    UA_NodeId nodeId = UA_NODEID_STRING(1, "onwrite");
+    UA_StatusCode retval =
+        UA_Server_addVariableNode(server, nodeId, UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                  UA_QUALIFIEDNAME(1, "onwrite"),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                  attr, NULL, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    /* The requested samplingInterval of zero is kept */
+    UA_MonitoredItem *mon = createValueMonitoredItem(nodeId);
+    ck_assert(mon->samplingInterval == 0.0);
+    ck_assert_uint_eq(mon->currentQueueSize, 1);
+
+    /* Writes are notified without sampling by the timer */
+    i = 1;
+    UA_Variant value;
+    UA_Variant_setScalar(&value, &i, &UA_TYPES[UA_TYPES_INT32]);
+    retval = UA_Server_writeValue(server, nodeId, value);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(mon->currentQueueSize, 2);
+
+    /* Writing the same value again does not create a notification */
+    retval = UA_Server_writeValue(server, nodeId, value);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(mon->currentQueueSize, 2);
+
+    /* Writes through the service */
+    i = 2;
+    UA_WriteValue wv;
+    UA_WriteValue_init(&wv);
+    wv.nodeId = nodeId;
+    wv.attributeId = UA_ATTRIBUTEID_VALUE;
+    wv.value.hasValue = true;
+    wv.value.value = value;
+    UA_WriteRequest request;
+    UA_WriteRequest_init(&request);
+    request.nodesToWrite = &wv;
+    request.nodesToWriteSize = 1;
+    UA_WriteResponse response;
+    UA_WriteResponse_init(&response);
+    Service_Write(server, &adminSession, &request, &response);
+    ck_assert_uint_eq(response.responseHeader.serviceResult, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(response.resultsSize, 1);
+    ck_assert_uint_eq(response.results[0], UA_STATUSCODE_GOOD);
+    UA_WriteResponse_deleteMembers(&response);
+    ck_assert_uint_eq(mon->currentQueueSize, 3);
+
+    /* With an onRead callback, the value is sampled by the timer again */
+    UA_ValueCallback callback;
+    memset(&callback, 0, sizeof(UA_ValueCallback));
+    callback.onRead = onReadNoop;
+    retval = UA_Server_setVariableNode_valueCallback(server, nodeId, callback);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert(mon->samplingInterval == server->config.samplingIntervalLimits.min);
+    ck_assert(mon->sampleCallbackIsRegistered);
+    ck_assert_ptr_ne(mon->samplingGroup, NULL);
+    ck_assert_ptr_ne(mon->samplingGroup->tick, NULL);
+    i = 3;
+    retval = UA_Server_writeValue(server, nodeId, value);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(mon->currentQueueSize, 3);
+}
+END_TEST
+
+START_TEST(Server_monitoredItemQueue) {
+    UA_Int32 i = 0;
+    UA_VariableAttributes attr = UA_VariableAttributes_default;
+    UA_Variant_setScalar(&attr.value, &i, &UA_TYPES[UA_TYPES_INT32]);
+    UA_NodeId nodeId = UA_NODEID_STRING(1, "queue");
+    UA_StatusCode retval =
+        UA_Server_addVariableNode(server, nodeId, UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES),
+                                  UA_QUALIFIEDNAME(1, "queue"),
+                                  UA_NODEID_NUMERIC(0, UA_NS0ID_BASEDATAVARIABLETYPE),
+                                  attr, NULL, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    /* Overfill the queue of 10 slots. The newest sample is replaced
+     * (discardOldest is false). */
+    UA_MonitoredItem *mon = createValueMonitoredItem(nodeId);
+    ck_assert_uint_eq(mon->maxQueueSize, 10);
+    UA_Variant value;
+    UA_Variant_setScalar(&value, &i, &UA_TYPES[UA_TYPES_INT32]);
+    for(i = 1; i < 15; i++) {
+        retval = UA_Server_writeValue(server, nodeId, value);
+        ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+        UA_MoniteredItem_SampleCallback(server, mon);
+    }
+    ck_assert_uint_eq(mon->currentQueueSize, 10);
+
+    /* Scalars are stored in the slots */
+    MonitoredItem_queuedValue *newest = &mon->queue[(mon->queueStart + 9) % 10];
+    ck_assert_ptr_eq(newest->value.value.data, newest->scalar.data);
+    ck_assert_int_eq(*(UA_Int32*)newest->value.value.data, 14);
+
+    /* Shrink the queue. The oldest samples are kept. */
+    retval = MonitoredItem_setQueueSize(mon, 3, false);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(mon->currentQueueSize, 3);
+
+    /* Dequeue the samples in order. The notifications own their value. */
+    for(UA_Int32 j = 0; j < 3; j++) {
+        UA_MonitoredItemNotification min;
+        MonitoredItem_dequeueNotification(mon, &min);
+        ck_assert(min.value.hasValue);
+        ck_assert_int_eq(*(UA_Int32*)min.value.value.data, j);
+        UA_MonitoredItemNotification_deleteMembers(&min);
+    }
+    ck_assert_uint_eq(mon->currentQueueSize, 0);
+}
+END_TEST
+
 #endif /* UA_ENABLE_SUBSCRIPTIONS */
 
 static Suite* testSuite_Client(void) {
@@ -321,6 +717,12 @@ static Suite* testSuite_Client(void) {
     tcase_add_test(tc_server, Server_deleteSubscription);
     tcase_add_test(tc_server, Server_republish_invalid);
     tcase_add_test(tc_server, Server_publishCallback);
+    tcase_add_test(tc_server, Server_monitoredItemDetectChange);
+    tcase_add_test(tc_server, Server_monitoredItemSharedSampling);
+    tcase_add_test(tc_server, Server_monitoredItemBatchedSampling);
+    tcase_add_test(tc_server, Server_monitoredItemDataSourceSamplingPerSession);
+    tcase_add_test(tc_server, Server_monitoredItemNotifyOnWrite);
+    tcase_add_test(tc_server, Server_monitoredItemQueue);
 #endif /* UA_ENABLE_SUBSCRIPTIONS */
     suite_add_tcase(s, tc_server);
 
@@ -125,6 +125,71 @@ START_TEST(Service_Browse_WithBrowseName) {
 }
 END_TEST
 
+static size_t
+countReferences(UA_Server *server, const UA_NodeId nodeId,
+                const UA_NodeId referenceTypeId, const UA_NodeId target) {
+    UA_BrowseDescription bd;
+    UA_BrowseDescription_init(&bd);
+    bd.nodeId = nodeId;
+    bd.referenceTypeId = referenceTypeId;
+    bd.includeSubtypes = true;
+    bd.browseDirection = UA_BROWSEDIRECTION_FORWARD;
+    UA_BrowseResult br = UA_Server_browse(server, 0, &bd);
+    ck_assert_int_eq(br.statusCode, UA_STATUSCODE_GOOD);
+    size_t found = 0;
+    for(size_t i = 0; i < br.referencesSize; i++) {
+        if(UA_NodeId_equal(&br.references[i].nodeId.nodeId, &target))
+            found++;
+    }
+    UA_BrowseResult_deleteMembers(&br);
+    return found;
+}
+
+START_TEST(Service_Browse_WithReferenceSubtypes) {
+    UA_ServerConfig *config = UA_ServerConfig_new_default();
+    UA_Server *server = UA_Server_new(config);
+
+    const UA_NodeId objects = UA_NODEID_NUMERIC(0, UA_NS0ID_OBJECTSFOLDER);
+    const UA_NodeId organizes = UA_NODEID_NUMERIC(0, UA_NS0ID_ORGANIZES);
+    const UA_NodeId hierarchical = UA_NODEID_NUMERIC(0, UA_NS0ID_HIERARCHICALREFERENCES);
+    const UA_NodeId hasSubtype = UA_NODEID_NUMERIC(0, UA_NS0ID_HASSUBTYPE);
+    const UA_NodeId serverNode = UA_NODEID_NUMERIC(0, UA_NS0ID_SERVER);
+
+    /* Warm up the subtype cache */
+    ck_assert_uint_eq(countReferences(server, objects, hierarchical, serverNode), 1);
+    ck_assert_uint_eq(countReferences(server, objects, hasSubtype, serverNode), 0);
+
+    /* Add a new subtype of Organizes and use it for a reference */
+    const UA_NodeId myRef = UA_NODEID_NUMERIC(1, 5000);
+    UA_ReferenceTypeAttributes attr = UA_ReferenceTypeAttributes_default;
+    attr.displayName = UA_LOCALIZEDTEXT("en-US", "MyOrganizes");
+    UA_StatusCode retval =
+        UA_Server_addReferenceTypeNode(server, myRef, organizes, hasSubtype,
+                                       UA_QUALIFIEDNAME(1, "MyOrganizes"),
+                                       attr, NULL, NULL);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    const UA_NodeId target = UA_NODEID_NUMERIC(0, UA_NS0ID_TYPESFOLDER);
+    UA_ExpandedNodeId targetExp = UA_EXPANDEDNODEID_NUMERIC(0, UA_NS0ID_TYPESFOLDER);
+    retval = UA_Server_addReference(server, objects, myRef, targetExp, true);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    ck_assert_uint_eq(countReferences(server, objects, myRef, target), 1);
+    ck_assert_uint_eq(countReferences(server, objects, organizes, target), 1);
+    ck_assert_uint_eq(countReferences(server, objects, hierarchical, target), 1);
+
+    /* Remove the reference and the reference type again */
+    retval = UA_Server_deleteReference(server, objects, myRef, true, targetExp, true);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    retval = UA_Server_deleteNode(server, myRef, true);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+    ck_assert_uint_eq(countReferences(server, objects, organizes, target), 0);
+
+    UA_Server_delete(server);
+    UA_ServerConfig_delete(config);
+}
+END_TEST
+
 START_TEST(Service_TranslateBrowsePathsToNodeIds) {
     UA_Client *client = UA_Client_new(UA_ClientConfig_default);
 
@@ -178,6 +243,7 @@ static Suite *testSuite_Service_TranslateBrowsePathsToNodeIds(void) {
     TCase *tc_browse = tcase_create("Browse Service");
     tcase_add_test(tc_browse, Service_Browse_WithBrowseName);
     tcase_add_test(tc_browse, Service_Browse_WithMaxResults);
+    tcase_add_test(tc_browse, Service_Browse_WithReferenceSubtypes);
     suite_add_tcase(s, tc_browse);
 
     TCase *tc_translate = tcase_create("TranslateBrowsePathsToNodeIds");
@@ -7,6 +7,8 @@
 
 #include "ua_types.h"
 #include "server/ua_services.h"
+#include "ua_server_internal.h"
+#include "ua_config_default.h"
 #include "check.h"
 
 START_TEST(Session_init_ShallWork) {
@@ -46,11 +48,41 @@ START_TEST(Session_updateLifetime_ShallWork) {
 }
 END_TEST
 
+START_TEST(Session_statistics_ShallCountLookups) {
+    UA_ServerConfig *config = UA_ServerConfig_new_default();
+    UA_Server *server = UA_Server_new(config);
+
+    UA_CreateSessionRequest request;
+    UA_CreateSessionRequest_init(&request);
+    UA_Session *session = NULL;
+    UA_StatusCode retval =
+        UA_SessionManager_createSession(&server->sessionManager, NULL, &request, &session);
+    ck_assert_uint_eq(retval, UA_STATUSCODE_GOOD);
+
+    UA_Session *found =
+        UA_SessionManager_getSessionByToken(&server->sessionManager,
+                                            &session->authenticationToken);
+    ck_assert_ptr_eq(found, session);
+    found = UA_SessionManager_getSessionById(&server->sessionManager, &session->sessionId);
+    ck_assert_ptr_eq(found, session);
+
+    UA_SessionStatistics stats;
+    UA_Server_getSessionStatistics(server, &stats);
+    ck_assert_uint_eq(stats.currentSessionCount, 1);
+    ck_assert_uint_eq(stats.lookups, 2);
+    ck_assert_uint_ge(stats.lookupComparisons, 2);
+
+    UA_Server_delete(server);
+    UA_ServerConfig_delete(config);
+}
+END_TEST
+
 static Suite* testSuite_Session(void) {
     Suite *s = suite_create("Session");
     TCase *tc_core = tcase_create("Core");
     tcase_add_test(tc_core, Session_init_ShallWork);
     tcase_add_test(tc_core, Session_updateLifetime_ShallWork);
+    tcase_add_test(tc_core, Session_statistics_ShallCountLookups);
 
     suite_add_tcase(s,tc_core);
     return s;
@@ -494,6 +494,12 @@ printh('''/**
 printh("#define " + outname.upper() + "_COUNT %s" % (str(len(filtered_types))))
 printh("extern UA_EXPORT const UA_DataType " + outname.upper() + "[" + outname.upper() + "_COUNT];")
 
+printh('''
+/* Indices into the type array, sorted by the numeric typeId and by the
+ * binaryEncodingId. Used for the binary search in the type lookup. */''')
+printh("extern const UA_UInt16 " + outname.upper() + "_TYPEID_INDEX[" + outname.upper() + "_COUNT];")
+printh("extern const UA_UInt16 " + outname.upper() + "_BINARYENCODINGID_INDEX[" + outname.upper() + "_COUNT];")
+
 i = 0
 for t in filtered_types:
     printh("\n/**\n * " +  t.name)
@@ -573,6 +579,27 @@ for t in filtered_types:
     printc(t.datatype_c() + ",")
 printc("};\n")
 
+def typeIdKey(t):
+    if t.name in typedescriptions:
+        return int(typedescriptions[t.name].nodeid)
+    return 0
+
+def binaryEncodingIdKey(t):
+    if t.name in typedescriptions:
+        return int(typedescriptions[t.name].binaryEncodingId)
+    return 0
+
+def printIndex(name, key):
+    # Equal keys keep the order of the type array
+    indices = sorted(range(len(filtered_types)), key=lambda i: (key(filtered_types[i]), i))
+    printc("const UA_UInt16 %s_%s[%s_COUNT] = {" % (outname.upper(), name, outname.upper()))
+    for j in range(0, len(indices), 16):
+        printc("    " + ", ".join(str(i) for i in indices[j:j+16]) + ",")
+    printc("};\n")
+
+printIndex("TYPEID_INDEX", typeIdKey)
+printIndex("BINARYENCODINGID_INDEX", binaryEncodingIdKey)
+
 ##################
 # Print Encoding #
 ##################
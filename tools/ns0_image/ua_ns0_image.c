@@ -0,0 +1,50 @@
+/* This work is licensed under a Creative Commons CCZero 1.0 Universal License.
+ * See http://creativecommons.org/publicdomain/zero/1.0/ for more information. */
+
+/* Writes the namespace zero of a freshly created server into an image file.
+ * Servers load the image with UA_Nodestore_image_newFromFile instead of
+ * creating namespace zero node by node at startup:
+ *
+ *   UA_ServerConfig *config = UA_ServerConfig_new_default();
+ *   config->nodestore.deleteNodestore(config->nodestore.context);
+ *   UA_Nodestore_image_newFromFile(&config->nodestore, "ua_namespace0.image");
+ *   UA_Server *server = UA_Server_new(config); */
+
+#ifdef _MSC_VER
+# define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <stdio.h>
+#include "open62541.h"
+
+int main(int argc, char **argv) {
+    if(argc != 2) {
+        printf("Usage: %s <image file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    UA_ServerConfig *config = UA_ServerConfig_new_default();
+    UA_Server *server = UA_Server_new(config);
+    UA_ByteString image = UA_BYTESTRING_NULL;
+    UA_StatusCode retval = UA_Nodestore_image_encode(&config->nodestore, &image);
+    UA_Server_delete(server);
+    UA_ServerConfig_delete(config);
+    if(retval != UA_STATUSCODE_GOOD) {
+        printf("Encoding the image failed with %s\n", UA_StatusCode_name(retval));
+        return EXIT_FAILURE;
+    }
+
+    FILE *f = fopen(argv[1], "wb");
+    size_t written = 0;
+    if(f) {
+        written = fwrite(image.data, 1, image.length, f);
+        fclose(f);
+    }
+    size_t length = image.length;
+    UA_ByteString_deleteMembers(&image);
+    if(written != length) {
+        printf("Could not write the image to %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -18,9 +18,6 @@ if [ -z ${DOCKER+x} ]; then
 		sudo -E apt-get -yq --no-install-suggests --no-install-recommends --force-yes install clang-3.9 clang-tidy-3.9 libfuzzer-3.9-dev
 	fi
 
-	sudo add-apt-repository -y ppa:lttng/ppa
-	sudo apt-get update -qq
-	sudo apt-get install -y liburcu4 liburcu-dev
 	echo -en 'travis_fold:end:script.before_install.external\\r'
 
 	echo "=== Installing python packages ===" && echo -en 'travis_fold:start:before_install.python\\r'